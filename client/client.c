@@ -0,0 +1,210 @@
+/*
+ * client.c - Thin client for tinyshell --serve
+ *
+ * Sends a script, the current directory, the environment and the script's
+ * arguments to a running server, with this process's stdin/stdout/stderr
+ * attached, then waits for the exit status. Signals that would stop a
+ * local shell (Ctrl-C, SIGTERM, ...) are forwarded to the script. Only
+ * libc is linked, so starting the client is about as cheap as a process
+ * can be.
+ */
+
+#include "../include/serve.h"
+#include "../include/utils.h"
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static volatile sig_atomic_t pending_signal;
+
+static void on_signal(int sig)
+{
+    pending_signal = sig;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-s SOCKET] [-v] (-c TEXT | SCRIPT) [ARGS...]\n", prog);
+}
+
+// Read a whole script file
+static int read_file(const char *path, StrBuf *out)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    for (;;)
+    {
+        if (sb_reserve(out, 4096) < 0)
+        {
+            close(fd);
+            errno = ENOMEM;
+            return -1;
+        }
+        ssize_t n = read(fd, out->data + out->len, out->cap - out->len - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            close(fd);
+            return n < 0 ? -1 : 0;
+        }
+        out->len += n;
+        out->data[out->len] = '\0';
+    }
+}
+
+static int connect_server(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    int bufsize = SERVE_MSG_MAX;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int main(int argc, char **argv)
+{
+    const char *sock_path = getenv(SERVE_SOCKET_ENV);
+    const char *text = NULL;
+    int verbose = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            sock_path = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            text = argv[++i];
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose = 1;
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        if (text)
+        {
+            i++;
+            break;
+        }
+    }
+    if (!sock_path || (!text && i == argc))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    StrBuf script;
+    sb_init(&script);
+    if (!text)
+    {
+        if (read_file(argv[i], &script) < 0)
+        {
+            perror(argv[i]);
+            return 127;
+        }
+        i++;
+    }
+    else
+        sb_append(&script, text, strlen(text));
+
+    // The request: header, cwd, script, the whole environment (replacing
+    // the server's), then the script's arguments
+    ServeRequest hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.type = SERVE_RUN;
+    hdr.flags = SERVE_ENV_CLEAR;
+    for (char **e = environ; *e; e++)
+        hdr.envc++;
+    hdr.argc = argc - i;
+    StrBuf msg;
+    sb_init(&msg);
+    sb_append(&msg, (const char *)&hdr, sizeof(hdr));
+    char *cwd = get_current_dir();
+    sb_append(&msg, cwd ? cwd : "/", strlen(cwd ? cwd : "/") + 1);
+    sb_append(&msg, script.data ? script.data : "", script.len + 1);
+    for (char **e = environ; *e; e++)
+        sb_append(&msg, *e, strlen(*e) + 1);
+    for (; i < argc; i++)
+        sb_append(&msg, argv[i], strlen(argv[i]) + 1);
+    if (msg.len > SERVE_MSG_MAX)
+    {
+        fprintf(stderr, "tinyshell-client: request too large (%zu bytes, limit %d)\n", msg.len, SERVE_MSG_MAX);
+        return 2;
+    }
+
+    int sock = connect_server(sock_path);
+    if (sock < 0)
+    {
+        perror(sock_path);
+        return 127;
+    }
+    const int stdio[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    if (send_fds(sock, msg.data, msg.len, stdio, 3) < 0)
+    {
+        perror("send");
+        return 127;
+    }
+    sb_free(&msg);
+    sb_free(&script);
+
+    // Forward the signals a terminal or supervisor would send to a local shell
+    struct sigaction sa;
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; // recv() must return to forward them
+    const int forwarded[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2 };
+    for (size_t k = 0; k < sizeof(forwarded) / sizeof(forwarded[0]); k++)
+        sigaction(forwarded[k], &sa, NULL);
+
+    ServeReply reply;
+    for (;;)
+    {
+        ssize_t n = recv(sock, &reply, sizeof(reply), 0);
+        if (n == (ssize_t)sizeof(reply))
+            break;
+        if (n < 0 && errno == EINTR)
+        {
+            ServeRequest sig;
+            memset(&sig, 0, sizeof(sig));
+            sig.type = SERVE_SIGNAL;
+            sig.sig = pending_signal;
+            pending_signal = 0;
+            if (sig.sig)
+                send_fds(sock, &sig, sizeof(sig), NULL, 0);
+            continue;
+        }
+        fprintf(stderr, "tinyshell-client: connection to server lost\n");
+        return 127;
+    }
+    close(sock);
+
+    if (verbose)
+        fprintf(stderr, "status %d  wall %.3f ms  user %.3f ms  sys %.3f ms  maxrss %lld KB  faults %lld/%lld  switches %lld/%lld\n",
+                reply.status, reply.wall_ns / 1e6, reply.utime_us / 1e3, reply.stime_us / 1e3,
+                (long long)reply.maxrss_kb, (long long)reply.minflt, (long long)reply.majflt,
+                (long long)reply.nvcsw, (long long)reply.nivcsw);
+
+    // Die the way the script's shell did, so our caller sees the same status
+    if (reply.signal)
+    {
+        signal(reply.signal, SIG_DFL);
+        raise(reply.signal);
+    }
+    return reply.status;
+}
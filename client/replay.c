@@ -0,0 +1,498 @@
+/*
+ * replay.c - Replay a recorded session through tinyshell over a pty
+ *
+ * Reads a file written by record (or --record / TINYSHELL_RECORD), starts
+ * tinyshell on a pseudo-terminal in the directory of the first entry and
+ * types each input into it, at the recorded pace or as fast as the shell
+ * takes it. The latency of an input is the time from writing it to the
+ * next main prompt appearing, which covers readline, the parser, the
+ * executor and job control as a user sees them. Prints the distribution
+ * per command name next to the run times recorded in the session.
+ *
+ * The inputs really run: replay a session in a scratch copy of whatever
+ * it touched.
+ */
+
+#include "../include/record.h"
+#include "../include/stats.h"
+#include "../include/utils.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <limits.h>
+
+#define REPLAY_TIMEOUT_S 30 // Default wait for a prompt before sending Ctrl-C
+#define REPLAY_TAIL 4096 // Shell output kept to find the prompt in
+#define REPLAY_TOP 15 // Commands listed in the report
+#define REPLAY_PROMPT_END ">" COLOR_RESET " " // How main.c's prompts end
+#define REPLAY_PROMPT_START COLOR_CYAN "tinyshell" // Main prompt; continuation prompts are just "> "
+
+// One input of the recording
+typedef struct
+{
+    char *text;
+    char *cwd; // Directory it ran in (the previous one if not recorded)
+    char name[32]; // First word, for grouping
+    uint64_t think_ms;
+    uint64_t rec_us; // Run time when recorded
+    uint64_t lat_us; // Run time now
+    int replayed;
+} Step;
+
+static int master = -1;
+static char tail[REPLAY_TAIL];
+static size_t tail_len;
+static char prompt_cwd[PATH_MAX_LEN]; // Directory shown in the last main prompt
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-f] [-v] [-s SPEED] [-t SECS] [-x SHELL] RECORDING [-- SHELL_ARGS...]\n", prog);
+}
+
+static int read_file(const char *path, StrBuf *out)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    for (;;)
+    {
+        if (sb_reserve(out, 65536) < 0)
+        {
+            close(fd);
+            errno = ENOMEM;
+            return -1;
+        }
+        ssize_t n = read(fd, out->data + out->len, out->cap - out->len - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            close(fd);
+            return n < 0 ? -1 : 0;
+        }
+        out->len += n;
+        out->data[out->len] = '\0';
+    }
+}
+
+// Split a recording into steps (pointing into data); returns the count or -1
+static int load_steps(char *data, Step **out)
+{
+    int cap = 256, n = 0;
+    Step *steps = malloc(sizeof(Step) * cap);
+    char *cwd = NULL;
+    int lineno = 0;
+    for (char *line = data; steps && line && *line; )
+    {
+        char *nl = strchr(line, '\n');
+        if (nl)
+            *nl = '\0';
+        lineno++;
+        RecordEntry e;
+        int r = record_parse(line, &e);
+        if (r < 0)
+            fprintf(stderr, "line %d: malformed entry skipped\n", lineno);
+        if (r == 0)
+        {
+            if (n == cap)
+            {
+                Step *grown = realloc(steps, sizeof(Step) * (cap *= 2));
+                if (!grown)
+                {
+                    free(steps);
+                    return -1;
+                }
+                steps = grown;
+            }
+            if (e.cwd)
+                cwd = e.cwd;
+            Step *s = &steps[n++];
+            memset(s, 0, sizeof(*s));
+            s->text = e.text;
+            s->cwd = cwd;
+            s->think_ms = e.think_ms;
+            s->rec_us = e.run_us;
+            size_t len = strcspn(e.text, " \t\n;|&<>()");
+            snprintf(s->name, sizeof(s->name), "%.*s", (int)(len ? len : strlen(e.text)), e.text);
+        }
+        line = nl ? nl + 1 : NULL;
+    }
+    *out = steps;
+    return steps ? n : -1;
+}
+
+// Start the shell on a new pty; returns its pid
+static pid_t start_shell(const char *shell, char **args, const char *dir)
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+        return -1;
+    const char *slave_name = ptsname(master);
+    struct winsize ws = { 50, 200, 0, 0 };
+    ioctl(master, TIOCSWINSZ, &ws);
+
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    // Child: a session of its own with the pty as controlling terminal
+    setsid();
+    int slave = slave_name ? open(slave_name, O_RDWR) : -1;
+    if (slave < 0 || ioctl(slave, TIOCSCTTY, 0) < 0)
+    {
+        perror("pty");
+        _exit(127);
+    }
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    dup2(slave, STDERR_FILENO);
+    if (slave > STDERR_FILENO)
+        close(slave);
+    unsetenv(RECORD_ENV); // Don't record the replay
+    if (!getenv("TERM"))
+        setenv("TERM", "xterm", 1);
+    if (dir && chdir(dir) < 0)
+        perror(dir);
+    execvp(shell, args);
+    perror(shell);
+    _exit(127);
+}
+
+// Length of the output without the cursor placement the built-in line
+// editor adds after its prompt ("\033[0K\r\033[NC")
+static size_t strip_editor(void)
+{
+    size_t n = tail_len;
+    if (n > 0 && tail[n - 1] == 'C')
+    {
+        size_t i = n - 1;
+        while (i > 0 && tail[i - 1] >= '0' && tail[i - 1] <= '9')
+            i--;
+        if (i >= 2 && memcmp(tail + i - 2, "\033[", 2) == 0)
+            n = i - 2;
+    }
+    if (n >= 5 && memcmp(tail + n - 5, "\033[0K\r", 5) == 0)
+        return n - 5;
+    return tail_len;
+}
+
+// Check whether the output so far ends with a main prompt; notes its directory
+static int at_prompt(void)
+{
+    size_t end_len = strlen(REPLAY_PROMPT_END), start_len = strlen(REPLAY_PROMPT_START);
+    size_t out_len = strip_editor();
+    if (out_len < start_len + end_len || memcmp(tail + out_len - end_len, REPLAY_PROMPT_END, end_len) != 0)
+        return 0;
+    // Last prompt start, with no line break after it
+    for (size_t i = out_len - end_len; i-- > 0; )
+    {
+        if (tail[i] == '\n')
+            return 0;
+        if (i + start_len <= out_len - end_len && memcmp(tail + i, REPLAY_PROMPT_START, start_len) == 0)
+        {
+            const char *p = tail + i + start_len;
+            size_t len = tail + out_len - end_len - p;
+            prompt_cwd[0] = '\0';
+            if (len > 0 && *p == ':' && len - 1 < sizeof(prompt_cwd))
+                snprintf(prompt_cwd, sizeof(prompt_cwd), "%.*s", (int)(len - 1), p + 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Read shell output until a main prompt (if want_prompt) or the deadline;
+// returns 1 at a prompt, 0 at the deadline, -1 once the shell is gone
+static int pump(uint64_t deadline, int want_prompt, int echo)
+{
+    for (;;)
+    {
+        uint64_t now = monotonic_ns();
+        if (now >= deadline)
+            return 0;
+        struct pollfd pfd = { master, POLLIN, 0 };
+        int ms = (int)((deadline - now + 999999) / 1000000);
+        int r = poll(&pfd, 1, ms);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            continue;
+        char buf[4096];
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1; // EIO: every process on the pty is gone
+        if (echo)
+            write_all(STDERR_FILENO, buf, n);
+        if ((size_t)n >= sizeof(tail))
+        {
+            memcpy(tail, buf + n - sizeof(tail), sizeof(tail));
+            tail_len = sizeof(tail);
+        }
+        else
+        {
+            if (tail_len + n > sizeof(tail))
+            {
+                size_t drop = tail_len + n - sizeof(tail);
+                memmove(tail, tail + drop, tail_len - drop);
+                tail_len -= drop;
+            }
+            memcpy(tail + tail_len, buf, n);
+            tail_len += n;
+        }
+        if (want_prompt && at_prompt())
+            return 1;
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// q-th quantile of a sorted array
+static double quantile(const uint64_t *v, int n, double q)
+{
+    return n ? v[(int)((n - 1) * q + 0.5)] / 1000.0 : 0;
+}
+
+// Latency distribution of the replayed steps named name (NULL = all)
+static void report_row(const Step *steps, int n, const char *name, uint64_t *lat, uint64_t *rec)
+{
+    int k = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (steps[i].replayed && (!name || strcmp(steps[i].name, name) == 0))
+        {
+            lat[k] = steps[i].lat_us;
+            rec[k] = steps[i].rec_us;
+            k++;
+        }
+    }
+    qsort(lat, k, sizeof(uint64_t), cmp_u64);
+    qsort(rec, k, sizeof(uint64_t), cmp_u64);
+    printf("%-16.16s %6d %10.3f %10.3f %10.3f %10.3f %10.3f\n", name ? name : "(all)", k,
+           quantile(lat, k, 0.5), quantile(lat, k, 0.9), quantile(lat, k, 0.99), quantile(lat, k, 1), quantile(rec, k, 0.5));
+}
+
+static void report(const Step *steps, int n)
+{
+    uint64_t *lat = malloc(sizeof(uint64_t) * (n + 1));
+    uint64_t *rec = malloc(sizeof(uint64_t) * (n + 1));
+    if (!lat || !rec)
+    {
+        free(lat);
+        free(rec);
+        return;
+    }
+    printf("%-16s %6s %10s %10s %10s %10s %10s\n", "command", "count", "p50 ms", "p90 ms", "p99 ms", "max ms", "rec p50 ms");
+    report_row(steps, n, NULL, lat, rec);
+
+    // Names by total replay time, largest first
+    const char *names[REPLAY_TOP];
+    uint64_t totals[REPLAY_TOP];
+    int nnames = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (!steps[i].replayed)
+            continue;
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++)
+            seen = steps[j].replayed && strcmp(steps[j].name, steps[i].name) == 0;
+        if (seen)
+            continue;
+        uint64_t total = 0;
+        for (int j = i; j < n; j++)
+        {
+            if (steps[j].replayed && strcmp(steps[j].name, steps[i].name) == 0)
+                total += steps[j].lat_us;
+        }
+        int pos = nnames < REPLAY_TOP ? nnames++ : REPLAY_TOP;
+        while (pos > 0 && totals[pos - 1] < total)
+        {
+            if (pos < REPLAY_TOP)
+            {
+                names[pos] = names[pos - 1];
+                totals[pos] = totals[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < REPLAY_TOP)
+        {
+            names[pos] = steps[i].name;
+            totals[pos] = total;
+        }
+    }
+    for (int i = 0; i < nnames; i++)
+        report_row(steps, n, names[i], lat, rec);
+    free(lat);
+    free(rec);
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 1; // 0 = as fast as possible
+    uint64_t timeout_ns = REPLAY_TIMEOUT_S * 1000000000ull;
+    int verbose = 0;
+    const char *shell = NULL;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0)
+            speed = 0;
+        else if (strcmp(argv[i], "-v") == 0)
+            verbose++;
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0)
+            speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0)
+            timeout_ns = (uint64_t)(atof(argv[++i]) * 1e9);
+        else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc)
+            shell = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (i == argc)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *path = argv[i++];
+
+    // Default shell: the tinyshell next to this program
+    char shell_buf[PATH_MAX_LEN];
+    if (!shell)
+    {
+        char self[PATH_MAX_LEN];
+        ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+        const char *prog = argv[0];
+        if (n > 0)
+        {
+            self[n] = '\0';
+            prog = self;
+        }
+        const char *slash = strrchr(prog, '/');
+        snprintf(shell_buf, sizeof(shell_buf), "%.*stinyshell", slash ? (int)(slash - prog + 1) : 2, slash ? prog : "./");
+        shell = shell_buf;
+    }
+    // The shell starts in the recording's directory: a relative path must not
+    char shell_abs[PATH_MAX];
+    if (strchr(shell, '/') && realpath(shell, shell_abs))
+        shell = shell_abs;
+    if (i < argc && strcmp(argv[i], "--") == 0)
+        i++;
+    char *args[argc - i + 2];
+    args[0] = (char *)shell;
+    for (int k = i; k < argc; k++)
+        args[k - i + 1] = argv[k];
+    args[argc - i + 1] = NULL;
+
+    StrBuf data;
+    sb_init(&data);
+    if (read_file(path, &data) < 0)
+    {
+        perror(path);
+        return 1;
+    }
+    Step *steps;
+    int n = data.data ? load_steps(data.data, &steps) : 0;
+    if (n <= 0)
+    {
+        fprintf(stderr, "%s: no entries\n", path);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    uint64_t t0 = monotonic_ns();
+    pid_t pid = start_shell(shell, args, steps[0].cwd);
+    if (pid < 0)
+    {
+        perror("pty");
+        return 1;
+    }
+    if (pump(t0 + timeout_ns, 1, verbose > 1) != 1)
+    {
+        fprintf(stderr, "%s: no prompt\n", shell);
+        kill(pid, SIGKILL);
+        return 1;
+    }
+    uint64_t startup_ns = monotonic_ns() - t0;
+
+    int done = 0, timed_out = 0, moved = 0, alive = 1;
+    for (int k = 0; k < n && alive; k++)
+    {
+        Step *s = &steps[k];
+        if (speed > 0 && s->think_ms > 0 && pump(monotonic_ns() + (uint64_t)(s->think_ms * 1e6 / speed), 0, verbose > 1) < 0)
+            break;
+        if (s->cwd && prompt_cwd[0] && strcmp(s->cwd, prompt_cwd) != 0)
+            moved++; // The session went somewhere the recording did not
+
+        uint64_t t_send = monotonic_ns();
+        if (write_all(master, s->text, strlen(s->text)) < 0 || write_all(master, "\n", 1) < 0)
+            break;
+        int r = pump(t_send + timeout_ns, 1, verbose > 1);
+        uint64_t lat = monotonic_ns() - t_send;
+        if (r == 0)
+        {
+            // Stuck (reading the terminal, say): interrupt it, then end its input
+            timed_out++;
+            fprintf(stderr, "timed out: %s\n", s->text);
+            write_all(master, "\003", 1);
+            if ((r = pump(monotonic_ns() + 2000000000ull, 1, verbose > 1)) == 0)
+            {
+                write_all(master, "\004", 1);
+                r = pump(monotonic_ns() + 2000000000ull, 1, verbose > 1);
+            }
+            alive = r == 1;
+            continue;
+        }
+        s->lat_us = lat / 1000;
+        s->replayed = 1;
+        done++;
+        if (verbose)
+        {
+            // One line per input, as in the recording
+            printf("%10.3f ms  ", lat / 1e6);
+            for (const char *p = s->text; *p; p++)
+            {
+                if (*p == '\n')
+                    fputs("\\n", stdout);
+                else
+                    putchar(*p);
+            }
+            putchar('\n');
+        }
+        alive = r == 1; // A recorded exit ends the replay
+    }
+    uint64_t total_ns = monotonic_ns() - t0;
+
+    // Ctrl-D at the prompt ends the shell; closing the pty hangs up anything left
+    if (alive)
+    {
+        write_all(master, "\004", 1);
+        pump(monotonic_ns() + 2000000000ull, 0, 0);
+    }
+    close(master);
+    int status;
+    if (waitpid(pid, &status, WNOHANG) == 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+
+    char pace[32] = "as fast as possible";
+    if (speed > 0)
+        snprintf(pace, sizeof(pace), speed == 1 ? "recorded pace" : "%gx recorded pace", speed);
+    printf("replayed %d of %d inputs in %.2fs (%s), startup %.1f ms, %d timed out, %d in another directory\n",
+           done, n, total_ns / 1e9, pace, startup_ns / 1e6, timed_out, moved);
+    report(steps, n);
+    free(steps);
+    sb_free(&data);
+    return done == n ? 0 : 1;
+}
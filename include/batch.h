@@ -0,0 +1,20 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "shell.h"
+
+#define BATCH_ENV_MARGIN 4096 // Bytes kept free below ARG_MAX, as xargs does
+
+/**
+ * Run "batch [-j N] [-n N] CMD ARGS..." from its unexpanded words
+ * Leading words without expansions (CMD and its fixed options) are repeated
+ * in every invocation; the words from the first expansion on are expanded
+ * without the MAX_ARGS limit and packed into as few invocations as fit
+ * sysconf(_SC_ARG_MAX). -j runs up to N external invocations at once
+ * (0 = one per CPU); -n caps the items per invocation.
+ * @param cmd: Parsed command whose argv[0] is "batch"
+ * @return: 0 if every invocation succeeded, else the first failing status
+ */
+int batch_run(Command *cmd);
+
+#endif // BATCH_H
@@ -1,42 +1,135 @@
-#ifndef BUILTINS_H
-#define BUILTINS_H
-
-/**
- * Built-in: exit command
- * @param argc: Argument count
- * @param argv: Argument array
- */
-void builtin_exit(int argc, char **argv);
-
-/**
- * Built-in: cd command
- * @param argc: Argument count
- * @param argv: Argument array
- */
-void builtin_cd(int argc, char **argv);
-
-/**
- * Built-in: help command
- */
-void builtin_help(void);
-
-/**
- * Built-in: fg command - bring job to foreground
- * @param argc: Argument count
- * @param argv: Argument array (%N format)
- */
-void builtin_fg(int argc, char **argv);
-
-/**
- * Built-in: bg command - continue job in background
- * @param argc: Argument count
- * @param argv: Argument array (%N format)
- */
-void builtin_bg(int argc, char **argv);
-
-/**
- * Built-in: jobs command - list all jobs
- */
-void builtin_jobs(void);
-
-#endif // BUILTINS_H
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+// Builtin flags
+#define BUILTIN_PURE 0x1 // No side effects on shell state (safe to run in-process for $(...))
+#define BUILTIN_STAGE 0x2 // Filter reading its input: always runs as a forked pipeline stage
+
+// Builtin entry point: returns the command's exit status
+typedef int (*BuiltinFn)(int argc, char **argv);
+
+// Builtin table entry
+typedef struct Builtin
+{
+    const char *name; // Command name
+    BuiltinFn fn; // Implementation
+    int flags; // BUILTIN_* flags
+} Builtin;
+
+/**
+ * Enter every builtin into the name table (called once by resolve.c)
+ */
+void register_builtins(void);
+
+/**
+ * Look up a builtin by name
+ * @param name: Command name
+ * @return: Table entry, or NULL if name is not a builtin
+ */
+const Builtin* find_builtin(const char *name);
+
+/**
+ * Built-in: exit command
+ * @param argc: Argument count
+ * @param argv: Argument array
+ */
+int builtin_exit(int argc, char **argv);
+
+/**
+ * Built-in: cd command
+ * @param argc: Argument count
+ * @param argv: Argument array
+ */
+int builtin_cd(int argc, char **argv);
+
+/**
+ * Built-in: help command
+ */
+int builtin_help(int argc, char **argv);
+
+/**
+ * Built-in: fg command - bring job to foreground
+ * @param argc: Argument count
+ * @param argv: Argument array (%N format)
+ */
+int builtin_fg(int argc, char **argv);
+
+/**
+ * Built-in: bg command - continue job in background
+ * @param argc: Argument count
+ * @param argv: Argument array (%N format)
+ */
+int builtin_bg(int argc, char **argv);
+
+/**
+ * Built-in: jobs command - list all jobs (-l adds per-process resource use)
+ * @param argc: Argument count
+ * @param argv: Argument array
+ */
+int builtin_jobs(int argc, char **argv);
+
+/**
+ * Built-in: pwd command - print current directory
+ */
+int builtin_pwd(int argc, char **argv);
+
+/**
+ * Built-in: echo command - print arguments
+ * @param argc: Argument count
+ * @param argv: Argument array (-n suppresses the newline)
+ */
+int builtin_echo(int argc, char **argv);
+
+/**
+ * Built-in: read command - read a line and split it into variables
+ *   read [-u FD|p|p:NAME] VAR...
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: 0 for a line, 1 at end of file, 2 on error
+ */
+int builtin_read(int argc, char **argv);
+
+/**
+ * Built-in: trace command - start or stop execution tracing
+ * @param argc: Argument count
+ * @param argv: Argument array (FILE to start, "off" to stop)
+ */
+int builtin_trace(int argc, char **argv);
+
+/**
+ * Built-in: stats command - print counters and latency histograms
+ * @param argc: Argument count
+ * @param argv: Argument array (-j for JSON, -r to reset afterwards)
+ */
+int builtin_stats(int argc, char **argv);
+
+/**
+ * Built-in: alias command - list, show or define aliases
+ * @param argc: Argument count
+ * @param argv: Argument array (NAME=VALUE to define, NAME to show)
+ */
+int builtin_alias(int argc, char **argv);
+
+/**
+ * Built-in: unalias command - remove aliases
+ * @param argc: Argument count
+ * @param argv: Argument array (-a removes all)
+ */
+int builtin_unalias(int argc, char **argv);
+
+/**
+ * Built-in: type command - show how each name resolves
+ * @param argc: Argument count
+ * @param argv: Names to look up
+ */
+int builtin_type(int argc, char **argv);
+
+/**
+ * Built-in: set command - shell options
+ *   set [-C|+C] [-o noclobber|+o noclobber]; with no arguments lists them
+ * @param argc: Argument count
+ * @param argv: Argument array
+ */
+int builtin_set(int argc, char **argv);
+
+#endif // BUILTINS_H
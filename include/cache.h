@@ -0,0 +1,34 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "script.h"
+
+#define CACHE_MAGIC   0x43485354u // "TSHC"
+#define CACHE_VERSION 5 // Bump whenever Program/Insn layout or opcodes change
+
+// Set to disable reading and writing the cache (--no-cache)
+extern int cache_disabled;
+
+/**
+ * Directory under the user's cache home ($XDG_CACHE_HOME or ~/.cache),
+ * created if needed: <cache home>/tinyshell[/sub]
+ * @param sub: Subdirectory name, or NULL for the top directory
+ * @param buf: Receives the path
+ * @param size: Size of buf
+ * @return: 0 on success, -1 if there is no cache home or it cannot be created
+ */
+int cache_dir(const char *sub, char *buf, size_t size);
+
+/**
+ * Load a script, from the compiled cache when it is still valid
+ * A valid cache file is mapped and executed in place; otherwise the script
+ * is compiled and the cache rewritten. Entries are keyed by the script's
+ * absolute path and invalidated by a change of mtime or size.
+ * @param path: Script file
+ * @param out: Receives the program on SCRIPT_OK
+ * @param from_cache: Set to 1 if the program came from the cache (may be NULL)
+ * @return: SCRIPT_OK, SCRIPT_ERROR (reported), or -1 if the file cannot be read
+ */
+int cache_load_script(const char *path, Program **out, int *from_cache);
+
+#endif // CACHE_H
@@ -0,0 +1,71 @@
+#ifndef COPROC_H
+#define COPROC_H
+
+#include "shell.h"
+#include "utils.h"
+
+#define COPROC_MAX 8 // Coprocesses at once
+#define COPROC_BUF_SIZE 4096 // Read-ahead for read -u p
+
+/**
+ * Check a coprocess name: a letter or _ followed by letters, digits or _
+ * @param name: Candidate name
+ * @return: Non-zero if valid
+ */
+int coproc_valid_name(const char *name);
+
+/**
+ * Create the pipes for a new coprocess; the shell's ends are held until
+ * coproc_commit() or coproc_abort()
+ * @param child: Receives the first stage's stdin [0] and the last stage's stdout [1]
+ *               (the caller closes them once the pipeline is started)
+ * @return: 0 on success, -1 on error
+ */
+int coproc_open(int child[2]);
+
+/**
+ * Register the coprocess whose pipes coproc_open() made; it becomes the current one (p)
+ * A coprocess already called name is forgotten and its ends are closed.
+ * @param name: Coprocess name (also sets $NAME_PID)
+ * @param pid: Last stage of the pipeline
+ */
+void coproc_commit(const char *name, pid_t pid);
+
+/**
+ * Close the ends of a coprocess that could not be started
+ */
+void coproc_abort(void);
+
+/**
+ * Look up one of the shell's ends of a coprocess (>&p, <&p, >&p:NAME)
+ * @param name: Coprocess name, or NULL for the current one
+ * @param end: PIPE_WRITE for its stdin, PIPE_READ for its stdout
+ * @return: Descriptor, or -1 after printing an error
+ */
+int coproc_fd(const char *name, int end);
+
+/**
+ * Read one line from a coprocess's stdout through the shell's read-ahead
+ * @param name: Coprocess name, or NULL for the current one
+ * @param line: Receives the line without its newline
+ * @return: 1 for a line, 0 at end of file (line holds any partial line), -1 on error
+ */
+int coproc_getline(const char *name, StrBuf *line);
+
+/**
+ * Close every coprocess end in a forked child of the shell, so that only
+ * the shell keeps a coprocess's stdin open
+ */
+void coproc_close_child(void);
+
+/**
+ * Built-in: coproc - list coprocesses or close one's input
+ *   coproc | coproc -c [NAME]
+ * (coproc NAME pipeline is handled by the executor, like timeout)
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: Exit status
+ */
+int builtin_coproc(int argc, char **argv);
+
+#endif // COPROC_H
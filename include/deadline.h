@@ -0,0 +1,107 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include "shell.h"
+
+#define TIMEOUT_STATUS 124 // $? of a pipeline stopped by its deadline (as timeout(1))
+
+// How long a pipeline may run and how it is stopped
+typedef struct
+{
+    uint64_t duration_ns; // Time allowed (0 = no limit)
+    int sig; // Signal sent when it runs out
+    uint64_t grace_ns; // SIGKILL this long after sig if still running (0 = never)
+} DeadlineSpec;
+
+/**
+ * Parse a signal name (TERM, SIGTERM) or number
+ * @param s: Text to parse
+ * @return: Signal number, or -1 if unknown
+ */
+int parse_signal(const char *s);
+
+/**
+ * Parse a duration: seconds with an optional s, m, h or d suffix ("1.5", "10m")
+ * @param s: Text to parse
+ * @param ns: Receives the duration in nanoseconds
+ * @return: 0 on success, -1 if invalid
+ */
+int parse_duration(const char *s, uint64_t *ns);
+
+/**
+ * Parse "[-s SIG] [-k GRACE] DURATION" at the start of a timeout command
+ * DURATION and GRACE are numbers with an optional s, m, h or d suffix.
+ * @param argc: Argument count (argv[0] is the command name)
+ * @param argv: Argument array
+ * @param spec: Filled with the parsed limit
+ * @return: Index of the first word of the command to run, or -1 after printing an error
+ */
+int timeout_parse(int argc, char **argv, DeadlineSpec *spec);
+
+/**
+ * Put processes that were just started under a deadline
+ * Each process is tracked through a pidfd, so a late signal can never
+ * reach a recycled pid.
+ * @param spec: Limit to enforce (duration_ns must be non-zero)
+ * @param pgid: Process group to signal (0 = signal each process instead)
+ * @param pids: The processes (pipeline stages)
+ * @param npids: Number of processes
+ * @param label: Command line shown by the deadline builtin
+ * @return: Deadline id, or -1 on error
+ */
+int deadline_add(const DeadlineSpec *spec, pid_t pgid, const pid_t *pids, int npids, const char *label);
+
+/**
+ * Forget a deadline (its processes finished)
+ * @param id: Id from deadline_add() (-1 is ignored)
+ */
+void deadline_cancel(int id);
+
+/**
+ * Check whether a deadline has run out
+ * @param id: Id from deadline_add()
+ * @return: 0 if not, 1 once its signal was sent, 2 once SIGKILL followed
+ */
+int deadline_fired(int id);
+
+/**
+ * Timer descriptor for the shell's event loop: readable when a deadline is due
+ * @return: timerfd, or -1 when no deadline is pending
+ */
+int deadline_fd(void);
+
+/**
+ * Signal every process group whose deadline has passed and re-arm the timer
+ */
+void deadline_run(void);
+
+/**
+ * waitpid() that keeps enforcing deadlines while it blocks
+ * With no deadline pending this is a plain waitpid(); otherwise SIGCHLD
+ * (through a signalfd) and the deadline timer are polled together.
+ * @param pid: As waitpid()
+ * @param status: As waitpid()
+ * @param options: As waitpid()
+ * @return: As waitpid()
+ */
+pid_t deadline_waitpid(pid_t pid, int *status, int options);
+
+/**
+ * Built-in: timeout [-s SIG] [-k GRACE] DURATION command args...
+ * At the start of a pipeline the shell applies the limit to every stage
+ * instead; this runs a single command under it.
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: The command's status, or 124 if it timed out
+ */
+int builtin_timeout(int argc, char **argv);
+
+/**
+ * Built-in: deadline command - list, set or remove job deadlines
+ *   deadline | deadline [-s SIG] [-k GRACE] %N DURATION | deadline %N off
+ * @param argc: Argument count
+ * @param argv: Argument array
+ */
+int builtin_deadline(int argc, char **argv);
+
+#endif // DEADLINE_H
@@ -1,43 +1,129 @@
-#ifndef EXECUTOR_H
-#define EXECUTOR_H
-
-#include "shell.h"
-
-/**
- * Execute a command with PATH search
- * @param cmd: Command name
- * @param argv: Argument array
- */
-void exec_with_path(const char *cmd, char **argv);
-
-/**
- * Set up file redirections for a command
- * @param cmd: Command with redirection info
- */
-void setup_redirection(Command *cmd);
-
-/**
- * Execute a pipeline of commands
- * @param cmds: Array of commands
- * @param num_cmds: Number of commands in pipeline
- */
-void execute_pipeline(Command cmds[], int num_cmds);
-
-/**
- * Display process exit status
- * @param status: Exit status from waitpid
- */
-void print_exit_status(int status);
-
-/**
- * SIGCHLD signal handler for reaping zombie processes
- * @param sig: Signal number
- */
-void sigchld_handler(int sig);
-
-/**
- * Check for completed jobs and print notifications
- */
-void check_job_notifications(void);
-
-#endif // EXECUTOR_H
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include "shell.h"
+
+// Descriptors a redirected { } group replaced in the shell itself
+typedef struct
+{
+    int saved[REDIR_FD_MAX + 1]; // Copy of the original fd, -1 if it was closed, -2 if untouched
+} RedirSave;
+
+/**
+ * Execute a command with PATH search
+ * @param cmd: Command name
+ * @param argv: Argument array
+ */
+void exec_with_path(const char *cmd, char **argv);
+
+/**
+ * Execute a program whose path was resolved in advance (never returns)
+ * @param path: Executable path
+ * @param argv: Argument array
+ */
+void exec_resolved(const char *path, char **argv);
+
+/**
+ * Run a command in the current process (used after fork): applies leading
+ * NAME=value words and redirections, then runs a builtin or execs
+ * @param cmd: Expanded command
+ */
+void exec_command(Command *cmd);
+
+/**
+ * Restore default dispositions for signals the shell ignores
+ */
+void reset_child_signals(void);
+
+/**
+ * Convert a waitpid status to a shell exit code
+ * @param status: Status from waitpid
+ * @return: Exit code, or 128+N for signal N
+ */
+int status_to_code(int status);
+
+/**
+ * Open the files of a command's redirections in the shell (close-on-exec,
+ * moved to REDIR_FD_MIN or above) and check its dups, so errors are
+ * reported before anything is spawned
+ * @param cmd: Command whose redirs get their opened descriptors
+ * @return: 0 on success, -1 after printing the error (nothing left open)
+ */
+int open_redirections(Command *cmd);
+
+/**
+ * Close the descriptors opened by open_redirections()
+ * @param cmd: Command whose redirections were opened
+ */
+void close_redirections(Command *cmd);
+
+/**
+ * Apply a command's redirections in the child (dup2/close only)
+ * @param cmd: Command whose redirections were opened by open_redirections()
+ */
+void setup_redirection(Command *cmd);
+
+/**
+ * Apply redirections to the shell itself (for a { } group), saving the
+ * descriptors they replace; files are opened once for the whole group
+ * @param cmd: Command holding only redirections, targets expanded
+ * @param save: Receives what restore_redirections() puts back
+ * @return: 0 on success, -1 after printing the error (nothing changed)
+ */
+int redirect_shell(Command *cmd, RedirSave *save);
+
+/**
+ * Undo redirect_shell()
+ * @param save: Descriptors saved by redirect_shell()
+ */
+void restore_redirections(RedirSave *save);
+
+/**
+ * Expand and execute a pipeline of commands (sets last_exit_status)
+ * @param cmds: Array of commands
+ * @param num_cmds: Number of commands in pipeline
+ */
+void execute_pipeline(Command cmds[], int num_cmds);
+
+/**
+ * Add a background job to the job table
+ * @param pid: Process reported for the job (last pipeline stage)
+ * @param pgid: Job's process group
+ * @param cmd_line: Command line shown by jobs
+ * @param start_ns: Launch time (monotonic ns)
+ * @return: Job number, or -1 if the table is full
+ */
+int add_job(pid_t pid, pid_t pgid, const char *cmd_line, uint64_t start_ns);
+
+/**
+ * Give terminal control to a process group (prints an error on failure)
+ * @param pgid: Process group to move to the foreground
+ * @return: Result of tcsetpgrp
+ */
+int give_terminal(pid_t pgid);
+
+/**
+ * Run a pipeline whose words were already expanded (sets last_exit_status)
+ * @param cmds: Array of commands
+ * @param num_cmds: Number of commands in pipeline
+ */
+void run_pipeline(Command cmds[], int num_cmds);
+
+/**
+ * Display process exit status
+ * @param status: Exit status from waitpid
+ */
+void print_exit_status(int status);
+
+/**
+ * SIGCHLD signal handler for reaping zombie processes
+ * @param sig: Signal number
+ */
+void sigchld_handler(int sig);
+
+/**
+ * Check for completed jobs and print notifications
+ */
+void check_job_notifications(void);
+
+#endif // EXECUTOR_H
@@ -0,0 +1,63 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "shell.h"
+#include "utils.h"
+
+// Positional parameters ($1.., $#, $@) of the running function or script
+extern int positional_argc;
+extern char **positional_argv;
+
+/**
+ * Expand one word without field splitting
+ * @param word: Word to expand
+ * @param out: Buffer the expansion is appended to (not NUL-terminated separately)
+ */
+void expand_word(const char *word, StrBuf *out);
+
+/**
+ * Expand $NAME, ${NAME}, $?, $$, $(...) and `...` in a command's words
+ * Unquoted expansion results in arguments are split on whitespace.
+ * Expanded strings are stored in arena, which must outlive the command.
+ * Pipeline stages need separate arenas: growing one moves the words already in it.
+ * @param cmd: Parsed command (argv and redirection targets are rewritten)
+ * @param arena: Storage for expanded words
+ * @return: 0 on success, -1 on error
+ */
+int expand_command(Command *cmd, StrBuf *arena);
+
+/**
+ * Check whether a word contains anything to expand ($, ` or \\)
+ * @param word: Word to check
+ * @return: Non-zero if expand_word would change it
+ */
+int word_needs_expansion(const char *word);
+
+/**
+ * Expand and split words with no limit on the number of results
+ * @param words: Words to expand
+ * @param nwords: Number of words
+ * @param out: Receives the fields, each NUL-terminated, back to back
+ * @return: Number of fields, or -1 on allocation failure
+ */
+int expand_fields(char *const *words, int nwords, StrBuf *out);
+
+/**
+ * Run a command line and capture its standard output
+ * Side-effect-free builtins run in-process without forking.
+ * Trailing newlines are removed from the captured text.
+ * @param src: Command text (need not be NUL-terminated)
+ * @param len: Length of src
+ * @param out: Buffer the output is appended to
+ * @return: Exit status of the command
+ */
+int capture_output(const char *src, size_t len, StrBuf *out);
+
+/**
+ * Check whether a word has the form NAME=value
+ * @param word: Word to check
+ * @return: Length of NAME if it is an assignment, 0 otherwise
+ */
+size_t assignment_name_len(const char *word);
+
+#endif // EXPAND_H
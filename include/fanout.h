@@ -0,0 +1,34 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "shell.h"
+
+#define FANOUT_CHUNK (64 * 1024) // Bytes moved per round (one default pipe's worth)
+#define FANOUT_SCRATCH_SIZE (256 * 1024) // Scratch pipe capacity: must hold a full round
+
+/**
+ * Check whether a redirection is one of stdout's file targets (>, >|, >>)
+ * @param r: Redirection
+ * @return: Non-zero if fanout_output() writes to it
+ */
+int fanout_target(const Redirect *r);
+
+/**
+ * Check whether a command's stdout has several targets (cmd > a > b, cmd > a | next)
+ * @param cmd: Command with its redirections and pipe_out set
+ * @return: Non-zero if fanout_output() is needed
+ */
+int fanout_needed(const Command *cmd);
+
+/**
+ * Send a command's stdout to all of its output targets (called in the child)
+ * Uses the already opened target files (and the pipeline pipe if
+ * cmd->pipe_out), then forks: the new process returns to run the command
+ * with stdout on a pipe, while this one copies that pipe to each target
+ * with tee(2)/splice(2) and exits with the command's status once the
+ * output is written.
+ * @param cmd: Command with more than one output target
+ */
+void fanout_output(Command *cmd);
+
+#endif // FANOUT_H
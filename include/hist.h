@@ -0,0 +1,25 @@
+#ifndef HIST_H
+#define HIST_H
+
+#define HIST_MAX 1000 // Inputs kept (oldest dropped first)
+
+/**
+ * Add an input to the shell's history (a repeat of the last one is not added)
+ * @param text: Complete input, possibly several lines
+ */
+void hist_add(const char *text);
+
+/**
+ * Number of inputs in the history
+ * @return: Count, at most HIST_MAX
+ */
+int hist_count(void);
+
+/**
+ * Look up an input
+ * @param i: Index, 0 = oldest
+ * @return: The input, or NULL if i is out of range
+ */
+const char *hist_get(int i);
+
+#endif // HIST_H
@@ -0,0 +1,65 @@
+#ifndef JOBLOG_H
+#define JOBLOG_H
+
+#include "shell.h"
+#include <signal.h>
+
+#define JOBLOG_RING_SIZE (64 * 1024) // Most recent output kept per job
+#define JOBLOG_PIPE_SIZE (1024 * 1024) // Capture pipe capacity asked for, so jobs rarely wait on a drain
+
+// joblog_wait() results
+#define JOBLOG_READY 1 // The descriptor is readable
+#define JOBLOG_REDRAW 2 // Output went over the prompt
+
+/**
+ * Create the capture pipe for the next background job, if capture is on
+ * The read end is held until joblog_attach() binds it to the job.
+ * @return: Write end for the job's stdout/stderr (close-on-exec), or -1 if not capturing
+ */
+int joblog_pipe(void);
+
+/**
+ * Bind the pipe from joblog_pipe() to the job that was just created
+ * @param job_num: Job number (ignored with the pipe closed if < 0)
+ * @param cmd_line: Command line shown by joblog
+ */
+void joblog_attach(int job_num, const char *cmd_line);
+
+/**
+ * Close a pipe from joblog_pipe() that was not attached to a job
+ */
+void joblog_discard(void);
+
+/**
+ * Move whatever captured jobs have written into their ring buffers
+ * @param timeout_ms: Longest wait for output (0 = don't wait, -1 = until some arrives)
+ */
+void joblog_drain(int timeout_ms);
+
+/**
+ * Wait for input while draining captured jobs, running due job deadlines and
+ * onchange reruns; the event loop behind both line editors
+ * @param fd: Input descriptor to wait for
+ * @param sigmask: Signal mask while waiting (as ppoll), or NULL to keep waiting through signals
+ * @return: JOBLOG_READY, JOBLOG_REDRAW, 0 if a signal arrived, -1 on error
+ */
+int joblog_wait(int fd, const sigset_t *sigmask);
+
+#ifndef NO_READLINE
+/**
+ * Readline input hook: waits with joblog_wait() for a key
+ * @param stream: Readline's input stream
+ * @return: Next input character, as rl_getc()
+ */
+int joblog_getc(FILE *stream);
+#endif
+
+/**
+ * Built-in: joblog command - control and view background job output capture
+ *   joblog on [DIR] | joblog off | joblog | joblog [-f] %N
+ * @param argc: Argument count
+ * @param argv: Argument array
+ */
+int builtin_joblog(int argc, char **argv);
+
+#endif // JOBLOG_H
@@ -0,0 +1,27 @@
+#ifndef JTOP_H
+#define JTOP_H
+
+#include "shell.h"
+
+#define JTOP_MAX_PROCS 512 // Job processes sampled per refresh
+#define JTOP_INTERVAL_NS 2000000000ull // Default jtop refresh interval (2s)
+#define JTOP_MIN_DELTA_NS 100000000ull // Shorter gaps between samples are too coarse for CPU% (0.1s)
+
+/**
+ * Print every job and each process in its process group: pid, state,
+ * CPU% since the previous sample (or since the process started), RSS,
+ * bytes read and written, elapsed time and the full command line (jobs -l)
+ * @return: 0 on success, 1 if /proc could not be read
+ */
+int jobs_print_long(void);
+
+/**
+ * Built-in: jtop - refresh the jobs -l view until q is pressed or no job is left
+ *   jtop [-d SECS] [-n COUNT]
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: Exit status
+ */
+int builtin_jtop(int argc, char **argv);
+
+#endif // JTOP_H
@@ -0,0 +1,39 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include "shell.h"
+
+/**
+ * Start the launcher (zygote) helper process
+ * The helper is a fresh exec of the shell binary that forks children with
+ * CLONE_PARENT, so they are children of the shell and job control
+ * (waitpid, SIGCHLD, process groups) works unchanged.
+ * @return: 0 on success, -1 on error
+ */
+int launcher_start(void);
+
+/**
+ * Check whether the launcher is running
+ * @return: Non-zero when spawn requests can be sent
+ */
+int launcher_active(void);
+
+/**
+ * Ask the launcher to start an external command
+ * @param cmd: Expanded command (builtins are rejected)
+ * @param in_fd: Descriptor to become the child's stdin
+ * @param out_fd: Descriptor to become the child's stdout
+ * @param err_fd: Descriptor to become the child's stderr
+ * @param pgid: Process group to join (0 = new group, -1 = leave unchanged)
+ * @return: Child pid, or -1 if the launcher cannot run this command
+ */
+pid_t launcher_spawn(Command *cmd, int in_fd, int out_fd, int err_fd, pid_t pgid);
+
+/**
+ * Entry point of the helper process (tinyshell --launcher FD)
+ * @param sock: Request socket
+ * @return: Exit code
+ */
+int launcher_main(int sock);
+
+#endif // LAUNCHER_H
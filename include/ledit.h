@@ -0,0 +1,51 @@
+#ifndef LEDIT_H
+#define LEDIT_H
+
+#include <stddef.h>
+
+#define LEDIT_DEFAULT_COLS 80 // Terminal width when TIOCGWINSZ fails
+#define LEDIT_ESC_MAX 16 // Longest escape sequence collected
+
+// Result of ledit_feed()
+typedef enum
+{
+    LEDIT_MORE, // Line not finished: wait until the input is readable again
+    LEDIT_LINE, // A line was entered
+    LEDIT_EOF // Ctrl-D on an empty line, or end of input
+} LeditStatus;
+
+/**
+ * Start editing a line: puts a terminal in raw mode and shows the prompt
+ * Input that is not a terminal is read as plain lines.
+ * @param in_fd: Input descriptor (keys)
+ * @param out_fd: Output descriptor (prompt and echo)
+ * @param prompt: Prompt (ANSI color sequences take no columns)
+ * @return: 0 on success, -1 on error
+ */
+int ledit_start(int in_fd, int out_fd, const char *prompt);
+
+/**
+ * Process the input that is available without blocking; call it when in_fd
+ * is readable (poll), so the caller's event loop keeps running between keys.
+ * Bytes after the end of a line stay unread for whatever runs next.
+ * @param line: Receives the line for LEDIT_LINE (without newline; caller frees)
+ * @return: LEDIT_MORE, LEDIT_LINE or LEDIT_EOF
+ */
+LeditStatus ledit_feed(char **line);
+
+/**
+ * Erase the line being edited so other output can be printed
+ */
+void ledit_hide(void);
+
+/**
+ * Draw the prompt and the line again (after ledit_hide() or stray output)
+ */
+void ledit_show(void);
+
+/**
+ * Stop editing: restores the terminal mode saved by ledit_start()
+ */
+void ledit_stop(void);
+
+#endif // LEDIT_H
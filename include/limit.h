@@ -0,0 +1,82 @@
+#ifndef LIMIT_H
+#define LIMIT_H
+
+#include "shell.h"
+
+#define LIMIT_CPU_PERIOD_US 100000 // cpu.max period; -c CPUS sets the quota per period
+#define LIMIT_MAX 64 // Limited jobs at once
+
+// Limits asked for by limit -c/-m/-p (0 = none)
+typedef struct
+{
+    uint64_t cpu_quota_us; // CPU time per LIMIT_CPU_PERIOD_US
+    uint64_t mem_bytes; // memory.max (RLIMIT_AS without cgroups)
+    uint64_t pids; // pids.max (RLIMIT_NPROC without cgroups)
+} LimitSpec;
+
+/**
+ * Parse the options of a leading limit prefix
+ *   limit [-c CPUS] [-m SIZE] [-p N] command...
+ * @param argc: Argument count
+ * @param argv: Argument array (argv[0] is "limit")
+ * @param spec: Receives the limits
+ * @return: Index of the first word after the options (argc if none),
+ *          or -1 after printing an error
+ */
+int limit_parse(int argc, char **argv, LimitSpec *spec);
+
+/**
+ * Prepare a job's cgroup (when a writable cgroup v2 tree is available)
+ * and apply its limits; processes forked until limit_launched() join it
+ * @param spec: Limits for the job
+ * @return: Handle for limit_launched(), or -1 on error
+ */
+int limit_begin(const LimitSpec *spec);
+
+/**
+ * Check whether a limited job is being launched (its stages must be forked
+ * by the shell, not started through the launcher)
+ * @return: Non-zero between limit_begin() and limit_launched()
+ */
+int limit_active(void);
+
+/**
+ * Move a freshly forked child into the job's cgroup, or apply the limits
+ * with setrlimit where cgroups cannot enforce them
+ */
+void limit_enter_child(void);
+
+/**
+ * In the shell, after forking a stage: put it in the job's cgroup as well
+ * (the child also joins itself before exec), so the cgroup never looks
+ * empty while the job runs
+ * @param pid: The stage's process
+ */
+void limit_forked(pid_t pid);
+
+/**
+ * End the launch started by limit_begin()
+ * @param id: Handle from limit_begin()
+ * A job that already finished (foreground) has its totals printed now;
+ * one still running (tracked with a pidfd) or with processes left in its
+ * cgroup, once it is gone.
+ * @param pid: Last stage of the job (-1 if nothing started)
+ */
+void limit_launched(int id, pid_t pid);
+
+/**
+ * Print the totals of limited jobs that left the job table and remove their cgroups
+ */
+void limit_reap(void);
+
+/**
+ * Built-in: limit - list limited jobs or change a job's limits
+ *   limit | limit [-c CPUS] [-m SIZE] [-p N] %N
+ * (limit ... command is handled by the executor, like timeout)
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: Exit status
+ */
+int builtin_limit(int argc, char **argv);
+
+#endif // LIMIT_H
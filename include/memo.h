@@ -0,0 +1,26 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "shell.h"
+
+#define MEMO_VERSION     1 // Bump whenever the entry file format changes
+#define MEMO_DEFAULT_MAX (256ull << 20) // Store limit when TINYSHELL_CACHE_MAX is unset
+#define MEMO_CHUNK       65536 // Bytes copied per read while recording or replaying
+
+/**
+ * Built-in: cache command - memoize a deterministic command's output
+ *   cache [-e VAR]... [-i FILE]... [--] cmd args...
+ *   cache stats | cache clear
+ * The key covers argv, the working directory, the named environment
+ * variables and the device/inode/size/mtime of each input file. A hit
+ * replays the stored stdout, stderr and exit status; a miss runs the
+ * command, copying its output to the store as it is produced. The store
+ * ($XDG_CACHE_HOME/tinyshell/memo) keeps output blobs by content hash and
+ * evicts least recently used entries beyond TINYSHELL_CACHE_MAX bytes.
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: The command's (possibly replayed) exit status
+ */
+int builtin_cache(int argc, char **argv);
+
+#endif // MEMO_H
@@ -1,21 +1,29 @@
-#ifndef PARSER_H
-#define PARSER_H
-
-#include "shell.h"
-
-/**
- * Parse a single command and extract redirections
- * @param input: Input string to parse
- * @param cmd: Command structure to fill
- */
-void parse_command(char *input, Command *cmd);
-
-/**
- * Split input by pipes and parse each command
- * @param input: Full input line
- * @param cmds: Array to store parsed commands
- * @return: Number of commands in pipeline
- */
-int split_pipeline(char *input, Command cmds[]);
-
-#endif // PARSER_H
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "shell.h"
+
+/**
+ * Parse a single command and extract redirections
+ * @param input: Input string to parse
+ * @param cmd: Command structure to fill
+ * @return: 0 on success, -1 after reporting too many words or redirections
+ */
+int parse_command(char *input, Command *cmd);
+
+/**
+ * Split input by pipes and parse each command
+ * @param input: Full input line
+ * @param cmds: Array to store parsed commands (MAX_CMDS entries)
+ * @return: Number of commands in pipeline, or -1 after a parse error
+ */
+int split_pipeline(char *input, Command cmds[]);
+
+/**
+ * Skip over a $(...) or `...` substitution
+ * @param p: Pointer to the '$' of "$(" or to the opening backtick
+ * @return: Pointer just past the closing ')' or backtick (end of string if unterminated)
+ */
+const char* skip_subst(const char *p);
+
+#endif // PARSER_H
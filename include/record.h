@@ -0,0 +1,67 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "shell.h"
+
+#define RECORD_MAGIC "#tinyshell-record 1" // First word of a session header line
+#define RECORD_ENV "TINYSHELL_RECORD" // Record every interactive session to this file
+#define RECORD_LINE_MAX (64 * 1024) // Longest entry written (longer inputs are skipped)
+
+// One entry of a recording: an input as it was handed to the compiler
+// On disk: THINK_MS \t RUN_US \t STATUS \t CWD \t TEXT \n, with \, tab and
+// newline in CWD and TEXT escaped as \\, \t and \n. CWD is empty when it is
+// the same as in the previous entry.
+typedef struct
+{
+    uint64_t think_ms; // Prompt shown to input complete
+    uint64_t run_us; // Input complete to the next prompt
+    int status; // $? afterwards (2 for a syntax error)
+    char *cwd; // Directory the input ran in, NULL if unchanged
+    char *text; // The input (several lines for if/for/while/case/functions)
+} RecordEntry;
+
+/**
+ * Start appending interactive inputs to a file (replaces any open recording)
+ * Each session starts with a RECORD_MAGIC header line.
+ * @param path: Recording file, created if missing
+ * @return: 0 on success, -1 on error
+ */
+int record_open(const char *path);
+
+/**
+ * Stop recording
+ */
+void record_close(void);
+
+/**
+ * Note an input that is about to run (no-op when not recording)
+ * @param text: Complete input
+ * @param think_ns: Time from the prompt to the input being complete
+ */
+void record_begin(const char *text, uint64_t think_ns);
+
+/**
+ * Write the entry started by record_begin() (dropped if recording stopped
+ * or started in between, so record FILE and record off are not recorded)
+ * @param status: Exit status of the input
+ */
+void record_end(int status);
+
+/**
+ * Parse one line of a recording in place (fields point into line)
+ * @param line: Line without its newline; modified
+ * @param entry: Receives the fields
+ * @return: 0 for an entry, 1 for a header or comment line, -1 if malformed
+ */
+int record_parse(char *line, RecordEntry *entry);
+
+/**
+ * Built-in: record - start or stop recording interactive input
+ *   record [FILE|off]
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: Exit status
+ */
+int builtin_record(int argc, char **argv);
+
+#endif // RECORD_H
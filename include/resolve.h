@@ -0,0 +1,92 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include "shell.h"
+#include "builtins.h"
+
+// What a command name resolved to
+typedef enum {
+    CMD_UNRESOLVED, // resolve_command has not run yet
+    CMD_ASSIGN,     // Only NAME=value words
+    CMD_FUNCTION,   // Shell function
+    CMD_BUILTIN,    // Builtin (Command.builtin)
+    CMD_EXTERNAL,   // Executable found on PATH (Command.path)
+    CMD_BATCH,      // batch prefix: words are expanded by batch_run itself
+    CMD_GROUP,      // ( ) or { } pipeline stage (Command.group); argv[0] is its text
+    CMD_NOT_FOUND   // Nothing by that name
+} CmdKind;
+
+// Everything the shell knows about one name; resolution order is
+// alias, then function, then builtin, then PATH
+typedef struct
+{
+    char *name;
+    uint32_t hash;
+    char *alias; // Alias text as defined (NULL if none)
+    char **alias_argv; // Alias text split into words
+    char *alias_words; // Storage for alias_argv
+    int alias_argc;
+    void *func; // Shell function (owned by script.c)
+    const Builtin *builtin; // Builtin with this name
+    char *path; // Hashed PATH lookup (NULL if not looked up or not found)
+    uint32_t path_gen; // PATH generation the lookup belongs to
+} NameEntry;
+
+/**
+ * Find a name in the table
+ * @param name: Command name
+ * @return: Entry, or NULL if the name is unknown
+ */
+NameEntry* name_find(const char *name);
+
+/**
+ * Find a name, adding an empty entry if it is unknown
+ * Entries may move when the table grows: do not keep the pointer.
+ * @param name: Command name
+ * @return: Entry, or NULL on allocation failure
+ */
+NameEntry* name_add(const char *name);
+
+/**
+ * Iterate over all entries
+ * @param iter: Cursor, start at 0
+ * @return: Next entry, or NULL at the end
+ */
+NameEntry* name_next(size_t *iter);
+
+/**
+ * Define or replace an alias
+ * @param name: Alias name
+ * @param value: Replacement text (split into words on whitespace)
+ * @return: 0 on success, -1 on allocation failure
+ */
+int alias_set(const char *name, const char *value);
+
+/**
+ * Remove an alias
+ * @param name: Alias name
+ * @return: 0 on success, -1 if there was no such alias
+ */
+int alias_unset(const char *name);
+
+/**
+ * Replace an aliased command name with the alias words (before expansion)
+ * @param cmd: Command to rewrite in place
+ * @return: 0 on success, -1 after reporting that the words would not fit in argv
+ */
+int alias_expand(Command *cmd);
+
+/**
+ * Look up an executable on PATH, remembering the result until PATH changes
+ * @param name: Command name (no '/')
+ * @return: Full path, or NULL if not found
+ */
+const char* resolve_path(const char *name);
+
+/**
+ * Decide once what an expanded command runs: fills kind, first, builtin, path
+ * @param cmd: Command to resolve (no-op if already resolved)
+ */
+void resolve_command(Command *cmd);
+
+#endif // RESOLVE_H
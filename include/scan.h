@@ -0,0 +1,49 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/**
+ * Count the occurrences of a byte (e.g. newlines)
+ * Uses AVX2 or SSE2 when the CPU has them, scalar code otherwise.
+ * @param buf: Data
+ * @param len: Length of data
+ * @param c: Byte to count
+ * @return: Number of occurrences
+ */
+size_t scan_count(const char *buf, size_t len, char c);
+
+/**
+ * Find the n-th occurrence of a byte
+ * @param buf: Data
+ * @param len: Length of data
+ * @param c: Byte to look for
+ * @param n: Which occurrence (1 = first)
+ * @param seen: Set to the number of occurrences passed (n - 1 when found)
+ * @return: Pointer to the n-th occurrence, or NULL if there are fewer
+ */
+const char *scan_nth(const char *buf, size_t len, char c, size_t n, size_t *seen);
+
+/**
+ * Find the first occurrence of a fixed string
+ * Candidates are filtered 32 (or 16) bytes at a time on the needle's first
+ * and last byte and confirmed with memcmp.
+ * @param hay: Data to search
+ * @param len: Length of data
+ * @param needle: String to find
+ * @param nlen: Length of needle (0 matches at hay)
+ * @return: Pointer to the match, or NULL
+ */
+const char *scan_find(const char *hay, size_t len, const char *needle, size_t nlen);
+
+/**
+ * Count words (runs of non-whitespace, as wc does in the C locale)
+ * @param buf: Data
+ * @param len: Length of data
+ * @param in_word: In/out: whether the byte before buf ended a word, so
+ *                 consecutive chunks can be counted separately
+ * @return: Number of words starting in buf
+ */
+size_t scan_words(const char *buf, size_t len, int *in_word);
+
+#endif // SCAN_H
@@ -0,0 +1,137 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "shell.h"
+
+// Compile results
+#define SCRIPT_OK         0
+#define SCRIPT_INCOMPLETE 1 // Input ends inside a construct: read more lines
+#define SCRIPT_ERROR      2 // Syntax error (already reported)
+
+#define NO_STR UINT32_MAX // Pool offset meaning "none"
+
+// A redirection is stored as two words: fd/op/src packed, then the target
+#define REDIR_PACK(fd, op, src) ((uint32_t)(fd) | (uint32_t)(op) << 8 | (uint32_t)((src) + 1) << 16)
+#define REDIR_PACKED_FD(w) ((int)((w) & 0xff))
+#define REDIR_PACKED_OP(w) ((int)((w) >> 8 & 0xff))
+#define REDIR_PACKED_SRC(w) ((int)((w) >> 16 & 0xff) - 1)
+
+// Bytecode operations
+typedef enum {
+    OP_HALT,       // Stop the program
+    OP_RUN,        // a: pipeline index; run it (or call a function)
+    OP_NOT,        // Invert last_exit_status (! pipeline)
+    OP_TRUE,       // Set last_exit_status to 0
+    OP_JMP,        // a: target pc
+    OP_JFALSE,     // a: target pc, taken when last_exit_status != 0
+    OP_JTRUE,      // a: target pc, taken when last_exit_status == 0
+    OP_FOR_INIT,   // a: first word index, b: word count; expand the list
+    OP_FOR_NEXT,   // a: variable name (pool offset), b: pc of OP_FOR_END when exhausted
+    OP_FOR_END,    // Drop the innermost for-loop state
+    OP_CASE_SET,   // a: subject word (pool offset)
+    OP_CASE_MATCH, // a: pattern word (pool offset), b: target pc on match
+    OP_DEFUN,      // a: name (pool offset), b: pc after the body; body starts at pc + 1
+    OP_RET,        // Return from a function
+    OP_GROUP,      // a: pc after the body, b: group text (pool offset); skip a ( ) or { } stage's body
+    OP_REDIR,      // a: command (redirections only), b: pc past the group; redirect the shell for { }
+    OP_UNREDIR     // Undo the innermost OP_REDIR
+} OpCode;
+
+// One instruction
+typedef struct
+{
+    uint32_t op; // OpCode
+    int32_t a; // First operand
+    int32_t b; // Second operand
+} Insn;
+
+// A simple command, with strings stored as pool offsets. argc 0 marks a
+// ( ) or { } stage: argv_start is then the pc of its body
+typedef struct
+{
+    uint32_t argv_start; // Index of the first word in Program.words
+    uint32_t argc; // Number of words
+    uint32_t redir_start; // Index in Program.words of the first redirection (two words each)
+    uint32_t num_redirs; // Number of redirections
+    uint32_t background; // 1 if command runs in background (&)
+} CmdTemplate;
+
+// A pipeline: a run of consecutive command templates
+typedef struct
+{
+    uint32_t cmd_start; // Index of the first command in Program.cmds
+    uint32_t num_cmds; // Number of commands
+} PipeTemplate;
+
+// Compiled program: flat arrays that index a string pool, so it can be
+// executed repeatedly without re-parsing and stored without pointers
+typedef struct Program
+{
+    Insn *code;
+    uint32_t ncode;
+    PipeTemplate *pipes;
+    uint32_t npipes;
+    CmdTemplate *cmds;
+    uint32_t ncmds;
+    uint32_t *words; // Pool offsets of command and list words
+    uint32_t nwords;
+    char *pool; // NUL-terminated strings
+    uint32_t pool_len;
+    int refs; // Owners: the runner plus one per defined function
+    void *map; // Cache file mapping the arrays live in (NULL if heap-allocated)
+    size_t map_len;
+} Program;
+
+/**
+ * Compile shell text (one or more lines) to bytecode
+ * @param text: Source text
+ * @param out: Receives the program on SCRIPT_OK
+ * @return: SCRIPT_OK, SCRIPT_INCOMPLETE or SCRIPT_ERROR
+ */
+int script_compile(const char *text, Program **out);
+
+/**
+ * Execute a compiled program
+ * @param prog: Program to run
+ * @return: Exit status of the last command
+ */
+int script_run(Program *prog);
+
+/**
+ * Drop a reference to a program, freeing it when unused
+ * @param prog: Program to release
+ */
+void script_release(Program *prog);
+
+/**
+ * Run the body of a ( ) or { } pipeline stage (in the child forked for it)
+ * Its last command, if external, is exec'd in place instead of forked.
+ * @param prog: Program holding the body
+ * @param pc: First instruction of the body
+ * @return: Exit status
+ */
+int script_run_group(Program *prog, uint32_t pc);
+
+/**
+ * Check whether a shell function is defined
+ * @param name: Function name
+ * @return: 1 if defined, 0 otherwise
+ */
+int script_is_function(const char *name);
+
+/**
+ * Run a shell function with the given arguments
+ * @param argc: Argument count (argv[0] is the function name)
+ * @param argv: Arguments
+ * @return: Exit status, or -1 if no such function
+ */
+int script_call(int argc, char **argv);
+
+/**
+ * Compile and run text in one step (errors are reported)
+ * @param text: Source text
+ * @return: Exit status, or -1 on syntax error or incomplete input
+ */
+int script_eval(const char *text);
+
+#endif // SCRIPT_H
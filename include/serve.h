@@ -0,0 +1,57 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "shell.h"
+
+#define SERVE_MSG_MAX (256 * 1024) // Largest request (script text included)
+#define SERVE_BACKLOG 64 // Pending connections
+#define SERVE_SPARES 4 // Server copies kept waiting in accept()
+#define SERVE_SOCKET_ENV "TINYSHELL_SOCKET" // Default socket path for the client
+
+// Message types (client to server)
+#define SERVE_RUN 1 // Run a script; stdin, stdout and stderr are attached
+#define SERVE_SIGNAL 2 // Send sig to the running script's process group (after SERVE_RUN)
+
+// Request flags
+#define SERVE_ENV_CLEAR 0x1 // Start from an empty environment, not the server's
+
+// Fixed part of a request; for SERVE_RUN it is followed by NUL-separated
+// strings: cwd, the script text, env[0..envc-1] (NAME=value sets, a bare
+// NAME unsets), then args[0..argc-1] ($1, $2, ...)
+typedef struct
+{
+    uint32_t type; // SERVE_RUN or SERVE_SIGNAL
+    uint32_t flags; // SERVE_* flags
+    uint32_t envc; // Number of environment entries
+    uint32_t argc; // Number of script arguments
+    int32_t sig; // Signal for SERVE_SIGNAL
+} ServeRequest;
+
+// Reply to SERVE_RUN, sent once the script and everything it waited for exited
+typedef struct
+{
+    int32_t status; // Exit code, as $? would show it
+    int32_t signal; // Signal that killed the script's shell, or 0
+    int64_t wall_ns; // Request received to script exit
+    int64_t utime_us; // User CPU of the script and the children it waited for
+    int64_t stime_us; // System CPU, likewise
+    int64_t maxrss_kb; // Largest resident set among them
+    int64_t minflt; // Page faults without I/O
+    int64_t majflt; // Page faults with I/O
+    int64_t nvcsw; // Voluntary context switches
+    int64_t nivcsw; // Involuntary context switches
+} ServeReply;
+
+/**
+ * Run as a server (tinyshell --serve PATH) until SIGINT or SIGTERM
+ * Listens on a Unix SOCK_SEQPACKET socket (mode 0600). Each connection
+ * carries one SERVE_RUN request, taken by a copy of the server forked in
+ * advance which then runs the script like a script file; clients never
+ * see each other's cd, variables or functions. Without pidfd_open (Linux 5.3)
+ * requests are served one at a time.
+ * @param path: Socket path (a stale socket there is replaced)
+ * @return: Exit code
+ */
+int serve_main(const char *path);
+
+#endif // SERVE_H
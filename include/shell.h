@@ -1,68 +1,104 @@
-#ifndef SHELL_H
-#define SHELL_H
-
-#define _GNU_SOURCE
-#include <errno.h>
-#include <fcntl.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-
-// ANSI color codes
-#define COLOR_RESET   "\033[0m"
-#define COLOR_RED     "\033[1;31m"
-#define COLOR_BLUE    "\033[1;34m"
-#define COLOR_CYAN    "\033[1;36m"
-
-// Constants
-#define MAX_ARGS 128
-#define MAX_CMDS 64
-#define PATH_MAX_LEN 1024
-
-// Pipe ends for readability
-#define PIPE_READ  0
-#define PIPE_WRITE 1
-
-// Command structure for pipeline
-typedef struct 
-{
-    char *argv[MAX_ARGS]; // Arguments for this command
-    int argc; // Number of arguments
-    char *infile; // Input redirection filename (NULL if none)
-    char *outfile; // Output redirection filename (NULL if none)
-    char *errfile; // Stderr redirection filename (NULL if none)
-    int append; // 1 for >>, 0 for >
-    int background; // 1 if command should run in background (&)
-} Command;
-
-// Job states
-typedef enum {
-    JOB_RUNNING,
-    JOB_STOPPED,
-    JOB_DONE
-} JobState;
-
-// Job structure for background job tracking
-typedef struct 
-{
-    int job_num; // Job number
-    pid_t pid; // Process ID
-    pid_t pgid; // Process Group ID
-    char *cmd_line; // Command line string
-    JobState state; // Job state (running/stopped/done)
-} Job;
-
-// Global job tracking (defined in executor.c)
-#define MAX_JOBS 64
-extern Job jobs[MAX_JOBS];
-extern int next_job_num;
-extern pid_t shell_pgid; // Shell's process group ID
-extern int shell_terminal; // Shell's controlling terminal fd
-
-extern char **environ;
-
-#endif // SHELL_H
+#ifndef SHELL_H
+#define SHELL_H
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// ANSI color codes
+#define COLOR_RESET   "\033[0m"
+#define COLOR_RED     "\033[1;31m"
+#define COLOR_BLUE    "\033[1;34m"
+#define COLOR_CYAN    "\033[1;36m"
+
+// Constants
+#define MAX_ARGS 128
+#define MAX_CMDS 1024 // Stages per pipeline
+#define MAX_REDIRS 16 // Redirections per command
+#define REDIR_FD_MAX 9 // Highest descriptor a redirection can name (n>file, n>&m)
+#define REDIR_FD_MIN 10 // Files opened for redirections are moved at or above this
+#define PATH_MAX_LEN 1024
+
+// Pipe ends for readability
+#define PIPE_READ  0
+#define PIPE_WRITE 1
+
+// Redirection kinds
+typedef enum {
+    REDIR_IN,      // n<file
+    REDIR_OUT,     // n>file (refuses an existing file under set -C)
+    REDIR_CLOBBER, // n>|file
+    REDIR_APPEND,  // n>>file
+    REDIR_RDWR,    // n<>file
+    REDIR_DUP,     // n>&m, n<&m
+    REDIR_CLOSE,   // n>&-, n<&-
+    REDIR_COPROC   // n>&p, n<&p: a coprocess's stdin or stdout (n>&p:NAME for a named one)
+} RedirOp;
+
+// One redirection; a command's list is applied left to right
+typedef struct
+{
+    int fd; // Descriptor being redirected (0-REDIR_FD_MAX)
+    int op; // RedirOp
+    int src; // Descriptor copied by REDIR_DUP; PIPE_WRITE or PIPE_READ end for REDIR_COPROC
+    char *target; // File name for file operations, coprocess name for REDIR_COPROC (NULL otherwise)
+    int opened; // Descriptor the shell opened for target (-1 until opened)
+} Redirect;
+
+// Command structure for pipeline
+typedef struct 
+{
+    char *argv[MAX_ARGS]; // Arguments for this command
+    int argc; // Number of arguments
+    Redirect redirs[MAX_REDIRS]; // Redirections, in command-line order
+    int num_redirs; // Number of redirections
+    int background; // 1 if command should run in background (&)
+    int pipe_out; // 1 if stdout feeds the next pipeline stage
+    int kind; // CmdKind from resolve_command (0 = not resolved yet)
+    int first; // Index of the command name after leading NAME=value words
+    int substituted; // 1 if expanding its words ran a command substitution
+    const struct Builtin *builtin; // Implementation when kind is CMD_BUILTIN
+    const char *path; // Executable when kind is CMD_EXTERNAL
+    struct Program *group; // Program holding the body when kind is CMD_GROUP
+    uint32_t group_pc; // First instruction of that body
+} Command;
+
+// Job states
+typedef enum {
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_DONE
+} JobState;
+
+// Job structure for background job tracking
+typedef struct 
+{
+    int job_num; // Job number
+    pid_t pid; // Process ID
+    pid_t pgid; // Process Group ID
+    char *cmd_line; // Command line string
+    JobState state; // Job state (running/stopped/done)
+    uint64_t start_ns; // Launch time (monotonic ns, for stats)
+} Job;
+
+// Global job tracking (defined in executor.c)
+#define MAX_JOBS 64
+extern Job jobs[MAX_JOBS];
+extern int next_job_num;
+extern pid_t shell_pgid; // Shell's process group ID
+extern int shell_terminal; // Shell's controlling terminal fd
+extern int last_exit_status; // Exit code of the last command ($?)
+extern int interactive; // 1 when doing job control and status reporting
+extern int noclobber; // set -C: > refuses to overwrite existing files
+
+extern char **environ;
+
+#endif // SHELL_H
@@ -0,0 +1,86 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+// Histogram precision: 2^HIST_SUB_BITS linear sub-buckets per power of two (~12% error)
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS  (64 << HIST_SUB_BITS)
+
+// Event counters
+typedef enum {
+    STAT_COMMANDS,       // Commands launched (external or in a pipeline)
+    STAT_BUILTINS,       // Builtins run in the shell process
+    STAT_PIPELINES,      // Pipelines executed
+    STAT_FORKS,          // fork() calls
+    STAT_LAUNCHER_SPAWNS, // Commands started by the launcher helper
+    STAT_JOBS_CREATED,   // Entries added to the job table
+    STAT_JOBS_REAPED,    // Job table entries that finished
+    STAT_SIGCHLD,        // SIGCHLD deliveries to the shell
+    STAT_CHILD_SIGNALED, // Children terminated by a signal
+    STAT_CHILD_STOPPED,  // Children stopped (e.g. Ctrl-Z)
+    STAT_CACHE_HITS,     // cache commands replayed from the store
+    STAT_CACHE_MISSES,   // cache commands run and recorded
+    STAT_CACHE_EVICTIONS, // cache entries evicted to stay under the size limit
+    STAT_DEADLINES_FIRED, // timeout/deadline signals sent to overdue pipelines
+    STAT_COUNTER_MAX
+} StatCounter;
+
+// Latency/size histograms
+typedef enum {
+    HIST_FORK_NS,        // Parent-side fork() latency (ns)
+    HIST_RUN_US,         // Launch to exit of a job or foreground command (us)
+    HIST_PIPELINE_DEPTH, // Commands per pipeline
+    HIST_MAX
+} StatHist;
+
+// Log-linear (HDR-style) histogram; all updates are single fetch_add operations
+typedef struct
+{
+    _Atomic uint64_t sum;
+    _Atomic uint64_t buckets[HIST_BUCKETS];
+} Histogram;
+
+extern _Atomic uint64_t stat_counters[STAT_COUNTER_MAX];
+
+/**
+ * Monotonic clock in nanoseconds (async-signal-safe)
+ * @return: Current time
+ */
+static inline uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Increment a counter (wait-free, safe from signal handlers)
+ * @param c: Counter to bump
+ */
+static inline void stat_inc(StatCounter c)
+{
+    atomic_fetch_add_explicit(&stat_counters[c], 1, memory_order_relaxed);
+}
+
+/**
+ * Record a value in a histogram (wait-free, safe from signal handlers)
+ * @param h: Histogram to update
+ * @param value: Sample value
+ */
+void stat_record(StatHist h, uint64_t value);
+
+/**
+ * Print all counters and histograms
+ * @param json: Non-zero for a JSON object, zero for a table
+ */
+void stats_print(int json);
+
+/**
+ * Reset all counters and histograms to zero
+ */
+void stats_reset(void);
+
+#endif // STATS_H
@@ -0,0 +1,41 @@
+#ifndef TEXTCMD_H
+#define TEXTCMD_H
+
+#include "shell.h"
+
+#define TEXT_CHUNK (1024 * 1024) // Read size for pipes and terminals
+#define TEXT_OUT_BUF (64 * 1024) // Output is written in blocks of this size
+#define TEXT_MAX_PATTERNS 32 // -e patterns per grep
+
+/**
+ * Built-in: grep [-cHhlnqsvF] [-e PATTERN]... PATTERN [FILE...]
+ * Fixed strings only: a pattern without -F must not contain any of
+ * . [ ] * ^ $ \ (where a literal match would differ from the regex).
+ * Anything else (other options, real regexes) runs the external grep.
+ * Regular files are mapped instead of read.
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: 0 if a line was selected, 1 if none, 2 on error
+ */
+int builtin_grep(int argc, char **argv);
+
+/**
+ * Built-in: wc [-lwc] [FILE...]
+ * Counts as wc does in the C locale; other options run the external wc.
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: 0, or 1 if a file could not be read
+ */
+int builtin_wc(int argc, char **argv);
+
+/**
+ * Built-in: head [-n N | -c N | -N] [FILE...]
+ * On a regular file the offset is left just past the output, so a
+ * following command sharing the descriptor continues from there.
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: 0, or 1 if a file could not be read
+ */
+int builtin_head(int argc, char **argv);
+
+#endif // TEXTCMD_H
@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Trace output fd (-1 when tracing is disabled)
+extern int trace_fd;
+
+/**
+ * Check whether tracing is enabled (one load on the hot path)
+ * @return: Non-zero when events are being recorded
+ */
+static inline int trace_enabled(void)
+{
+    return trace_fd >= 0;
+}
+
+/**
+ * Current monotonic time in microseconds (0 when tracing is disabled)
+ * @return: Timestamp for trace_complete
+ */
+static inline uint64_t trace_now(void)
+{
+    if (trace_fd < 0)
+        return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/**
+ * Start writing Chrome Trace Event JSON to a file (replaces any open trace)
+ * The trace is closed at exit; the exit handler is registered only once.
+ * @param path: Output file
+ * @return: 0 on success, -1 on error
+ */
+int trace_open(const char *path);
+
+/**
+ * Finish the JSON array and stop tracing
+ */
+void trace_close(void);
+
+/**
+ * Record a complete ("X") event that started at start and ends now
+ * Async-signal-safe: each event is a single write() to an O_APPEND file,
+ * so the shell, its children and the SIGCHLD handler can all record.
+ * @param name: Event name
+ * @param cat: Category
+ * @param start: Value of trace_now() at the start of the span
+ * @param detail: Optional "detail" argument (NULL for none)
+ */
+void trace_complete(const char *name, const char *cat, uint64_t start, const char *detail);
+
+/**
+ * Record an instant ("i") event
+ * @param name: Event name
+ * @param cat: Category
+ * @param detail: Optional "detail" argument (NULL for none)
+ */
+void trace_instant(const char *name, const char *cat, const char *detail);
+
+#endif // TRACE_H
@@ -1,16 +1,107 @@
-#ifndef UTILS_H
-#define UTILS_H
-
-/**
- * Get the current working directory for prompt
- * @return: Current directory path
- */
-char* get_current_dir(void);
-
-/**
- * Read a line from stdin
- * @return: Input line (caller must free)
- */
-char* read_line(void);
-
-#endif // UTILS_H
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_PASSED_FDS 24 // Descriptors per message: stdio plus a command's redirections
+
+// Growable byte buffer (always NUL-terminated once data is non-NULL)
+typedef struct
+{
+    char *data; // Buffer contents
+    size_t len; // Bytes used (excluding terminator)
+    size_t cap; // Bytes allocated
+} StrBuf;
+
+/**
+ * Get the current working directory for prompt
+ * @return: Current directory path
+ */
+char* get_current_dir(void);
+
+/**
+ * Read a line from stdin
+ * @return: Input line (caller must free)
+ */
+char* read_line(void);
+
+/**
+ * Initialize an empty buffer
+ * @param sb: Buffer to initialize
+ */
+void sb_init(StrBuf *sb);
+
+/**
+ * Make room for at least extra more bytes (plus terminator)
+ * @param sb: Buffer to grow
+ * @param extra: Number of bytes needed after len
+ * @return: 0 on success, -1 on allocation failure
+ */
+int sb_reserve(StrBuf *sb, size_t extra);
+
+/**
+ * Append n bytes to the buffer
+ * @param sb: Buffer to append to
+ * @param s: Bytes to append
+ * @param n: Number of bytes
+ * @return: 0 on success, -1 on allocation failure
+ */
+int sb_append(StrBuf *sb, const char *s, size_t n);
+
+/**
+ * Append a single character to the buffer
+ * @param sb: Buffer to append to
+ * @param c: Character to append
+ * @return: 0 on success, -1 on allocation failure
+ */
+int sb_putc(StrBuf *sb, char c);
+
+/**
+ * Release the buffer's memory
+ * @param sb: Buffer to free
+ */
+void sb_free(StrBuf *sb);
+
+/**
+ * Write all bytes, retrying short writes and EINTR
+ * @param fd: Destination descriptor
+ * @param buf: Bytes to write
+ * @param len: Number of bytes
+ * @return: 0 on success, -1 on error
+ */
+int write_all(int fd, const void *buf, size_t len);
+
+/**
+ * Send a message with file descriptors attached (SCM_RIGHTS)
+ * @param sock: Unix socket
+ * @param buf: Message bytes
+ * @param len: Message length
+ * @param fds: Descriptors to pass
+ * @param nfds: Number of descriptors (at most MAX_PASSED_FDS)
+ * @return: Bytes sent, or -1 on error
+ */
+long send_fds(int sock, const void *buf, size_t len, const int *fds, int nfds);
+
+/**
+ * Receive a message and any attached file descriptors (SCM_RIGHTS)
+ * Received descriptors are marked close-on-exec.
+ * @param sock: Unix socket
+ * @param buf: Buffer for the message
+ * @param len: Buffer size
+ * @param fds: Array receiving descriptors (MAX_PASSED_FDS entries)
+ * @param nfds: Set to the number of descriptors received
+ * @return: Bytes received, 0 on EOF, -1 on error
+ */
+long recv_fds(int sock, void *buf, size_t len, int *fds, int *nfds);
+
+/**
+ * Format a byte count for display: bytes below 1K, otherwise one decimal
+ * and a K/M/G/T/P suffix (powers of 1024)
+ * @param buf: Output buffer
+ * @param size: Buffer size
+ * @param n: Byte count
+ */
+void format_bytes(char *buf, size_t size, uint64_t n);
+
+#endif // UTILS_H
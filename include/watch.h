@@ -0,0 +1,35 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "shell.h"
+
+#define WATCH_MAX 16 // onchange registrations at once
+#define WATCH_DEBOUNCE_NS 100000000ull // Default quiet time before a rerun (0.1s)
+#define WATCH_CANCEL_NS 1000000000ull // Wait for a cancelled run before SIGKILL (1s)
+
+/**
+ * Descriptor for the shell's event loop: readable when watched files
+ * changed or a debounced rerun is due
+ * @return: Descriptor, or -1 when nothing is watched
+ */
+int watch_fd(void);
+
+/**
+ * Read pending file events and start every rerun that is due
+ * @return: Number of runs started
+ */
+int watch_run(void);
+
+/**
+ * Built-in: onchange - rerun a command when files change
+ *   onchange [-r] [-i] [-d SECS] [-s SIG] PATH... -- COMMAND...
+ *   onchange (list) | onchange -x ID (remove)
+ * Interactive shells return at once and rerun the command as a background
+ * job from the input loop; scripts wait for changes until killed.
+ * @param argc: Argument count
+ * @param argv: Argument array
+ * @return: Exit status
+ */
+int builtin_onchange(int argc, char **argv);
+
+#endif // WATCH_H
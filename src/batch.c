@@ -0,0 +1,267 @@
+/*
+ * batch.c - Running a command over argument lists larger than one exec allows
+ *
+ * The trailing (expanded) arguments are packed greedily into invocations
+ * that fit the kernel's argument space, like xargs, so "batch rm $(cat list)"
+ * works for lists of any length instead of failing with E2BIG.
+ */
+
+#include "../include/batch.h"
+#include "../include/expand.h"
+#include "../include/executor.h"
+#include "../include/resolve.h"
+#include "../include/script.h"
+#include "../include/stats.h"
+#include "../include/trace.h"
+#include <limits.h>
+#include <signal.h>
+
+// Bytes an argument takes in execve's argument area
+static size_t arg_cost(const char *s)
+{
+    return strlen(s) + 1 + sizeof(char *);
+}
+
+// Argument space left once the environment is accounted for
+static size_t arg_budget(void)
+{
+    long max = sysconf(_SC_ARG_MAX);
+    if (max <= 0)
+        max = 131072;
+    size_t used = BATCH_ENV_MARGIN;
+    for (char **e = environ; *e; e++)
+        used += arg_cost(*e);
+    return (size_t)max > used ? (size_t)max - used : 0;
+}
+
+// Parse a non-negative numeric option value (which may be a variable)
+static int option_value(const char *word, int *out)
+{
+    StrBuf buf;
+    sb_init(&buf);
+    expand_word(word, &buf);
+    sb_putc(&buf, '\0');
+    char *end;
+    long v = strtol(buf.data, &end, 10);
+    int ok = buf.data[0] != '\0' && *end == '\0' && v >= 0 && v <= INT_MAX;
+    if (ok)
+        *out = (int)v;
+    sb_free(&buf);
+    return ok ? 0 : -1;
+}
+
+// Start one external invocation; it stays in the shell's process group
+static pid_t spawn_chunk(const char *path, char **argv)
+{
+    uint64_t t0 = monotonic_ns();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        reset_child_signals();
+        exec_resolved(path, argv);
+    }
+    if (pid > 0)
+    {
+        stat_inc(STAT_FORKS);
+        stat_inc(STAT_COMMANDS);
+        stat_record(HIST_FORK_NS, monotonic_ns() - t0);
+    }
+    return pid;
+}
+
+// Wait for one invocation and return its exit code
+static int wait_chunk(pid_t pid)
+{
+    int status = 0;
+    for (;;)
+    {
+        pid_t r = waitpid(pid, &status, WUNTRACED);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return 127;
+        // A batch is not a job and cannot be suspended: keep it going
+        if (WIFSTOPPED(status))
+        {
+            kill(pid, SIGCONT);
+            continue;
+        }
+        return status_to_code(status);
+    }
+}
+
+// Run the command over all items in ARG_MAX-sized invocations
+static int run_chunks(Command *target, char **fixed, int nfixed, char **items, int nitems, int jobs, int max_items)
+{
+    size_t budget = arg_budget();
+    size_t fixed_cost = 0;
+    for (int i = 0; i < nfixed; i++)
+        fixed_cost += arg_cost(fixed[i]);
+    if (fixed_cost >= budget)
+    {
+        fprintf(stderr, "%sbatch: %s: %s%s\n", COLOR_RED, fixed[0], strerror(E2BIG), COLOR_RESET);
+        return 126;
+    }
+
+    // Functions receive their arguments through a fixed-size frame
+    if (target->kind == CMD_FUNCTION && (max_items == 0 || max_items > MAX_ARGS - 1 - nfixed))
+        max_items = MAX_ARGS - 1 - nfixed;
+
+    char **argv = malloc(sizeof(char *) * (nfixed + nitems + 1));
+    pid_t *running = malloc(sizeof(pid_t) * jobs);
+    if (!argv || !running)
+    {
+        free(argv);
+        free(running);
+        perror("malloc");
+        return 1;
+    }
+    memcpy(argv, fixed, sizeof(char *) * nfixed);
+
+    int result = 0, head = 0, active = 0;
+    int k = 0;
+    do
+    {
+        // Pack as many items as fit; a single oversized item still runs (and fails) alone
+        size_t cost = fixed_cost;
+        int take = 0;
+        while (k + take < nitems && (max_items == 0 || take < max_items))
+        {
+            size_t c = arg_cost(items[k + take]);
+            if (take > 0 && cost + c > budget)
+                break;
+            cost += c;
+            argv[nfixed + take] = items[k + take];
+            take++;
+        }
+        argv[nfixed + take] = NULL;
+        k += take;
+
+        int status = -1;
+        if (target->kind == CMD_BUILTIN)
+            status = target->builtin->fn(nfixed + take, argv);
+        else if (target->kind == CMD_FUNCTION)
+            status = script_call(nfixed + take, argv);
+        else
+        {
+            // Keep at most jobs invocations running; the oldest is collected first
+            if (active == jobs)
+            {
+                status = wait_chunk(running[head]);
+                head = (head + 1) % jobs;
+                active--;
+            }
+            pid_t pid = spawn_chunk(target->path, argv);
+            if (pid < 0)
+            {
+                perror("fork");
+                if (status <= 0)
+                    status = 1;
+                k = nitems;
+            }
+            else
+                running[(head + active++) % jobs] = pid;
+        }
+
+        if (status > 0 && result == 0)
+            result = status;
+        // Ctrl-C stops launching further invocations
+        if (status == 128 + SIGINT)
+            k = nitems;
+    } while (k < nitems);
+
+    while (active > 0)
+    {
+        int status = wait_chunk(running[head]);
+        head = (head + 1) % jobs;
+        active--;
+        if (status > 0 && result == 0)
+            result = status;
+    }
+
+    free(running);
+    free(argv);
+    return result;
+}
+
+// Run "batch [-j N] [-n N] CMD ARGS..."
+int batch_run(Command *cmd)
+{
+    int jobs = 1, max_items = 0;
+    int i = 1;
+    while (i < cmd->argc && cmd->argv[i][0] == '-')
+    {
+        int *opt = strcmp(cmd->argv[i], "-j") == 0 ? &jobs :
+                   strcmp(cmd->argv[i], "-n") == 0 ? &max_items : NULL;
+        if (!opt || i + 1 >= cmd->argc || option_value(cmd->argv[i + 1], opt) < 0)
+        {
+            i = cmd->argc;
+            break;
+        }
+        i += 2;
+    }
+    if (i >= cmd->argc)
+    {
+        fprintf(stderr, "%sbatch: usage: batch [-j N] [-n N] command args...%s\n", COLOR_RED, COLOR_RESET);
+        return 2;
+    }
+    if (jobs == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (int)cpus : 1;
+    }
+
+    // Literal leading words are the command; everything from the first expansion on is data
+    char **fixed = cmd->argv + i;
+    int nfixed = 0;
+    while (i + nfixed < cmd->argc && !word_needs_expansion(fixed[nfixed]))
+        nfixed++;
+    if (nfixed == 0)
+    {
+        fprintf(stderr, "%sbatch: the command name must be a literal word%s\n", COLOR_RED, COLOR_RESET);
+        return 2;
+    }
+
+    Command target;
+    memset(&target, 0, sizeof(target));
+    target.argc = 1;
+    target.argv[0] = fixed[0];
+    resolve_command(&target);
+    if (target.kind == CMD_NOT_FOUND || target.kind == CMD_ASSIGN)
+    {
+        fprintf(stderr, "%s%s: command not found%s\n", COLOR_RED, fixed[0], COLOR_RESET);
+        return 127;
+    }
+
+    uint64_t t0 = trace_now();
+    StrBuf fields;
+    sb_init(&fields);
+    int nitems = expand_fields(fixed + nfixed, cmd->argc - i - nfixed, &fields);
+    char **items = nitems >= 0 ? malloc(sizeof(char *) * (nitems + 1)) : NULL;
+    if (!items)
+    {
+        sb_free(&fields);
+        perror("batch");
+        return 1;
+    }
+    size_t off = 0;
+    for (int n = 0; n < nitems; n++)
+    {
+        items[n] = fields.data + off;
+        off += strlen(items[n]) + 1;
+    }
+
+    // Keep the SIGCHLD handler away from the invocations we wait for
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    int status = run_chunks(&target, fixed, nfixed, items, nitems, jobs, max_items);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+
+    trace_complete("batch", "pipeline", t0, fixed[0]);
+    free(items);
+    sb_free(&fields);
+    return status;
+}
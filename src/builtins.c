@@ -1,209 +1,650 @@
-/*
- * builtins.c - Built-in shell commands
- */
-
-#include "../include/builtins.h"
-#include "../include/shell.h"
-
-// Built-in: exit command
-void builtin_exit(int argc, char **argv)
-{
-    int code = 0;
-    if (argc >= 2) 
-        code = atoi(argv[1]);
-    exit(code);
-}
-
-// Built-in: cd command
-void builtin_cd(int argc, char **argv)
-{
-    const char *dir = (argc >= 2) ? argv[1] : getenv("HOME");
-    if (!dir) 
-    {
-        fprintf(stderr, "%scd: HOME not set%s\n", COLOR_RED, COLOR_RESET);
-        return;
-    }
-    if (chdir(dir) != 0) 
-    {
-        perror("cd");
-    }
-}
-
-// Built-in: help command
-void builtin_help(void)
-{
-    printf("TinyShell - Built-in commands:\n");
-    printf(" %sexit [code]%s Exit the shell with optional code\n", COLOR_BLUE, COLOR_RESET);
-    printf(" %scd [dir]%s Change directory (default: HOME)\n", COLOR_BLUE, COLOR_RESET);
-    printf(" %sjobs%s List all background jobs\n", COLOR_BLUE, COLOR_RESET);
-    printf(" %sfg %%N%s Bring job N to foreground\n", COLOR_BLUE, COLOR_RESET);
-    printf(" %sbg %%N%s Continue job N in background\n", COLOR_BLUE, COLOR_RESET);
-    printf(" %shelp%s Show this help message\n", COLOR_BLUE, COLOR_RESET);
-    printf("\nAll other commands are executed via PATH search.\n");
-    printf("Use Ctrl-Z to suspend a foreground job.\n");
-}
-
-// Helper function to find job by number
-static Job* find_job(int job_num)
-{
-    for (int i = 0; i < MAX_JOBS; i++)
-    {
-        if (jobs[i].state != JOB_DONE && jobs[i].job_num == job_num)
-            return &jobs[i];
-    }
-    return NULL;
-}
-
-// Built-in: jobs command - list all jobs
-void builtin_jobs(void)
-{
-    for (int i = 0; i < MAX_JOBS; i++)
-    {
-        if (jobs[i].state != JOB_DONE && jobs[i].cmd_line != NULL)
-        {
-            const char *state_str = (jobs[i].state == JOB_RUNNING) ? "Running" : "Stopped";
-            printf("[%d]  %s    %s\n", jobs[i].job_num, state_str, jobs[i].cmd_line);
-        }
-    }
-}
-
-// Built-in: fg command - bring job to foreground
-void builtin_fg(int argc, char **argv)
-{
-    if (argc < 2)
-    {
-        fprintf(stderr, "%sfg: usage: fg %%N%s\n", COLOR_RED, COLOR_RESET);
-        return;
-    }
-    
-    // Parse job number from %N format
-    int job_num = -1;
-    if (argv[1][0] == '%')
-        job_num = atoi(argv[1] + 1);
-    else
-        job_num = atoi(argv[1]);
-    
-    Job *job = find_job(job_num);
-    if (!job)
-    {
-        fprintf(stderr, "%sfg: %%%d: no such job%s\n", COLOR_RED, job_num, COLOR_RESET);
-        return;
-    }
-    
-    // Print what we're foregrounding
-    printf("%s\n", job->cmd_line);
-    
-    // Block SIGCHLD during critical section
-    sigset_t mask, prev;
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGCHLD);
-    sigprocmask(SIG_BLOCK, &mask, &prev);
-    
-    // Give terminal control to the job's process group
-    if (tcsetpgrp(shell_terminal, job->pgid) < 0)
-    {
-        perror("tcsetpgrp");
-        sigprocmask(SIG_SETMASK, &prev, NULL);
-        return;
-    }
-    
-    // Send SIGCONT to continue the job if it was stopped
-    if (job->state == JOB_STOPPED)
-    {
-        kill(-job->pgid, SIGCONT);
-    }
-    
-    job->state = JOB_RUNNING;
-    
-    // Unblock SIGCHLD
-    sigprocmask(SIG_SETMASK, &prev, NULL);
-    
-    // Wait for the job to complete or stop
-    // Retry if interrupted by a signal (EINTR)
-    // Use -pgid to wait for any process in the job's process group (handles pipelines)
-    int status;
-    pid_t result;
-    do {
-        result = waitpid(-job->pgid, &status, WUNTRACED);
-    } while (result == -1 && errno == EINTR);
-    
-    // Take back terminal control
-    if (tcsetpgrp(shell_terminal, shell_pgid) < 0)
-    {
-        perror("tcsetpgrp");
-    }
-    
-    // Block SIGCHLD while updating job status
-    sigprocmask(SIG_BLOCK, &mask, &prev);
-    
-    if (result > 0)
-    {
-        if (WIFSTOPPED(status))
-        {
-            // Job was stopped (Ctrl-Z)
-            job->state = JOB_STOPPED;
-            printf("\n[%d]+  Stopped    %s\n", job->job_num, job->cmd_line);
-        }
-        else if (WIFEXITED(status) || WIFSIGNALED(status))
-        {
-            // Job completed - fully clean up the entry
-            job->state = JOB_DONE;
-            if (job->cmd_line)
-            {
-                free(job->cmd_line);
-                job->cmd_line = NULL;
-            }
-            job->job_num = 0;
-            job->pid = 0;
-            job->pgid = 0;
-        }
-    }
-    
-    // Unblock SIGCHLD
-    sigprocmask(SIG_SETMASK, &prev, NULL);
-}
-
-// Built-in: bg command - continue job in background
-void builtin_bg(int argc, char **argv)
-{
-    if (argc < 2)
-    {
-        fprintf(stderr, "%sbg: usage: bg %%N%s\n", COLOR_RED, COLOR_RESET);
-        return;
-    }
-    
-    // Parse job number from %N format
-    int job_num = -1;
-    if (argv[1][0] == '%')
-        job_num = atoi(argv[1] + 1);
-    else
-        job_num = atoi(argv[1]);
-    
-    Job *job = find_job(job_num);
-    if (!job)
-    {
-        fprintf(stderr, "%sbg: %%%d: no such job%s\n", COLOR_RED, job_num, COLOR_RESET);
-        return;
-    }
-    
-    if (job->state == JOB_STOPPED)
-    {
-        // Block SIGCHLD during state change
-        sigset_t mask, prev;
-        sigemptyset(&mask);
-        sigaddset(&mask, SIGCHLD);
-        sigprocmask(SIG_BLOCK, &mask, &prev);
-        
-        // Send SIGCONT to continue the job in background
-        kill(-job->pgid, SIGCONT);
-        job->state = JOB_RUNNING;
-        printf("[%d]+ %s &\n", job->job_num, job->cmd_line);
-        
-        // Unblock SIGCHLD
-        sigprocmask(SIG_SETMASK, &prev, NULL);
-    }
-    else
-    {
-        fprintf(stderr, "%sbg: job %%%d already running%s\n", COLOR_RED, job_num, COLOR_RESET);
-    }
-}
+/*
+ * builtins.c - Built-in shell commands
+ */
+
+#include "../include/builtins.h"
+#include "../include/shell.h"
+#include "../include/utils.h"
+#include "../include/executor.h"
+#include "../include/trace.h"
+#include "../include/stats.h"
+#include "../include/resolve.h"
+#include "../include/memo.h"
+#include "../include/joblog.h"
+#include "../include/deadline.h"
+#include "../include/textcmd.h"
+#include "../include/watch.h"
+#include "../include/jtop.h"
+#include "../include/coproc.h"
+#include "../include/limit.h"
+#include "../include/record.h"
+#include <ctype.h>
+
+// Builtin table (searched by find_builtin)
+static const Builtin builtin_table[] =
+{
+    { "exit", builtin_exit, 0 },
+    { "cd",   builtin_cd,   0 },
+    { "help", builtin_help, BUILTIN_PURE },
+    { "jobs", builtin_jobs, BUILTIN_PURE },
+    { "fg",   builtin_fg,   0 },
+    { "bg",   builtin_bg,   0 },
+    { "pwd",  builtin_pwd,  BUILTIN_PURE },
+    { "echo", builtin_echo, BUILTIN_PURE },
+    { "trace", builtin_trace, 0 },
+    { "stats", builtin_stats, 0 }, // Not pure: -r resets the counters
+    { "record", builtin_record, 0 },
+    { "alias", builtin_alias, 0 },
+    { "unalias", builtin_unalias, 0 },
+    { "type", builtin_type, BUILTIN_PURE },
+    { "set",  builtin_set,  0 },
+    { "timeout", builtin_timeout, 0 },
+    { "deadline", builtin_deadline, 0 },
+    { "limit", builtin_limit, 0 },
+    { "cache", builtin_cache, 0 },
+    { "joblog", builtin_joblog, 0 },
+    { "grep", builtin_grep, BUILTIN_STAGE },
+    { "wc",   builtin_wc,   BUILTIN_STAGE },
+    { "head", builtin_head, BUILTIN_STAGE },
+    { "onchange", builtin_onchange, 0 },
+    { "jtop", builtin_jtop, 0 },
+    { "coproc", builtin_coproc, 0 },
+    { "read", builtin_read, 0 },
+};
+
+// Enter every builtin into the name table
+void register_builtins(void)
+{
+    for (size_t i = 0; i < sizeof(builtin_table) / sizeof(builtin_table[0]); i++)
+    {
+        NameEntry *e = name_add(builtin_table[i].name);
+        if (e)
+            e->builtin = &builtin_table[i];
+    }
+}
+
+// Look up a builtin by name
+const Builtin* find_builtin(const char *name)
+{
+    NameEntry *e = name_find(name);
+    return e ? e->builtin : NULL;
+}
+
+// Order aliases by name for listing
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp((*(NameEntry *const *)a)->name, (*(NameEntry *const *)b)->name);
+}
+
+// Built-in: alias command - list, show or define aliases
+int builtin_alias(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        size_t iter = 0, n = 0;
+        NameEntry *e;
+        while ((e = name_next(&iter)) != NULL)
+            n += e->alias != NULL;
+        NameEntry **list = malloc(sizeof(NameEntry *) * (n + 1));
+        if (!list)
+            return 1;
+        iter = n = 0;
+        while ((e = name_next(&iter)) != NULL)
+        {
+            if (e->alias)
+                list[n++] = e;
+        }
+        qsort(list, n, sizeof(NameEntry *), compare_entries);
+        for (size_t i = 0; i < n; i++)
+            printf("alias %s='%s'\n", list[i]->name, list[i]->alias);
+        free(list);
+        return 0;
+    }
+
+    // NAME=VALUE: the value runs to the end of the line (there is no quoting,
+    // so alias ll='ls -l' arrives as two words); surrounding quotes are dropped
+    char *eq = strchr(argv[1], '=');
+    if (eq && eq > argv[1])
+    {
+        StrBuf value;
+        sb_init(&value);
+        sb_append(&value, eq + 1, strlen(eq + 1));
+        for (int i = 2; i < argc; i++)
+        {
+            sb_putc(&value, ' ');
+            sb_append(&value, argv[i], strlen(argv[i]));
+        }
+        sb_putc(&value, '\0');
+        char *v = value.data;
+        size_t len = value.len - 1;
+        if (len >= 2 && (v[0] == '\'' || v[0] == '"') && v[len - 1] == v[0])
+        {
+            v[len - 1] = '\0';
+            v++;
+        }
+        *eq = '\0';
+        int rc = alias_set(argv[1], v);
+        *eq = '=';
+        sb_free(&value);
+        if (rc < 0)
+        {
+            perror("alias");
+            return 1;
+        }
+        return 0;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        NameEntry *e = name_find(argv[i]);
+        if (e && e->alias)
+            printf("alias %s='%s'\n", e->name, e->alias);
+        else
+        {
+            fprintf(stderr, "%salias: %s: not found%s\n", COLOR_RED, argv[i], COLOR_RESET);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+// Built-in: unalias command - remove aliases
+int builtin_unalias(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "%sunalias: usage: unalias [-a] name...%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    if (strcmp(argv[1], "-a") == 0)
+    {
+        size_t iter = 0;
+        NameEntry *e;
+        while ((e = name_next(&iter)) != NULL)
+        {
+            if (e->alias)
+                alias_unset(e->name);
+        }
+        return 0;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (alias_unset(argv[i]) < 0)
+        {
+            fprintf(stderr, "%sunalias: %s: not found%s\n", COLOR_RED, argv[i], COLOR_RESET);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+// Built-in: set command - turn shell options on (-) or off (+)
+int builtin_set(int argc, char **argv)
+{
+    if (argc == 1 || (argc == 2 && strcmp(argv[1], "-o") == 0))
+    {
+        printf("noclobber\t%s\n", noclobber ? "on" : "off");
+        return 0;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        const char *opt = argv[i];
+        int on = opt[0] == '-';
+        if ((on || opt[0] == '+') && strcmp(opt + 1, "C") == 0)
+            noclobber = on;
+        else if ((on || opt[0] == '+') && strcmp(opt + 1, "o") == 0 &&
+                 i + 1 < argc && strcmp(argv[i + 1], "noclobber") == 0)
+            noclobber = on, i++;
+        else
+        {
+            fprintf(stderr, "%sset: %s: unsupported option%s\n", COLOR_RED, opt, COLOR_RESET);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Built-in: type command - show how each name would be resolved
+int builtin_type(int argc, char **argv)
+{
+    int ret = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const char *name = argv[i];
+        NameEntry *e = name_find(name);
+        const char *path;
+        if (e && e->alias)
+            printf("%s is aliased to '%s'\n", name, e->alias);
+        else if (e && e->func)
+            printf("%s is a function\n", name);
+        else if (e && e->builtin)
+            printf("%s is a shell builtin\n", name);
+        else if (strchr(name, '/') && access(name, X_OK) == 0)
+            printf("%s is %s\n", name, name);
+        else if (!strchr(name, '/') && (path = resolve_path(name)) != NULL)
+            printf("%s is %s\n", name, path);
+        else
+        {
+            fprintf(stderr, "%stype: %s: not found%s\n", COLOR_RED, name, COLOR_RESET);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+// Built-in: exit command
+int builtin_exit(int argc, char **argv)
+{
+    int code = 0;
+    if (argc >= 2) 
+        code = atoi(argv[1]);
+    exit(code);
+}
+
+// Built-in: cd command
+int builtin_cd(int argc, char **argv)
+{
+    const char *dir = (argc >= 2) ? argv[1] : getenv("HOME");
+    if (!dir) 
+    {
+        fprintf(stderr, "%scd: HOME not set%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    if (chdir(dir) != 0) 
+    {
+        perror("cd");
+        return 1;
+    }
+    return 0;
+}
+
+// Built-in: pwd command
+int builtin_pwd(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    char *cwd = get_current_dir();
+    if (!cwd)
+    {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+// Built-in: echo command
+int builtin_echo(int argc, char **argv)
+{
+    int newline = 1;
+    int i = 1;
+    if (argc > 1 && strcmp(argv[1], "-n") == 0)
+    {
+        newline = 0;
+        i++;
+    }
+    for (; i < argc; i++)
+    {
+        fputs(argv[i], stdout);
+        if (i < argc - 1)
+            putchar(' ');
+    }
+    if (newline)
+        putchar('\n');
+    return 0;
+}
+
+// Read one line from fd into line (without the newline); 1 for a line, 0 at
+// end of file, -1 on error. Nothing past the newline is consumed: files are
+// read in blocks and the rest is given back with lseek, pipes a byte at a time
+static int read_line_fd(int fd, StrBuf *line)
+{
+    char buf[4096];
+    int seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+    for (;;)
+    {
+        ssize_t n = read(fd, buf, seekable ? sizeof(buf) : 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            perror("read");
+            return -1;
+        }
+        if (n == 0)
+            return 0;
+        char *nl = memchr(buf, '\n', n);
+        sb_append(line, buf, nl ? (size_t)(nl - buf) : (size_t)n);
+        if (nl)
+        {
+            if (nl + 1 < buf + n)
+                lseek(fd, (nl + 1) - (buf + n), SEEK_CUR);
+            return 1;
+        }
+    }
+}
+
+// Built-in: read command - read a line and split it into variables
+int builtin_read(int argc, char **argv)
+{
+    const char *from = NULL;
+    int i = 1;
+    if (argc > 2 && strcmp(argv[1], "-u") == 0)
+    {
+        from = argv[2];
+        i = 3;
+    }
+    if (i >= argc)
+    {
+        fprintf(stderr, "%sread: usage: read [-u FD|p|p:NAME] VAR...%s\n", COLOR_RED, COLOR_RESET);
+        return 2;
+    }
+
+    StrBuf line;
+    sb_init(&line);
+    int r;
+    if (from && from[0] == 'p' && (from[1] == '\0' || from[1] == ':'))
+        r = coproc_getline(from[1] ? from + 2 : NULL, &line);
+    else
+    {
+        int fd = from ? atoi(from) : STDIN_FILENO;
+        if (from && (!isdigit((unsigned char)from[0]) || fd > REDIR_FD_MAX))
+        {
+            fprintf(stderr, "%sread: %s: bad file descriptor%s\n", COLOR_RED, from, COLOR_RESET);
+            return 2;
+        }
+        r = read_line_fd(fd, &line);
+    }
+    if (r < 0)
+    {
+        sb_free(&line);
+        return 2;
+    }
+
+    // Whitespace-separated fields; the last variable takes the rest of the line
+    char empty[1] = "";
+    char *p = line.data ? line.data : empty;
+    for (; i < argc; i++)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        char *end = p;
+        if (i == argc - 1)
+        {
+            end = p + strlen(p);
+            while (end > p && (end[-1] == ' ' || end[-1] == '\t'))
+                end--;
+        }
+        else
+        {
+            while (*end && *end != ' ' && *end != '\t')
+                end++;
+        }
+        char save = *end;
+        *end = '\0';
+        setenv(argv[i], p, 1);
+        *end = save;
+        p = end;
+    }
+    sb_free(&line);
+    return r == 1 ? 0 : 1;
+}
+
+// Built-in: trace command - start/stop Chrome trace output
+int builtin_trace(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("tracing %s\n", trace_enabled() ? "on" : "off");
+        return 0;
+    }
+    if (strcmp(argv[1], "off") == 0)
+    {
+        trace_close();
+        return 0;
+    }
+    if (trace_open(argv[1]) < 0)
+    {
+        fprintf(stderr, "%strace: %s: %s%s\n", COLOR_RED, argv[1], strerror(errno), COLOR_RESET);
+        return 1;
+    }
+    return 0;
+}
+
+// Built-in: stats command - dump (and optionally reset) counters
+int builtin_stats(int argc, char **argv)
+{
+    int json = 0, reset = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0)
+            json = 1;
+        else if (strcmp(argv[i], "-r") == 0)
+            reset = 1;
+        else
+        {
+            fprintf(stderr, "%sstats: usage: stats [-j] [-r]%s\n", COLOR_RED, COLOR_RESET);
+            return 1;
+        }
+    }
+    stats_print(json);
+    if (reset)
+        stats_reset();
+    return 0;
+}
+
+// Built-in: help command
+int builtin_help(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+    printf("TinyShell - Built-in commands:\n");
+    printf(" %sexit [code]%s Exit the shell with optional code\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %scd [dir]%s Change directory (default: HOME)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sjobs [-l]%s List all background jobs (-l: each process's CPU, memory and I/O)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sjtop [-d SECS] [-n COUNT]%s Keep refreshing jobs -l until q is pressed\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sfg %%N%s Bring job N to foreground\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sbg %%N%s Continue job N in background\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sjoblog on [DIR]|off%s Capture background job output instead of printing it\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sjoblog [-f] %%N%s Show (or follow) the captured output of job N\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %stimeout [-s SIG] [-k GRACE] DURATION cmd...%s Signal the pipeline if it runs longer than DURATION\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sdeadline [%%N DURATION|off]%s Give a running job a time limit, or list them\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %slimit [-c CPUS] [-m SIZE] [-p N] cmd...%s Run the pipeline in its own cgroup; print its CPU, memory and I/O totals\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %slimit [-c CPUS] [-m SIZE] [-p N] %%N%s Limit a running job, or list limited jobs\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sonchange [-r] [-i] [-d SECS] PATH... -- cmd%s Rerun cmd as a job when files change (-x ID removes)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %scoproc NAME cmd [| cmd...]%s Start a job the shell writes to (>&p) and reads from (<&p)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %scoproc [-c [NAME]]%s List coprocesses, or close one's input\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sread [-u FD|p|p:NAME] VAR...%s Read a line into variables\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %spwd%s Print the current directory\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %secho [-n] args%s Print arguments\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %strace [FILE|off]%s Record launches as a Chrome trace\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sstats [-j] [-r]%s Show launch counters/latencies (JSON, reset)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %srecord [FILE|off]%s Append each input with its timing to FILE, for tinyshell-replay\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %salias [name=value]%s Define or list aliases\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sunalias [-a] name%s Remove aliases\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sbatch [-j N] [-n N] cmd args%s Run cmd over any number of arguments in ARG_MAX-sized chunks\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %scache [-e VAR] [-i FILE] -- cmd%s Replay cmd's output when argv, env and inputs are unchanged\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %scache stats|clear%s Show or empty the output cache\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sgrep [-cHhlnqsvF] [-e PAT] PAT [file...]%s Fixed-string grep without an exec (regexes run grep)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %swc [-lwc] [file...]%s Count lines, words and bytes\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %shead [-n N|-c N] [file...]%s Print the first N lines (or bytes)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %stype name...%s Show how names resolve (alias, function, builtin, file)\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %sset [-C|+C]%s Refuse (or allow) > overwriting existing files; >| always overwrites\n", COLOR_BLUE, COLOR_RESET);
+    printf(" %shelp%s Show this help message\n", COLOR_BLUE, COLOR_RESET);
+    printf("\nAll other commands are executed via PATH search.\n");
+    printf("Use $(cmd) or `cmd` to substitute a command's output, NAME=value to set a variable.\n");
+    printf("Use Ctrl-Z to suspend a foreground job.\n");
+    return 0;
+}
+
+// Helper function to find job by number
+static Job* find_job(int job_num)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (jobs[i].state != JOB_DONE && jobs[i].job_num == job_num)
+            return &jobs[i];
+    }
+    return NULL;
+}
+
+// Built-in: jobs command - list all jobs
+int builtin_jobs(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "-l") == 0)
+        return jobs_print_long();
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (jobs[i].state != JOB_DONE && jobs[i].cmd_line != NULL)
+        {
+            const char *state_str = (jobs[i].state == JOB_RUNNING) ? "Running" : "Stopped";
+            printf("[%d]  %s    %s\n", jobs[i].job_num, state_str, jobs[i].cmd_line);
+        }
+    }
+    return 0;
+}
+
+// Built-in: fg command - bring job to foreground
+int builtin_fg(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "%sfg: usage: fg %%N%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    
+    // Parse job number from %N format
+    int job_num = -1;
+    if (argv[1][0] == '%')
+        job_num = atoi(argv[1] + 1);
+    else
+        job_num = atoi(argv[1]);
+    
+    Job *job = find_job(job_num);
+    if (!job)
+    {
+        fprintf(stderr, "%sfg: %%%d: no such job%s\n", COLOR_RED, job_num, COLOR_RESET);
+        return 1;
+    }
+    
+    // Print what we're foregrounding
+    printf("%s\n", job->cmd_line);
+    
+    // Block SIGCHLD during critical section
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    
+    // Give terminal control to the job's process group
+    if (give_terminal(job->pgid) < 0)
+    {
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return 1;
+    }
+    
+    // Send SIGCONT to continue the job if it was stopped
+    if (job->state == JOB_STOPPED)
+    {
+        kill(-job->pgid, SIGCONT);
+    }
+    
+    job->state = JOB_RUNNING;
+    
+    // Unblock SIGCHLD
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    
+    // Wait for the job to complete or stop
+    // Retry if interrupted by a signal (EINTR)
+    // Use -pgid to wait for any process in the job's process group (handles pipelines)
+    int status;
+    pid_t result;
+    do {
+        result = deadline_waitpid(-job->pgid, &status, WUNTRACED);
+    } while (result == -1 && errno == EINTR);
+    
+    // Take back terminal control
+    give_terminal(shell_pgid);
+    
+    // Block SIGCHLD while updating job status
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    
+    int ret = 1;
+    if (result > 0)
+    {
+        ret = status_to_code(status);
+        if (WIFSTOPPED(status))
+        {
+            // Job was stopped (Ctrl-Z)
+            job->state = JOB_STOPPED;
+            printf("\n[%d]+  Stopped    %s\n", job->job_num, job->cmd_line);
+        }
+        else if (WIFEXITED(status) || WIFSIGNALED(status))
+        {
+            // Job completed - fully clean up the entry
+            job->state = JOB_DONE;
+            stat_inc(STAT_JOBS_REAPED);
+            stat_record(HIST_RUN_US, (monotonic_ns() - job->start_ns) / 1000);
+            if (job->cmd_line)
+            {
+                free(job->cmd_line);
+                job->cmd_line = NULL;
+            }
+            job->job_num = 0;
+            job->pid = 0;
+            job->pgid = 0;
+        }
+    }
+    
+    // Unblock SIGCHLD
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return ret;
+}
+
+// Built-in: bg command - continue job in background
+int builtin_bg(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "%sbg: usage: bg %%N%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    
+    // Parse job number from %N format
+    int job_num = -1;
+    if (argv[1][0] == '%')
+        job_num = atoi(argv[1] + 1);
+    else
+        job_num = atoi(argv[1]);
+    
+    Job *job = find_job(job_num);
+    if (!job)
+    {
+        fprintf(stderr, "%sbg: %%%d: no such job%s\n", COLOR_RED, job_num, COLOR_RESET);
+        return 1;
+    }
+    
+    if (job->state == JOB_STOPPED)
+    {
+        // Block SIGCHLD during state change
+        sigset_t mask, prev;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &prev);
+        
+        // Send SIGCONT to continue the job in background
+        kill(-job->pgid, SIGCONT);
+        job->state = JOB_RUNNING;
+        printf("[%d]+ %s &\n", job->job_num, job->cmd_line);
+        
+        // Unblock SIGCHLD
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return 0;
+    }
+
+    fprintf(stderr, "%sbg: job %%%d already running%s\n", COLOR_RED, job_num, COLOR_RESET);
+    return 1;
+}
@@ -0,0 +1,266 @@
+/*
+ * cache.c - Compiled script cache
+ *
+ * A compiled Program holds no pointers (everything indexes the string
+ * pool), so it is stored as a header followed by its arrays verbatim:
+ *
+ *   CacheHeader | source path (padded) | code | pipes | cmds | words | pool
+ *
+ * Loading maps the file privately and points the Program at the mapping,
+ * so a warm start does no parsing and no copying.
+ */
+
+#include "../include/cache.h"
+#include "../include/utils.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Fixed-size file header; all sections that follow stay 4-byte aligned
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    int64_t mtime_sec; // Source file modification time
+    int64_t mtime_nsec;
+    uint64_t size; // Source file size
+    uint32_t path_len; // Length of the source path (without NUL)
+    uint32_t ncode;
+    uint32_t npipes;
+    uint32_t ncmds;
+    uint32_t nwords;
+    uint32_t pool_len;
+} CacheHeader;
+
+int cache_disabled = 0;
+
+// Bytes taken by the path, rounded up to keep the arrays aligned
+static size_t padded(size_t len)
+{
+    return (len + 7) & ~(size_t)7;
+}
+
+// Total size of a cache file described by a header
+static size_t cache_size(const CacheHeader *h)
+{
+    return sizeof(CacheHeader) + padded(h->path_len) +
+           (size_t)h->ncode * sizeof(Insn) +
+           (size_t)h->npipes * sizeof(PipeTemplate) +
+           (size_t)h->ncmds * sizeof(CmdTemplate) +
+           (size_t)h->nwords * sizeof(uint32_t) +
+           h->pool_len;
+}
+
+// Directory under the user's cache home, created if needed
+int cache_dir(const char *sub, char *buf, size_t size)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg)
+        snprintf(buf, size, "%s", xdg);
+    else if (home && *home)
+        snprintf(buf, size, "%s/.cache", home);
+    else
+        return -1;
+    mkdir(buf, 0700);
+    size_t len = strlen(buf);
+    snprintf(buf + len, size - len, "/tinyshell");
+    if (mkdir(buf, 0700) < 0 && errno != EEXIST)
+        return -1;
+    if (sub)
+    {
+        len = strlen(buf);
+        snprintf(buf + len, size - len, "/%s", sub);
+        if (mkdir(buf, 0700) < 0 && errno != EEXIST)
+            return -1;
+    }
+    return 0;
+}
+
+// Build the cache file name for an absolute script path
+static int cache_file(const char *abs_path, char *buf, size_t size)
+{
+    char dir[PATH_MAX_LEN];
+    if (cache_dir(NULL, dir, sizeof(dir)) < 0)
+        return -1;
+
+    // FNV-1a over the path; the stored path catches collisions
+    uint64_t hash = 14695981039346656037ull;
+    for (const char *p = abs_path; *p; p++)
+    {
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ull;
+    }
+    snprintf(buf, size, "%s/%016llx.tsc", dir, (unsigned long long)hash);
+    return 0;
+}
+
+// Map a cache file and check it still describes the source
+static int map_cache(const char *cache_path, const char *abs_path, const struct stat *src, Program **out)
+{
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return -1;
+    }
+
+    // Private writable mapping: the interpreter may patch words in place
+    size_t len = st.st_size;
+    char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    const CacheHeader *h = (const CacheHeader *)map;
+    size_t path_len = strlen(abs_path);
+    if (h->magic != CACHE_MAGIC || h->version != CACHE_VERSION ||
+        h->mtime_sec != (int64_t)src->st_mtim.tv_sec ||
+        h->mtime_nsec != (int64_t)src->st_mtim.tv_nsec ||
+        h->size != (uint64_t)src->st_size || h->path_len != path_len ||
+        cache_size(h) != len || memcmp(map + sizeof(CacheHeader), abs_path, path_len) != 0)
+    {
+        munmap(map, len);
+        return -1;
+    }
+
+    Program *prog = calloc(1, sizeof(Program));
+    if (!prog)
+    {
+        munmap(map, len);
+        return -1;
+    }
+    char *p = map + sizeof(CacheHeader) + padded(path_len);
+    prog->code = (Insn *)p;
+    prog->ncode = h->ncode;
+    p += (size_t)h->ncode * sizeof(Insn);
+    prog->pipes = (PipeTemplate *)p;
+    prog->npipes = h->npipes;
+    p += (size_t)h->npipes * sizeof(PipeTemplate);
+    prog->cmds = (CmdTemplate *)p;
+    prog->ncmds = h->ncmds;
+    p += (size_t)h->ncmds * sizeof(CmdTemplate);
+    prog->words = (uint32_t *)p;
+    prog->nwords = h->nwords;
+    p += (size_t)h->nwords * sizeof(uint32_t);
+    prog->pool = p;
+    prog->pool_len = h->pool_len;
+    prog->map = map;
+    prog->map_len = len;
+    prog->refs = 1;
+
+    // A truncated pool would let the interpreter run off the mapping
+    if (h->pool_len == 0 || prog->pool[h->pool_len - 1] != '\0')
+    {
+        script_release(prog);
+        return -1;
+    }
+    *out = prog;
+    return 0;
+}
+
+// Store a compiled program; written to a temporary file and renamed into place
+static void write_cache(const char *cache_path, const char *abs_path, const struct stat *src, const Program *prog)
+{
+    char tmp[PATH_MAX_LEN + 16];
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", cache_path);
+    int fd = mkstemp(tmp);
+    if (fd < 0)
+        return;
+
+    CacheHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.mtime_sec = src->st_mtim.tv_sec;
+    h.mtime_nsec = src->st_mtim.tv_nsec;
+    h.size = src->st_size;
+    h.path_len = strlen(abs_path);
+    h.ncode = prog->ncode;
+    h.npipes = prog->npipes;
+    h.ncmds = prog->ncmds;
+    h.nwords = prog->nwords;
+    h.pool_len = prog->pool_len;
+
+    static const char zeros[8];
+    int ok = write_all(fd, &h, sizeof(h)) == 0 &&
+             write_all(fd, abs_path, h.path_len) == 0 &&
+             write_all(fd, zeros, padded(h.path_len) - h.path_len) == 0 &&
+             write_all(fd, prog->code, (size_t)h.ncode * sizeof(Insn)) == 0 &&
+             write_all(fd, prog->pipes, (size_t)h.npipes * sizeof(PipeTemplate)) == 0 &&
+             write_all(fd, prog->cmds, (size_t)h.ncmds * sizeof(CmdTemplate)) == 0 &&
+             write_all(fd, prog->words, (size_t)h.nwords * sizeof(uint32_t)) == 0 &&
+             write_all(fd, prog->pool, h.pool_len) == 0;
+    close(fd);
+    if (!ok || rename(tmp, cache_path) < 0)
+        unlink(tmp);
+}
+
+// Read a whole file into a NUL-terminated buffer
+static char *read_file(int fd, size_t size)
+{
+    char *text = malloc(size + 1);
+    if (!text)
+        return NULL;
+    size_t got = 0;
+    while (got < size)
+    {
+        ssize_t n = read(fd, text + got, size - got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    text[got] = '\0';
+    return text;
+}
+
+// Load a script, preferring a valid cache entry
+int cache_load_script(const char *path, Program **out, int *from_cache)
+{
+    if (from_cache)
+        *from_cache = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    char cache_path[PATH_MAX_LEN];
+    char *abs_path = cache_disabled ? NULL : realpath(path, NULL);
+    int use_cache = abs_path && cache_file(abs_path, cache_path, sizeof(cache_path)) == 0;
+    if (use_cache && map_cache(cache_path, abs_path, &st, out) == 0)
+    {
+        if (from_cache)
+            *from_cache = 1;
+        close(fd);
+        free(abs_path);
+        return SCRIPT_OK;
+    }
+
+    char *text = read_file(fd, st.st_size);
+    close(fd);
+    if (!text)
+    {
+        free(abs_path);
+        return -1;
+    }
+    int rc = script_compile(text, out);
+    free(text);
+    if (rc == SCRIPT_INCOMPLETE)
+    {
+        fprintf(stderr, "%s%s: syntax error: unexpected end of file%s\n", COLOR_RED, path, COLOR_RESET);
+        rc = SCRIPT_ERROR;
+    }
+    if (rc == SCRIPT_OK && use_cache)
+        write_cache(cache_path, abs_path, &st, *out);
+    free(abs_path);
+    return rc;
+}
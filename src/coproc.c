@@ -0,0 +1,312 @@
+/*
+ * coproc.c - Coprocesses: background pipelines the shell talks to
+ *
+ * coproc NAME pipeline starts a job whose first stage reads from a pipe
+ * the shell writes and whose last stage writes to a pipe the shell reads.
+ * The shell's ends live at or above REDIR_FD_MIN, close-on-exec, and are
+ * reached through >&p and <&p redirections (p:NAME for one that is not
+ * the latest) and read -u p. A worker started once then answers any
+ * number of requests without a process start per request.
+ */
+
+#include "../include/coproc.h"
+#include "../include/executor.h"
+#include <ctype.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/syscall.h>
+
+// One coprocess
+typedef struct
+{
+    char *name; // NULL = free slot
+    pid_t pid; // Last stage of the pipeline
+    int pidfd; // Tells when it exited (-1 if pidfd_open failed)
+    int to; // Shell's end of its stdin (-1 once closed)
+    int from; // Shell's end of its stdout (-1 once closed)
+    char *buf; // Read-ahead for coproc_getline()
+    size_t pos; // Next unread byte in buf
+    size_t len; // Bytes in buf
+    unsigned seq; // Start order, to find the latest
+} Coproc;
+
+static Coproc coprocs[COPROC_MAX];
+static int current = -1; // What p means
+static unsigned next_seq = 1;
+static int pending[2] = { -1, -1 }; // Ends made by coproc_open(), not yet committed
+
+// Check a coprocess name: a letter or _ followed by letters, digits or _
+int coproc_valid_name(const char *name)
+{
+    if (!name || !(isalpha((unsigned char)name[0]) || name[0] == '_'))
+        return 0;
+    for (const char *p = name; *p; p++)
+    {
+        if (!isalnum((unsigned char)*p) && *p != '_')
+            return 0;
+    }
+    return 1;
+}
+
+static void close_end(int *fd)
+{
+    if (*fd >= 0)
+        close(*fd);
+    *fd = -1;
+}
+
+static int has_exited(const Coproc *c)
+{
+    if (c->pidfd >= 0)
+    {
+        struct pollfd pfd = { c->pidfd, POLLIN, 0 };
+        return poll(&pfd, 1, 0) > 0;
+    }
+    return kill(c->pid, 0) < 0 && errno == ESRCH;
+}
+
+// Forget a coprocess; p moves to the latest one left
+static void release(Coproc *c)
+{
+    char var[128];
+    snprintf(var, sizeof(var), "%s_PID", c->name);
+    unsetenv(var);
+    close_end(&c->to);
+    close_end(&c->from);
+    close_end(&c->pidfd);
+    free(c->name);
+    free(c->buf);
+    memset(c, 0, sizeof(*c));
+
+    current = -1;
+    for (int i = 0; i < COPROC_MAX; i++)
+    {
+        if (coprocs[i].name && (current < 0 || coprocs[i].seq > coprocs[current].seq))
+            current = i;
+    }
+}
+
+// Close the stdin of coprocesses that exited, and drop those with nothing left to read
+static void sweep(void)
+{
+    for (int i = 0; i < COPROC_MAX; i++)
+    {
+        Coproc *c = &coprocs[i];
+        if (!c->name || !has_exited(c))
+            continue;
+        close_end(&c->to);
+        struct pollfd pfd = { c->from, POLLIN, 0 };
+        if (c->from < 0 || (c->pos == c->len && (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))))
+            release(c);
+    }
+}
+
+static Coproc *find(const char *name)
+{
+    if (!name)
+        return current >= 0 ? &coprocs[current] : NULL;
+    for (int i = 0; i < COPROC_MAX; i++)
+    {
+        if (coprocs[i].name && strcmp(coprocs[i].name, name) == 0)
+            return &coprocs[i];
+    }
+    return NULL;
+}
+
+// Create the pipes for a new coprocess
+int coproc_open(int child[2])
+{
+    sweep();
+    int slots = 0;
+    for (int i = 0; i < COPROC_MAX; i++)
+        slots += coprocs[i].name == NULL;
+    if (slots == 0)
+    {
+        fprintf(stderr, "%scoproc: too many coprocesses%s\n", COLOR_RED, COLOR_RESET);
+        return -1;
+    }
+
+    int in[2], out[2];
+    if (pipe2(in, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+    if (pipe2(out, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    // Out of the way of the descriptors redirections name
+    pending[PIPE_WRITE] = fcntl(in[PIPE_WRITE], F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+    pending[PIPE_READ] = fcntl(out[PIPE_READ], F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+    close(in[PIPE_WRITE]);
+    close(out[PIPE_READ]);
+    child[0] = in[PIPE_READ];
+    child[1] = out[PIPE_WRITE];
+
+    // The shell writes to coprocesses itself: one that died must not take it down
+    // (reset_child_signals() puts SIGPIPE back for children)
+    signal(SIGPIPE, SIG_IGN);
+    return 0;
+}
+
+// Register the coprocess whose pipes coproc_open() made
+void coproc_commit(const char *name, pid_t pid)
+{
+    Coproc *old = find(name);
+    if (old)
+        release(old);
+    Coproc *c = NULL;
+    for (int i = 0; i < COPROC_MAX && !c; i++)
+    {
+        if (!coprocs[i].name)
+        {
+            c = &coprocs[i];
+            current = i;
+        }
+    }
+    c->name = strdup(name);
+    c->pid = pid;
+    c->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    c->to = pending[PIPE_WRITE];
+    c->from = pending[PIPE_READ];
+    c->seq = next_seq++;
+    pending[0] = pending[1] = -1;
+
+    char var[128], val[16];
+    snprintf(var, sizeof(var), "%s_PID", name);
+    snprintf(val, sizeof(val), "%d", (int)pid);
+    setenv(var, val, 1);
+
+    // Show it as a coprocess in the job table
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        char *text;
+        if (jobs[i].state != JOB_DONE && jobs[i].pid == pid && jobs[i].cmd_line &&
+            asprintf(&text, "coproc %s %s", name, jobs[i].cmd_line) >= 0)
+        {
+            free(jobs[i].cmd_line);
+            jobs[i].cmd_line = text;
+        }
+    }
+}
+
+// Close the ends of a coprocess that could not be started
+void coproc_abort(void)
+{
+    close_end(&pending[0]);
+    close_end(&pending[1]);
+}
+
+// Look up one of the shell's ends of a coprocess
+int coproc_fd(const char *name, int end)
+{
+    sweep();
+    Coproc *c = find(name);
+    if (!c)
+    {
+        fprintf(stderr, "%s%s: no such coprocess%s\n", COLOR_RED, name ? name : "p", COLOR_RESET);
+        return -1;
+    }
+    int fd = end == PIPE_WRITE ? c->to : c->from;
+    if (fd < 0)
+    {
+        fprintf(stderr, "%scoproc %s: %s is closed%s\n", COLOR_RED, c->name, end == PIPE_WRITE ? "input" : "output", COLOR_RESET);
+        return -1;
+    }
+    if (end == PIPE_READ && c->pos < c->len)
+    {
+        // Lines read ahead by read -u would be skipped
+        fprintf(stderr, "%scoproc %s: output partly read by read -u%s\n", COLOR_RED, c->name, COLOR_RESET);
+        return -1;
+    }
+    return fd;
+}
+
+// Read one line from a coprocess's stdout through the shell's read-ahead
+int coproc_getline(const char *name, StrBuf *line)
+{
+    Coproc *c = find(name);
+    if (!c || c->from < 0)
+    {
+        if (!c)
+            fprintf(stderr, "%s%s: no such coprocess%s\n", COLOR_RED, name ? name : "p", COLOR_RESET);
+        return c ? 0 : -1;
+    }
+    if (!c->buf && !(c->buf = malloc(COPROC_BUF_SIZE)))
+        return -1;
+    for (;;)
+    {
+        char *nl = memchr(c->buf + c->pos, '\n', c->len - c->pos);
+        if (nl)
+        {
+            sb_append(line, c->buf + c->pos, nl - (c->buf + c->pos));
+            c->pos = nl + 1 - c->buf;
+            return 1;
+        }
+        sb_append(line, c->buf + c->pos, c->len - c->pos);
+        c->pos = c->len = 0;
+        ssize_t n = read(c->from, c->buf, COPROC_BUF_SIZE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            perror("read");
+            return -1;
+        }
+        if (n == 0)
+        {
+            close_end(&c->from);
+            return 0;
+        }
+        c->len = n;
+    }
+}
+
+// Close every coprocess end in a forked child of the shell
+void coproc_close_child(void)
+{
+    for (int i = 0; i < COPROC_MAX; i++)
+    {
+        if (!coprocs[i].name)
+            continue; // Free slots are zeroed: their "descriptors" are stdin
+        close_end(&coprocs[i].to);
+        close_end(&coprocs[i].from);
+        close_end(&coprocs[i].pidfd);
+    }
+    close_end(&pending[0]);
+    close_end(&pending[1]);
+}
+
+// Built-in: coproc - list coprocesses or close one's input
+int builtin_coproc(int argc, char **argv)
+{
+    sweep();
+    if (argc == 1)
+    {
+        for (int i = 0; i < COPROC_MAX; i++)
+        {
+            Coproc *c = &coprocs[i];
+            if (c->name)
+                printf("%c %-12s %7d  %s\n", i == current ? '+' : ' ', c->name, (int)c->pid,
+                       c->to >= 0 ? "running" : "input closed");
+        }
+        return 0;
+    }
+    if (strcmp(argv[1], "-c") == 0 && argc <= 3)
+    {
+        Coproc *c = find(argc == 3 ? argv[2] : NULL);
+        if (!c)
+        {
+            fprintf(stderr, "%scoproc: %s: no such coprocess%s\n", COLOR_RED, argc == 3 ? argv[2] : "p", COLOR_RESET);
+            return 1;
+        }
+        close_end(&c->to);
+        return 0;
+    }
+    fprintf(stderr, "%scoproc: usage: coproc NAME command [| command...] | coproc [-c [NAME]]%s\n", COLOR_RED, COLOR_RESET);
+    return 2;
+}
@@ -0,0 +1,503 @@
+/*
+ * deadline.c - Time limits for pipelines and jobs (timeout, deadline)
+ *
+ * Every limit lives in one table; a single CLOCK_MONOTONIC timerfd is armed
+ * for the earliest one and polled by the shell's event loop (the readline
+ * input hook, and deadline_waitpid() while a foreground pipeline runs).
+ * When a limit passes, its process group gets the signal (then SIGKILL
+ * after the grace period). Processes are tracked with pidfds, so the shell
+ * knows when they are gone without relying on pids that may be reused.
+ */
+
+#include "../include/deadline.h"
+#include "../include/executor.h"
+#include "../include/resolve.h"
+#include "../include/stats.h"
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#define DEADLINE_IDLE UINT64_MAX // due_ns of a deadline with nothing left to do
+
+// One limit on a group of processes
+typedef struct
+{
+    int id; // 0 = free slot
+    pid_t pgid; // Group to signal (0 = signal each pidfd)
+    int *pidfds; // One per process (-1 if pidfd_open failed)
+    int npidfds;
+    int sig;
+    uint64_t grace_ns;
+    uint64_t due_ns; // Next action (monotonic), DEADLINE_IDLE when none
+    int fired; // 0, 1 = sig sent, 2 = SIGKILL sent
+    char *label;
+} Deadline;
+
+static Deadline deadlines[MAX_JOBS];
+static int next_id = 1;
+static int timer_fd = -1;
+static int sigchld_fd = -1;
+
+// Signals accepted by name for -s
+static const struct
+{
+    const char *name;
+    int sig;
+} signal_names[] = {
+    { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+    { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "PIPE", SIGPIPE }, { "ALRM", SIGALRM },
+    { "TERM", SIGTERM }, { "CONT", SIGCONT }, { "STOP", SIGSTOP }, { "TSTP", SIGTSTP },
+};
+
+// Parse a signal name (TERM, SIGTERM) or number; -1 if unknown
+int parse_signal(const char *s)
+{
+    if (strncmp(s, "SIG", 3) == 0)
+        s += 3;
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+    {
+        if (strcasecmp(s, signal_names[i].name) == 0)
+            return signal_names[i].sig;
+    }
+    char *end;
+    long n = strtol(s, &end, 10);
+    return (*s && !*end && n > 0 && n < NSIG) ? (int)n : -1;
+}
+
+// Name of a signal for listings
+static const char *signal_name(int sig)
+{
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+    {
+        if (signal_names[i].sig == sig)
+            return signal_names[i].name;
+    }
+    return "?";
+}
+
+// Parse "1.5", "30s", "10m", "2h", "1d" into nanoseconds; -1 if invalid
+int parse_duration(const char *s, uint64_t *ns)
+{
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s || !isfinite(v) || v < 0)
+        return -1;
+    double scale = 1;
+    if (*end == 'm')
+        scale = 60;
+    else if (*end == 'h')
+        scale = 3600;
+    else if (*end == 'd')
+        scale = 86400;
+    else if (*end && *end != 's')
+        return -1;
+    if (*end && end[1])
+        return -1;
+    double total = v * scale * 1e9;
+    if (total >= 1.8e19)
+        return -1;
+    *ns = (uint64_t)total;
+    return 0;
+}
+
+// Parse -s SIG / -k GRACE options; returns the index after them, -1 on error
+static int parse_options(int argc, char **argv, int i, DeadlineSpec *spec, const char *who)
+{
+    spec->sig = SIGTERM;
+    spec->grace_ns = 0;
+    for (; i + 1 < argc && (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-k") == 0); i += 2)
+    {
+        if (argv[i][1] == 's' && (spec->sig = parse_signal(argv[i + 1])) < 0)
+        {
+            fprintf(stderr, "%s%s: %s: invalid signal%s\n", COLOR_RED, who, argv[i + 1], COLOR_RESET);
+            return -1;
+        }
+        if (argv[i][1] == 'k' && parse_duration(argv[i + 1], &spec->grace_ns) < 0)
+        {
+            fprintf(stderr, "%s%s: %s: invalid duration%s\n", COLOR_RED, who, argv[i + 1], COLOR_RESET);
+            return -1;
+        }
+    }
+    return i;
+}
+
+// Parse the arguments of timeout up to the command
+int timeout_parse(int argc, char **argv, DeadlineSpec *spec)
+{
+    int i = parse_options(argc, argv, 1, spec, "timeout");
+    if (i < 0)
+        return -1;
+    if (i + 1 >= argc)
+    {
+        fprintf(stderr, "%stimeout: usage: timeout [-s SIG] [-k GRACE] DURATION command...%s\n", COLOR_RED, COLOR_RESET);
+        return -1;
+    }
+    if (parse_duration(argv[i], &spec->duration_ns) < 0)
+    {
+        fprintf(stderr, "%stimeout: %s: invalid duration%s\n", COLOR_RED, argv[i], COLOR_RESET);
+        return -1;
+    }
+    return i + 1;
+}
+
+// Check whether a process tracked by pidfd has exited (unknown counts as running)
+static int pidfd_exited(int pidfd)
+{
+    struct pollfd pfd = { pidfd, POLLIN, 0 };
+    return pidfd >= 0 && poll(&pfd, 1, 0) > 0;
+}
+
+// Check whether any process of a deadline is still running
+static int still_running(const Deadline *d)
+{
+    for (int i = 0; i < d->npidfds; i++)
+    {
+        if (!pidfd_exited(d->pidfds[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Release a slot
+static void clear_deadline(Deadline *d)
+{
+    for (int i = 0; i < d->npidfds; i++)
+    {
+        if (d->pidfds[i] >= 0)
+            close(d->pidfds[i]);
+    }
+    free(d->pidfds);
+    free(d->label);
+    memset(d, 0, sizeof(*d));
+}
+
+// Arm the timer for the earliest pending deadline (or disarm it)
+static void rearm(void)
+{
+    uint64_t next = DEADLINE_IDLE;
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (deadlines[i].id != 0 && deadlines[i].due_ns < next)
+            next = deadlines[i].due_ns;
+    }
+    if (timer_fd < 0)
+        return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next != DEADLINE_IDLE)
+    {
+        its.it_value.tv_sec = next / 1000000000u;
+        its.it_value.tv_nsec = next % 1000000000u;
+        if (next == 0)
+            its.it_value.tv_nsec = 1;  // All zero would disarm
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Find a deadline by id
+static Deadline *find_deadline(int id)
+{
+    for (int i = 0; id > 0 && i < MAX_JOBS; i++)
+    {
+        if (deadlines[i].id == id)
+            return &deadlines[i];
+    }
+    return NULL;
+}
+
+// Put processes under a deadline
+int deadline_add(const DeadlineSpec *spec, pid_t pgid, const pid_t *pids, int npids, const char *label)
+{
+    if (timer_fd < 0)
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd < 0)
+    {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    // Reuse the slot of a deadline whose processes are all gone
+    Deadline *d = NULL;
+    for (int i = 0; i < MAX_JOBS && !d; i++)
+    {
+        if (deadlines[i].id == 0)
+            d = &deadlines[i];
+    }
+    for (int i = 0; i < MAX_JOBS && !d; i++)
+    {
+        if (!still_running(&deadlines[i]))
+        {
+            clear_deadline(&deadlines[i]);
+            d = &deadlines[i];
+        }
+    }
+    if (!d)
+    {
+        fprintf(stderr, "%s%s: too many deadlines%s\n", COLOR_RED, label, COLOR_RESET);
+        return -1;
+    }
+
+    d->pidfds = malloc(sizeof(int) * npids);
+    d->label = strdup(label);
+    if (!d->pidfds || !d->label)
+    {
+        clear_deadline(d);
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < npids; i++)
+        d->pidfds[d->npidfds++] = syscall(SYS_pidfd_open, pids[i], 0);
+    d->pgid = pgid;
+    d->sig = spec->sig;
+    d->grace_ns = spec->grace_ns;
+    d->due_ns = monotonic_ns() + spec->duration_ns;
+    d->fired = 0;
+    d->id = next_id++;
+    rearm();
+    return d->id;
+}
+
+// Forget a deadline
+void deadline_cancel(int id)
+{
+    Deadline *d = find_deadline(id);
+    if (!d)
+        return;
+    clear_deadline(d);
+    rearm();
+}
+
+// Check whether a deadline has run out
+int deadline_fired(int id)
+{
+    Deadline *d = find_deadline(id);
+    return d ? d->fired : 0;
+}
+
+// Timer descriptor while a deadline is pending
+int deadline_fd(void)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (deadlines[i].id != 0 && deadlines[i].due_ns != DEADLINE_IDLE)
+            return timer_fd;
+    }
+    return -1;
+}
+
+// Send a signal to a deadline's processes
+static void signal_deadline(const Deadline *d, int sig)
+{
+    if (d->pgid > 0)
+    {
+        kill(-d->pgid, sig);
+        return;
+    }
+    for (int i = 0; i < d->npidfds; i++)
+    {
+        if (d->pidfds[i] >= 0)
+            syscall(SYS_pidfd_send_signal, d->pidfds[i], sig, NULL, 0);
+    }
+}
+
+// Act on every deadline that has passed
+void deadline_run(void)
+{
+    uint64_t expirations;
+    if (timer_fd >= 0 && read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        return;
+
+    uint64_t now = monotonic_ns();
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Deadline *d = &deadlines[i];
+        if (d->id == 0 || d->due_ns > now)
+            continue;
+        d->due_ns = DEADLINE_IDLE;
+        if (!still_running(d))
+            continue;
+        if (d->fired == 0)
+        {
+            // Stopped processes only see the signal once continued
+            signal_deadline(d, d->sig);
+            if (d->sig != SIGKILL && d->sig != SIGCONT)
+                signal_deadline(d, SIGCONT);
+            d->fired = 1;
+            if (d->grace_ns > 0)
+                d->due_ns = now + d->grace_ns;
+        }
+        else
+        {
+            signal_deadline(d, SIGKILL);
+            d->fired = 2;
+        }
+        stat_inc(STAT_DEADLINES_FIRED);
+    }
+    rearm();
+}
+
+// waitpid() that keeps enforcing deadlines while it blocks
+pid_t deadline_waitpid(pid_t pid, int *status, int options)
+{
+    if (deadline_fd() < 0)
+        return waitpid(pid, status, options);
+
+    // SIGCHLD stays pending while blocked, so the signalfd sees every exit
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    if (sigchld_fd < 0)
+        sigchld_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    int consumed = 0;
+    pid_t r;
+    for (;;)
+    {
+        r = waitpid(pid, status, options | WNOHANG);
+        if (r != 0)
+            break;
+        int tfd = deadline_fd();
+        if (sigchld_fd < 0 || tfd < 0)
+        {
+            r = waitpid(pid, status, options);
+            break;
+        }
+        struct pollfd pfd[2] = { { sigchld_fd, POLLIN, 0 }, { tfd, POLLIN, 0 } };
+        if (poll(pfd, 2, -1) < 0 && errno != EINTR)
+        {
+            r = waitpid(pid, status, options);
+            break;
+        }
+        struct signalfd_siginfo si;
+        while (pfd[0].revents && read(sigchld_fd, &si, sizeof(si)) > 0)
+            consumed = 1;
+        if (pfd[1].revents)
+            deadline_run();
+    }
+
+    // Hand the reaper the notifications we swallowed (for background jobs)
+    if (consumed)
+        raise(SIGCHLD);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return r;
+}
+
+// Built-in: timeout - run one command under a time limit
+int builtin_timeout(int argc, char **argv)
+{
+    DeadlineSpec spec;
+    int start = timeout_parse(argc, argv, &spec);
+    if (start < 0)
+        return 125;
+
+    Command target;
+    memset(&target, 0, sizeof(target));
+    target.argc = argc - start < MAX_ARGS ? argc - start : MAX_ARGS - 1;
+    memcpy(target.argv, argv + start, sizeof(char *) * target.argc);
+    target.argv[target.argc] = NULL;
+    resolve_command(&target);
+
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        reset_child_signals();
+        exec_command(&target);
+    }
+    if (pid < 0)
+    {
+        perror("fork");
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return 125;
+    }
+    stat_inc(STAT_FORKS);
+    stat_inc(STAT_COMMANDS);
+
+    int id = spec.duration_ns ? deadline_add(&spec, 0, &pid, 1, argv[start]) : -1;
+    int status = 0;
+    while (deadline_waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    int code = deadline_fired(id) == 1 ? TIMEOUT_STATUS : status_to_code(status);
+    deadline_cancel(id);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return code;
+}
+
+// Find a live job by number
+static Job *job_by_number(int job_num)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (jobs[i].state != JOB_DONE && jobs[i].job_num == job_num)
+            return &jobs[i];
+    }
+    return NULL;
+}
+
+// Built-in: deadline - list, set or remove job deadlines
+int builtin_deadline(int argc, char **argv)
+{
+    if (argc == 1)
+    {
+        uint64_t now = monotonic_ns();
+        for (int i = 0; i < MAX_JOBS; i++)
+        {
+            Deadline *d = &deadlines[i];
+            if (d->id == 0 || !still_running(d))
+                continue;
+            char job[16] = "-";
+            for (int j = 0; j < MAX_JOBS; j++)
+            {
+                if (d->pgid > 0 && jobs[j].state != JOB_DONE && jobs[j].pgid == d->pgid)
+                    snprintf(job, sizeof(job), "%%%d", jobs[j].job_num);
+            }
+            if (d->due_ns == DEADLINE_IDLE)
+                printf("%-5s %-5s %10s  %s\n", job, signal_name(d->sig), "expired", d->label);
+            else
+                printf("%-5s %-5s %9.1fs  %s\n", job, d->fired ? "KILL" : signal_name(d->sig),
+                       d->due_ns > now ? (d->due_ns - now) / 1e9 : 0.0, d->label);
+        }
+        return 0;
+    }
+
+    DeadlineSpec spec;
+    int i = parse_options(argc, argv, 1, &spec, "deadline");
+    if (i < 0)
+        return 1;
+    if (i + 2 != argc)
+    {
+        fprintf(stderr, "%sdeadline: usage: deadline [-s SIG] [-k GRACE] %%N DURATION|off%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    const char *spec_str = argv[i];
+    Job *job = job_by_number(atoi(spec_str[0] == '%' ? spec_str + 1 : spec_str));
+    if (!job)
+    {
+        fprintf(stderr, "%sdeadline: %s: no such job%s\n", COLOR_RED, spec_str, COLOR_RESET);
+        return 1;
+    }
+
+    // A job has at most one deadline: the new one replaces it
+    for (int j = 0; j < MAX_JOBS; j++)
+    {
+        if (deadlines[j].id != 0 && deadlines[j].pgid == job->pgid)
+            deadline_cancel(deadlines[j].id);
+    }
+    if (strcmp(argv[i + 1], "off") == 0)
+        return 0;
+    if (parse_duration(argv[i + 1], &spec.duration_ns) < 0 || spec.duration_ns == 0)
+    {
+        fprintf(stderr, "%sdeadline: %s: invalid duration%s\n", COLOR_RED, argv[i + 1], COLOR_RESET);
+        return 1;
+    }
+    pid_t pids[2] = { job->pid, job->pgid };
+    return deadline_add(&spec, job->pgid, pids, job->pid == job->pgid ? 1 : 2, job->cmd_line) < 0;
+}
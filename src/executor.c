@@ -1,525 +1,1140 @@
-/*
- * executor.c - Pipeline execution and process management
- */
-
-#include "../include/executor.h"
-#include "../include/builtins.h"
-#include <signal.h>
-#include <termios.h>
-
-// Global job tracking
-Job jobs[MAX_JOBS];
-int next_job_num = 1;
-pid_t shell_pgid;
-int shell_terminal;
-
-// Helper function to update job status (called by SIGCHLD handler)
-static void update_job_status(pid_t pid, int status)
-{
-    for (int i = 0; i < MAX_JOBS; i++)
-    {
-        if (jobs[i].pid == pid && jobs[i].state != JOB_DONE)
-        {
-            if (WIFEXITED(status) || WIFSIGNALED(status))
-            {
-                // Job completed
-                jobs[i].state = JOB_DONE;
-            }
-            else if (WIFSTOPPED(status))
-            {
-                jobs[i].state = JOB_STOPPED;
-            }
-            else if (WIFCONTINUED(status))
-            {
-                jobs[i].state = JOB_RUNNING;
-            }
-            break;
-        }
-    }
-}
-
-// SIGCHLD handler to reap zombie processes and update job status
-void sigchld_handler(int sig)
-{
-    (void)sig;  // Suppress unused parameter warning
-    int saved_errno = errno;
-    int status;
-    pid_t pid;
-    
-    // Reap all available zombie children
-    // WNOHANG: return immediately if no child has exited
-    // WUNTRACED: return if child has stopped
-    // WCONTINUED: return if stopped child has continued
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
-    {
-        update_job_status(pid, status);
-    }
-    
-    // Only restore errno if no real error occurred
-    // (ECHILD just means no more children, not an error)
-    if (pid == -1 && errno != ECHILD) {
-        // Real error occurred, keep the errno
-    } else {
-        errno = saved_errno;
-    }
-}
-
-// Check for completed jobs and print notifications
-void check_job_notifications(void)
-{
-    for (int i = 0; i < MAX_JOBS; i++)
-    {
-        if (jobs[i].state == JOB_DONE && jobs[i].cmd_line != NULL)
-        {
-            printf("\n[%d]+  Done       %s\n", jobs[i].job_num, jobs[i].cmd_line);
-            free(jobs[i].cmd_line);
-            jobs[i].cmd_line = NULL;
-            jobs[i].job_num = 0;
-            jobs[i].pid = 0;
-            jobs[i].pgid = 0;
-        }
-    }
-}
-
-// Add a background job to the jobs list
-static int add_job(pid_t pid, pid_t pgid, const char *cmd_line) 
-{
-    // Block SIGCHLD to prevent race conditions
-    sigset_t mask, prev;
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGCHLD);
-    sigprocmask(SIG_BLOCK, &mask, &prev);
-    
-    int job_num = -1;
-    for (int i = 0; i < MAX_JOBS; i++) 
-    {
-        if (jobs[i].state == JOB_DONE) 
-        {
-            jobs[i].job_num = next_job_num++;
-            jobs[i].pid = pid;
-            jobs[i].pgid = pgid;
-            jobs[i].cmd_line = strdup(cmd_line);
-            jobs[i].state = JOB_RUNNING;
-            job_num = jobs[i].job_num;
-            break;
-        }
-    }
-    
-    // Restore signal mask
-    sigprocmask(SIG_SETMASK, &prev, NULL);
-    return job_num;
-}
-
-// Execution with manual PATH search + execve
-void exec_with_path(const char *cmd, char **argv) 
-{
-    // If it contains '/', try directly
-    if (strchr(cmd, '/')) 
-    {
-        execve(cmd, argv, environ);
-        perror("execve");
-        _exit(127);
-    }
-
-    char *path = getenv("PATH");
-    if (!path) 
-    {
-        fprintf(stderr, "No PATH set\n");
-        _exit(127);
-    }
-
-    char *path_copy = strdup(path);
-    if (!path_copy) 
-    {
-        perror("strdup");
-        _exit(127);
-    }
-
-    char full[PATH_MAX_LEN];
-    for (char *dir = strtok(path_copy, ":"); dir; dir = strtok(NULL, ":")) 
-    {
-        snprintf(full, sizeof(full), "%s/%s", dir, cmd);
-        if (access(full, X_OK) == 0) 
-        {
-            execve(full, argv, environ);
-            perror("execve");
-            free(path_copy);
-            _exit(127);
-        }
-    }
-
-    fprintf(stderr, "%s%s: command not found%s\n", COLOR_RED, cmd, COLOR_RESET);
-    free(path_copy);
-    _exit(127);
-}
-
-// Display process termination information
-void print_exit_status(int status) 
-{
-    if (WIFEXITED(status)) 
-    {
-        int code = WEXITSTATUS(status);
-        printf("%s[exit status: %d]%s\n", COLOR_BLUE, code, COLOR_RESET);
-    } 
-    else if (WIFSIGNALED(status)) 
-    {
-        int sig = WTERMSIG(status);
-        printf("%s[terminated by signal: %s]%s\n", COLOR_BLUE, strsignal(sig), COLOR_RESET);
-    }
-}
-
-// Set up input/output/error redirection if needed
-void setup_redirection(Command *cmd) 
-{
-    // Input redirection (<)
-    if (cmd->infile) 
-    {
-        int fd = open(cmd->infile, O_RDONLY);
-        if (fd < 0) 
-        {
-            fprintf(stderr, "%s%s: %s%s\n", COLOR_RED, cmd->infile, strerror(errno), COLOR_RESET);
-            _exit(1);
-        }
-        
-        if (dup2(fd, STDIN_FILENO) < 0) 
-        {
-            perror("dup2");
-            close(fd);
-            _exit(1);
-        }
-        close(fd);
-    }
-    
-    // Output redirection (> or >>)
-    if (cmd->outfile) 
-    {
-        int flags = O_WRONLY | O_CREAT;
-        if (cmd->append) 
-            flags |= O_APPEND;
-        else 
-            flags |= O_TRUNC;
-        
-        int fd = open(cmd->outfile, flags, 0644);
-        if (fd < 0) 
-        {
-            perror("open");
-            _exit(1);
-        }
-        
-        if (dup2(fd, STDOUT_FILENO) < 0) 
-        {
-            perror("dup2");
-            close(fd);
-            _exit(1);
-        }
-        close(fd);
-    }
-    
-    // Stderr redirection (2>)
-    if (cmd->errfile) 
-    {
-        int fd = open(cmd->errfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) 
-        {
-            perror("open");
-            _exit(1);
-        }
-        
-        if (dup2(fd, STDERR_FILENO) < 0) 
-        {
-            perror("dup2");
-            close(fd);
-            _exit(1);
-        }
-        close(fd);
-    }
-}
-
-// Execute a pipeline of commands
-void execute_pipeline(Command cmds[], int num_cmds) 
-{
-    if (num_cmds == 0) 
-        return;
-    
-    // Check for built-in commands (only valid for single command, no pipes, no redirections)
-    if (num_cmds == 1 && cmds[0].outfile == NULL && cmds[0].infile == NULL && cmds[0].errfile == NULL) 
-    {
-        if (strcmp(cmds[0].argv[0], "exit") == 0) 
-        {
-            builtin_exit(cmds[0].argc, cmds[0].argv);
-            return;
-        }
-        if (strcmp(cmds[0].argv[0], "cd") == 0) 
-        {
-            builtin_cd(cmds[0].argc, cmds[0].argv);
-            return;
-        }
-        if (strcmp(cmds[0].argv[0], "help") == 0) 
-        {
-            builtin_help();
-            return;
-        }
-        if (strcmp(cmds[0].argv[0], "jobs") == 0) 
-        {
-            builtin_jobs();
-            return;
-        }
-        if (strcmp(cmds[0].argv[0], "fg") == 0) 
-        {
-            builtin_fg(cmds[0].argc, cmds[0].argv);
-            return;
-        }
-        if (strcmp(cmds[0].argv[0], "bg") == 0) 
-        {
-            builtin_bg(cmds[0].argc, cmds[0].argv);
-            return;
-        }
-    }
-    
-    // Single command (possibly with redirection)
-    if (num_cmds == 1) 
-    {
-        pid_t pid = fork();
-        if (pid < 0) 
-        {
-            perror("fork");
-            return;
-        }
-        
-        if (pid == 0) 
-        {
-            // Restore default signal handlers in child
-            struct sigaction sa;
-            sa.sa_handler = SIG_DFL;
-            sigemptyset(&sa.sa_mask);
-            sa.sa_flags = 0;
-            sigaction(SIGINT, &sa, NULL);
-            sigaction(SIGTSTP, &sa, NULL);
-            sigaction(SIGTTIN, &sa, NULL);
-            sigaction(SIGTTOU, &sa, NULL);
-
-            // Child process
-            // Create new process group (both foreground and background)
-            setpgid(0, 0);
-            
-            setup_redirection(&cmds[0]);
-            exec_with_path(cmds[0].argv[0], cmds[0].argv);
-        } 
-        else 
-        {
-            // Parent process
-            pid_t pgid = pid;  // Use child's PID as process group ID
-            setpgid(pid, pgid);
-            
-            if (cmds[0].background) 
-            {
-                // Background job - don't wait
-                // Add to job list and print job info
-                char cmd_str[256];
-                snprintf(cmd_str, sizeof(cmd_str), "%s", cmds[0].argv[0]);
-                for (int i = 1; i < cmds[0].argc && i < 10; i++) 
-                {
-                    strncat(cmd_str, " ", sizeof(cmd_str) - strlen(cmd_str) - 1);
-                    strncat(cmd_str, cmds[0].argv[i], sizeof(cmd_str) - strlen(cmd_str) - 1);
-                }
-                
-                int job_num = add_job(pid, pgid, cmd_str);
-                printf("[%d] %d\n", job_num, pid);
-            } 
-            else 
-            {
-                // Foreground job - give it terminal control
-                if (tcsetpgrp(shell_terminal, pgid) < 0)
-                {
-                    perror("tcsetpgrp");
-                }
-                
-                // Wait for completion or stop
-                int status;
-                waitpid(pid, &status, WUNTRACED);
-                
-                // Take back terminal control
-                if (tcsetpgrp(shell_terminal, shell_pgid) < 0)
-                {
-                    perror("tcsetpgrp");
-                }
-                
-                if (WIFSTOPPED(status)) {
-                    // Job was stopped (Ctrl-Z)
-                    char cmd_str[256];
-                    snprintf(cmd_str, sizeof(cmd_str), "%s", cmds[0].argv[0]);
-                    for (int i = 1; i < cmds[0].argc && i < 10; i++) 
-                    {
-                        strncat(cmd_str, " ", sizeof(cmd_str) - strlen(cmd_str) - 1);
-                        strncat(cmd_str, cmds[0].argv[i], sizeof(cmd_str) - strlen(cmd_str) - 1);
-                    }
-                    int job_num = add_job(pid, pgid, cmd_str);
-                    jobs[job_num - 1].state = JOB_STOPPED;
-                    printf("\n[%d]+  Stopped    %s\n", job_num, cmd_str);
-                } else {
-                    print_exit_status(status);
-                }
-            }
-        }
-        return;
-    }
-    
-    // Multiple commands in pipeline
-    int pipefds[2 * (num_cmds - 1)];
-    
-    // Create all pipes
-    for (int i = 0; i < num_cmds - 1; i++) 
-    {
-        if (pipe(pipefds + i * 2) < 0) 
-        {
-            perror("pipe");
-            return;
-        }
-    }
-    
-    // Fork and execute each command
-    pid_t pids[MAX_CMDS];
-    for (int i = 0; i < num_cmds; i++) 
-    {
-        pids[i] = fork();
-        if (pids[i] < 0) 
-        {
-            perror("fork");
-            return;
-        }
-        
-        if (pids[i] == 0) 
-        {
-            // Child process
-            // Create process group for first child, join for others
-            if (i == 0)
-                setpgid(0, 0);  // First child creates new process group
-            else
-                setpgid(0, pids[0]);  // Others join the first child's group
-            
-            // Restore default signal handlers in child
-            struct sigaction sa;
-            sa.sa_handler = SIG_DFL;
-            sigemptyset(&sa.sa_mask);
-            sa.sa_flags = 0;
-            sigaction(SIGINT, &sa, NULL);
-            sigaction(SIGTSTP, &sa, NULL);
-            sigaction(SIGTTIN, &sa, NULL);
-            sigaction(SIGTTOU, &sa, NULL);
-
-            // Redirect input from previous pipe (if not first command)
-            if (i > 0) 
-            {
-                if (dup2(pipefds[(i - 1) * 2 + PIPE_READ], STDIN_FILENO) < 0) 
-                {
-                    perror("dup2");
-                    _exit(1);
-                }
-            }
-
-            // Redirect output to next pipe (if not last command)
-            if (i < num_cmds - 1) 
-            {
-                if (dup2(pipefds[i * 2 + PIPE_WRITE], STDOUT_FILENO) < 0) 
-                {
-                    perror("dup2");
-                    _exit(1);
-                }
-            }
-
-            // Close all pipe file descriptors
-            for (int j = 0; j < 2 * (num_cmds - 1); j++) 
-                close(pipefds[j]);
-
-            // Set up file redirections (applied AFTER pipe setup)
-            setup_redirection(&cmds[i]);
-
-            // Execute command
-            exec_with_path(cmds[i].argv[0], cmds[i].argv);
-        }
-    }
-    
-    // Parent process: close all pipes
-    for (int i = 0; i < 2 * (num_cmds - 1); i++) 
-        close(pipefds[i]);
-    
-    // Check if the last command in pipeline is background
-    int is_background = cmds[num_cmds - 1].background;
-    
-    if (is_background) 
-    {
-        // Background pipeline - don't wait
-        // Put all processes in same process group (first child's PID)
-        pid_t pgid = pids[0];
-        for (int i = 0; i < num_cmds; i++) 
-        {
-            setpgid(pids[i], pgid);
-        }
-        
-        // Add the pipeline as a job (use last PID as representative)
-        char cmd_str[256] = "";
-        for (int i = 0; i < num_cmds && strlen(cmd_str) < 200; i++) 
-        {
-            if (i > 0) strncat(cmd_str, " | ", sizeof(cmd_str) - strlen(cmd_str) - 1);
-            strncat(cmd_str, cmds[i].argv[0], sizeof(cmd_str) - strlen(cmd_str) - 1);
-        }
-        
-        int job_num = add_job(pids[num_cmds - 1], pgid, cmd_str);
-        printf("[%d] %d\n", job_num, pids[num_cmds - 1]);
-    } 
-    else 
-    {
-        // Foreground pipeline - give terminal control and wait
-        pid_t pgid = pids[0];
-        
-        // Give terminal control to pipeline
-        if (tcsetpgrp(shell_terminal, pgid) < 0)
-        {
-            perror("tcsetpgrp");
-        }
-        
-        // Wait for the entire process group
-        // Use -pgid to wait for any process in the pipeline
-        int status;
-        pid_t result;
-        int num_finished = 0;
-        
-        while (num_finished < num_cmds)
-        {
-            result = waitpid(-pgid, &status, WUNTRACED);
-            
-            if (result < 0)
-                break;  // Error occurred
-            
-            if (WIFSTOPPED(status))
-            {
-                // Pipeline was stopped - create job
-                char cmd_str[256] = "";
-                for (int j = 0; j < num_cmds && strlen(cmd_str) < 200; j++) 
-                {
-                    if (j > 0) strncat(cmd_str, " | ", sizeof(cmd_str) - strlen(cmd_str) - 1);
-                    strncat(cmd_str, cmds[j].argv[0], sizeof(cmd_str) - strlen(cmd_str) - 1);
-                }
-                int job_num = add_job(pids[num_cmds - 1], pgid, cmd_str);
-                jobs[job_num - 1].state = JOB_STOPPED;
-                printf("\n[%d]+  Stopped    %s\n", job_num, cmd_str);
-                break;  // Exit wait loop
-            }
-            else if (WIFEXITED(status) || WIFSIGNALED(status))
-            {
-                num_finished++;
-                if (num_finished == num_cmds)
-                {
-                    // Last process finished - print status
-                    print_exit_status(status);
-                }
-            }
-        }
-        
-        // Return terminal control to shell
-        if (tcsetpgrp(shell_terminal, shell_pgid) < 0)
-        {
-            perror("tcsetpgrp");
-        }
-    }
-}
+/*
+ * executor.c - Pipeline execution and process management
+ */
+
+#include "../include/executor.h"
+#include "../include/builtins.h"
+#include "../include/expand.h"
+#include "../include/trace.h"
+#include "../include/stats.h"
+#include "../include/launcher.h"
+#include "../include/script.h"
+#include "../include/resolve.h"
+#include "../include/batch.h"
+#include "../include/joblog.h"
+#include "../include/fanout.h"
+#include "../include/deadline.h"
+#include "../include/coproc.h"
+#include "../include/limit.h"
+#include <signal.h>
+#include <termios.h>
+
+// Global job tracking
+Job jobs[MAX_JOBS];
+int next_job_num = 1;
+pid_t shell_pgid;
+int shell_terminal;
+int last_exit_status = 0;
+int interactive = 1;
+int noclobber = 0;
+
+// Helper function to update job status (called by SIGCHLD handler)
+static void update_job_status(pid_t pid, int status)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (jobs[i].pid == pid && jobs[i].state != JOB_DONE)
+        {
+            if (WIFEXITED(status) || WIFSIGNALED(status))
+            {
+                // Job completed
+                jobs[i].state = JOB_DONE;
+                stat_inc(STAT_JOBS_REAPED);
+                stat_record(HIST_RUN_US, (monotonic_ns() - jobs[i].start_ns) / 1000);
+            }
+            else if (WIFSTOPPED(status))
+            {
+                jobs[i].state = JOB_STOPPED;
+            }
+            else if (WIFCONTINUED(status))
+            {
+                jobs[i].state = JOB_RUNNING;
+            }
+            break;
+        }
+    }
+}
+
+// Format "pid N" for trace events without stdio (signal handler context)
+static void format_pid(char *buf, pid_t pid)
+{
+    char tmp[16];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + pid % 10;
+        pid /= 10;
+    } while (pid > 0);
+    memcpy(buf, "pid ", 4);
+    buf += 4;
+    while (n > 0)
+        *buf++ = tmp[--n];
+    *buf = '\0';
+}
+
+// SIGCHLD handler to reap zombie processes and update job status
+void sigchld_handler(int sig)
+{
+    (void)sig;  // Suppress unused parameter warning
+    int saved_errno = errno;
+    int status;
+    pid_t pid;
+    uint64_t t0 = trace_now();
+    stat_inc(STAT_SIGCHLD);
+    
+    // Reap all available zombie children
+    // WNOHANG: return immediately if no child has exited
+    // WUNTRACED: return if child has stopped
+    // WCONTINUED: return if stopped child has continued
+    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+    {
+        update_job_status(pid, status);
+        if (WIFSIGNALED(status))
+            stat_inc(STAT_CHILD_SIGNALED);
+        else if (WIFSTOPPED(status))
+            stat_inc(STAT_CHILD_STOPPED);
+        if (trace_enabled())
+        {
+            char detail[24];
+            format_pid(detail, pid);
+            trace_instant("reap", "reaper", detail);
+        }
+    }
+    trace_complete("sigchld", "reaper", t0, NULL);
+    
+    // Only restore errno if no real error occurred
+    // (ECHILD just means no more children, not an error)
+    if (pid == -1 && errno != ECHILD) {
+        // Real error occurred, keep the errno
+    } else {
+        errno = saved_errno;
+    }
+}
+
+// Check for completed jobs and print notifications
+void check_job_notifications(void)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (jobs[i].state == JOB_DONE && jobs[i].cmd_line != NULL)
+        {
+            printf("\n[%d]+  Done       %s\n", jobs[i].job_num, jobs[i].cmd_line);
+            free(jobs[i].cmd_line);
+            jobs[i].cmd_line = NULL;
+            jobs[i].job_num = 0;
+            jobs[i].pid = 0;
+            jobs[i].pgid = 0;
+        }
+    }
+    limit_reap();
+}
+
+// Add a background job to the jobs list
+int add_job(pid_t pid, pid_t pgid, const char *cmd_line, uint64_t start_ns) 
+{
+    // Block SIGCHLD to prevent race conditions
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    
+    int job_num = -1;
+    for (int i = 0; i < MAX_JOBS; i++) 
+    {
+        if (jobs[i].state == JOB_DONE) 
+        {
+            jobs[i].job_num = next_job_num++;
+            jobs[i].pid = pid;
+            jobs[i].pgid = pgid;
+            jobs[i].cmd_line = strdup(cmd_line);
+            jobs[i].state = JOB_RUNNING;
+            jobs[i].start_ns = start_ns;
+            job_num = jobs[i].job_num;
+            stat_inc(STAT_JOBS_CREATED);
+            break;
+        }
+    }
+    
+    // Restore signal mask
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return job_num;
+}
+
+// Hand the terminal to a process group (traced)
+int give_terminal(pid_t pgid)
+{
+    uint64_t t0 = trace_now();
+    int ret = tcsetpgrp(shell_terminal, pgid);
+    if (ret < 0)
+    {
+        perror("tcsetpgrp");
+    }
+    trace_complete("tcsetpgrp", "terminal", t0, pgid == shell_pgid ? "shell" : "job");
+    return ret;
+}
+
+// Execution with manual PATH search + execve
+void exec_with_path(const char *cmd, char **argv) 
+{
+    uint64_t t0 = trace_now();
+
+    // If it contains '/', try directly
+    if (strchr(cmd, '/')) 
+    {
+        trace_complete("exec", "exec", t0, cmd);
+        execve(cmd, argv, environ);
+        perror("execve");
+        _exit(127);
+    }
+
+    char *path = getenv("PATH");
+    if (!path) 
+    {
+        fprintf(stderr, "No PATH set\n");
+        _exit(127);
+    }
+
+    char *path_copy = strdup(path);
+    if (!path_copy) 
+    {
+        perror("strdup");
+        _exit(127);
+    }
+
+    char full[PATH_MAX_LEN];
+    for (char *dir = strtok(path_copy, ":"); dir; dir = strtok(NULL, ":")) 
+    {
+        snprintf(full, sizeof(full), "%s/%s", dir, cmd);
+        if (access(full, X_OK) == 0) 
+        {
+            // Span covers PATH resolution up to the execve call
+            trace_complete("exec", "exec", t0, full);
+            execve(full, argv, environ);
+            perror("execve");
+            free(path_copy);
+            _exit(127);
+        }
+    }
+
+    trace_complete("exec-not-found", "exec", t0, cmd);
+    fprintf(stderr, "%s%s: command not found%s\n", COLOR_RED, cmd, COLOR_RESET);
+    free(path_copy);
+    _exit(127);
+}
+
+// Execute an already resolved program; a stale PATH hash falls back to a search
+void exec_resolved(const char *path, char **argv) 
+{
+    uint64_t t0 = trace_now();
+    trace_complete("exec", "exec", t0, path);
+    execve(path, argv, environ);
+    if (errno == ENOENT && !strchr(argv[0], '/'))
+        exec_with_path(argv[0], argv);
+    perror(argv[0]);
+    _exit(errno == ENOENT ? 127 : 126);
+}
+
+// Display process termination information
+void print_exit_status(int status) 
+{
+    if (WIFEXITED(status)) 
+    {
+        int code = WEXITSTATUS(status);
+        printf("%s[exit status: %d]%s\n", COLOR_BLUE, code, COLOR_RESET);
+    } 
+    else if (WIFSIGNALED(status)) 
+    {
+        int sig = WTERMSIG(status);
+        printf("%s[terminated by signal: %s]%s\n", COLOR_BLUE, strsignal(sig), COLOR_RESET);
+    }
+}
+
+// Convert a waitpid status to a shell exit code ($?)
+int status_to_code(int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status))
+        return 128 + WSTOPSIG(status);
+    return 0;
+}
+
+// Restore default handlers for the signals the shell ignores
+void reset_child_signals(void)
+{
+    struct sigaction sa;
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTSTP, &sa, NULL);
+    sigaction(SIGTTIN, &sa, NULL);
+    sigaction(SIGTTOU, &sa, NULL);
+    sigaction(SIGPIPE, &sa, NULL); // Ignored once the shell has a coprocess
+
+    // The shell blocks SIGCHLD around launches; the mask survives exec
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+// Run a command in the current (child) process: never returns
+void exec_command(Command *cmd)
+{
+    resolve_command(cmd);
+
+    // Leading NAME=value words only affect this command's environment
+    for (int i = 0; i < cmd->first; i++)
+    {
+        size_t name_len = assignment_name_len(cmd->argv[i]);
+        cmd->argv[i][name_len] = '\0';
+        setenv(cmd->argv[i], cmd->argv[i] + name_len + 1, 1);
+        cmd->argv[i][name_len] = '=';
+    }
+
+    setup_redirection(cmd);
+    char **argv = cmd->argv + cmd->first;
+    int argc = cmd->argc - cmd->first;
+    int code = 0;
+    switch ((CmdKind)cmd->kind)
+    {
+    case CMD_FUNCTION:
+        // Pipeline stage running a function: no job control in here
+        interactive = 0;
+        code = script_call(argc, argv);
+        break;
+    case CMD_BUILTIN:
+        code = cmd->builtin->fn(argc, argv);
+        break;
+    case CMD_EXTERNAL:
+        exec_resolved(cmd->path, argv);
+        break;
+    case CMD_BATCH:
+        code = batch_run(cmd);
+        break;
+    case CMD_GROUP:
+        // ( ) or { } stage: runs without job control, like a function
+        interactive = 0;
+        code = script_run_group(cmd->group, cmd->group_pc);
+        break;
+    case CMD_NOT_FOUND:
+        fprintf(stderr, "%s%s: command not found%s\n", COLOR_RED, argv[0], COLOR_RESET);
+        code = 127;
+        break;
+    default:
+        break;
+    }
+    fflush(stdout);
+    _exit(code & 0xff);
+}
+
+// Apply NAME=value words to the shell itself (command is only assignments)
+static void apply_assignments(Command *cmd)
+{
+    for (int i = 0; i < cmd->argc; i++)
+    {
+        size_t name_len = assignment_name_len(cmd->argv[i]);
+        cmd->argv[i][name_len] = '\0';
+        setenv(cmd->argv[i], cmd->argv[i] + name_len + 1, 1);
+        cmd->argv[i][name_len] = '=';
+    }
+}
+
+// Open the file of one redirection, honoring set -C; returns the fd or -1
+static int open_target(const Redirect *r)
+{
+    switch (r->op)
+    {
+    case REDIR_IN:
+        return open(r->target, O_RDONLY | O_CLOEXEC);
+    case REDIR_RDWR:
+        return open(r->target, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    case REDIR_APPEND:
+        return open(r->target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    case REDIR_OUT:
+        if (noclobber)
+        {
+            // Only regular files are protected: > /dev/null still works
+            int fd = open(r->target, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd >= 0 || errno != EEXIST)
+                return fd;
+            struct stat st;
+            fd = open(r->target, O_WRONLY | O_CLOEXEC);
+            if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+            {
+                close(fd);
+                errno = EEXIST;
+                return -1;
+            }
+            return fd;
+        }
+        // fall through
+    default:
+        return open(r->target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+}
+
+// Open every file a command redirects to, in the shell, before anything is spawned
+int open_redirections(Command *cmd)
+{
+    unsigned valid = 0x7; // Descriptors a dup may copy: stdio and earlier targets
+    for (int i = 0; i < cmd->num_redirs; i++)
+    {
+        Redirect *r = &cmd->redirs[i];
+        r->opened = -1;
+        if (r->op == REDIR_CLOSE)
+        {
+            valid &= ~(1u << r->fd);
+            continue;
+        }
+        if (r->op == REDIR_DUP)
+        {
+            if (r->src < 0 || r->src > REDIR_FD_MAX || !(valid & (1u << r->src)))
+            {
+                fprintf(stderr, "%s%d: bad file descriptor%s\n", COLOR_RED, r->src, COLOR_RESET);
+                close_redirections(cmd);
+                return -1;
+            }
+            valid |= 1u << r->fd;
+            continue;
+        }
+        if (r->op == REDIR_COPROC)
+        {
+            int end = coproc_fd(r->target, r->src);
+            r->opened = end < 0 ? -1 : fcntl(end, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+            if (r->opened < 0)
+            {
+                if (end >= 0)
+                    perror("fcntl");
+                close_redirections(cmd);
+                return -1;
+            }
+            valid |= 1u << r->fd;
+            continue;
+        }
+
+        int fd = open_target(r);
+        if (fd >= 0 && fd < REDIR_FD_MIN)
+        {
+            // Keep it clear of the descriptors the child will dup2 onto
+            int high = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+            close(fd);
+            fd = high;
+        }
+        if (fd < 0)
+        {
+            if (errno == EEXIST && r->op == REDIR_OUT)
+                fprintf(stderr, "%s%s: cannot overwrite existing file%s\n", COLOR_RED, r->target, COLOR_RESET);
+            else
+                fprintf(stderr, "%s%s: %s%s\n", COLOR_RED, r->target, strerror(errno), COLOR_RESET);
+            close_redirections(cmd);
+            return -1;
+        }
+        r->opened = fd;
+        valid |= 1u << r->fd;
+    }
+    return 0;
+}
+
+// Close the shell's copies of a command's redirection files
+void close_redirections(Command *cmd)
+{
+    for (int i = 0; i < cmd->num_redirs; i++)
+    {
+        if (cmd->redirs[i].opened >= 0)
+            close(cmd->redirs[i].opened);
+        cmd->redirs[i].opened = -1;
+    }
+}
+
+// Apply a command's redirections in the child; the files are already open
+void setup_redirection(Command *cmd) 
+{
+    if (cmd->num_redirs == 0)
+        return;
+    uint64_t t0 = trace_now();
+
+    // Several targets for stdout (cmd > a > b, or cmd > a | next): copy the output to each
+    int fanout = fanout_needed(cmd);
+    int fanned = 0;
+
+    for (int i = 0; i < cmd->num_redirs; i++)
+    {
+        Redirect *r = &cmd->redirs[i];
+        if (fanout && fanout_target(r))
+        {
+            // Left to right: stdout becomes the fan-out pipe at its first
+            // target, so an earlier 2>&1 still gets the original stdout
+            if (!fanned)
+                fanout_output(cmd);
+            fanned = 1;
+            continue;
+        }
+        if (r->op == REDIR_CLOSE)
+        {
+            close(r->fd);
+            continue;
+        }
+        int from = r->op == REDIR_DUP ? r->src : r->opened;
+        if (from != r->fd && dup2(from, r->fd) < 0)
+        {
+            fprintf(stderr, "%s%d: %s%s\n", COLOR_RED, from, strerror(errno), COLOR_RESET);
+            _exit(1);
+        }
+    }
+
+    // Builtins and functions don't exec, so drop the originals here
+    close_redirections(cmd);
+
+    trace_complete("redirect", "redirect", t0, cmd->argv[0]);
+}
+
+// Redirect the shell's own descriptors for a { } group
+int redirect_shell(Command *cmd, RedirSave *save)
+{
+    if (open_redirections(cmd) < 0)
+        return -1;
+
+    // Output buffered so far belongs to the old descriptors
+    fflush(stdout);
+    fflush(stderr);
+    for (int fd = 0; fd <= REDIR_FD_MAX; fd++)
+        save->saved[fd] = -2;
+    for (int i = 0; i < cmd->num_redirs; i++)
+    {
+        Redirect *r = &cmd->redirs[i];
+        if (save->saved[r->fd] == -2)
+            save->saved[r->fd] = fcntl(r->fd, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+        if (r->op == REDIR_CLOSE)
+        {
+            close(r->fd);
+            continue;
+        }
+        int from = r->op == REDIR_DUP ? r->src : r->opened;
+        if (from != r->fd && dup2(from, r->fd) < 0)
+        {
+            fprintf(stderr, "%s%d: %s%s\n", COLOR_RED, from, strerror(errno), COLOR_RESET);
+            restore_redirections(save);
+            close_redirections(cmd);
+            return -1;
+        }
+    }
+    close_redirections(cmd);
+    return 0;
+}
+
+// Put back the descriptors a { } group replaced
+void restore_redirections(RedirSave *save)
+{
+    fflush(stdout);
+    fflush(stderr);
+    for (int fd = 0; fd <= REDIR_FD_MAX; fd++)
+    {
+        if (save->saved[fd] == -2)
+            continue;
+        if (save->saved[fd] >= 0)
+        {
+            dup2(save->saved[fd], fd);
+            close(save->saved[fd]);
+        }
+        else
+        {
+            close(fd);
+        }
+        save->saved[fd] = -2;
+    }
+}
+
+// Start one command through the launcher if possible, otherwise fork()
+// Returns 0 in a forked child (which must set itself up), the pid in the parent
+static pid_t spawn_command(Command *cmd, int in_fd, int out_fd, int err_fd, pid_t pgid)
+{
+    uint64_t t_trace = trace_now();
+    uint64_t t0 = monotonic_ns();
+    const char *name = cmd->argv[0];
+
+    // Stages of a limited job join its cgroup themselves, so they are forked here
+    pid_t pid = limit_active() ? -1 : launcher_spawn(cmd, in_fd, out_fd, err_fd, pgid);
+    if (pid > 0)
+    {
+        stat_inc(STAT_LAUNCHER_SPAWNS);
+        stat_inc(STAT_COMMANDS);
+        stat_record(HIST_FORK_NS, monotonic_ns() - t0);
+        trace_complete("spawn", "fork", t_trace, name);
+        return pid;
+    }
+
+    // Children that run builtins flush stdio on exit: don't let them repeat our output
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        coproc_close_child();
+        limit_enter_child();
+    }
+    if (pid > 0)
+    {
+        limit_forked(pid);
+        stat_inc(STAT_FORKS);
+        stat_inc(STAT_COMMANDS);
+        stat_record(HIST_FORK_NS, monotonic_ns() - t0);
+        trace_complete("fork", "fork", t_trace, name);
+    }
+    return pid;
+}
+
+// Describe a pipeline for the job table: every word and redirection, untruncated
+// (caller must free)
+static char *job_text(Command cmds[], int num_cmds)
+{
+    static const char *const ops[] = { "<", ">", ">|", ">>", "<>", ">&", ">&-", ">&p" };
+    StrBuf sb;
+    sb_init(&sb);
+    for (int i = 0; i < num_cmds; i++)
+    {
+        if (i > 0)
+            sb_append(&sb, " | ", 3);
+        for (int j = 0; j < cmds[i].argc; j++)
+        {
+            if (j > 0)
+                sb_putc(&sb, ' ');
+            sb_append(&sb, cmds[i].argv[j], strlen(cmds[i].argv[j]));
+        }
+        for (int j = 0; j < cmds[i].num_redirs; j++)
+        {
+            const Redirect *r = &cmds[i].redirs[j];
+            char buf[32];
+            int default_fd = r->op == REDIR_IN || r->op == REDIR_RDWR || (r->op == REDIR_COPROC && r->src == PIPE_READ) ? 0 : 1;
+            int n = r->fd == default_fd ? 0 : snprintf(buf, sizeof(buf), "%d", r->fd);
+            n += snprintf(buf + n, sizeof(buf) - n, "%s", ops[r->op]);
+            if (r->op == REDIR_DUP)
+                n += snprintf(buf + n, sizeof(buf) - n, "%d", r->src);
+            if (r->op == REDIR_COPROC)
+                n += snprintf(buf + n, sizeof(buf) - n, "%s", r->target ? ":" : "");
+            sb_putc(&sb, ' ');
+            sb_append(&sb, buf, n);
+            if (r->target)
+                sb_append(&sb, r->target, strlen(r->target));
+        }
+    }
+    if (!sb.data)
+        return strdup("");
+    return sb.data;
+}
+
+// Launch a single external command (SIGCHLD blocked by the caller)
+// in_fd and out_fd are its stdin and stdout; log_fd, if not -1, receives
+// the stderr of a background job; limit, if not NULL, is how long the
+// command may run. Returns its pid, or -1
+static pid_t launch_single(Command *cmd, int in_fd, int out_fd, int log_fd, const DeadlineSpec *limit, uint64_t t_start)
+{
+    int err_fd = log_fd >= 0 ? log_fd : STDERR_FILENO;
+    pid_t pid = spawn_command(cmd, in_fd, out_fd, err_fd, interactive ? 0 : -1);
+    if (pid < 0) 
+    {
+        perror("fork");
+        return -1;
+    }
+    
+    if (pid == 0) 
+    {
+        // Restore default signal handlers in child
+        reset_child_signals();
+
+        // Child process
+        // Create new process group (both foreground and background)
+        if (interactive)
+            setpgid(0, 0);
+        if ((in_fd != STDIN_FILENO && dup2(in_fd, STDIN_FILENO) < 0) ||
+            (out_fd != STDOUT_FILENO && dup2(out_fd, STDOUT_FILENO) < 0) ||
+            (err_fd != STDERR_FILENO && dup2(err_fd, STDERR_FILENO) < 0)) 
+        {
+            perror("dup2");
+            _exit(1);
+        }
+        
+        exec_command(cmd);
+    } 
+    else if (!interactive) 
+    {
+        // Non-interactive (e.g. inside $(...)): no job control, just wait
+        int dl = limit ? deadline_add(limit, 0, &pid, 1, cmd->argv[0]) : -1;
+        int status = 0;
+        if (!cmd->background && deadline_waitpid(pid, &status, 0) > 0)
+        {
+            last_exit_status = deadline_fired(dl) == 1 ? TIMEOUT_STATUS : status_to_code(status);
+            stat_record(HIST_RUN_US, (monotonic_ns() - t_start) / 1000);
+        }
+        if (!cmd->background)
+            deadline_cancel(dl);
+    }
+    else 
+    {
+        // Parent process
+        pid_t pgid = pid;  // Use child's PID as process group ID
+        setpgid(pid, pgid);
+        int dl = limit ? deadline_add(limit, pgid, &pid, 1, cmd->argv[0]) : -1;
+        
+        if (cmd->background) 
+        {
+            // Background job - don't wait
+            // Add to job list and print job info
+            char *cmd_str = job_text(cmd, 1);
+            int job_num = add_job(pid, pgid, cmd_str, t_start);
+            if (log_fd >= 0)
+                joblog_attach(job_num, cmd_str);
+            printf("[%d] %d\n", job_num, pid);
+            free(cmd_str);
+        } 
+        else 
+        {
+            // Foreground job - give it terminal control
+            give_terminal(pgid);
+            
+            // Wait for completion or stop
+            int status;
+            uint64_t t_wait = trace_now();
+            deadline_waitpid(pid, &status, WUNTRACED);
+            trace_complete("wait", "wait", t_wait, cmd->argv[0]);
+            
+            // Take back terminal control
+            give_terminal(shell_pgid);
+            
+            if (WIFSTOPPED(status)) {
+                // Job was stopped (Ctrl-Z)
+                char *cmd_str = job_text(cmd, 1);
+                int job_num = add_job(pid, pgid, cmd_str, t_start);
+                jobs[job_num - 1].state = JOB_STOPPED;
+                printf("\n[%d]+  Stopped    %s\n", job_num, cmd_str);
+                free(cmd_str);
+            } else {
+                print_exit_status(status);
+                stat_record(HIST_RUN_US, (monotonic_ns() - t_start) / 1000);
+            }
+            last_exit_status = status_to_code(status);
+            if (!WIFSTOPPED(status))
+            {
+                // A stopped job keeps its deadline
+                if (deadline_fired(dl) == 1)
+                    last_exit_status = TIMEOUT_STATUS;
+                deadline_cancel(dl);
+            }
+        }
+    }
+    return pid;
+}
+
+// Launch a multi-stage pipeline (SIGCHLD blocked by the caller)
+// first_in is the first stage's stdin and last_out the last stage's stdout;
+// log_fd, if not -1, receives every stage's stderr; limit, if not NULL, is
+// how long the whole pipeline may run. Returns the last stage's pid, or -1
+static pid_t launch_multi(Command cmds[], int num_cmds, int first_in, int last_out, int log_fd, const DeadlineSpec *limit, uint64_t t_start)
+{
+    // Stages are connected one at a time, so at most two pipes are open in
+    // the shell and each child only inherits the ends it uses
+    pid_t pids[num_cmds];
+    int in_fd = first_in; // Read end of the previous stage's pipe
+    for (int i = 0; i < num_cmds; i++) 
+    {
+        int fds[2] = { -1, -1 };
+        if (i < num_cmds - 1 && pipe2(fds, O_CLOEXEC) < 0) 
+        {
+            perror("pipe");
+            if (in_fd != first_in) 
+                close(in_fd);
+            num_cmds = i;  // Wait for the stages already running
+            break;
+        }
+        int out_fd = (i < num_cmds - 1) ? fds[PIPE_WRITE] : last_out;
+        cmds[i].pipe_out = i < num_cmds - 1;
+        int err_fd = log_fd >= 0 ? log_fd : STDERR_FILENO;
+        pid_t pgid = !interactive ? -1 : (i == 0 ? 0 : pids[0]);
+        pids[i] = spawn_command(&cmds[i], in_fd, out_fd, err_fd, pgid);
+        
+        if (pids[i] == 0) 
+        {
+            // Child process
+            // Create process group for first child, join for others
+            // (without job control every stage stays in the caller's group)
+            if (interactive && i == 0)
+                setpgid(0, 0);  // First child creates new process group
+            else if (interactive)
+                setpgid(0, pids[0]);  // Others join the first child's group
+            
+            // Restore default signal handlers in child
+            reset_child_signals();
+
+            // Connect this stage's pipe ends (dup2 clears close-on-exec)
+            if ((in_fd != STDIN_FILENO && dup2(in_fd, STDIN_FILENO) < 0) ||
+                (out_fd != STDOUT_FILENO && dup2(out_fd, STDOUT_FILENO) < 0) ||
+                (err_fd != STDERR_FILENO && dup2(err_fd, STDERR_FILENO) < 0)) 
+            {
+                perror("dup2");
+                _exit(1);
+            }
+
+            // Functions, groups and builtins never exec, so close-on-exec alone
+            // would leave this stage holding its own pipe's read end: it would
+            // never get SIGPIPE once the reader is gone
+            if (fds[PIPE_READ] >= 0)
+                close(fds[PIPE_READ]);
+            if (in_fd > STDERR_FILENO)
+                close(in_fd);
+            if (out_fd > STDERR_FILENO)
+                close(out_fd);
+
+            // Pipes are O_CLOEXEC already; one call covers anything else inherited
+            close_range(3, ~0U, CLOSE_RANGE_CLOEXEC);
+
+            // Set up file redirections (applied AFTER pipe setup) and execute
+            exec_command(&cmds[i]);
+        }
+        
+        // Parent: the child owns its ends now
+        if (in_fd != first_in) 
+            close(in_fd);
+        if (out_fd != last_out) 
+            close(out_fd);
+        in_fd = fds[PIPE_READ];
+        
+        if (pids[i] < 0) 
+        {
+            perror("fork");
+            if (in_fd >= 0) 
+                close(in_fd);
+            num_cmds = i;
+            break;
+        }
+        if (interactive)
+            setpgid(pids[i], i == 0 ? pids[i] : pids[0]);  // Parent side too, avoids the race with the child
+    }
+    if (num_cmds == 0) 
+        return -1;
+    
+    // Check if the last command in pipeline is background
+    int is_background = cmds[num_cmds - 1].background;
+    
+    // One deadline covers every stage (the whole group when there is one)
+    int dl = limit ? deadline_add(limit, interactive ? pids[0] : 0, pids, num_cmds, cmds[0].argv[0]) : -1;
+    
+    if (!interactive) 
+    {
+        // Non-interactive: wait for each stage; $? is the last stage's status
+        for (int i = 0; i < num_cmds && !is_background; i++) 
+        {
+            int status = 0;
+            if (deadline_waitpid(pids[i], &status, 0) > 0 && i == num_cmds - 1)
+            {
+                last_exit_status = deadline_fired(dl) == 1 ? TIMEOUT_STATUS : status_to_code(status);
+                stat_record(HIST_RUN_US, (monotonic_ns() - t_start) / 1000);
+            }
+        }
+        if (!is_background)
+            deadline_cancel(dl);
+    }
+    else if (is_background) 
+    {
+        // Background pipeline - don't wait
+        // Put all processes in same process group (first child's PID)
+        pid_t pgid = pids[0];
+        for (int i = 0; i < num_cmds; i++) 
+        {
+            setpgid(pids[i], pgid);
+        }
+        
+        // Add the pipeline as a job (use last PID as representative)
+        char *cmd_str = job_text(cmds, num_cmds);
+        int job_num = add_job(pids[num_cmds - 1], pgid, cmd_str, t_start);
+        if (log_fd >= 0)
+            joblog_attach(job_num, cmd_str);
+        printf("[%d] %d\n", job_num, pids[num_cmds - 1]);
+        free(cmd_str);
+    } 
+    else 
+    {
+        // Foreground pipeline - give terminal control and wait
+        pid_t pgid = pids[0];
+        
+        // Give terminal control to pipeline
+        give_terminal(pgid);
+        
+        // Wait for the entire process group
+        // Use -pgid to wait for any process in the pipeline
+        int status;
+        pid_t result;
+        int num_finished = 0;
+        uint64_t t_wait = trace_now();
+        
+        while (num_finished < num_cmds)
+        {
+            result = deadline_waitpid(-pgid, &status, WUNTRACED);
+            
+            if (result < 0)
+                break;  // Error occurred
+            
+            if (WIFSTOPPED(status))
+            {
+                // Pipeline was stopped - create job
+                char *cmd_str = job_text(cmds, num_cmds);
+                int job_num = add_job(pids[num_cmds - 1], pgid, cmd_str, t_start);
+                jobs[job_num - 1].state = JOB_STOPPED;
+                printf("\n[%d]+  Stopped    %s\n", job_num, cmd_str);
+                free(cmd_str);
+                break;  // Exit wait loop
+            }
+            else if (WIFEXITED(status) || WIFSIGNALED(status))
+            {
+                num_finished++;
+                if (num_finished == num_cmds)
+                {
+                    // Last process finished - print status
+                    print_exit_status(status);
+                    last_exit_status = deadline_fired(dl) == 1 ? TIMEOUT_STATUS : status_to_code(status);
+                    stat_record(HIST_RUN_US, (monotonic_ns() - t_start) / 1000);
+                    deadline_cancel(dl);
+                }
+            }
+        }
+        
+        trace_complete("wait", "wait", t_wait, cmds[num_cmds - 1].argv[0]);
+        
+        // Return terminal control to shell
+        give_terminal(shell_pgid);
+    }
+    return pids[num_cmds - 1];
+}
+
+// Launch a parsed pipeline (words already expanded)
+static void launch_pipeline(Command cmds[], int num_cmds) 
+{
+    // Leading timeout, limit and coproc words apply to the whole pipeline,
+    // enforced by the shell; each may appear once, in any order
+    DeadlineSpec spec;
+    const DeadlineSpec *limit = NULL;
+    LimitSpec res;
+    int limited = 0;
+    const char *coproc_name = NULL;
+    while (cmds[0].kind == CMD_BUILTIN && cmds[0].first == 0) 
+    {
+        BuiltinFn fn = cmds[0].builtin->fn;
+        int start = 0;
+        if (fn == builtin_timeout && !limit) 
+        {
+            start = timeout_parse(cmds[0].argc, cmds[0].argv, &spec);
+            if (start < 0) 
+            {
+                last_exit_status = 125;
+                return;
+            }
+            if (spec.duration_ns > 0) 
+                limit = &spec;
+        }
+        else if (fn == builtin_limit && !limited && cmds[0].argc > 1) 
+        {
+            // limit ... %JOB is the builtin itself
+            start = limit_parse(cmds[0].argc, cmds[0].argv, &res);
+            if (start < 0) 
+            {
+                last_exit_status = 125;
+                return;
+            }
+            if (start == cmds[0].argc || cmds[0].argv[start][0] == '%') 
+                break;
+            limited = 1;
+        }
+        else if (fn == builtin_coproc && !coproc_name && cmds[0].argc > 2 && cmds[0].argv[1][0] != '-') 
+        {
+            // coproc NAME pipeline: a background job whose stdin and stdout are the shell's
+            coproc_name = cmds[0].argv[1];
+            if (!coproc_valid_name(coproc_name)) 
+            {
+                fprintf(stderr, "%scoproc: %s: invalid name%s\n", COLOR_RED, coproc_name, COLOR_RESET);
+                last_exit_status = 2;
+                return;
+            }
+            start = 2;
+            cmds[num_cmds - 1].background = 1;
+        }
+        else 
+            break;
+        cmds[0].argc -= start;
+        memmove(cmds[0].argv, cmds[0].argv + start, sizeof(char *) * (cmds[0].argc + 1));
+        cmds[0].kind = CMD_UNRESOLVED;
+        resolve_command(&cmds[0]);
+    }
+    int prefixed = limit || limited || coproc_name;
+    
+    // Builtins run in the shell itself (a single command without a prefix);
+    // their redirections are applied to the shell's descriptors and put back
+    // after. Several stdout targets need the fan-out of a forked stage.
+    if (num_cmds == 1 && !prefixed && cmds[0].num_redirs > 0 && !fanout_needed(&cmds[0]) &&
+        cmds[0].kind == CMD_BUILTIN && cmds[0].first == 0 && !(cmds[0].builtin->flags & BUILTIN_STAGE)) 
+    {
+        RedirSave save;
+        if (redirect_shell(&cmds[0], &save) < 0) 
+        {
+            last_exit_status = 1;
+            return;
+        }
+        stat_inc(STAT_BUILTINS);
+        last_exit_status = cmds[0].builtin->fn(cmds[0].argc, cmds[0].argv);
+        restore_redirections(&save);
+        return;
+    }
+    if (num_cmds == 1 && cmds[0].num_redirs == 0 && !prefixed) 
+    {
+        if (cmds[0].kind == CMD_ASSIGN) 
+        {
+            // NAME=$(cmd) keeps the substitution's status, as in POSIX shells
+            apply_assignments(&cmds[0]);
+            if (!cmds[0].substituted) 
+                last_exit_status = 0;
+            return;
+        }
+        if (cmds[0].kind == CMD_BUILTIN && cmds[0].first == 0 && !(cmds[0].builtin->flags & BUILTIN_STAGE)) 
+        {
+            stat_inc(STAT_BUILTINS);
+            last_exit_status = cmds[0].builtin->fn(cmds[0].argc, cmds[0].argv);
+            return;
+        } 
+        if (cmds[0].kind == CMD_BATCH && !cmds[0].background) 
+        {
+            last_exit_status = batch_run(&cmds[0]);
+            return;
+        }
+    }
+    
+    // Open and check every redirection first: a bad one costs no process
+    for (int i = 0; i < num_cmds; i++) 
+    {
+        if (open_redirections(&cmds[i]) < 0) 
+        {
+            while (i-- > 0) 
+                close_redirections(&cmds[i]);
+            last_exit_status = 1;
+            return;
+        }
+    }
+    
+    int limit_id = limited ? limit_begin(&res) : -1;
+    if (limited && limit_id < 0) 
+    {
+        for (int i = 0; i < num_cmds; i++) 
+            close_redirections(&cmds[i]);
+        last_exit_status = 1;
+        return;
+    }
+    
+    stat_inc(STAT_PIPELINES);
+    stat_record(HIST_PIPELINE_DEPTH, num_cmds);
+    uint64_t t_start = monotonic_ns();
+    
+    // Keep the SIGCHLD handler from reaping foreground children before they
+    // are waited for, and background ones before they are in the job table
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    
+    // With joblog on, background jobs write to a pipe the shell drains
+    int log_fd = interactive && cmds[num_cmds - 1].background ? joblog_pipe() : -1;
+    int in_fd = STDIN_FILENO;
+    int out_fd = log_fd >= 0 ? log_fd : STDOUT_FILENO;
+    int coproc_ends[2];
+    if (coproc_name) 
+    {
+        if (coproc_open(coproc_ends) < 0) 
+        {
+            if (log_fd >= 0) 
+            {
+                close(log_fd);
+                joblog_discard();
+            }
+            for (int i = 0; i < num_cmds; i++) 
+                close_redirections(&cmds[i]);
+            limit_launched(limit_id, -1);
+            sigprocmask(SIG_SETMASK, &prev, NULL);
+            last_exit_status = 1;
+            return;
+        }
+        in_fd = coproc_ends[0];
+        out_fd = coproc_ends[1];
+    }
+    
+    pid_t last;
+    if (num_cmds == 1) 
+        last = launch_single(&cmds[0], in_fd, out_fd, log_fd, limit, t_start);
+    else 
+        last = launch_multi(cmds, num_cmds, in_fd, out_fd, log_fd, limit, t_start);
+    
+    if (coproc_name) 
+    {
+        close(coproc_ends[0]);
+        close(coproc_ends[1]);
+        if (last > 0) 
+            coproc_commit(coproc_name, last);
+        else 
+            coproc_abort();
+    }
+    limit_launched(limit_id, last);
+    if (log_fd >= 0) 
+    {
+        close(log_fd);
+        joblog_discard();
+    }
+    for (int i = 0; i < num_cmds; i++) 
+        close_redirections(&cmds[i]);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+// Run a pipeline whose words are already expanded
+void run_pipeline(Command cmds[], int num_cmds) 
+{
+    // A command that expanded to nothing (e.g. "$(true)") keeps the substitution's status
+    if (num_cmds == 0 || (num_cmds == 1 && cmds[0].argc == 0 && cmds[0].kind != CMD_GROUP)) 
+        return;
+    
+    // Decide what each stage runs once, before any branch looks at it
+    for (int i = 0; i < num_cmds; i++) 
+        resolve_command(&cmds[i]);
+    
+    uint64_t t0 = trace_now();
+    launch_pipeline(cmds, num_cmds);
+    trace_complete("pipeline", "pipeline", t0, cmds[0].argc > 0 ? cmds[0].argv[0] : NULL);
+}
+
+// Execute a pipeline of commands
+void execute_pipeline(Command cmds[], int num_cmds) 
+{
+    if (num_cmds == 0) 
+        return;
+    
+    // Expand $VAR and $(...) in every stage before anything is launched; each
+    // stage gets its own arena, as growing one moves the words already in it
+    StrBuf *arenas = calloc(num_cmds, sizeof(StrBuf));
+    if (!arenas) 
+    {
+        perror("calloc");
+        last_exit_status = 1;
+        return;
+    }
+    int ok = 1;
+    for (int i = 0; i < num_cmds && ok; i++) 
+    {
+        if (expand_command(&cmds[i], &arenas[i]) < 0) 
+        {
+            fprintf(stderr, "%sexpansion failed%s\n", COLOR_RED, COLOR_RESET);
+            last_exit_status = 1;
+            ok = 0;
+        }
+    }
+    
+    if (ok) 
+        run_pipeline(cmds, num_cmds);
+    
+    for (int i = 0; i < num_cmds; i++) 
+        sb_free(&arenas[i]);
+    free(arenas);
+}
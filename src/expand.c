@@ -0,0 +1,444 @@
+/*
+ * expand.c - Variable and command substitution
+ */
+
+#include "../include/expand.h"
+#include "../include/parser.h"
+#include "../include/executor.h"
+#include "../include/builtins.h"
+#include "../include/script.h"
+#include "../include/resolve.h"
+#include <ctype.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#define CAPTURE_CHUNK 65536 // Bytes requested per read() while capturing
+
+int positional_argc = 0;
+char **positional_argv = NULL;
+
+static unsigned long subst_runs; // Command substitutions started so far
+
+// Read everything from fd into out using large reads
+static void read_all(int fd, StrBuf *out)
+{
+    for (;;)
+    {
+        if (sb_reserve(out, CAPTURE_CHUNK) < 0)
+        {
+            perror("realloc");
+            return;
+        }
+        ssize_t n = read(fd, out->data + out->len, CAPTURE_CHUNK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        out->len += n;
+        out->data[out->len] = '\0';
+    }
+}
+
+// Run a side-effect-free builtin with stdout pointed at an in-memory file
+static int capture_builtin(const Builtin *b, Command *cmd, StrBuf *out, int *status)
+{
+    fflush(stdout);
+    int mfd = memfd_create("tinyshell-subst", MFD_CLOEXEC);
+    if (mfd < 0)
+        return -1;
+    int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (saved < 0)
+    {
+        close(mfd);
+        return -1;
+    }
+
+    dup2(mfd, STDOUT_FILENO);
+    *status = b->fn(cmd->argc, cmd->argv);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    lseek(mfd, 0, SEEK_SET);
+    read_all(mfd, out);
+    close(mfd);
+    return 0;
+}
+
+// Run a command line in a child with stdout connected to a pipe the shell drains
+static int capture_forked(const char *text, StrBuf *out)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    // Keep the SIGCHLD handler from reaping the child before we wait for it
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        close(fds[PIPE_READ]);
+        close(fds[PIPE_WRITE]);
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return 1;
+    }
+
+    if (pid == 0)
+    {
+        // Child: behaves like a non-interactive subshell
+        dup2(fds[PIPE_WRITE], STDOUT_FILENO);
+        reset_child_signals();
+        signal(SIGCHLD, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        interactive = 0;
+
+        script_eval(text);
+        fflush(stdout);
+        _exit(last_exit_status & 0xff);
+    }
+
+    // Parent: drain the pipe, then collect the child's status
+    close(fds[PIPE_WRITE]);
+    read_all(fds[PIPE_READ], out);
+    close(fds[PIPE_READ]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return status_to_code(status);
+}
+
+// Check whether text is a single command naming a pure builtin
+static const Builtin* pure_builtin_command(const char *text)
+{
+    while (*text == ' ' || *text == '\t')
+        text++;
+    size_t len = strcspn(text, " \t\n");
+    char name[32];
+    if (len == 0 || len >= sizeof(name))
+        return NULL;
+    memcpy(name, text, len);
+    name[len] = '\0';
+
+    // Anything beyond a plain pipeline-free command goes to a subshell
+    if (strpbrk(text, "|&;<>(){}\n"))
+        return NULL;
+    NameEntry *e = name_find(name);
+    if (!e || e->alias || e->func || !e->builtin)
+        return NULL;
+    return (e->builtin->flags & BUILTIN_PURE) ? e->builtin : NULL;
+}
+
+// Run a command line and capture its standard output
+int capture_output(const char *src, size_t len, StrBuf *out)
+{
+    subst_runs++;
+    char *text = strndup(src, len);
+    if (!text)
+    {
+        perror("strndup");
+        return 1;
+    }
+
+    size_t start = out->len;
+    int status = 1;
+    const Builtin *b = pure_builtin_command(text);
+    if (b)
+    {
+        // Fast path: pure builtins need no process at all
+        Command cmd;
+        StrBuf arena;
+        sb_init(&arena);
+        int parsed = parse_command(text, &cmd);
+        if (parsed == 0 && expand_command(&cmd, &arena) == 0 && cmd.argc > 0 &&
+            capture_builtin(b, &cmd, out, &status) == 0)
+            b = NULL;
+        sb_free(&arena);
+        if (b && parsed == 0)
+            status = capture_forked(text, out);
+    }
+    else
+    {
+        status = capture_forked(text, out);
+    }
+
+    // Strip trailing newlines like POSIX shells do
+    while (out->len > start && out->data[out->len - 1] == '\n')
+        out->data[--out->len] = '\0';
+
+    free(text);
+    last_exit_status = status;
+    return status;
+}
+
+// Check whether a word has the form NAME=value
+size_t assignment_name_len(const char *word)
+{
+    if (!isalpha((unsigned char)word[0]) && word[0] != '_')
+        return 0;
+    size_t i = 1;
+    while (isalnum((unsigned char)word[i]) || word[i] == '_')
+        i++;
+    return word[i] == '=' ? i : 0;
+}
+
+// Append the value of a variable (or special parameter) to out
+static void append_var(const char *name, size_t len, StrBuf *out)
+{
+    char tmp[32];
+    if (len == 1 && name[0] == '?')
+    {
+        snprintf(tmp, sizeof(tmp), "%d", last_exit_status);
+        sb_append(out, tmp, strlen(tmp));
+        return;
+    }
+    if (len == 1 && name[0] == '$')
+    {
+        snprintf(tmp, sizeof(tmp), "%d", (int)getpid());
+        sb_append(out, tmp, strlen(tmp));
+        return;
+    }
+    if (len == 1 && name[0] == '#')
+    {
+        snprintf(tmp, sizeof(tmp), "%d", positional_argc);
+        sb_append(out, tmp, strlen(tmp));
+        return;
+    }
+    if (len == 1 && (name[0] == '@' || name[0] == '*'))
+    {
+        for (int i = 0; i < positional_argc; i++)
+        {
+            if (i > 0)
+                sb_putc(out, ' ');
+            sb_append(out, positional_argv[i], strlen(positional_argv[i]));
+        }
+        return;
+    }
+    if (len > 0 && isdigit((unsigned char)name[0]))
+    {
+        // $0 is the shell, $1.. index the positional parameters
+        int n = atoi(name);
+        const char *val = (n == 0) ? "tinyshell" : (n <= positional_argc ? positional_argv[n - 1] : "");
+        sb_append(out, val, strlen(val));
+        return;
+    }
+
+    char key[256];
+    if (len == 0 || len >= sizeof(key))
+        return;
+    memcpy(key, name, len);
+    key[len] = '\0';
+    const char *val = getenv(key);
+    if (val)
+        sb_append(out, val, strlen(val));
+}
+
+// Expand one word into out
+void expand_word(const char *w, StrBuf *out)
+{
+    const char *p = w;
+    while (*p)
+    {
+        if (p[0] == '\\' && p[1])
+        {
+            sb_putc(out, p[1]);
+            p += 2;
+        }
+        else if (p[0] == '`' || (p[0] == '$' && p[1] == '('))
+        {
+            // Command substitution
+            const char *end = skip_subst(p);
+            const char *inner = p + (p[0] == '`' ? 1 : 2);
+            const char *inner_end = end;
+            if (inner_end > inner && (inner_end[-1] == ')' || inner_end[-1] == '`'))
+                inner_end--;
+            capture_output(inner, inner_end - inner, out);
+            p = end;
+        }
+        else if (p[0] == '$' && p[1] == '{')
+        {
+            const char *close = strchr(p + 2, '}');
+            if (!close)
+            {
+                sb_append(out, p, strlen(p));
+                break;
+            }
+            append_var(p + 2, close - (p + 2), out);
+            p = close + 1;
+        }
+        else if (p[0] == '$' && p[1] && strchr("?$#@*0123456789", p[1]))
+        {
+            append_var(p + 1, 1, out);
+            p += 2;
+        }
+        else if (p[0] == '$' && (isalpha((unsigned char)p[1]) || p[1] == '_'))
+        {
+            const char *name = ++p;
+            while (isalnum((unsigned char)*p) || *p == '_')
+                p++;
+            append_var(name, p - name, out);
+        }
+        else
+        {
+            sb_putc(out, *p++);
+        }
+    }
+}
+
+// Check whether a word contains anything to expand
+int word_needs_expansion(const char *w)
+{
+    return strpbrk(w, "$`\\") != NULL;
+}
+
+// Expand a redirection target in place (no word splitting)
+static void expand_target(char **target, size_t *off, StrBuf *arena)
+{
+    *off = (size_t)-1;
+    if (!*target || !word_needs_expansion(*target))
+        return;
+    *off = arena->len;
+    expand_word(*target, arena);
+    sb_putc(arena, '\0');
+}
+
+// Expand words into NUL-terminated fields stored back to back, without an argument limit
+int expand_fields(char *const *words, int nwords, StrBuf *out)
+{
+    int count = 0;
+    for (int i = 0; i < nwords; i++)
+    {
+        if (!word_needs_expansion(words[i]))
+        {
+            if (sb_append(out, words[i], strlen(words[i]) + 1) < 0)
+                return -1;
+            count++;
+            continue;
+        }
+
+        // Expand, then split in place (fields only ever move left)
+        size_t start = out->len;
+        expand_word(words[i], out);
+        size_t end = out->len;
+        size_t r = start, w = start;
+        while (r < end)
+        {
+            while (r < end && isspace((unsigned char)out->data[r]))
+                r++;
+            if (r >= end)
+                break;
+            while (r < end && !isspace((unsigned char)out->data[r]))
+                out->data[w++] = out->data[r++];
+            if (r < end)
+                r++; // Past the separator, which the NUL may overwrite
+            out->data[w++] = '\0';
+            count++;
+        }
+        out->len = w;
+    }
+    return count;
+}
+
+// Expand variables and command substitutions in a command's words
+int expand_command(Command *cmd, StrBuf *arena)
+{
+    // Words are recorded as arena offsets until the end, since the arena may move
+    char *lit[MAX_ARGS];
+    size_t off[MAX_ARGS];
+    int n = 0;
+    int leading = 1;
+    int overflow = 0;
+    unsigned long runs = subst_runs;
+
+    // A ( ) or { } stage's only word is its text: just the redirections expand
+    int words = cmd->kind == CMD_GROUP ? 0 : cmd->argc;
+    for (int i = 0; i < words && !overflow; i++)
+    {
+        char *w = cmd->argv[i];
+        if (n == MAX_ARGS - 1)
+        {
+            overflow = 1;
+            break;
+        }
+        int is_assign = leading && assignment_name_len(w) > 0;
+        if (!is_assign)
+            leading = 0;
+
+        if (!word_needs_expansion(w))
+        {
+            lit[n] = w;
+            off[n++] = (size_t)-1;
+            continue;
+        }
+
+        size_t start = arena->len;
+        expand_word(w, arena);
+        size_t end = arena->len;
+        if (sb_putc(arena, '\0') < 0)
+            return -1;
+
+        if (is_assign)
+        {
+            lit[n] = NULL;
+            off[n++] = start;
+            continue;
+        }
+
+        // Split the expansion on whitespace; empty results vanish
+        size_t p = start;
+        while (p < end)
+        {
+            while (p < end && isspace((unsigned char)arena->data[p]))
+                p++;
+            if (p >= end)
+                break;
+            if (n == MAX_ARGS - 1)
+            {
+                overflow = 1;
+                break;
+            }
+            lit[n] = NULL;
+            off[n++] = p;
+            while (p < end && !isspace((unsigned char)arena->data[p]))
+                p++;
+            arena->data[p++] = '\0';
+        }
+    }
+
+    if (overflow)
+    {
+        fprintf(stderr, "%s%s: too many arguments (limit %d); try batch%s\n",
+                COLOR_RED, cmd->argv[0], MAX_ARGS - 1, COLOR_RESET);
+        return -1;
+    }
+
+    size_t target_off[MAX_REDIRS];
+    for (int i = 0; i < cmd->num_redirs; i++)
+        expand_target(&cmd->redirs[i].target, &target_off[i], arena);
+
+    // Arena is final: convert offsets to pointers
+    if (cmd->kind != CMD_GROUP)
+    {
+        for (int i = 0; i < n; i++)
+            cmd->argv[i] = (off[i] == (size_t)-1) ? lit[i] : arena->data + off[i];
+        cmd->argv[n] = NULL;
+        cmd->argc = n;
+    }
+    for (int i = 0; i < cmd->num_redirs; i++)
+    {
+        if (target_off[i] != (size_t)-1)
+            cmd->redirs[i].target = arena->data + target_off[i];
+    }
+    cmd->substituted = subst_runs != runs;
+    return 0;
+}
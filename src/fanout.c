@@ -0,0 +1,261 @@
+/*
+ * fanout.c - Copying one command's output to several targets (multios)
+ *
+ * "cmd > a > b | next" runs cmd with stdout on a single data pipe. Each
+ * round, the bytes waiting in it are duplicated into one scratch pipe per
+ * extra target with tee(2); the scratch pipes are spliced to their targets
+ * and the data pipe itself to the last one, so the output never passes
+ * through user space. Targets splice cannot write to (files opened with
+ * >>) fall back to read/write. The files were opened by the shell.
+ */
+
+#include "../include/fanout.h"
+#include "../include/executor.h"
+#include "../include/utils.h"
+#include <signal.h>
+
+// One place the output goes
+typedef struct
+{
+    int fd;
+    int scratch[2]; // This round's copy (unused for the last target)
+    int copy; // splice refused this target: use read/write
+    int dead; // Writing failed (e.g. the reader exited): discard its copies
+} Target;
+
+// Move exactly len bytes from a pipe to a target
+static int move_bytes(int from, Target *t, size_t len)
+{
+    char buf[FANOUT_CHUNK];
+    while (len > 0)
+    {
+        size_t want = len < sizeof(buf) ? len : sizeof(buf);
+        ssize_t n;
+        if (!t->dead && !t->copy)
+        {
+            n = splice(from, NULL, t->fd, NULL, len, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINVAL)
+            {
+                t->copy = 1;
+                continue;
+            }
+            if (n < 0 && errno != EINTR)
+            {
+                t->dead = 1;
+                continue;
+            }
+        }
+        else
+        {
+            // Dead targets are still drained so the other targets keep flowing
+            n = read(from, buf, want);
+            if (n > 0 && !t->dead && write_all(t->fd, buf, n) < 0)
+                t->dead = 1;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+// Fallback when tee(2) is unavailable: copy through a buffer
+static void copy_loop(int from, Target *targets, int n)
+{
+    char buf[FANOUT_CHUNK];
+    for (;;)
+    {
+        ssize_t got = read(from, buf, sizeof(buf));
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return;
+        for (int i = 0; i < n; i++)
+        {
+            if (!targets[i].dead && write_all(targets[i].fd, buf, got) < 0)
+                targets[i].dead = 1;
+        }
+    }
+}
+
+// Copy the data pipe to every target until the command closes it
+static void fanout_loop(int data, Target *targets, int n)
+{
+    int last = n - 1;
+    for (;;)
+    {
+        ssize_t m = tee(data, targets[0].scratch[PIPE_WRITE], FANOUT_CHUNK, 0);
+        if (m < 0 && errno == EINTR)
+            continue;
+        if (m < 0)
+        {
+            copy_loop(data, targets, n);
+            return;
+        }
+        if (m == 0)
+            return;
+
+        // Scratch pipes are empty and larger than a round, so each tee copies all m bytes
+        for (int i = 1; i < last; i++)
+        {
+            ssize_t t;
+            do
+                t = tee(data, targets[i].scratch[PIPE_WRITE], m, 0);
+            while (t < 0 && errno == EINTR);
+            if (t != m)
+            {
+                perror("tee");
+                return;
+            }
+        }
+        for (int i = 0; i < last; i++)
+        {
+            if (move_bytes(targets[i].scratch[PIPE_READ], &targets[i], m) < 0)
+                return;
+        }
+        if (move_bytes(data, &targets[last], m) < 0)
+            return;
+    }
+}
+
+static int compare_fd(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// Close every descriptor from 3 up except the n in keep (sorted in place)
+static void close_others(int *keep, int n)
+{
+    qsort(keep, n, sizeof(int), compare_fd);
+    unsigned int lo = 3;
+    for (int i = 0; i < n; i++)
+    {
+        if ((unsigned int)keep[i] > lo)
+            close_range(lo, keep[i] - 1, 0);
+        if ((unsigned int)keep[i] + 1 > lo)
+            lo = keep[i] + 1;
+    }
+    close_range(lo, ~0U, 0);
+}
+
+// Check whether a redirection sends stdout to a file
+int fanout_target(const Redirect *r)
+{
+    return r->fd == STDOUT_FILENO && r->target &&
+           (r->op == REDIR_OUT || r->op == REDIR_CLOBBER || r->op == REDIR_APPEND);
+}
+
+// Check whether a command's stdout has more than one place to go
+int fanout_needed(const Command *cmd)
+{
+    int n = cmd->pipe_out;
+    for (int i = 0; i < cmd->num_redirs; i++)
+        n += fanout_target(&cmd->redirs[i]);
+    return n > 1;
+}
+
+// Send a command's stdout to all of its output targets
+void fanout_output(Command *cmd)
+{
+    Target targets[MAX_REDIRS + 1];
+    int n = 0;
+    for (int i = 0; i < cmd->num_redirs; i++)
+    {
+        if (fanout_target(&cmd->redirs[i]))
+            targets[n++].fd = cmd->redirs[i].opened;
+    }
+    int piped = cmd->pipe_out;
+    if (piped)
+        targets[n++].fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+
+    int data[2];
+    if (pipe2(data, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        _exit(1);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        targets[i].copy = 0;
+        targets[i].dead = 0;
+        targets[i].scratch[PIPE_READ] = targets[i].scratch[PIPE_WRITE] = -1;
+        if (i < n - 1)
+        {
+            if (pipe2(targets[i].scratch, O_CLOEXEC) < 0)
+            {
+                perror("pipe");
+                _exit(1);
+            }
+            fcntl(targets[i].scratch[PIPE_WRITE], F_SETPIPE_SZ, FANOUT_SCRATCH_SIZE);
+        }
+    }
+
+    // Our own wait below must not be pre-empted by the shell's reaper
+    signal(SIGCHLD, SIG_DFL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        _exit(1);
+    }
+    if (pid == 0)
+    {
+        // The command: stdout is the data pipe; builtins don't exec, so close
+        // the rest (the caller closes the redirection files)
+        dup2(data[PIPE_WRITE], STDOUT_FILENO);
+        close(data[PIPE_READ]);
+        close(data[PIPE_WRITE]);
+        if (piped)
+            close(targets[n - 1].fd);
+        for (int i = 0; i < n; i++)
+        {
+            if (targets[i].scratch[PIPE_READ] >= 0)
+            {
+                close(targets[i].scratch[PIPE_READ]);
+                close(targets[i].scratch[PIPE_WRITE]);
+            }
+        }
+        return;
+    }
+
+    // Hold nothing but the targets, so neighbouring stages see EOF/EPIPE as
+    // soon as their real peer is gone (the shell's pipe ends are inherited)
+    close(data[PIPE_WRITE]);
+    int keep[3 * (MAX_REDIRS + 1) + 1];
+    int nkeep = 0;
+    keep[nkeep++] = data[PIPE_READ];
+    for (int i = 0; i < n; i++)
+    {
+        keep[nkeep++] = targets[i].fd;
+        if (targets[i].scratch[PIPE_READ] >= 0)
+        {
+            keep[nkeep++] = targets[i].scratch[PIPE_READ];
+            keep[nkeep++] = targets[i].scratch[PIPE_WRITE];
+        }
+    }
+    close_others(keep, nkeep);
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd >= 0)
+    {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    fanout_loop(data[PIPE_READ], targets, n);
+    close(data[PIPE_READ]);
+    for (int i = 0; i < n; i++)
+        close(targets[i].fd);
+
+    // Exit as the command did, once all of its output is written
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (WIFSIGNALED(status))
+    {
+        signal(WTERMSIG(status), SIG_DFL);
+        kill(getpid(), WTERMSIG(status));
+    }
+    _exit(status_to_code(status));
+}
@@ -0,0 +1,41 @@
+/*
+ * hist.c - The shell's input history: a ring of the last HIST_MAX inputs
+ */
+
+#include "../include/hist.h"
+#include "../include/shell.h"
+
+static char *ring[HIST_MAX];
+static int first; // Slot of the oldest input
+static int count;
+
+void hist_add(const char *text)
+{
+    if (!text || !*text)
+        return;
+    if (count > 0 && strcmp(hist_get(count - 1), text) == 0)
+        return;
+    char *copy = strdup(text);
+    if (!copy)
+        return;
+    if (count == HIST_MAX)
+    {
+        free(ring[first]);
+        ring[first] = copy;
+        first = (first + 1) % HIST_MAX;
+        return;
+    }
+    ring[(first + count++) % HIST_MAX] = copy;
+}
+
+int hist_count(void)
+{
+    return count;
+}
+
+const char *hist_get(int i)
+{
+    if (i < 0 || i >= count)
+        return NULL;
+    return ring[(first + i) % HIST_MAX];
+}
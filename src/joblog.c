@@ -0,0 +1,365 @@
+/*
+ * joblog.c - Background job output capture
+ *
+ * With capture on, a background job's stdout and stderr go to a pipe instead
+ * of the terminal. The shell drains the pipes from its input loop (while
+ * readline waits for a key and before each prompt) into one fixed-size ring
+ * buffer per job, optionally copying everything to a file, so a chatty job
+ * never waits on the terminal and never scribbles over the prompt.
+ */
+
+#include "../include/joblog.h"
+#include "../include/utils.h"
+#include "../include/deadline.h"
+#include "../include/watch.h"
+#include <poll.h>
+#include <signal.h>
+#ifndef NO_READLINE
+#include <readline/readline.h>
+#endif
+
+// Captured output of one job
+typedef struct
+{
+    int job_num; // 0 = free slot
+    int fd; // Read end of the capture pipe (-1 once the job closed it)
+    int spill_fd; // Copy of all output (-1 if not spilling)
+    char *cmd_line;
+    char *ring; // Byte k of the output lives at ring[k % JOBLOG_RING_SIZE]
+    uint64_t total; // Bytes received so far
+} JobLog;
+
+static JobLog logs[MAX_JOBS];
+static int capture_on;
+static char *spill_dir; // Directory for full copies (NULL = ring only)
+static int pending_fd = -1; // Read end made by joblog_pipe, not yet attached
+
+static volatile sig_atomic_t follow_interrupted;
+
+// Free a slot, or the finished log of the oldest job; NULL if all are live
+static JobLog *free_slot(void)
+{
+    JobLog *oldest = NULL;
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (logs[i].job_num == 0)
+            return &logs[i];
+        if (logs[i].fd < 0 && (!oldest || logs[i].job_num < oldest->job_num))
+            oldest = &logs[i];
+    }
+    return oldest;
+}
+
+// Release a log's resources
+static void clear_log(JobLog *l)
+{
+    if (l->job_num != 0 && l->fd >= 0)
+        close(l->fd);
+    if (l->job_num != 0 && l->spill_fd >= 0)
+        close(l->spill_fd);
+    free(l->cmd_line);
+    free(l->ring);
+    memset(l, 0, sizeof(*l));
+    l->fd = -1;
+    l->spill_fd = -1;
+}
+
+// Find the log of a job by number
+static JobLog *find_log(int job_num)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (logs[i].job_num != 0 && logs[i].job_num == job_num)
+            return &logs[i];
+    }
+    return NULL;
+}
+
+// Create the capture pipe for the next background job
+int joblog_pipe(void)
+{
+    joblog_discard();
+    if (!capture_on || !free_slot())
+        return -1;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+        return -1;
+    // A bigger pipe lets jobs keep writing while the shell waits on a foreground command
+    fcntl(fds[PIPE_READ], F_SETPIPE_SZ, JOBLOG_PIPE_SIZE);
+    fcntl(fds[PIPE_READ], F_SETFL, O_NONBLOCK);
+    pending_fd = fds[PIPE_READ];
+    return fds[PIPE_WRITE];
+}
+
+// Close an unattached capture pipe
+void joblog_discard(void)
+{
+    if (pending_fd >= 0)
+        close(pending_fd);
+    pending_fd = -1;
+}
+
+// Bind the pending pipe to a job
+void joblog_attach(int job_num, const char *cmd_line)
+{
+    JobLog *l = job_num > 0 && pending_fd >= 0 ? free_slot() : NULL;
+    if (!l)
+    {
+        joblog_discard();
+        return;
+    }
+    clear_log(l);
+    l->ring = malloc(JOBLOG_RING_SIZE);
+    l->cmd_line = strdup(cmd_line);
+    if (!l->ring || !l->cmd_line)
+    {
+        clear_log(l);
+        joblog_discard();
+        return;
+    }
+    if (spill_dir)
+    {
+        char path[PATH_MAX_LEN];
+        snprintf(path, sizeof(path), "%s/tinyshell.%d.job%d.log", spill_dir, (int)getpid(), job_num);
+        l->spill_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (l->spill_fd < 0)
+            perror(path);
+    }
+    l->job_num = job_num;
+    l->fd = pending_fd;
+    pending_fd = -1;
+}
+
+// Read everything available from a job's pipe into its ring
+static void drain_log(JobLog *l)
+{
+    char buf[8192];
+    while (l->fd >= 0)
+    {
+        ssize_t n = read(l->fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return;
+        if (n <= 0)
+        {
+            // The job (and every process sharing the pipe) has finished
+            close(l->fd);
+            l->fd = -1;
+            if (l->spill_fd >= 0)
+                close(l->spill_fd);
+            l->spill_fd = -1;
+            return;
+        }
+        if (l->spill_fd >= 0 && write_all(l->spill_fd, buf, n) < 0)
+        {
+            close(l->spill_fd);
+            l->spill_fd = -1;
+        }
+
+        // Only the last JOBLOG_RING_SIZE bytes survive
+        const char *p = buf;
+        if ((size_t)n > JOBLOG_RING_SIZE)
+        {
+            l->total += n - JOBLOG_RING_SIZE;
+            p += n - JOBLOG_RING_SIZE;
+            n = JOBLOG_RING_SIZE;
+        }
+        size_t pos = l->total % JOBLOG_RING_SIZE;
+        size_t first = (size_t)n < JOBLOG_RING_SIZE - pos ? (size_t)n : JOBLOG_RING_SIZE - pos;
+        memcpy(l->ring + pos, p, first);
+        memcpy(l->ring, p + first, n - first);
+        l->total += n;
+    }
+}
+
+// Collect the open capture pipes; map[i] is the log behind pfd[i]
+static int poll_set(struct pollfd *pfd, JobLog **map)
+{
+    int n = 0;
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (logs[i].job_num != 0 && logs[i].fd >= 0)
+        {
+            pfd[n].fd = logs[i].fd;
+            pfd[n].events = POLLIN;
+            pfd[n].revents = 0;
+            map[n++] = &logs[i];
+        }
+    }
+    return n;
+}
+
+// Drain captured jobs, waiting up to timeout_ms for output
+void joblog_drain(int timeout_ms)
+{
+    struct pollfd pfd[MAX_JOBS];
+    JobLog *map[MAX_JOBS];
+    int n = poll_set(pfd, map);
+    if (n == 0 || poll(pfd, n, timeout_ms) <= 0)
+        return;
+    for (int i = 0; i < n; i++)
+    {
+        if (pfd[i].revents)
+            drain_log(map[i]);
+    }
+}
+
+// Wait for fd to become readable, draining jobs, enforcing deadlines and
+// rerunning onchange commands meanwhile
+int joblog_wait(int fd, const sigset_t *sigmask)
+{
+    for (;;)
+    {
+        struct pollfd pfd[MAX_JOBS + 3];
+        JobLog *map[MAX_JOBS];
+        int n = poll_set(pfd + 3, map);
+        int timer = deadline_fd();
+        int watch = watch_fd();
+        if (n == 0 && timer < 0 && watch < 0 && !sigmask)
+            return JOBLOG_READY; // Nothing else to wait for: the caller can block on fd
+        pfd[0].fd = fd;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd = timer;  // Ignored by poll while negative
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
+        pfd[2].fd = watch;
+        pfd[2].events = POLLIN;
+        pfd[2].revents = 0;
+        if (ppoll(pfd, n + 3, NULL, sigmask) < 0)
+        {
+            if (errno != EINTR)
+                return -1;
+            if (sigmask)
+                return 0;
+            continue;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (pfd[i + 3].revents)
+                drain_log(map[i]);
+        }
+        if (pfd[1].revents)
+            deadline_run();
+        if (pfd[2].revents && watch_run() > 0)
+            return JOBLOG_REDRAW;  // The job line went over the prompt
+        if (pfd[0].revents)
+            return JOBLOG_READY;
+    }
+}
+
+#ifndef NO_READLINE
+// Readline input hook: keep draining jobs, enforcing deadlines and rerunning
+// onchange commands until a key arrives
+int joblog_getc(FILE *stream)
+{
+    while (joblog_wait(fileno(stream), NULL) == JOBLOG_REDRAW)
+        rl_forced_update_display();
+    return rl_getc(stream);
+}
+#endif
+
+// Print a log's output from byte offset from; returns the new offset
+static uint64_t print_log(const JobLog *l, uint64_t from)
+{
+    uint64_t start = l->total > JOBLOG_RING_SIZE ? l->total - JOBLOG_RING_SIZE : 0;
+    if (from < start)
+    {
+        fflush(stdout);
+        fprintf(stderr, "%s[%llu bytes dropped]%s\n", COLOR_BLUE,
+                (unsigned long long)(start - from), COLOR_RESET);
+        from = start;
+    }
+    fflush(stdout);
+    while (from < l->total)
+    {
+        size_t pos = from % JOBLOG_RING_SIZE;
+        size_t len = l->total - from < JOBLOG_RING_SIZE - pos ? l->total - from : JOBLOG_RING_SIZE - pos;
+        if (write_all(STDOUT_FILENO, l->ring + pos, len) < 0)
+            break;
+        from += len;
+    }
+    return l->total;
+}
+
+static void follow_sigint(int sig)
+{
+    (void)sig;
+    follow_interrupted = 1;
+}
+
+// Print a job's output as it arrives until it finishes or Ctrl-C
+static void follow_log(JobLog *l)
+{
+    struct sigaction sa, old;
+    sa.sa_handler = follow_sigint;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; // Let poll() return on Ctrl-C
+    sigaction(SIGINT, &sa, &old);
+    follow_interrupted = 0;
+
+    joblog_drain(0);
+    uint64_t seen = print_log(l, 0);
+    while (!follow_interrupted && l->fd >= 0)
+    {
+        joblog_drain(-1);
+        seen = print_log(l, seen);
+    }
+    sigaction(SIGINT, &old, NULL);
+}
+
+// Built-in: joblog command
+int builtin_joblog(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "on") == 0 && argc <= 3)
+    {
+        char *dir = argc == 3 ? strdup(argv[2]) : NULL;
+        if (argc == 3 && (!dir || access(dir, W_OK) < 0))
+        {
+            perror(argv[2]);
+            free(dir);
+            return 1;
+        }
+        free(spill_dir);
+        spill_dir = dir;
+        capture_on = 1;
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "off") == 0)
+    {
+        capture_on = 0;
+        return 0;
+    }
+
+    joblog_drain(0);
+    if (argc == 1)
+    {
+        for (int i = 0; i < MAX_JOBS; i++)
+        {
+            if (logs[i].job_num != 0)
+                printf("[%d] %-8s %10llu bytes  %s\n", logs[i].job_num, logs[i].fd >= 0 ? "running" : "done",
+                       (unsigned long long)logs[i].total, logs[i].cmd_line);
+        }
+        return 0;
+    }
+
+    int follow = argc == 3 && strcmp(argv[1], "-f") == 0;
+    const char *spec = argv[argc - 1];
+    if (argc != 2 + follow)
+    {
+        fprintf(stderr, "%sjoblog: usage: joblog on [DIR] | joblog off | joblog [-f] %%N%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    JobLog *l = find_log(atoi(spec[0] == '%' ? spec + 1 : spec));
+    if (!l)
+    {
+        fprintf(stderr, "%sjoblog: %s: no captured output%s\n", COLOR_RED, spec, COLOR_RESET);
+        return 1;
+    }
+    if (follow)
+        follow_log(l);
+    else
+        print_log(l, 0);
+    return 0;
+}
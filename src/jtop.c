@@ -0,0 +1,338 @@
+/*
+ * jtop.c - Per-job resource view (jobs -l, jtop)
+ *
+ * A job's members are the processes in its process group, the same set
+ * that job control signals. One pass over /proc reads every process's
+ * stat line and keeps those in a job's group; only for them are io and
+ * cmdline read. Samples are kept until the next pass, so CPU% covers the
+ * time between two refreshes.
+ */
+
+#include "../include/jtop.h"
+#include "../include/deadline.h"
+#include "../include/stats.h"
+#include "../include/utils.h"
+#include <dirent.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+
+// One process of a job at the time of a sample
+typedef struct
+{
+    pid_t pid;
+    pid_t pgid;
+    char state; // R, S, D, T, Z, ...
+    uint64_t ticks; // User plus system CPU, clock ticks
+    uint64_t start; // Start time, clock ticks after boot
+    long rss_kb;
+    uint64_t rchar; // Bytes passed to read() and friends (pipes included)
+    uint64_t wchar; // Bytes passed to write() and friends
+    int have_io; // 0 when /proc/PID/io could not be read
+    char comm[32]; // Name from stat, for processes without a cmdline
+} ProcSample;
+
+static ProcSample samples[2][JTOP_MAX_PROCS];
+static int nsamples[2];
+static int cur; // samples[cur] is the latest pass
+static uint64_t sample_ns[2]; // CLOCK_BOOTTIME of each pass
+
+static uint64_t boottime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Read a small /proc file relative to dir; returns its length or -1
+static ssize_t read_proc(int dir, const char *path, char *buf, size_t size)
+{
+    int fd = openat(dir, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n >= 0)
+        buf[n] = '\0';
+    return n;
+}
+
+// Parse /proc/PID/stat; the name is skipped by its last ')' as it may contain anything
+static int parse_stat(char *buf, ProcSample *p)
+{
+    char *open = strchr(buf, '(');
+    char *close_paren = strrchr(buf, ')');
+    if (!open || !close_paren || close_paren[1] != ' ')
+        return -1;
+    size_t len = close_paren - open - 1;
+    if (len >= sizeof(p->comm))
+        len = sizeof(p->comm) - 1;
+    memcpy(p->comm, open + 1, len);
+    p->comm[len] = '\0';
+    unsigned long utime, stime;
+    unsigned long long start;
+    long rss;
+    if (sscanf(close_paren + 2, "%c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %*d %*d %llu %*u %ld",
+               &p->state, &p->pgid, &utime, &stime, &start, &rss) != 6)
+        return -1;
+    p->ticks = utime + stime;
+    p->start = start;
+    p->rss_kb = rss * (sysconf(_SC_PAGESIZE) / 1024);
+    return 0;
+}
+
+static void parse_io(const char *buf, ProcSample *p)
+{
+    const char *r = strstr(buf, "rchar: ");
+    const char *w = strstr(buf, "wchar: ");
+    p->have_io = r && w;
+    if (p->have_io)
+    {
+        p->rchar = strtoull(r + 7, NULL, 10);
+        p->wchar = strtoull(w + 7, NULL, 10);
+    }
+}
+
+// Sample every process in one of the jobs' groups into a new pass
+static int take_sample(void)
+{
+    pid_t groups[MAX_JOBS];
+    int ngroups = 0;
+    for (int i = 0; i < MAX_JOBS; i++)
+        if (jobs[i].state != JOB_DONE && jobs[i].cmd_line)
+            groups[ngroups++] = jobs[i].pgid;
+
+    cur ^= 1;
+    nsamples[cur] = 0;
+    sample_ns[cur] = boottime_ns();
+    if (ngroups == 0)
+        return 0;
+
+    DIR *proc = opendir("/proc");
+    if (!proc)
+    {
+        perror("/proc");
+        return -1;
+    }
+    int dir = dirfd(proc);
+    struct dirent *de;
+    char path[300], buf[1024];
+    while ((de = readdir(proc)) != NULL && nsamples[cur] < JTOP_MAX_PROCS)
+    {
+        if (de->d_name[0] < '1' || de->d_name[0] > '9')
+            continue;
+        ProcSample *p = &samples[cur][nsamples[cur]];
+        snprintf(path, sizeof(path), "%s/stat", de->d_name);
+        if (read_proc(dir, path, buf, sizeof(buf)) <= 0 || parse_stat(buf, p) < 0)
+            continue; // Gone since readdir
+        int member = 0;
+        for (int g = 0; g < ngroups && !member; g++)
+            member = p->pgid == groups[g];
+        if (!member)
+            continue;
+        p->pid = atoi(de->d_name);
+        snprintf(path, sizeof(path), "%s/io", de->d_name);
+        p->have_io = 0;
+        if (read_proc(dir, path, buf, sizeof(buf)) > 0)
+            parse_io(buf, p);
+        nsamples[cur]++;
+    }
+    closedir(proc);
+    return 0;
+}
+
+// CPU% of p since the previous pass, or since it started if it is new
+// (or the previous pass is only a few clock ticks old)
+static double cpu_percent(const ProcSample *p, long hz)
+{
+    const ProcSample *old = NULL;
+    int n = sample_ns[cur] - sample_ns[cur ^ 1] >= JTOP_MIN_DELTA_NS ? nsamples[cur ^ 1] : 0;
+    for (int i = 0; i < n && !old; i++)
+        if (samples[cur ^ 1][i].pid == p->pid && samples[cur ^ 1][i].start == p->start)
+            old = &samples[cur ^ 1][i];
+    uint64_t since = old ? sample_ns[cur ^ 1] : p->start * (1000000000ull / hz);
+    uint64_t ticks = old ? p->ticks - old->ticks : p->ticks;
+    if (sample_ns[cur] <= since)
+        return 0;
+    return 100.0 * ticks * (1e9 / hz) / (sample_ns[cur] - since);
+}
+
+static void format_elapsed(char *buf, size_t size, uint64_t ns)
+{
+    uint64_t s = ns / 1000000000ull;
+    if (s < 60)
+        snprintf(buf, size, "%.1fs", ns / 1e9);
+    else if (s < 3600)
+        snprintf(buf, size, "%llu:%02llu", (unsigned long long)s / 60, (unsigned long long)s % 60);
+    else
+        snprintf(buf, size, "%llu:%02llu:%02llu", (unsigned long long)s / 3600,
+                 (unsigned long long)s / 60 % 60, (unsigned long long)s % 60);
+}
+
+// Print the whole command line of pid, NULs shown as spaces
+static void print_cmdline(const ProcSample *p)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", (int)p->pid);
+    StrBuf sb;
+    sb_init(&sb);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    while (fd >= 0 && sb_reserve(&sb, 4096) == 0)
+    {
+        ssize_t n = read(fd, sb.data + sb.len, sb.cap - sb.len - 1);
+        if (n <= 0)
+            break;
+        sb.len += n;
+    }
+    if (fd >= 0)
+        close(fd);
+    while (sb.len > 0 && sb.data[sb.len - 1] == '\0')
+        sb.len--;
+    for (size_t i = 0; i < sb.len; i++)
+        if (sb.data[i] == '\0')
+            sb.data[i] = ' ';
+    if (sb.len > 0)
+        printf("%.*s\n", (int)sb.len, sb.data);
+    else
+        printf("[%s]\n", p->comm); // Zombie or kernel thread
+    sb_free(&sb);
+}
+
+// Print every job and each process in its group (jobs -l)
+int jobs_print_long(void)
+{
+    if (take_sample() < 0)
+        return 1;
+    long hz = sysconf(_SC_CLK_TCK);
+    uint64_t now = monotonic_ns();
+    char rss[16], rd[16], wr[16], el[16];
+    printf("%-13s %7s %s %6s %8s %8s %8s %8s  %s\n", "JOB", "PID", "S", "CPU%", "RSS", "READ", "WRITE", "ELAPSED", "COMMAND");
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        Job *job = &jobs[i];
+        if (job->state == JOB_DONE || !job->cmd_line)
+            continue;
+
+        // Job line: totals over its processes
+        double cpu = 0;
+        long rss_kb = 0;
+        uint64_t rchar = 0, wchar = 0;
+        for (int k = 0; k < nsamples[cur]; k++)
+        {
+            const ProcSample *p = &samples[cur][k];
+            if (p->pgid != job->pgid)
+                continue;
+            cpu += cpu_percent(p, hz);
+            rss_kb += p->rss_kb;
+            rchar += p->rchar;
+            wchar += p->wchar;
+        }
+        char label[24];
+        snprintf(label, sizeof(label), "[%d] %s", job->job_num, job->state == JOB_RUNNING ? "Running" : "Stopped");
+        format_bytes(rss, sizeof(rss), (uint64_t)rss_kb * 1024);
+        format_bytes(rd, sizeof(rd), rchar);
+        format_bytes(wr, sizeof(wr), wchar);
+        format_elapsed(el, sizeof(el), job->start_ns ? now - job->start_ns : 0);
+        printf("%-13s %7s %s %6.1f %8s %8s %8s %8s  %s\n", label, "", " ", cpu, rss, rd, wr, el, job->cmd_line);
+
+        for (int k = 0; k < nsamples[cur]; k++)
+        {
+            const ProcSample *p = &samples[cur][k];
+            if (p->pgid != job->pgid)
+                continue;
+            format_bytes(rss, sizeof(rss), (uint64_t)p->rss_kb * 1024);
+            format_bytes(rd, sizeof(rd), p->rchar);
+            format_bytes(wr, sizeof(wr), p->wchar);
+            uint64_t started = p->start * (1000000000ull / hz);
+            format_elapsed(el, sizeof(el), sample_ns[cur] > started ? sample_ns[cur] - started : 0);
+            printf("%-13s %7d %c %6.1f %8s %8s %8s %8s  ", "", (int)p->pid, p->state, cpu_percent(p, hz),
+                   rss, p->have_io ? rd : "-", p->have_io ? wr : "-", el);
+            print_cmdline(p);
+        }
+    }
+    return 0;
+}
+
+// Jobs still in the table
+static int count_jobs(void)
+{
+    int n = 0;
+    for (int i = 0; i < MAX_JOBS; i++)
+        n += jobs[i].state != JOB_DONE && jobs[i].cmd_line != NULL;
+    return n;
+}
+
+// Sleep until due; returns 1 if q was pressed on the terminal
+static int wait_refresh(uint64_t due, int tty)
+{
+    for (;;)
+    {
+        uint64_t now = monotonic_ns();
+        if (now >= due)
+            return 0;
+        struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+        int r = poll(tty ? &pfd : NULL, tty ? 1 : 0, (int)((due - now + 999999) / 1000000));
+        if (r > 0)
+        {
+            char c;
+            if (read(STDIN_FILENO, &c, 1) <= 0 || c == 'q' || c == 'Q' || c == 4)
+                return 1;
+        }
+    }
+}
+
+// Built-in: jtop - refresh the jobs -l view until q is pressed or no job is left
+int builtin_jtop(int argc, char **argv)
+{
+    uint64_t interval = JTOP_INTERVAL_NS;
+    long count = -1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc && parse_duration(argv[i + 1], &interval) == 0 && interval > 0)
+            i++;
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0)
+            count = atol(argv[++i]);
+        else
+        {
+            fprintf(stderr, "%sjtop: usage: jtop [-d SECS] [-n COUNT]%s\n", COLOR_RED, COLOR_RESET);
+            return 2;
+        }
+    }
+
+    // Keys are read one at a time without echo; without a terminal there
+    // are no keys (stdin still holds the rest of the input)
+    int tty = isatty(STDIN_FILENO);
+    int clear = isatty(STDOUT_FILENO);
+    struct termios saved, raw;
+    if (tty && tcgetattr(STDIN_FILENO, &saved) == 0)
+    {
+        raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+    else
+        tty = 0;
+
+    int status = 0;
+    uint64_t due = monotonic_ns();
+    for (long n = 0; count < 0 || n < count; n++)
+    {
+        if (n > 0 && wait_refresh(due, tty))
+            break;
+        due = monotonic_ns() + interval;
+        if (clear)
+            fputs("\033[H\033[2J", stdout);
+        int njobs = count_jobs();
+        printf("jtop: %d job%s, every %.1fs%s\n", njobs, njobs == 1 ? "" : "s", interval / 1e9, tty ? " (q quits)" : "");
+        status = jobs_print_long();
+        fflush(stdout);
+        if (status || njobs == 0)
+            break;
+    }
+
+    if (tty)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    return status;
+}
@@ -0,0 +1,290 @@
+/*
+ * launcher.c - Pre-forked launcher (zygote) for low-latency spawning
+ *
+ * The shell sends spawn requests (argv, environment delta, cwd, redirections,
+ * process group) over a SOCK_SEQPACKET socketpair, with the stage's
+ * stdin/stdout/stderr and the redirection files it has already opened
+ * attached via SCM_RIGHTS. The helper clones from its own
+ * small address space with CLONE_PARENT, so the new process is a child of the
+ * shell and is reaped and job-controlled exactly like a forked one.
+ */
+
+#include "../include/launcher.h"
+#include "../include/executor.h"
+#include "../include/builtins.h"
+#include "../include/expand.h"
+#include "../include/resolve.h"
+#include "../include/utils.h"
+#include "../include/fanout.h"
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#define LAUNCH_MSG_MAX (256 * 1024)
+
+// Fixed part of a spawn request; nredirs LaunchRedirects follow, then
+// NUL-separated strings: cwd, resolved path, argv[0..argc-1], env[0..envc-1]
+typedef struct
+{
+    int32_t pgid; // 0 = new group, >0 = join, -1 = leave unchanged
+    uint32_t nredirs; // Number of redirections
+    uint32_t argc; // Number of argv strings
+    uint32_t envc; // Number of environment delta entries
+} LaunchRequest;
+
+// A redirection; file ones take the next passed descriptor after stdio
+typedef struct
+{
+    int32_t fd;
+    int32_t op; // RedirOp
+    int32_t src; // REDIR_DUP source
+} LaunchRedirect;
+
+static int launcher_sock = -1;
+static char **env_snapshot; // Environment the helper started with
+static int env_snapshot_len;
+
+// Check whether the launcher is running
+int launcher_active(void)
+{
+    return launcher_sock >= 0;
+}
+
+// Start the helper: a fresh exec of this binary keeps its address space small
+int launcher_start(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+        return -1;
+    int bufsize = LAUNCH_MSG_MAX;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // Helper end must survive exec
+        int fd = dup(sv[1]);
+        char fdstr[16];
+        snprintf(fdstr, sizeof(fdstr), "%d", fd);
+        char *argv[] = { "tinyshell", "--launcher", fdstr, NULL };
+        execv("/proc/self/exe", argv);
+        _exit(127);
+    }
+
+    close(sv[1]);
+    launcher_sock = sv[0];
+
+    // Remember the helper's environment so requests only carry changes
+    for (env_snapshot_len = 0; environ[env_snapshot_len]; env_snapshot_len++)
+        ;
+    env_snapshot = malloc(sizeof(char *) * (env_snapshot_len + 1));
+    for (int i = 0; env_snapshot && i < env_snapshot_len; i++)
+        env_snapshot[i] = strdup(environ[i]);
+    return 0;
+}
+
+// Append a NUL-terminated string to the request
+static int put_str(StrBuf *msg, const char *s)
+{
+    return sb_append(msg, s ? s : "", strlen(s ? s : "") + 1);
+}
+
+// Check whether the environment still contains exactly this entry (or any NAME= if by_name)
+static int env_contains(char **env, int n, const char *entry, int by_name)
+{
+    size_t len = by_name ? (size_t)(strchr(entry, '=') - entry + 1) : strlen(entry) + 1;
+    for (int i = 0; (n < 0 ? env[i] != NULL : i < n); i++)
+    {
+        if (env[i] && strncmp(env[i], entry, len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Append the difference between the current environment and the snapshot
+static uint32_t put_env_delta(StrBuf *msg)
+{
+    uint32_t count = 0;
+    for (int i = 0; environ[i]; i++)
+    {
+        if (!env_contains(env_snapshot, env_snapshot_len, environ[i], 0))
+        {
+            put_str(msg, environ[i]);
+            count++;
+        }
+    }
+    for (int i = 0; i < env_snapshot_len; i++)
+    {
+        if (env_snapshot[i] && strchr(env_snapshot[i], '=') &&
+            !env_contains(environ, -1, env_snapshot[i], 1))
+        {
+            // Bare NAME means unset
+            sb_append(msg, env_snapshot[i], strchr(env_snapshot[i], '=') - env_snapshot[i]);
+            sb_putc(msg, '\0');
+            count++;
+        }
+    }
+    return count;
+}
+
+// Ask the launcher to start an external command
+pid_t launcher_spawn(Command *cmd, int in_fd, int out_fd, int err_fd, pid_t pgid)
+{
+    if (launcher_sock < 0 || cmd->argc == 0)
+        return -1;
+
+    // Builtins and functions need the shell's own state, and output fan-out
+    // needs a process of its own, so those are always forked
+    resolve_command(cmd);
+    if (cmd->kind != CMD_EXTERNAL || fanout_needed(cmd))
+        return -1;
+
+    StrBuf msg;
+    sb_init(&msg);
+    LaunchRequest req = { pgid, (uint32_t)cmd->num_redirs, (uint32_t)cmd->argc, 0 };
+    sb_append(&msg, (const char *)&req, sizeof(req));
+    int fds[MAX_PASSED_FDS] = { in_fd, out_fd, err_fd };
+    int nfds = 3;
+    for (int i = 0; i < cmd->num_redirs; i++)
+    {
+        const Redirect *r = &cmd->redirs[i];
+        LaunchRedirect lr = { r->fd, r->op, r->src };
+        sb_append(&msg, (const char *)&lr, sizeof(lr));
+        if (r->opened >= 0)
+            fds[nfds++] = r->opened;
+    }
+    char *cwd = get_current_dir();
+    put_str(&msg, cwd ? cwd : ".");
+    put_str(&msg, cmd->path);
+    for (int i = 0; i < cmd->argc; i++)
+        put_str(&msg, cmd->argv[i]);
+    req.envc = put_env_delta(&msg);
+    memcpy(msg.data, &req, sizeof(req));
+
+    pid_t pid = -1;
+    if (msg.len <= LAUNCH_MSG_MAX && send_fds(launcher_sock, msg.data, msg.len, fds, nfds) >= 0)
+    {
+        int32_t reply;
+        int dummy[MAX_PASSED_FDS];
+        if (recv_fds(launcher_sock, &reply, sizeof(reply), dummy, &nfds) == sizeof(reply) && reply > 0)
+            pid = reply;
+    }
+    else if (errno == EPIPE || errno == ECONNRESET)
+    {
+        // Helper died: fall back to fork() from now on
+        close(launcher_sock);
+        launcher_sock = -1;
+    }
+
+    sb_free(&msg);
+    return pid;
+}
+
+// Body of a cloned child: install fds, cwd and env, then exec
+static void launch_child(const LaunchRequest *req, char *body, int *fds, int nfds)
+{
+    if (req->pgid >= 0)
+        setpgid(0, req->pgid);
+    reset_child_signals();
+
+    // Redirection files go out of the way of every descriptor they may replace
+    for (int i = 3; i < nfds; i++)
+    {
+        if (fds[i] < REDIR_FD_MIN)
+            fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+    }
+    for (int i = 0; i < 3; i++)
+        dup2(fds[i], i);
+
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    const LaunchRedirect *lr = (const LaunchRedirect *)body;
+    int next_fd = 3;
+    for (uint32_t i = 0; i < req->nredirs && i < MAX_REDIRS; i++)
+    {
+        Redirect *r = &cmd.redirs[cmd.num_redirs++];
+        r->fd = lr[i].fd;
+        r->op = lr[i].op;
+        r->src = lr[i].src;
+        r->opened = -1;
+        if (r->op != REDIR_DUP && r->op != REDIR_CLOSE && next_fd < nfds)
+            r->opened = fds[next_fd++];
+    }
+
+    char *p = body + req->nredirs * sizeof(LaunchRedirect);
+    char *cwd = p;
+    p += strlen(p) + 1;
+    cmd.kind = CMD_EXTERNAL;
+    cmd.path = p;
+    p += strlen(p) + 1;
+
+    for (uint32_t i = 0; i < req->argc && i < MAX_ARGS - 1; i++)
+    {
+        cmd.argv[cmd.argc++] = p;
+        p += strlen(p) + 1;
+    }
+    cmd.argv[cmd.argc] = NULL;
+    while (cmd.first < cmd.argc && assignment_name_len(cmd.argv[cmd.first]) > 0)
+        cmd.first++;
+
+    for (uint32_t i = 0; i < req->envc; i++)
+    {
+        char *eq = strchr(p, '=');
+        if (eq)
+            putenv(p);
+        else
+            unsetenv(p);
+        p += strlen(p) + 1;
+    }
+
+    if (chdir(cwd) < 0)
+    {
+        perror(cwd);
+        _exit(126);
+    }
+    exec_command(&cmd);
+}
+
+// Helper main loop: one request in, one pid (or -errno) out
+int launcher_main(int sock)
+{
+    char *buf = malloc(LAUNCH_MSG_MAX + 1);
+    if (!buf)
+        return 1;
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+    for (;;)
+    {
+        int fds[MAX_PASSED_FDS];
+        int nfds;
+        long n = recv_fds(sock, buf, LAUNCH_MSG_MAX, fds, &nfds);
+        if (n <= 0)
+            return 0;  // Shell exited
+        buf[n] = '\0';
+
+        int32_t reply = -EINVAL;
+        LaunchRequest req;
+        if ((size_t)n >= sizeof(req))
+            memcpy(&req, buf, sizeof(req));
+        if ((size_t)n >= sizeof(req) && nfds >= 3 &&
+            req.nredirs <= ((size_t)n - sizeof(req)) / sizeof(LaunchRedirect))
+        {
+            // Like fork(), but the child's parent is the shell
+            pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+            if (pid == 0)
+                launch_child(&req, buf + sizeof(req), fds, nfds);
+            reply = pid < 0 ? -errno : pid;
+        }
+
+        for (int i = 0; i < nfds; i++)
+            close(fds[i]);
+        send_fds(sock, &reply, sizeof(reply), NULL, 0);
+    }
+}
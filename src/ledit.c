@@ -0,0 +1,468 @@
+/*
+ * ledit.c - Built-in line editor, a small alternative to readline
+ *
+ * The editor never blocks: the shell polls the input descriptor along with
+ * its job pipes and timers and calls ledit_feed() when keys are available,
+ * so job events are handled while the user types. The line is drawn on a
+ * single terminal row and scrolls horizontally when it gets too long; the
+ * up and down keys walk the shell's history (hist.c).
+ */
+
+#include "../include/ledit.h"
+#include "../include/hist.h"
+#include "../include/shell.h"
+#include "../include/utils.h"
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+
+static int in_fd = -1;
+static int out_fd = -1;
+static int is_tty;
+static int raw_on;
+static struct termios saved_termios;
+
+static char *prompt;
+static int prompt_cols; // Columns the prompt takes on screen
+
+static char *buf; // The line being edited (NUL-terminated)
+static size_t len;
+static size_t cap;
+static size_t pos; // Cursor (byte offset)
+static size_t left; // First byte shown when the line is scrolled
+
+static int hist_index; // Entry shown; hist_count() = the new line
+static char *saved_line; // The new line while history is shown
+
+static char esc[LEDIT_ESC_MAX]; // Escape sequence being collected
+static int esc_len;
+
+// UTF-8 continuation bytes take no column
+static int is_cont(char c)
+{
+    return ((unsigned char)c & 0xc0) == 0x80;
+}
+
+// Columns taken by s[0..n), skipping ANSI escape sequences
+static int text_cols(const char *s, size_t n)
+{
+    int cols = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (s[i] == '\033' && i + 1 < n && s[i + 1] == '[')
+        {
+            for (i += 2; i < n && !(s[i] >= 0x40 && s[i] <= 0x7e); i++)
+                ;
+            continue;
+        }
+        if (!is_cont(s[i]) && s[i] != '\001' && s[i] != '\002')
+            cols++;
+    }
+    return cols;
+}
+
+// Columns taken by buf[from..to), one per character
+static int line_cols(size_t from, size_t to)
+{
+    int cols = 0;
+    for (size_t i = from; i < to; i++)
+        cols += !is_cont(buf[i]);
+    return cols;
+}
+
+// Byte offset of the character before / after offset i
+static size_t prev_char(size_t i)
+{
+    while (i > 0 && is_cont(buf[--i]))
+        ;
+    return i;
+}
+
+static size_t next_char(size_t i)
+{
+    while (i < len && is_cont(buf[++i]))
+        ;
+    return i;
+}
+
+static int term_cols(void)
+{
+    struct winsize ws;
+    if (ioctl(out_fd, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0)
+        return LEDIT_DEFAULT_COLS;
+    return ws.ws_col;
+}
+
+// Redraw the prompt and the visible part of the line in one write
+static void refresh(void)
+{
+    if (!is_tty)
+        return;
+    int avail = term_cols() - prompt_cols - 1;
+    if (avail < 1)
+        avail = 1;
+    if (pos < left)
+        left = pos;
+    while (line_cols(left, pos) >= avail)
+        left = next_char(left);
+
+    StrBuf sb;
+    sb_init(&sb);
+    sb_append(&sb, "\r", 1);
+    sb_append(&sb, prompt, strlen(prompt));
+    int shown = 0;
+    size_t i = left;
+    while (i < len && shown < avail)
+    {
+        size_t next = next_char(i);
+        unsigned char c = buf[i];
+        if (c < 0x20)
+        {
+            // Control characters (a newline from a multi-line entry) show as reverse video letters
+            char ctl[] = { '\033', '[', '7', 'm', (char)(c + '@'), '\033', '[', '0', 'm' };
+            sb_append(&sb, ctl, sizeof(ctl));
+        }
+        else
+            sb_append(&sb, buf + i, next - i);
+        shown++;
+        i = next;
+    }
+    sb_append(&sb, "\033[0K\r", 5);
+    int col = prompt_cols + line_cols(left, pos);
+    if (col > 0)
+    {
+        char move[24];
+        int n = snprintf(move, sizeof(move), "\033[%dC", col);
+        sb_append(&sb, move, n);
+    }
+    if (sb.data)
+        write_all(out_fd, sb.data, sb.len);
+    sb_free(&sb);
+}
+
+// Replace the line with text, cursor at the end
+static void set_line(const char *text)
+{
+    size_t n = strlen(text);
+    if (n + 1 > cap)
+    {
+        char *grown = realloc(buf, n + 1);
+        if (!grown)
+            return;
+        buf = grown;
+        cap = n + 1;
+    }
+    memcpy(buf, text, n + 1);
+    len = pos = n;
+    left = 0;
+}
+
+static void insert(char c)
+{
+    if (len + 2 > cap)
+    {
+        size_t want = cap ? cap * 2 : 128;
+        char *grown = realloc(buf, want);
+        if (!grown)
+            return;
+        buf = grown;
+        cap = want;
+    }
+    memmove(buf + pos + 1, buf + pos, len - pos + 1);
+    buf[pos++] = c;
+    len++;
+}
+
+// Remove buf[from..to)
+static void erase(size_t from, size_t to)
+{
+    memmove(buf + from, buf + to, len - to + 1);
+    len -= to - from;
+    pos = from;
+}
+
+// Word boundaries for Alt-b / Alt-f / Ctrl-W: runs of non-blanks
+static size_t word_start(size_t i)
+{
+    while (i > 0 && buf[i - 1] == ' ')
+        i--;
+    while (i > 0 && buf[i - 1] != ' ')
+        i--;
+    return i;
+}
+
+static size_t word_end(size_t i)
+{
+    while (i < len && buf[i] == ' ')
+        i++;
+    while (i < len && buf[i] != ' ')
+        i++;
+    return i;
+}
+
+// Show history entry index (hist_count() = the line that was being typed)
+static void hist_move(int index)
+{
+    if (index < 0 || index > hist_count() || index == hist_index)
+        return;
+    if (hist_index == hist_count())
+    {
+        free(saved_line);
+        saved_line = strdup(buf);
+    }
+    hist_index = index;
+    set_line(index == hist_count() ? (saved_line ? saved_line : "") : hist_get(index));
+}
+
+// Act on a complete escape sequence
+static void escape_key(void)
+{
+    char final = esc[esc_len - 1];
+    if (esc_len == 2)
+    {
+        // Alt-<key>
+        if (final == 'b')
+            pos = word_start(pos);
+        else if (final == 'f')
+            pos = word_end(pos);
+        return;
+    }
+    // ESC [ 1 ; 5 C and friends: Ctrl-Right / Ctrl-Left move by words
+    int modified = esc_len > 4 && memchr(esc, ';', esc_len) != NULL;
+    int num = esc[1] == '[' ? atoi(esc + 2) : 0;
+    switch (final)
+    {
+    case 'A':
+        hist_move(hist_index - 1);
+        break;
+    case 'B':
+        hist_move(hist_index + 1);
+        break;
+    case 'C':
+        pos = modified ? word_end(pos) : next_char(pos);
+        break;
+    case 'D':
+        pos = modified ? word_start(pos) : prev_char(pos);
+        break;
+    case 'H':
+        pos = 0;
+        break;
+    case 'F':
+        pos = len;
+        break;
+    case '~':
+        if (num == 1 || num == 7)
+            pos = 0;
+        else if (num == 4 || num == 8)
+            pos = len;
+        else if (num == 3 && pos < len)
+            erase(pos, next_char(pos));
+        break;
+    }
+}
+
+// Collect one byte of an escape sequence; returns 1 once it is complete
+static int escape_byte(char c)
+{
+    if (esc_len == LEDIT_ESC_MAX)
+    {
+        esc_len = 0; // Not a sequence we know: drop it
+        return 0;
+    }
+    esc[esc_len++] = c;
+    if (esc_len == 2)
+        return c != '[' && c != 'O';
+    if (esc[1] == 'O')
+        return 1;
+    return esc_len > 2 && c >= 0x40 && c <= 0x7e;
+}
+
+// Handle one key byte on a terminal
+static LeditStatus key(char c)
+{
+    if (esc_len > 0)
+    {
+        if (escape_byte(c))
+        {
+            escape_key();
+            esc_len = 0;
+        }
+        return LEDIT_MORE;
+    }
+    switch (c)
+    {
+    case '\r':
+    case '\n':
+        pos = len;
+        refresh();
+        write_all(out_fd, "\n", 1);
+        return LEDIT_LINE;
+    case '\033':
+        esc[0] = c;
+        esc_len = 1;
+        break;
+    case KEY_CTRL('D'):
+        if (len == 0)
+            return LEDIT_EOF;
+        if (pos < len)
+            erase(pos, next_char(pos));
+        break;
+    case KEY_CTRL('C'):
+        write_all(out_fd, "^C\n", 3);
+        set_line("");
+        hist_index = hist_count();
+        break;
+    case 0x7f:
+    case KEY_CTRL('H'):
+        if (pos > 0)
+            erase(prev_char(pos), pos);
+        break;
+    case KEY_CTRL('A'):
+        pos = 0;
+        break;
+    case KEY_CTRL('E'):
+        pos = len;
+        break;
+    case KEY_CTRL('B'):
+        pos = prev_char(pos);
+        break;
+    case KEY_CTRL('F'):
+        pos = next_char(pos);
+        break;
+    case KEY_CTRL('P'):
+        hist_move(hist_index - 1);
+        break;
+    case KEY_CTRL('N'):
+        hist_move(hist_index + 1);
+        break;
+    case KEY_CTRL('K'):
+        erase(pos, len);
+        break;
+    case KEY_CTRL('U'):
+        erase(0, pos);
+        break;
+    case KEY_CTRL('W'):
+        erase(word_start(pos), pos);
+        break;
+    case KEY_CTRL('L'):
+        write_all(out_fd, "\033[H\033[2J", 7);
+        break;
+    default:
+        // No completion, and other control keys are ignored
+        if ((unsigned char)c >= 0x20)
+            insert(c);
+        break;
+    }
+    return LEDIT_MORE;
+}
+
+int ledit_start(int in, int out, const char *p)
+{
+    free(prompt);
+    prompt = strdup(p);
+    if (!prompt)
+        return -1;
+    prompt_cols = text_cols(prompt, strlen(prompt));
+    in_fd = in;
+    out_fd = out;
+    set_line("");
+    if (!buf)
+        return -1;
+    hist_index = hist_count();
+    free(saved_line);
+    saved_line = NULL;
+    esc_len = 0;
+
+    fflush(stdout);
+    is_tty = isatty(in_fd);
+    if (!is_tty)
+    {
+        write_all(out_fd, prompt, strlen(prompt));
+        return 0;
+    }
+    if (tcgetattr(in_fd, &saved_termios) == 0)
+    {
+        // Keys one at a time without echo or signals; output processing stays
+        // on so whatever the shell prints while editing still gets \r\n
+        struct termios raw = saved_termios;
+        raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+        raw.c_cflag |= CS8;
+        raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        raw_on = tcsetattr(in_fd, TCSANOW, &raw) == 0; // Keep typeahead
+    }
+    refresh();
+    return 0;
+}
+
+LeditStatus ledit_feed(char **line)
+{
+    LeditStatus status = LEDIT_MORE;
+    int pending = 1; // The caller saw the descriptor readable
+    while (pending > 0 && status == LEDIT_MORE)
+    {
+        // One byte at a time: typeahead after Enter belongs to the command
+        char c;
+        ssize_t n = read(in_fd, &c, 1);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            break;
+        if (n <= 0)
+        {
+            // End of input: a last line without a newline still counts
+            status = len > 0 && !is_tty ? LEDIT_LINE : LEDIT_EOF;
+            if (status == LEDIT_LINE)
+            {
+                write_all(out_fd, buf, len);
+                write_all(out_fd, "\n", 1);
+            }
+            break;
+        }
+        if (!is_tty)
+        {
+            if (c == '\n')
+            {
+                write_all(out_fd, buf, len);
+                write_all(out_fd, "\n", 1);
+                status = LEDIT_LINE;
+            }
+            else
+                insert(c);
+        }
+        else
+            status = key(c);
+        if (ioctl(in_fd, FIONREAD, &pending) < 0)
+            pending = 0;
+    }
+    if (status == LEDIT_MORE)
+        refresh();
+    if (status == LEDIT_LINE)
+    {
+        *line = strdup(buf);
+        if (!*line)
+            status = LEDIT_EOF;
+    }
+    return status;
+}
+
+void ledit_hide(void)
+{
+    if (is_tty)
+        write_all(out_fd, "\r\033[0K", 5);
+}
+
+void ledit_show(void)
+{
+    fflush(stdout);
+    refresh();
+}
+
+void ledit_stop(void)
+{
+    if (raw_on)
+        tcsetattr(in_fd, TCSANOW, &saved_termios);
+    raw_on = 0;
+    free(saved_line);
+    saved_line = NULL;
+}
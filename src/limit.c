@@ -0,0 +1,717 @@
+/*
+ * limit.c - Per-job cgroups: resource limits and exact totals
+ *
+ * limit [-c CPUS] [-m SIZE] [-p N] pipeline puts the job's processes in
+ * a cgroup of their own under <shell's cgroup>/tinyshell-PID, with the
+ * limits written to cpu.max, memory.max and pids.max. When the job is
+ * gone its CPU time, memory peak and IO come from the cgroup's files,
+ * which count every process the job ever had, reaped or not. Each stage
+ * is forked by the shell and writes itself to cgroup.procs before exec;
+ * the shell writes it there too, so the cgroup is never empty while the
+ * job runs. A job's slot lasts until a pidfd says its last stage exited.
+ *
+ * Without a writable cgroup v2 tree, or without a controller, the child
+ * applies setrlimit instead: RLIMIT_AS for -m and RLIMIT_NPROC for -p
+ * (per user, not per job). cpu.max has no rlimit counterpart.
+ */
+
+#include "../include/limit.h"
+#include "../include/utils.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Controllers the job cgroups can use
+enum { CTL_CPU = 1, CTL_MEMORY = 2, CTL_PIDS = 4, CTL_IO = 8 };
+
+// One limited job
+typedef struct
+{
+    int used;
+    pid_t pid; // Last stage (0 while launching)
+    int pidfd; // Readable once the last stage exited (-1 if none)
+    int job_num; // Job number if it was in the job table
+    char *dir; // Its cgroup, NULL without one
+    LimitSpec spec;
+    int rlimits; // Limits left to setrlimit (CTL_MEMORY, CTL_PIDS)
+    struct rusage before; // RUSAGE_CHILDREN at launch
+} JobLimit;
+
+static JobLimit limits[LIMIT_MAX];
+static int launching = -1; // Slot whose processes are being forked
+static int procs_fd = -1; // Its cgroup.procs
+
+static int cg_state; // 0 = not probed, 1 = usable, -1 = unavailable
+static char *cg_root; // <shell's cgroup>/tinyshell-PID
+static int controllers; // CTL_* enabled for children of cg_root
+static pid_t owner; // Shell that made cg_root (forked subshells must not remove it)
+static unsigned next_seq = 1;
+
+static int write_file(const char *path, const char *text)
+{
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    int r = write_all(fd, text, strlen(text));
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return r;
+}
+
+// Read a small file; returns its length or -1
+static ssize_t read_file(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+// Value of "key N" in a flat keyed file (cpu.stat, memory.events); -1 if absent
+static long long read_key(const char *dir, const char *file, const char *key)
+{
+    char path[PATH_MAX_LEN], buf[2048];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    if (read_file(path, buf, sizeof(buf)) < 0)
+        return -1;
+    size_t klen = strlen(key);
+    for (char *line = buf; line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL)
+    {
+        if (strncmp(line, key, klen) == 0 && line[klen] == ' ')
+            return strtoll(line + klen + 1, NULL, 10);
+    }
+    return -1;
+}
+
+// Single number file (memory.peak, memory.current); -1 if absent
+static long long read_value(const char *dir, const char *file)
+{
+    char path[PATH_MAX_LEN], buf[64];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    if (read_file(path, buf, sizeof(buf)) < 0 || !isdigit((unsigned char)buf[0]))
+        return -1;
+    return strtoll(buf, NULL, 10);
+}
+
+static void remove_root(void)
+{
+    if (!cg_root || getpid() != owner)
+        return;
+    DIR *d = opendir(cg_root);
+    struct dirent *e;
+    while (d && (e = readdir(d)))
+    {
+        char path[PATH_MAX_LEN];
+        if (strncmp(e->d_name, "job-", 4) != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", cg_root, e->d_name);
+        rmdir(path); // Fails (EBUSY) for jobs that outlive the shell: they keep their cgroup
+    }
+    if (d)
+        closedir(d);
+    rmdir(cg_root);
+}
+
+// Find our cgroup v2 directory and make tinyshell-PID under it (once)
+static int cg_setup(void)
+{
+    if (cg_state)
+        return cg_state;
+    cg_state = -1;
+
+    // The cgroup2 mount (/sys/fs/cgroup, or .../unified in hybrid setups)
+    char mount[PATH_MAX_LEN] = "", line[1024];
+    FILE *f = fopen("/proc/self/mountinfo", "re");
+    while (f && !mount[0] && fgets(line, sizeof(line), f))
+    {
+        char mnt[PATH_MAX_LEN], fstype[64];
+        char *sep = strstr(line, " - ");
+        if (sep && sscanf(sep + 3, "%63s", fstype) == 1 && strcmp(fstype, "cgroup2") == 0 &&
+            sscanf(line, "%*s %*s %*s %*s %1023s", mnt) == 1)
+            snprintf(mount, sizeof(mount), "%s", mnt);
+    }
+    if (f)
+        fclose(f);
+
+    // Our place in it: the "0::" line
+    char rel[PATH_MAX_LEN] = "";
+    f = fopen("/proc/self/cgroup", "re");
+    while (f && !rel[0] && fgets(line, sizeof(line), f))
+    {
+        if (strncmp(line, "0::", 3) == 0)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(rel, sizeof(rel), "%s", line + 3);
+        }
+    }
+    if (f)
+        fclose(f);
+    if (!mount[0] || !rel[0])
+        return cg_state;
+
+    char base[2 * PATH_MAX_LEN];
+    snprintf(base, sizeof(base), "%s%s", mount, strcmp(rel, "/") == 0 ? "" : rel);
+    if (asprintf(&cg_root, "%s/tinyshell-%d", base, (int)getpid()) < 0)
+    {
+        cg_root = NULL;
+        return cg_state;
+    }
+    if (mkdir(cg_root, 0755) < 0 && errno != EEXIST)
+    {
+        free(cg_root);
+        cg_root = NULL;
+        return cg_state;
+    }
+    owner = getpid();
+    atexit(remove_root);
+
+    // Pass down whatever controllers we are given. Enabling them in our own
+    // cgroup fails if it is not the root and has processes (the shell among
+    // them); the jobs then get accounting only and setrlimit limits.
+    static const char *const names[] = { "cpu", "memory", "pids", "io" };
+    char path[sizeof(base) + 32], buf[256];
+    for (int i = 0; i < 4; i++)
+    {
+        char op[16];
+        snprintf(op, sizeof(op), "+%s", names[i]);
+        snprintf(path, sizeof(path), "%s/cgroup.subtree_control", base);
+        write_file(path, op);
+        snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cg_root);
+        write_file(path, op);
+    }
+    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", cg_root);
+    if (read_file(path, buf, sizeof(buf)) >= 0)
+    {
+        for (char *tok = strtok(buf, " \n"); tok; tok = strtok(NULL, " \n"))
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                if (strcmp(tok, names[i]) == 0)
+                    controllers |= 1 << i;
+            }
+        }
+    }
+    return cg_state = 1;
+}
+
+// Parse SIZE with an optional K/M/G suffix
+static int parse_size(const char *s, uint64_t *bytes)
+{
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (end == s || errno)
+        return -1;
+    switch (*end)
+    {
+        case 'G': case 'g': v <<= 10; // fall through
+        case 'M': case 'm': v <<= 10; // fall through
+        case 'K': case 'k': v <<= 10; end++; break;
+        default: break;
+    }
+    if (*end || v == 0)
+        return -1;
+    *bytes = v;
+    return 0;
+}
+
+// Parse -c/-m/-p options; returns the index of the first other word
+int limit_parse(int argc, char **argv, LimitSpec *spec)
+{
+    memset(spec, 0, sizeof(*spec));
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-' && argv[i][1] && strchr("cmp", argv[i][1]) && argv[i][2] == '\0'; i += 2)
+    {
+        const char *v = argv[i + 1];
+        char *end;
+        int ok = 1;
+        if (argv[i][1] == 'c')
+        {
+            double cpus = strtod(v, &end);
+            ok = end != v && *end == '\0' && cpus > 0 && cpus < 1e6;
+            spec->cpu_quota_us = ok ? (uint64_t)(cpus * LIMIT_CPU_PERIOD_US + 0.5) : 0;
+        }
+        else if (argv[i][1] == 'm')
+            ok = parse_size(v, &spec->mem_bytes) == 0;
+        else
+        {
+            spec->pids = strtoull(v, &end, 10);
+            ok = end != v && *end == '\0' && spec->pids > 0;
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "%slimit: %s: invalid value for %s%s\n", COLOR_RED, v, argv[i], COLOR_RESET);
+            return -1;
+        }
+    }
+    if (i < argc && argv[i][0] == '-' && argv[i][1])
+    {
+        fprintf(stderr, "%slimit: %s: invalid option%s\n", COLOR_RED, argv[i], COLOR_RESET);
+        return -1;
+    }
+    return i;
+}
+
+// Write the limits of spec to a job cgroup; returns the ones that need setrlimit
+static int apply_cgroup(const char *dir, const LimitSpec *spec)
+{
+    char path[PATH_MAX_LEN], val[64];
+    int rest = 0;
+    if (spec->cpu_quota_us)
+    {
+        snprintf(path, sizeof(path), "%s/cpu.max", dir);
+        snprintf(val, sizeof(val), "%llu %d", (unsigned long long)spec->cpu_quota_us, LIMIT_CPU_PERIOD_US);
+        if (!(controllers & CTL_CPU) || write_file(path, val) < 0)
+            rest |= CTL_CPU;
+    }
+    if (spec->mem_bytes)
+    {
+        snprintf(path, sizeof(path), "%s/memory.max", dir);
+        snprintf(val, sizeof(val), "%llu", (unsigned long long)spec->mem_bytes);
+        if (!(controllers & CTL_MEMORY) || write_file(path, val) < 0)
+            rest |= CTL_MEMORY;
+        // No swapping around the limit, where that can be set
+        snprintf(path, sizeof(path), "%s/memory.swap.max", dir);
+        if (!(rest & CTL_MEMORY))
+            write_file(path, "0");
+    }
+    if (spec->pids)
+    {
+        snprintf(path, sizeof(path), "%s/pids.max", dir);
+        snprintf(val, sizeof(val), "%llu", (unsigned long long)spec->pids);
+        if (!(controllers & CTL_PIDS) || write_file(path, val) < 0)
+            rest |= CTL_PIDS;
+    }
+    return rest;
+}
+
+// Limits no controller takes: say which ones setrlimit covers
+static int fallback(int rest)
+{
+    if (rest & CTL_CPU)
+        fprintf(stderr, "%slimit: -c not enforced: no cpu controller%s\n", COLOR_RED, COLOR_RESET);
+    if ((rest & CTL_PIDS) && geteuid() == 0)
+        fprintf(stderr, "%slimit: -p not enforced: no pids controller (RLIMIT_NPROC does not apply to root)%s\n", COLOR_RED, COLOR_RESET);
+    return rest & (CTL_MEMORY | CTL_PIDS);
+}
+
+// Make a job cgroup; returns its path (caller frees) or NULL
+static char *make_cgroup(void)
+{
+    char *dir;
+    if (cg_setup() < 0 || asprintf(&dir, "%s/job-%u", cg_root, next_seq++) < 0)
+        return NULL;
+    if (mkdir(dir, 0755) < 0)
+    {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+static void release(JobLimit *l)
+{
+    if (l->used && l->pidfd >= 0)
+        close(l->pidfd);
+    if (l->dir && rmdir(l->dir) < 0 && errno != ENOENT)
+        fprintf(stderr, "%slimit: %s: %s%s\n", COLOR_RED, l->dir, strerror(errno), COLOR_RESET);
+    free(l->dir);
+    memset(l, 0, sizeof(*l));
+}
+
+// Prepare a job's cgroup and limits for the processes forked next
+int limit_begin(const LimitSpec *spec)
+{
+    // Scripts have no prompt to report finished jobs at: free their slots here
+    limit_reap();
+    JobLimit *l = NULL;
+    for (int i = 0; i < LIMIT_MAX && !l; i++)
+    {
+        if (!limits[i].used)
+            l = &limits[i];
+    }
+    if (!l)
+    {
+        fprintf(stderr, "%slimit: too many limited jobs%s\n", COLOR_RED, COLOR_RESET);
+        return -1;
+    }
+    memset(l, 0, sizeof(*l));
+    l->used = 1;
+    l->pidfd = -1;
+    l->spec = *spec;
+    l->dir = make_cgroup();
+    int rest = CTL_CPU | CTL_MEMORY | CTL_PIDS;
+    if (l->dir)
+    {
+        rest = apply_cgroup(l->dir, spec);
+        char path[PATH_MAX_LEN];
+        snprintf(path, sizeof(path), "%s/cgroup.procs", l->dir);
+        procs_fd = open(path, O_WRONLY | O_CLOEXEC);
+    }
+    if (!spec->cpu_quota_us)
+        rest &= ~CTL_CPU;
+    if (!spec->mem_bytes)
+        rest &= ~CTL_MEMORY;
+    if (!spec->pids)
+        rest &= ~CTL_PIDS;
+    l->rlimits = fallback(rest);
+    getrusage(RUSAGE_CHILDREN, &l->before);
+    launching = l - limits;
+    return launching;
+}
+
+int limit_active(void)
+{
+    return launching >= 0;
+}
+
+// In a forked child: join the job's cgroup, or take the limits as rlimits
+void limit_enter_child(void)
+{
+    if (launching < 0)
+        return;
+    JobLimit *l = &limits[launching];
+    if (procs_fd >= 0 && write_all(procs_fd, "0", 1) < 0)
+        perror("limit: cgroup.procs");
+    struct rlimit rl;
+    if (l->rlimits & CTL_MEMORY)
+    {
+        rl.rlim_cur = rl.rlim_max = l->spec.mem_bytes;
+        if (setrlimit(RLIMIT_AS, &rl) < 0)
+            perror("limit: RLIMIT_AS");
+    }
+    if (l->rlimits & CTL_PIDS)
+    {
+        rl.rlim_cur = rl.rlim_max = l->spec.pids;
+        if (setrlimit(RLIMIT_NPROC, &rl) < 0)
+            perror("limit: RLIMIT_NPROC");
+    }
+}
+
+// In the shell, after forking a stage: move it into the job's cgroup too, so
+// it is there when the launch ends even if the child has not run yet
+void limit_forked(pid_t pid)
+{
+    if (launching < 0 || procs_fd < 0)
+        return;
+    char val[16];
+    int n = snprintf(val, sizeof(val), "%d", (int)pid);
+    if (write(procs_fd, val, n) < 0 && errno != ESRCH)
+        perror("limit: cgroup.procs");
+}
+
+// Number of the live job whose last stage is pid (0 = none)
+static int live_job(pid_t pid)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+    {
+        if (jobs[i].state != JOB_DONE && jobs[i].pid == pid && jobs[i].cmd_line)
+            return jobs[i].job_num;
+    }
+    return 0;
+}
+
+// Whether any process is still in a job's cgroup
+static int populated(const JobLimit *l)
+{
+    return l->dir && read_key(l->dir, "cgroup.events", "populated") > 0;
+}
+
+// Whether a job is over: its last stage exited and nothing is left in its cgroup
+static int gone(const JobLimit *l)
+{
+    int exited;
+    if (l->pidfd >= 0)
+    {
+        struct pollfd pfd = { l->pidfd, POLLIN, 0 };
+        exited = poll(&pfd, 1, 0) > 0;
+    }
+    else
+        exited = kill(l->pid, 0) < 0 && errno == ESRCH;
+    return exited && !populated(l);
+}
+
+static uint64_t tv_us(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+// Print a finished job's totals and drop it; now is RUSAGE_CHILDREN right
+// after a foreground job was waited for (NULL for a job reaped in the background)
+static void finish(JobLimit *l, const struct rusage *now)
+{
+    long long user = -1, sys = -1, peak = -1, rd = -1, wr = -1, oom = -1, forks = -1;
+    if (l->dir)
+    {
+        user = read_key(l->dir, "cpu.stat", "user_usec");
+        sys = read_key(l->dir, "cpu.stat", "system_usec");
+        peak = read_value(l->dir, "memory.peak");
+        oom = read_key(l->dir, "memory.events", "oom_kill");
+        forks = read_key(l->dir, "pids.events", "max");
+
+        // io.stat: one "MAJ:MIN rbytes=N wbytes=N ..." line per device
+        char path[PATH_MAX_LEN], buf[4096];
+        snprintf(path, sizeof(path), "%s/io.stat", l->dir);
+        if (read_file(path, buf, sizeof(buf)) >= 0)
+        {
+            rd = wr = 0;
+            for (char *p = buf; (p = strstr(p, "bytes=")); p += 6)
+            {
+                long long v = strtoll(p + 6, NULL, 10);
+                if (p[-1] == 'r' && p[-2] == ' ')
+                    rd += v;
+                else if (p[-1] == 'w' && p[-2] == ' ')
+                    wr += v;
+            }
+        }
+    }
+    if (now)
+    {
+        // What the cgroup could not tell: the children waited for since launch
+        if (user < 0)
+            user = tv_us(&now->ru_utime) - tv_us(&l->before.ru_utime);
+        if (sys < 0)
+            sys = tv_us(&now->ru_stime) - tv_us(&l->before.ru_stime);
+        if (peak < 0 && now->ru_maxrss > l->before.ru_maxrss)
+            peak = now->ru_maxrss * 1024LL; // Largest single process, not the sum
+        if (rd < 0)
+            rd = (now->ru_inblock - l->before.ru_inblock) * 512LL;
+        if (wr < 0)
+            wr = (now->ru_oublock - l->before.ru_oublock) * 512LL;
+    }
+
+    if (user >= 0 || sys >= 0)
+    {
+        char label[16] = "";
+        if (l->job_num)
+            snprintf(label, sizeof(label), "[%d] ", l->job_num);
+        printf("%s[%scpu %.3fs (user %.3fs, sys %.3fs)", COLOR_BLUE, label,
+               (user + sys) / 1e6, user / 1e6, sys / 1e6);
+        char b[16];
+        if (peak >= 0)
+        {
+            format_bytes(b, sizeof(b), peak);
+            printf(", memory peak %s", b);
+        }
+        if (rd >= 0)
+        {
+            format_bytes(b, sizeof(b), rd);
+            printf(", read %s", b);
+        }
+        if (wr >= 0)
+        {
+            format_bytes(b, sizeof(b), wr);
+            printf(", written %s", b);
+        }
+        if (oom > 0)
+            printf(", %lld OOM kill%s", oom, oom == 1 ? "" : "s");
+        if (forks > 0)
+            printf(", %lld fork%s refused", forks, forks == 1 ? "" : "s");
+        printf("]%s\n", COLOR_RESET);
+    }
+    release(l);
+}
+
+// The launch started by limit_begin() is over
+void limit_launched(int id, pid_t pid)
+{
+    if (id < 0)
+        return;
+    if (procs_fd >= 0)
+        close(procs_fd);
+    procs_fd = -1;
+    launching = -1;
+
+    JobLimit *l = &limits[id];
+    if (pid <= 0)
+    {
+        release(l);
+        return;
+    }
+    l->pid = pid;
+    l->job_num = live_job(pid);
+    // Fails with ESRCH for a foreground job already waited for; a background
+    // one can't have been reaped yet, as SIGCHLD is blocked while launching
+    l->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (l->job_num || !gone(l))
+        return; // In the background, or stopped: limit_reap() reports it
+
+    struct rusage now;
+    getrusage(RUSAGE_CHILDREN, &now);
+    finish(l, &now);
+}
+
+// Report limited jobs that are gone
+void limit_reap(void)
+{
+    for (int i = 0; i < LIMIT_MAX; i++)
+    {
+        JobLimit *l = &limits[i];
+        if (l->used && l->pid > 0 && !live_job(l->pid) && gone(l))
+            finish(l, NULL);
+    }
+}
+
+// Processes of a process group (from /proc); returns how many were stored
+static int group_members(pid_t pgid, pid_t *pids, int max)
+{
+    DIR *d = opendir("/proc");
+    if (!d)
+        return 0;
+    int n = 0;
+    struct dirent *e;
+    while (n < max && (e = readdir(d)))
+    {
+        if (!isdigit((unsigned char)e->d_name[0]))
+            continue;
+        char path[300], buf[512];
+        snprintf(path, sizeof(path), "/proc/%s/stat", e->d_name);
+        if (read_file(path, buf, sizeof(buf)) < 0)
+            continue;
+        char *p = strrchr(buf, ')');
+        int pg;
+        if (p && sscanf(p + 1, " %*c %*d %d", &pg) == 1 && pg == pgid)
+            pids[n++] = atoi(e->d_name);
+    }
+    closedir(d);
+    return n;
+}
+
+// Set limits on a running job
+static int limit_job(const char *spec_str, const LimitSpec *spec)
+{
+    Job *job = NULL;
+    int job_num = atoi(spec_str[0] == '%' ? spec_str + 1 : spec_str);
+    for (int i = 0; i < MAX_JOBS && !job; i++)
+    {
+        if (jobs[i].state != JOB_DONE && jobs[i].job_num == job_num && jobs[i].cmd_line)
+            job = &jobs[i];
+    }
+    if (!job)
+    {
+        fprintf(stderr, "%slimit: %s: no such job%s\n", COLOR_RED, spec_str, COLOR_RESET);
+        return 1;
+    }
+
+    pid_t pids[256];
+    int n = group_members(job->pgid, pids, 256);
+    JobLimit *l = NULL;
+    for (int i = 0; i < LIMIT_MAX && !l; i++)
+    {
+        if (limits[i].used && limits[i].pid == job->pid)
+            l = &limits[i];
+    }
+    if (!l)
+    {
+        // Not started under limit: give it a cgroup now (its totals start here)
+        for (int i = 0; i < LIMIT_MAX && !l; i++)
+        {
+            if (!limits[i].used)
+                l = &limits[i];
+        }
+        if (!l)
+        {
+            fprintf(stderr, "%slimit: too many limited jobs%s\n", COLOR_RED, COLOR_RESET);
+            return 1;
+        }
+        memset(l, 0, sizeof(*l));
+        l->used = 1;
+        l->pid = job->pid;
+        l->pidfd = syscall(SYS_pidfd_open, job->pid, 0);
+        l->job_num = job->job_num;
+        l->dir = make_cgroup();
+        char path[PATH_MAX_LEN], val[16];
+        for (int i = 0; l->dir && i < n; i++)
+        {
+            snprintf(path, sizeof(path), "%s/cgroup.procs", l->dir);
+            snprintf(val, sizeof(val), "%d", (int)pids[i]);
+            if (write_file(path, val) < 0)
+                fprintf(stderr, "%slimit: moving %d: %s%s\n", COLOR_RED, (int)pids[i], strerror(errno), COLOR_RESET);
+        }
+    }
+
+    // Only the options given change
+    if (spec->cpu_quota_us)
+        l->spec.cpu_quota_us = spec->cpu_quota_us;
+    if (spec->mem_bytes)
+        l->spec.mem_bytes = spec->mem_bytes;
+    if (spec->pids)
+        l->spec.pids = spec->pids;
+    int rest = l->dir ? apply_cgroup(l->dir, spec) : CTL_CPU | CTL_MEMORY | CTL_PIDS;
+    if (!spec->cpu_quota_us)
+        rest &= ~CTL_CPU;
+    if (!spec->mem_bytes)
+        rest &= ~CTL_MEMORY;
+    if (!spec->pids)
+        rest &= ~CTL_PIDS;
+    rest = fallback(rest);
+
+    // The rest as rlimits of the processes running now (not of ones they start later)
+    for (int i = 0; i < n && rest; i++)
+    {
+        struct rlimit rl;
+        if ((rest & CTL_MEMORY) && (rl.rlim_cur = rl.rlim_max = spec->mem_bytes) &&
+            prlimit(pids[i], RLIMIT_AS, &rl, NULL) < 0)
+            fprintf(stderr, "%slimit: %d: %s%s\n", COLOR_RED, (int)pids[i], strerror(errno), COLOR_RESET);
+        if ((rest & CTL_PIDS) && (rl.rlim_cur = rl.rlim_max = spec->pids) &&
+            prlimit(pids[i], RLIMIT_NPROC, &rl, NULL) < 0)
+            fprintf(stderr, "%slimit: %d: %s%s\n", COLOR_RED, (int)pids[i], strerror(errno), COLOR_RESET);
+    }
+    return 0;
+}
+
+// Built-in: limit - list limited jobs or change a job's limits
+int builtin_limit(int argc, char **argv)
+{
+    limit_reap();
+    if (argc == 1)
+    {
+        int shown = 0;
+        for (int i = 0; i < LIMIT_MAX; i++)
+        {
+            JobLimit *l = &limits[i];
+            if (!l->used || l->pid <= 0)
+                continue;
+            char cpus[16] = "-", mem[16] = "-", pids[24] = "-", used[24] = "-", cur[16] = "-";
+            if (l->spec.cpu_quota_us)
+                snprintf(cpus, sizeof(cpus), "%.2f", l->spec.cpu_quota_us / (double)LIMIT_CPU_PERIOD_US);
+            if (l->spec.mem_bytes)
+                format_bytes(mem, sizeof(mem), l->spec.mem_bytes);
+            if (l->spec.pids)
+                snprintf(pids, sizeof(pids), "%llu", (unsigned long long)l->spec.pids);
+            long long usage = l->dir ? read_key(l->dir, "cpu.stat", "usage_usec") : -1;
+            long long now = l->dir ? read_value(l->dir, "memory.current") : -1;
+            if (usage >= 0)
+                snprintf(used, sizeof(used), "%.2fs", usage / 1e6);
+            if (now >= 0)
+                format_bytes(cur, sizeof(cur), now);
+            if (!shown++)
+                printf("%-6s %7s %6s %8s %6s %9s %8s  %s\n", "JOB", "PID", "CPUS", "MEM", "PIDS", "CPU", "MEMORY", "CGROUP");
+            char label[16];
+            snprintf(label, sizeof(label), "[%d]", l->job_num);
+            printf("%-6s %7d %6s %8s %6s %9s %8s  %s\n", label, (int)l->pid, cpus, mem, pids, used, cur,
+                   l->dir ? l->dir : "-");
+        }
+        return 0;
+    }
+
+    LimitSpec spec;
+    int i = limit_parse(argc, argv, &spec);
+    if (i < 0)
+        return 2;
+    if (i != argc - 1 || (!spec.cpu_quota_us && !spec.mem_bytes && !spec.pids))
+    {
+        fprintf(stderr, "%slimit: usage: limit [-c CPUS] [-m SIZE] [-p N] command... | limit [-c CPUS] [-m SIZE] [-p N] %%JOB%s\n", COLOR_RED, COLOR_RESET);
+        return 2;
+    }
+    return limit_job(argv[i], &spec);
+}
@@ -1,106 +1,395 @@
-/*
- * main.c - TinyShell Phase 2 main loop
- * A Unix shell implementation with I/O redirection and pipes
- */
-
-
-#include "../include/shell.h"
-#include "../include/parser.h"
-#include "../include/executor.h"
-#include "../include/utils.h"
-#include <readline/readline.h>
-#include <readline/history.h>
-#include <signal.h>
-
-int main(void) 
-{
-    // Setup shell for job control
-    shell_terminal = STDIN_FILENO;
-    shell_pgid = getpgrp();
-    
-    // Put shell in its own process group
-    if (setpgid(0, shell_pgid) < 0) 
-    {
-        perror("setpgid");
-        exit(1);
-    }
-    
-    // Take control of the terminal
-    tcsetpgrp(shell_terminal, shell_pgid);
-    
-    // Ignore SIGINT, SIGTSTP, SIGTTIN, and SIGTTOU in shell
-    struct sigaction sa;
-    sa.sa_handler = SIG_IGN;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, NULL);
-    sigaction(SIGTSTP, &sa, NULL);
-    sigaction(SIGTTIN, &sa, NULL);  // Ignore terminal input for background
-    sigaction(SIGTTOU, &sa, NULL);  // Ignore terminal output for background
-    
-    // Set up SIGCHLD handler to reap zombie processes
-    struct sigaction sa_chld;
-    sa_chld.sa_handler = sigchld_handler;
-    sigemptyset(&sa_chld.sa_mask);
-    sa_chld.sa_flags = SA_RESTART;  // Restart interrupted system calls
-    sigaction(SIGCHLD, &sa_chld, NULL);
-
-    char *line = NULL;
-    
-    // Initialize job tracking
-    for (int i = 0; i < MAX_JOBS; i++) 
-    {
-        jobs[i].state = JOB_DONE;
-        jobs[i].cmd_line = NULL;
-    }
-
-    while (1)
-    {
-        // Check for completed background jobs and notify user
-        check_job_notifications();
-        
-        // Prompt with current directory
-        char *cwd = get_current_dir();
-        char prompt[PATH_MAX_LEN + 32];
-        if (cwd)
-            snprintf(prompt, sizeof(prompt), "%stinyshell:%s>%s ", COLOR_CYAN, cwd, COLOR_RESET);
-        else
-            snprintf(prompt, sizeof(prompt), "%stinyshell>%s ", COLOR_CYAN, COLOR_RESET);
-
-        // Read input with readline
-        line = readline(prompt);
-        if (!line) // EOF (Ctrl-D)
-        {
-            printf("\n");
-            break;
-        }
-        if (*line == '\0')
-        {
-            free(line);
-            continue;
-        }
-        add_history(line);
-
-        // Make a copy of line for parsing (since strtok modifies it)
-        char *line_copy = strdup(line);
-        free(line);
-        if (!line_copy)
-        {
-            perror("strdup");
-            continue;
-        }
-
-        // Parse pipeline
-        Command cmds[MAX_CMDS];
-        int num_cmds = split_pipeline(line_copy, cmds);
-
-        // Execute commands
-        if (num_cmds > 0)
-        {
-            execute_pipeline(cmds, num_cmds);
-        }
-
-        free(line_copy);
-    }
-    return 0;
-}
+/*
+ * main.c - TinyShell Phase 2 main loop
+ * A Unix shell implementation with I/O redirection and pipes
+ */
+
+
+#include "../include/shell.h"
+#include "../include/executor.h"
+#include "../include/utils.h"
+#include "../include/trace.h"
+#include "../include/launcher.h"
+#include "../include/script.h"
+#include "../include/cache.h"
+#include "../include/expand.h"
+#include "../include/stats.h"
+#include "../include/joblog.h"
+#include "../include/serve.h"
+#include "../include/record.h"
+#include "../include/hist.h"
+#include "../include/ledit.h"
+#ifndef NO_READLINE
+#include <readline/readline.h>
+#include <readline/history.h>
+#endif
+#include <signal.h>
+
+#define MAX_STARTUP_PHASES 8
+
+// Startup phase timings reported by --profile-startup
+typedef struct
+{
+    const char *name;
+    uint64_t ns;
+} StartupPhase;
+
+static StartupPhase phases[MAX_STARTUP_PHASES];
+static int nphases;
+static uint64_t phase_start;
+
+// Line editor: the built-in one, or readline when compiled in
+#ifdef NO_READLINE
+static int use_ledit = 1;
+#else
+static int use_ledit;
+#endif
+
+// Close the current startup phase and start the next one
+static void end_phase(const char *name)
+{
+    uint64_t now = monotonic_ns();
+    if (nphases < MAX_STARTUP_PHASES)
+    {
+        phases[nphases].name = name;
+        phases[nphases].ns = now - phase_start;
+        nphases++;
+    }
+    phase_start = now;
+}
+
+// Print the time spent getting to the first prompt
+static void print_startup_profile(uint64_t t_main)
+{
+    fprintf(stderr, "startup:");
+    for (int i = 0; i < nphases; i++)
+        fprintf(stderr, " %s %.3f ms,", phases[i].name, phases[i].ns / 1e6);
+    fprintf(stderr, " total %.3f ms\n", (monotonic_ns() - t_main) / 1e6);
+}
+
+// Run a script file through the compiled cache
+static int run_script_file(const char *path, int *from_cache)
+{
+    Program *prog;
+    int rc = cache_load_script(path, &prog, from_cache);
+    if (rc < 0)
+    {
+        perror(path);
+        return 127;
+    }
+    if (rc != SCRIPT_OK)
+        return 2;
+    int status = script_run(prog);
+    script_release(prog);
+    return status;
+}
+
+// Print command-line usage
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--trace FILE] [--zygote] [--no-cache] [--profile-startup] [--record FILE] [--editor builtin|readline] [--serve SOCKET | SCRIPT [ARGS...]]\n", prog);
+}
+
+// Select the line editor by name; -1 if unknown
+static int pick_editor(const char *name)
+{
+    if (strcmp(name, "builtin") == 0)
+    {
+        use_ledit = 1;
+        return 0;
+    }
+    if (strcmp(name, "readline") != 0)
+        return -1;
+#ifdef NO_READLINE
+    fprintf(stderr, "%stinyshell: built without readline, using the built-in editor%s\n", COLOR_RED, COLOR_RESET);
+#else
+    use_ledit = 0;
+#endif
+    return 0;
+}
+
+// Read a line with the built-in editor, announcing finished jobs and
+// draining captured output while the user types
+static char *edit_line(const char *prompt)
+{
+    // SIGCHLD only gets through inside ppoll(), so no exit goes unnoticed
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+
+    char *line = NULL;
+    if (ledit_start(STDIN_FILENO, STDOUT_FILENO, prompt) == 0)
+    {
+        for (;;)
+        {
+            for (int i = 0; i < MAX_JOBS; i++)
+            {
+                if (jobs[i].state == JOB_DONE && jobs[i].cmd_line)
+                {
+                    ledit_hide();
+                    check_job_notifications();
+                    ledit_show();
+                    break;
+                }
+            }
+            int r = joblog_wait(STDIN_FILENO, &prev);
+            if (r == JOBLOG_REDRAW)
+                ledit_show();
+            if (r < 0 || (r == JOBLOG_READY && ledit_feed(&line) != LEDIT_MORE))
+                break;
+        }
+        ledit_stop();
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return line;
+}
+
+// Read a line with the selected editor; NULL at end of input
+static char *input_line(const char *prompt)
+{
+#ifndef NO_READLINE
+    if (!use_ledit)
+        return readline(prompt);
+#endif
+    return edit_line(prompt);
+}
+
+int main(int argc, char **argv) 
+{
+    // Internal: launcher helper process started by launcher_start()
+    if (argc == 3 && strcmp(argv[1], "--launcher") == 0)
+        return launcher_main(atoi(argv[2]));
+
+    uint64_t t_main = monotonic_ns();
+    phase_start = t_main;
+
+    // Tracing: --trace FILE, or TINYSHELL_TRACE in the environment
+    const char *trace_path = getenv("TINYSHELL_TRACE");
+    const char *zygote_env = getenv("TINYSHELL_ZYGOTE");
+    int use_zygote = zygote_env && strcmp(zygote_env, "1") == 0;
+    int profile_startup = 0;
+    const char *record_path = getenv(RECORD_ENV);
+    const char *editor = getenv("TINYSHELL_EDITOR");
+    if (editor && *editor && pick_editor(editor) < 0)
+        fprintf(stderr, "%stinyshell: TINYSHELL_EDITOR: unknown editor %s%s\n", COLOR_RED, editor, COLOR_RESET);
+    const char *script_path = NULL;
+    const char *serve_path = NULL;
+    for (int i = 1; i < argc && !script_path; i++) 
+    {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) 
+        {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--zygote") == 0) 
+        {
+            use_zygote = 1;
+        }
+        else if (strcmp(argv[i], "--no-cache") == 0) 
+        {
+            cache_disabled = 1;
+        }
+        else if (strcmp(argv[i], "--profile-startup") == 0) 
+        {
+            profile_startup = 1;
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) 
+        {
+            record_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--editor") == 0 && i + 1 < argc && pick_editor(argv[i + 1]) == 0) 
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) 
+        {
+            serve_path = argv[++i];
+        }
+        else if (argv[i][0] != '-' && !serve_path) 
+        {
+            // Script file: the remaining arguments become $1, $2, ...
+            script_path = argv[i];
+            positional_argc = argc - i - 1;
+            positional_argv = argv + i + 1;
+        }
+        else 
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (trace_path && *trace_path) 
+    {
+        if (trace_open(trace_path) < 0)
+            perror(trace_path);
+    }
+
+    // Scripts (and the server's requests) run without job control or a terminal
+    if (script_path || serve_path)
+    {
+        interactive = 0;
+        struct sigaction sa_chld;
+        sa_chld.sa_handler = sigchld_handler;
+        sigemptyset(&sa_chld.sa_mask);
+        sa_chld.sa_flags = SA_RESTART;
+        sigaction(SIGCHLD, &sa_chld, NULL);
+        for (int i = 0; i < MAX_JOBS; i++) 
+            jobs[i].state = JOB_DONE;
+        // Launcher children belong to whoever started the launcher, so
+        // requests running in forks of the server can't use one
+        if (serve_path)
+            return serve_main(serve_path);
+        if (use_zygote && launcher_start() < 0)
+            perror("launcher");
+        return run_script_file(script_path, NULL);
+    }
+
+    // Setup shell for job control
+    // A private descriptor for the terminal, so { ...; } < file can't take it away
+    shell_terminal = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+    if (shell_terminal < 0)
+        shell_terminal = STDIN_FILENO;
+    shell_pgid = getpgrp();
+    
+    // Put shell in its own process group (a session leader, as started by a
+    // terminal emulator or a pty driver, already leads one and may not move)
+    if (getsid(0) != getpid() && setpgid(0, shell_pgid) < 0) 
+    {
+        perror("setpgid");
+        exit(1);
+    }
+    
+    // Take control of the terminal
+    tcsetpgrp(shell_terminal, shell_pgid);
+    
+    // Ignore SIGINT, SIGTSTP, SIGTTIN, and SIGTTOU in shell
+    struct sigaction sa;
+    sa.sa_handler = SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTSTP, &sa, NULL);
+    sigaction(SIGTTIN, &sa, NULL);  // Ignore terminal input for background
+    sigaction(SIGTTOU, &sa, NULL);  // Ignore terminal output for background
+    
+    // Set up SIGCHLD handler to reap zombie processes
+    struct sigaction sa_chld;
+    sa_chld.sa_handler = sigchld_handler;
+    sigemptyset(&sa_chld.sa_mask);
+    sa_chld.sa_flags = SA_RESTART;  // Restart interrupted system calls
+    sigaction(SIGCHLD, &sa_chld, NULL);
+
+    end_phase("terminal");
+
+    // Start the launcher before readline/history grow the address space;
+    // it inherits the ignored job-control signals so Ctrl-C cannot kill it
+    if (use_zygote)
+    {
+        if (launcher_start() < 0)
+            perror("launcher");
+        end_phase("launcher");
+    }
+
+    char *line = NULL;
+    
+    // Initialize job tracking
+    for (int i = 0; i < MAX_JOBS; i++) 
+    {
+        jobs[i].state = JOB_DONE;
+        jobs[i].cmd_line = NULL;
+    }
+    end_phase("jobs");
+
+    // Startup file, executed from the compiled cache when unchanged
+    const char *home = getenv("HOME");
+    int rc_cached = 0;
+    if (home)
+    {
+        char rc_path[PATH_MAX_LEN];
+        snprintf(rc_path, sizeof(rc_path), "%s/.tinyshellrc", home);
+        if (access(rc_path, R_OK) == 0)
+            run_script_file(rc_path, &rc_cached);
+    }
+    end_phase(rc_cached ? "rc (cached)" : "rc");
+
+#ifndef NO_READLINE
+    // Initialize readline now rather than inside the first readline() call
+    if (!use_ledit)
+    {
+        rl_initialize();
+        using_history();
+        rl_getc_function = joblog_getc; // Drains captured job output while waiting for keys
+    }
+#endif
+    end_phase(use_ledit ? "editor" : "readline");
+    if (record_path && *record_path && record_open(record_path) < 0)
+        perror(record_path);
+    if (profile_startup)
+        print_startup_profile(t_main);
+
+    // Lines of a multi-line construct (if/for/while/case/function) being typed
+    StrBuf pending;
+    sb_init(&pending);
+    uint64_t t_prompt = 0; // First prompt of the input being typed (for record)
+
+    while (1)
+    {
+        // Collect captured job output, then notify about completed jobs
+        joblog_drain(0);
+        check_job_notifications();
+        
+        // Prompt with current directory ("> " while a construct is open)
+        char *cwd = get_current_dir();
+        char prompt[PATH_MAX_LEN + 32];
+        if (pending.len > 0)
+            snprintf(prompt, sizeof(prompt), "%s>%s ", COLOR_CYAN, COLOR_RESET);
+        else if (cwd)
+            snprintf(prompt, sizeof(prompt), "%stinyshell:%s>%s ", COLOR_CYAN, cwd, COLOR_RESET);
+        else
+            snprintf(prompt, sizeof(prompt), "%stinyshell>%s ", COLOR_CYAN, COLOR_RESET);
+
+        // Read input with the line editor
+        if (pending.len == 0)
+            t_prompt = monotonic_ns();
+        line = input_line(prompt);
+        if (!line) // EOF (Ctrl-D)
+        {
+            if (pending.len > 0)
+                fprintf(stderr, "%ssyntax error: unexpected end of input%s\n", COLOR_RED, COLOR_RESET);
+            printf("\n");
+            break;
+        }
+        if (*line == '\0' && pending.len == 0)
+        {
+            free(line);
+            continue;
+        }
+
+        if (pending.len > 0)
+            sb_putc(&pending, '\n');
+        sb_append(&pending, line, strlen(line));
+        free(line);
+
+        // Compile once; an open construct keeps reading lines
+        Program *prog;
+        int rc = script_compile(pending.data, &prog);
+        if (rc == SCRIPT_INCOMPLETE)
+            continue;
+        hist_add(pending.data);
+#ifndef NO_READLINE
+        if (!use_ledit)
+            add_history(pending.data);
+#endif
+        record_begin(pending.data, monotonic_ns() - t_prompt);
+        pending.len = 0;
+
+        // Execute commands
+        if (rc == SCRIPT_OK)
+        {
+            script_run(prog);
+            script_release(prog);
+        }
+        record_end(rc == SCRIPT_OK ? last_exit_status : 2);
+    }
+    sb_free(&pending);
+    return 0;
+}
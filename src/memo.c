@@ -0,0 +1,731 @@
+/*
+ * memo.c - Output memoization for deterministic commands (the cache builtin)
+ *
+ * The store lives under the cache home:
+ *
+ *   memo/entries/<key hash>   status, output object names, full key text
+ *   memo/objects/<content>    stdout/stderr blobs, named by content hash
+ *
+ * Entries keep the complete key so a hash collision is a miss, not a wrong
+ * replay. An entry's mtime is its last use; eviction drops the oldest
+ * entries and any object no remaining entry refers to.
+ */
+
+#include "../include/memo.h"
+#include "../include/cache.h"
+#include "../include/executor.h"
+#include "../include/resolve.h"
+#include "../include/stats.h"
+#include "../include/utils.h"
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+
+#define MEMO_NAME_LEN 48 // Object name buffer ("<hash>-<size>")
+
+// One stored result
+typedef struct
+{
+    char name[MEMO_NAME_LEN]; // Entry file name
+    int status;
+    char out[MEMO_NAME_LEN]; // stdout object
+    char err[MEMO_NAME_LEN]; // stderr object
+    uint64_t out_size;
+    uint64_t err_size;
+    uint64_t used; // Last hit or store (ns since the epoch)
+} MemoEntry;
+
+// An object file and the entries referring to it (eviction bookkeeping)
+typedef struct
+{
+    char name[MEMO_NAME_LEN];
+    uint64_t size;
+    int refs;
+} MemoObject;
+
+// Output stream being recorded: pipe from the command, copy target, temp file
+typedef struct
+{
+    int in;
+    int out;
+    int tmp;
+    char tmp_path[PATH_MAX_LEN];
+    uint64_t hash;
+    uint64_t size;
+} Recording;
+
+#define FNV64_INIT 14695981039346656037ull
+
+// FNV-1a, continuing from h
+static uint64_t fnv64(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Store directory, with its entries/ and objects/ subdirectories
+static int memo_dir(char *buf, size_t size)
+{
+    if (cache_dir("memo", buf, size) < 0)
+        return -1;
+    char sub[PATH_MAX_LEN];
+    snprintf(sub, sizeof(sub), "%s/entries", buf);
+    if (mkdir(sub, 0700) < 0 && errno != EEXIST)
+        return -1;
+    snprintf(sub, sizeof(sub), "%s/objects", buf);
+    if (mkdir(sub, 0700) < 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+// Size limit from TINYSHELL_CACHE_MAX (bytes, optional K/M/G suffix)
+static uint64_t memo_limit(void)
+{
+    const char *s = getenv("TINYSHELL_CACHE_MAX");
+    if (!s || !*s)
+        return MEMO_DEFAULT_MAX;
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+    switch (*end)
+    {
+        case 'G': case 'g': v <<= 10; // fall through
+        case 'M': case 'm': v <<= 10; // fall through
+        case 'K': case 'k': v <<= 10; end++; break;
+        default: break;
+    }
+    return *end == '\0' ? v : MEMO_DEFAULT_MAX;
+}
+
+// Object names are produced by this file; refuse anything else in an entry
+static int valid_object_name(const char *name)
+{
+    return name[0] && strspn(name, "0123456789abcdef-") == strlen(name);
+}
+
+// Append one NUL-terminated record to the key
+static void key_add(StrBuf *key, const char *tag, const char *value)
+{
+    sb_append(key, tag, strlen(tag));
+    sb_append(key, value, strlen(value));
+    sb_putc(key, '\0');
+}
+
+// Build the key text: cwd, selected environment, input file identities, argv
+static int build_key(StrBuf *key, char **envs, int nenvs, char **inputs, int ninputs, int argc, char **argv)
+{
+    char cwd[PATH_MAX_LEN];
+    if (!getcwd(cwd, sizeof(cwd)))
+        return -1;
+    key_add(key, "cwd=", cwd);
+
+    for (int i = 0; i < nenvs; i++)
+    {
+        const char *value = getenv(envs[i]);
+        key_add(key, value ? "env+" : "env-", envs[i]);
+        if (value)
+            key_add(key, "=", value);
+    }
+
+    // A file changed in place keeps its inode, so size and mtime come too
+    for (int i = 0; i < ninputs; i++)
+    {
+        struct stat st;
+        key_add(key, "in=", inputs[i]);
+        if (stat(inputs[i], &st) < 0)
+        {
+            key_add(key, "missing", "");
+            continue;
+        }
+        char id[128];
+        snprintf(id, sizeof(id), "%llx:%llx:%lld:%lld.%09ld",
+                 (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+                 (long long)st.st_size, (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+        key_add(key, "id=", id);
+    }
+
+    for (int i = 0; i < argc; i++)
+        key_add(key, "arg=", argv[i]);
+    return key->data ? 0 : -1;
+}
+
+// Read and parse an entry file; key/key_len receive the stored key (may be NULL)
+static int load_entry(const char *path, MemoEntry *e, char **key, size_t *key_len)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    char *text = malloc(st.st_size + 1);
+    ssize_t got = text ? read(fd, text, st.st_size) : -1;
+    close(fd);
+    if (got != st.st_size)
+    {
+        free(text);
+        return -1;
+    }
+    text[got] = '\0';
+
+    int version = 0, end = 0;
+    unsigned long long out_size, err_size;
+    size_t len;
+    if (sscanf(text, "tinyshell-memo %d status %d out %47s %llu err %47s %llu key %zu%n",
+               &version, &e->status, e->out, &out_size, e->err, &err_size, &len, &end) != 7 ||
+        version != MEMO_VERSION || text[end] != '\n' || (size_t)(got - end - 1) != len ||
+        !valid_object_name(e->out) || !valid_object_name(e->err))
+    {
+        free(text);
+        return -1;
+    }
+    e->out_size = out_size;
+    e->err_size = err_size;
+    e->used = (uint64_t)st.st_mtim.tv_sec * 1000000000u + st.st_mtim.tv_nsec;
+    if (key)
+    {
+        memmove(text, text + end + 1, len);
+        *key = text;
+        *key_len = len;
+    }
+    else
+        free(text);
+    return 0;
+}
+
+// Copy an open object to an output descriptor
+static void copy_out(int from, int to)
+{
+    char buf[MEMO_CHUNK];
+    ssize_t n;
+    while ((n = read(from, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 || write_all(to, buf, n) < 0)
+            break;
+    }
+}
+
+// Replay a stored result; -1 if its objects are gone (treated as a miss)
+static int replay(const char *dir, const char *entry_path, const MemoEntry *e)
+{
+    char path[PATH_MAX_LEN + MEMO_NAME_LEN];
+    snprintf(path, sizeof(path), "%s/objects/%s", dir, e->out);
+    int out = open(path, O_RDONLY | O_CLOEXEC);
+    snprintf(path, sizeof(path), "%s/objects/%s", dir, e->err);
+    int err = open(path, O_RDONLY | O_CLOEXEC);
+    if (out < 0 || err < 0)
+    {
+        if (out >= 0)
+            close(out);
+        if (err >= 0)
+            close(err);
+        return -1;
+    }
+
+    // The two streams are replayed one after the other, not interleaved
+    fflush(stdout);
+    copy_out(out, STDOUT_FILENO);
+    copy_out(err, STDERR_FILENO);
+    close(out);
+    close(err);
+
+    // Mark the entry as recently used for LRU eviction
+    utimensat(AT_FDCWD, entry_path, NULL, 0);
+    return e->status;
+}
+
+// Wait for the recorded command; a stopped one is continued like a batch
+static int wait_recorded(pid_t pid, int *status)
+{
+    for (;;)
+    {
+        pid_t r = waitpid(pid, status, WUNTRACED);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return -1;
+        if (WIFSTOPPED(*status))
+        {
+            kill(pid, SIGCONT);
+            continue;
+        }
+        return 0;
+    }
+}
+
+// Move a finished recording into the object store under its content name
+static int store_object(const char *dir, Recording *r, char *name)
+{
+    snprintf(name, MEMO_NAME_LEN, "%016llx-%llu", (unsigned long long)r->hash, (unsigned long long)r->size);
+    char path[PATH_MAX_LEN + MEMO_NAME_LEN];
+    snprintf(path, sizeof(path), "%s/objects/%s", dir, name);
+    if (rename(r->tmp_path, path) < 0)
+    {
+        unlink(r->tmp_path);
+        return -1;
+    }
+    r->tmp_path[0] = '\0';
+    return 0;
+}
+
+// Run the command with its output copied to temp files as it arrives
+static int record(const char *dir, int argc, char **argv, Recording rec[2], int *status)
+{
+    int pipes[2][2] = { { -1, -1 }, { -1, -1 } };
+    // The caller cleans up both slots, even when the first one fails
+    for (int s = 0; s < 2; s++)
+    {
+        rec[s].tmp = -1;
+        rec[s].tmp_path[0] = '\0';
+    }
+    for (int s = 0; s < 2; s++)
+    {
+        rec[s].in = -1;
+        rec[s].out = s == 0 ? STDOUT_FILENO : STDERR_FILENO;
+        rec[s].hash = FNV64_INIT;
+        rec[s].size = 0;
+        snprintf(rec[s].tmp_path, sizeof(rec[s].tmp_path), "%s/tmp.XXXXXX", dir);
+        rec[s].tmp = mkostemp(rec[s].tmp_path, O_CLOEXEC);
+        if (rec[s].tmp < 0)
+            rec[s].tmp_path[0] = '\0';
+        if (rec[s].tmp < 0 || pipe2(pipes[s], O_CLOEXEC) < 0)
+        {
+            perror("cache");
+            for (int i = 0; i <= s; i++)
+            {
+                if (pipes[i][0] >= 0)
+                {
+                    close(pipes[i][0]);
+                    close(pipes[i][1]);
+                }
+            }
+            return -1;
+        }
+    }
+
+    Command target;
+    memset(&target, 0, sizeof(target));
+    target.argc = argc < MAX_ARGS ? argc : MAX_ARGS - 1;
+    memcpy(target.argv, argv, sizeof(char *) * target.argc);
+    target.argv[target.argc] = NULL;
+
+    uint64_t t0 = monotonic_ns();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        reset_child_signals();
+        dup2(pipes[0][1], STDOUT_FILENO);
+        dup2(pipes[1][1], STDERR_FILENO);
+        exec_command(&target);
+    }
+    close(pipes[0][1]);
+    close(pipes[1][1]);
+    rec[0].in = pipes[0][0];
+    rec[1].in = pipes[1][0];
+    if (pid < 0)
+    {
+        perror("fork");
+        close(rec[0].in);
+        close(rec[1].in);
+        return -1;
+    }
+    stat_inc(STAT_FORKS);
+    stat_inc(STAT_COMMANDS);
+    stat_record(HIST_FORK_NS, monotonic_ns() - t0);
+
+    // Tee both streams until the command closes them
+    int ok = 1, open_streams = 2;
+    char buf[MEMO_CHUNK];
+    while (open_streams > 0)
+    {
+        struct pollfd pfd[2];
+        for (int s = 0; s < 2; s++)
+        {
+            pfd[s].fd = rec[s].in;
+            pfd[s].events = POLLIN;
+        }
+        if (poll(pfd, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int s = 0; s < 2; s++)
+        {
+            if (pfd[s].fd < 0 || !(pfd[s].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            ssize_t n = read(rec[s].in, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                close(rec[s].in);
+                rec[s].in = -1;
+                open_streams--;
+                continue;
+            }
+            if (s == 0)
+                fflush(stdout);
+            write_all(rec[s].out, buf, n);
+            if (write_all(rec[s].tmp, buf, n) < 0)
+                ok = 0;
+            rec[s].hash = fnv64(rec[s].hash, buf, n);
+            rec[s].size += n;
+        }
+    }
+    for (int s = 0; s < 2; s++)
+    {
+        if (rec[s].in >= 0)
+            close(rec[s].in);
+    }
+
+    if (wait_recorded(pid, status) < 0)
+        return -1;
+    return ok ? 0 : -1;
+}
+
+// Write the entry file for a recorded result
+static int write_entry(const char *dir, const char *entry_path, const MemoEntry *e, const StrBuf *key)
+{
+    char tmp[PATH_MAX_LEN];
+    snprintf(tmp, sizeof(tmp), "%s/tmp.XXXXXX", dir);
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    char head[256];
+    int n = snprintf(head, sizeof(head), "tinyshell-memo %d\nstatus %d\nout %s %llu\nerr %s %llu\nkey %zu\n",
+                     MEMO_VERSION, e->status, e->out, (unsigned long long)e->out_size,
+                     e->err, (unsigned long long)e->err_size, key->len);
+    int ok = write_all(fd, head, n) == 0 && write_all(fd, key->data, key->len) == 0;
+    close(fd);
+    if (!ok || rename(tmp, entry_path) < 0)
+    {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Order entries oldest first
+static int compare_used(const void *a, const void *b)
+{
+    const MemoEntry *x = a, *y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+static int compare_object(const void *a, const void *b)
+{
+    return strcmp(((const MemoObject *)a)->name, ((const MemoObject *)b)->name);
+}
+
+// Object by name in the sorted object list
+static MemoObject *find_object(MemoObject *objs, size_t n, const char *name)
+{
+    MemoObject probe;
+    snprintf(probe.name, sizeof(probe.name), "%s", name);
+    return bsearch(&probe, objs, n, sizeof(MemoObject), compare_object);
+}
+
+// Read the entries (and optionally objects) in the store
+static int scan_store(const char *dir, MemoEntry **entries, size_t *nentries, MemoObject **objects, size_t *nobjects)
+{
+    char path[PATH_MAX_LEN + MEMO_NAME_LEN];
+    *entries = NULL;
+    *nentries = 0;
+    *objects = NULL;
+    *nobjects = 0;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, pass == 0 ? "entries" : "objects");
+        DIR *d = opendir(path);
+        if (!d)
+            return -1;
+        size_t n = 0, cap = 0;
+        void *items = NULL;
+        size_t item_size = pass == 0 ? sizeof(MemoEntry) : sizeof(MemoObject);
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL)
+        {
+            size_t name_len = strlen(de->d_name);
+            if (de->d_name[0] == '.' || name_len >= MEMO_NAME_LEN)
+                continue;
+            if (n == cap)
+            {
+                cap = cap ? cap * 2 : 64;
+                void *grown = realloc(items, cap * item_size);
+                if (!grown)
+                    break;
+                items = grown;
+            }
+            if (pass == 0)
+            {
+                MemoEntry *e = (MemoEntry *)items + n;
+                snprintf(path, sizeof(path), "%s/entries/%s", dir, de->d_name);
+                if (load_entry(path, e, NULL, NULL) < 0)
+                    continue;
+                memcpy(e->name, de->d_name, name_len + 1);
+            }
+            else
+            {
+                MemoObject *o = (MemoObject *)items + n;
+                struct stat st;
+                snprintf(path, sizeof(path), "%s/objects/%s", dir, de->d_name);
+                if (stat(path, &st) < 0)
+                    continue;
+                memcpy(o->name, de->d_name, name_len + 1);
+                o->size = st.st_size;
+                o->refs = 0;
+            }
+            n++;
+        }
+        closedir(d);
+        if (pass == 0)
+        {
+            *entries = items;
+            *nentries = n;
+        }
+        else
+        {
+            *objects = items;
+            *nobjects = n;
+        }
+    }
+    return 0;
+}
+
+// Drop a reference to an object, deleting it with the last one
+static void unref_object(const char *dir, MemoObject *objs, size_t nobjs, const char *name, uint64_t *total)
+{
+    MemoObject *o = find_object(objs, nobjs, name);
+    if (!o || --o->refs > 0)
+        return;
+    char path[PATH_MAX_LEN + MEMO_NAME_LEN];
+    snprintf(path, sizeof(path), "%s/objects/%s", dir, o->name);
+    unlink(path);
+    *total -= o->size;
+}
+
+// Delete unreferenced objects, then least recently used entries over the limit
+static void evict(const char *dir, uint64_t limit)
+{
+    MemoEntry *entries;
+    MemoObject *objs;
+    size_t nentries, nobjs;
+    if (scan_store(dir, &entries, &nentries, &objs, &nobjs) == 0)
+    {
+        qsort(objs, nobjs, sizeof(MemoObject), compare_object);
+        uint64_t total = 0;
+        for (size_t i = 0; i < nobjs; i++)
+        {
+            objs[i].refs = 1; // Held until the orphan pass below
+            total += objs[i].size;
+        }
+        for (size_t i = 0; i < nentries; i++)
+        {
+            MemoObject *o;
+            if ((o = find_object(objs, nobjs, entries[i].out)) != NULL)
+                o->refs++;
+            if ((o = find_object(objs, nobjs, entries[i].err)) != NULL)
+                o->refs++;
+        }
+        for (size_t i = 0; i < nobjs; i++)
+            unref_object(dir, objs, nobjs, objs[i].name, &total);
+
+        qsort(entries, nentries, sizeof(MemoEntry), compare_used);
+        char path[PATH_MAX_LEN + MEMO_NAME_LEN];
+        for (size_t i = 0; i < nentries && total > limit; i++)
+        {
+            snprintf(path, sizeof(path), "%s/entries/%s", dir, entries[i].name);
+            unlink(path);
+            unref_object(dir, objs, nobjs, entries[i].out, &total);
+            unref_object(dir, objs, nobjs, entries[i].err, &total);
+            stat_inc(STAT_CACHE_EVICTIONS);
+        }
+    }
+    free(entries);
+    free(objs);
+}
+
+// cache stats: store contents and this session's counters
+static int memo_stats(const char *dir)
+{
+    MemoEntry *entries;
+    MemoObject *objs;
+    size_t nentries, nobjs;
+    uint64_t total = 0;
+    scan_store(dir, &entries, &nentries, &objs, &nobjs);
+    for (size_t i = 0; i < nobjs; i++)
+        total += objs[i].size;
+    free(entries);
+    free(objs);
+
+    printf("%sstore%s     %s\n", COLOR_CYAN, COLOR_RESET, dir);
+    printf("%sentries%s   %zu\n", COLOR_CYAN, COLOR_RESET, nentries);
+    printf("%sobjects%s   %zu (%llu bytes, limit %llu)\n", COLOR_CYAN, COLOR_RESET, nobjs,
+           (unsigned long long)total, (unsigned long long)memo_limit());
+    printf("%shits%s      %llu\n", COLOR_CYAN, COLOR_RESET,
+           (unsigned long long)atomic_load(&stat_counters[STAT_CACHE_HITS]));
+    printf("%smisses%s    %llu\n", COLOR_CYAN, COLOR_RESET,
+           (unsigned long long)atomic_load(&stat_counters[STAT_CACHE_MISSES]));
+    printf("%sevictions%s %llu\n", COLOR_CYAN, COLOR_RESET,
+           (unsigned long long)atomic_load(&stat_counters[STAT_CACHE_EVICTIONS]));
+    return 0;
+}
+
+// cache clear: remove every entry and object
+static int memo_clear(const char *dir)
+{
+    const char *subdirs[] = { "entries", "objects" };
+    for (int s = 0; s < 2; s++)
+    {
+        char path[PATH_MAX_LEN + MEMO_NAME_LEN];
+        snprintf(path, sizeof(path), "%s/%s", dir, subdirs[s]);
+        DIR *d = opendir(path);
+        if (!d)
+            continue;
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL)
+        {
+            if (de->d_name[0] == '.')
+                continue;
+            snprintf(path, sizeof(path), "%s/%s/%s", dir, subdirs[s], de->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    return 0;
+}
+
+// Look up the key, replaying a hit or recording a miss
+static int memo_run(const char *dir, const StrBuf *key, int argc, char **argv)
+{
+    char entry_path[PATH_MAX_LEN + MEMO_NAME_LEN];
+    snprintf(entry_path, sizeof(entry_path), "%s/entries/%016llx", dir,
+             (unsigned long long)fnv64(FNV64_INIT, key->data, key->len));
+
+    MemoEntry e;
+    char *stored_key = NULL;
+    size_t stored_len = 0;
+    if (load_entry(entry_path, &e, &stored_key, &stored_len) == 0)
+    {
+        int same = stored_len == key->len && memcmp(stored_key, key->data, key->len) == 0;
+        free(stored_key);
+        int status = same ? replay(dir, entry_path, &e) : -1;
+        if (status >= 0)
+        {
+            stat_inc(STAT_CACHE_HITS);
+            return status;
+        }
+    }
+    stat_inc(STAT_CACHE_MISSES);
+
+    // Keep the SIGCHLD handler away from the command we wait for
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    Recording rec[2];
+    int status = 0;
+    int rc = record(dir, argc, argv, rec, &status);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+
+    // Only completed runs are stored: a command killed by a signal (Ctrl-C) is not
+    int code = rc == 0 ? status_to_code(status) : 1;
+    if (rc == 0 && WIFEXITED(status))
+    {
+        memset(&e, 0, sizeof(e));
+        e.status = code;
+        e.out_size = rec[0].size;
+        e.err_size = rec[1].size;
+        if (store_object(dir, &rec[0], e.out) == 0 && store_object(dir, &rec[1], e.err) == 0 &&
+            write_entry(dir, entry_path, &e, key) == 0)
+            evict(dir, memo_limit());
+    }
+    for (int s = 0; s < 2; s++)
+    {
+        if (rec[s].tmp >= 0)
+            close(rec[s].tmp);
+        if (rec[s].tmp_path[0])
+            unlink(rec[s].tmp_path);
+    }
+    return code;
+}
+
+// Built-in: cache command
+int builtin_cache(int argc, char **argv)
+{
+    char dir[PATH_MAX_LEN];
+    if (memo_dir(dir, sizeof(dir)) < 0)
+    {
+        fprintf(stderr, "%scache: no usable cache directory%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    if (argc == 2 && strcmp(argv[1], "stats") == 0)
+        return memo_stats(dir);
+    if (argc == 2 && strcmp(argv[1], "clear") == 0)
+        return memo_clear(dir);
+
+    // Options name the environment variables and files the output depends on
+    char *envs[MAX_ARGS], *inputs[MAX_ARGS];
+    int nenvs = 0, ninputs = 0;
+    int i = 1;
+    while (i < argc && argv[i][0] == '-')
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        if (i + 1 >= argc || (strcmp(argv[i], "-e") != 0 && strcmp(argv[i], "-i") != 0))
+        {
+            i = argc;
+            break;
+        }
+        if (argv[i][1] == 'e')
+            envs[nenvs++] = argv[i + 1];
+        else
+            inputs[ninputs++] = argv[i + 1];
+        i += 2;
+    }
+    if (i >= argc)
+    {
+        fprintf(stderr, "%scache: usage: cache [-e VAR]... [-i FILE]... [--] command args... | cache stats | cache clear%s\n",
+                COLOR_RED, COLOR_RESET);
+        return 2;
+    }
+
+    // Unknown commands are reported, not remembered
+    Command target;
+    memset(&target, 0, sizeof(target));
+    target.argc = 1;
+    target.argv[0] = argv[i];
+    resolve_command(&target);
+    if (target.kind == CMD_NOT_FOUND || target.kind == CMD_ASSIGN)
+    {
+        fprintf(stderr, "%s%s: command not found%s\n", COLOR_RED, argv[i], COLOR_RESET);
+        return 127;
+    }
+
+    StrBuf key;
+    sb_init(&key);
+    if (build_key(&key, envs, nenvs, inputs, ninputs, argc - i, argv + i) < 0)
+    {
+        sb_free(&key);
+        perror("cache");
+        return 1;
+    }
+    int status = memo_run(dir, &key, argc - i, argv + i);
+    sb_free(&key);
+    return status;
+}
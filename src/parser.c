@@ -1,153 +1,276 @@
-/*
- * parser.c - Command parsing and pipeline splitting
- */
-
-#include "../include/parser.h"
-#include <ctype.h>
-
-// Parse a single command, checking for redirections (<, >, >>, 2>)
-void parse_command(char *input, Command *cmd) 
-{
-    cmd->argc = 0;
-    cmd->infile = NULL;
-    cmd->outfile = NULL;
-    cmd->errfile = NULL;
-    cmd->append = 0;
-    cmd->background = 0;
-    
-    // Check for & at the end (background execution)
-    char *bg_pos = input;
-    while (*bg_pos) bg_pos++;
-    bg_pos--;
-    
-    // Skip trailing whitespace
-    while (bg_pos > input && (*bg_pos == ' ' || *bg_pos == '\t' || *bg_pos == '\n')) 
-        bg_pos--;
-    
-    // Check if last non-whitespace character is &
-    if (bg_pos > input && *bg_pos == '&') 
-    {
-        cmd->background = 1;
-        *bg_pos = '\0';  // Remove & from command string
-    }
-    
-    char *cmd_start = input;
-    char *pos = input;
-    
-    // Scan through input and extract all redirections
-    while (*pos) 
-    {
-        if (pos[0] == '2' && pos[1] == '>') 
-        {
-            // Stderr redirection
-            *pos = '\0';
-            pos += 2;
-            while (*pos == ' ' || *pos == '\t') pos++;
-            
-            char *start = pos;
-            while (*pos && *pos != ' ' && *pos != '\t' && *pos != '<' && *pos != '>' && *pos != '\n') 
-                pos++;
-            
-            if (pos > start) 
-            {
-                cmd->errfile = start;
-                if (*pos) *pos++ = '\0';
-            }
-        }
-        else if (pos[0] == '>' && pos[1] == '>') 
-        {
-            // Append redirection
-            *pos = '\0';
-            pos += 2;
-            while (*pos == ' ' || *pos == '\t') pos++;
-            
-            char *start = pos;
-            while (*pos && *pos != ' ' && *pos != '\t' && *pos != '<' && *pos != '>' && *pos != '\n') 
-                pos++;
-            
-            if (pos > start) 
-            {
-                cmd->outfile = start;
-                cmd->append = 1;
-                if (*pos) *pos++ = '\0';
-            }
-        }
-        else if (*pos == '>') 
-        {
-            // Output redirection
-            *pos = '\0';
-            pos++;
-            while (*pos == ' ' || *pos == '\t') pos++;
-            
-            char *start = pos;
-            while (*pos && *pos != ' ' && *pos != '\t' && *pos != '<' && *pos != '>' && *pos != '\n') 
-                pos++;
-            
-            if (pos > start) 
-            {
-                cmd->outfile = start;
-                cmd->append = 0;
-                if (*pos) *pos++ = '\0';
-            }
-        }
-        else if (*pos == '<') 
-        {
-            // Input redirection
-            *pos = '\0';
-            pos++;
-            while (*pos == ' ' || *pos == '\t') pos++;
-            
-            char *start = pos;
-            while (*pos && *pos != ' ' && *pos != '\t' && *pos != '<' && *pos != '>' && *pos != '\n') 
-                pos++;
-            
-            if (pos > start) 
-            {
-                cmd->infile = start;
-                if (*pos) *pos++ = '\0';
-            }
-        }
-        else 
-        {
-            pos++;
-        }
-    }
-    
-    // Tokenize the command part (what's left after removing redirections)
-    char *token = strtok(cmd_start, " \t\n");
-    while (token && cmd->argc < MAX_ARGS - 1) 
-    {
-        if (*token) 
-        {
-            cmd->argv[cmd->argc++] = token;
-        }
-        token = strtok(NULL, " \t\n");
-    }
-    cmd->argv[cmd->argc] = NULL;
-}
-
-// Split input by | to get pipeline commands
-int split_pipeline(char *input, Command cmds[]) 
-{
-    int num_cmds = 0;
-    char *saveptr;
-    char *cmd_str = strtok_r(input, "|", &saveptr);
-    
-    while (cmd_str && num_cmds < MAX_CMDS) 
-    {
-        // Skip leading whitespace
-        while (*cmd_str && (*cmd_str == ' ' || *cmd_str == '\t')) 
-            cmd_str++;
-        
-        if (*cmd_str) 
-        {
-            parse_command(cmd_str, &cmds[num_cmds]);
-            if (cmds[num_cmds].argc > 0) 
-                num_cmds++;
-        }
-        
-        cmd_str = strtok_r(NULL, "|", &saveptr);
-    }
-    
-    return num_cmds;
-}
+/*
+ * parser.c - Command parsing and pipeline splitting
+ */
+
+#include "../include/parser.h"
+#include <ctype.h>
+
+// Check whether p starts a command substitution
+static int is_subst_start(const char *p)
+{
+    return p[0] == '`' || (p[0] == '$' && p[1] == '(');
+}
+
+// Skip over a $(...) or `...` substitution, honoring nesting
+const char* skip_subst(const char *p)
+{
+    if (*p == '`')
+    {
+        p++;
+        while (*p && *p != '`')
+        {
+            if (p[0] == '\\' && p[1])
+                p++;
+            p++;
+        }
+        return *p ? p + 1 : p;
+    }
+
+    int depth = 0;
+    p += 2;
+    while (*p)
+    {
+        if (is_subst_start(p))
+        {
+            p = skip_subst(p);
+            continue;
+        }
+        if (*p == '(')
+            depth++;
+        else if (*p == ')' && depth-- == 0)
+            return p + 1;
+        p++;
+    }
+    return p;
+}
+
+// Advance over a word, treating substitutions as part of it
+static char *skip_word(char *p, const char *stops)
+{
+    while (*p && !strchr(stops, *p))
+    {
+        if (is_subst_start(p))
+            p = (char *)skip_subst(p);
+        else
+            p++;
+    }
+    return p;
+}
+
+// Append a redirection; returns -1 after reporting more than MAX_REDIRS
+static int add_redirect(Command *cmd, const Redirect *r)
+{
+    if (cmd->num_redirs == MAX_REDIRS)
+    {
+        fprintf(stderr, "%stoo many redirections (limit %d)%s\n", COLOR_RED, MAX_REDIRS, COLOR_RESET);
+        return -1;
+    }
+    cmd->redirs[cmd->num_redirs++] = *r;
+    return 0;
+}
+
+// Recognize a redirection operator at p: [n]< [n]> [n]>> [n]>| [n]<>
+// [n]>&m [n]<&m [n]>&- [n]>&p[:NAME] &> &>> (n only counts at the start of a word).
+// Fills r and returns the text after the operator, or NULL if p is not one;
+// *both is set when stderr follows stdout (&>file, >&file)
+static char *scan_operator(char *p, int word_start, Redirect *r, int *both)
+{
+    int explicit_fd = word_start && isdigit((unsigned char)p[0]) && (p[1] == '<' || p[1] == '>');
+    *both = 0;
+    r->fd = -1;
+    r->src = -1;
+    r->target = NULL;
+    r->opened = -1;
+    if (explicit_fd)
+        r->fd = *p++ - '0';
+    else if (p[0] == '&' && p[1] == '>')
+    {
+        *both = 1;
+        p++;
+    }
+    if (*p != '<' && *p != '>')
+        return NULL;
+    int input = *p == '<';
+    if (r->fd < 0)
+        r->fd = input ? STDIN_FILENO : STDOUT_FILENO;
+
+    if (p[1] == '&' && !*both)
+    {
+        p += 2;
+        char *end = p;
+        while (isdigit((unsigned char)*end))
+            end++;
+        if (end > p && strchr(" \t\n<>", *end))
+        {
+            r->op = REDIR_DUP;
+            r->src = end - p > 2 ? REDIR_FD_MAX + 1 : atoi(p);  // Too long: rejected when opened
+            return end;
+        }
+        if (*p == '-' && strchr(" \t\n<>", p[1]))
+        {
+            r->op = REDIR_CLOSE;
+            return p + 1;
+        }
+        if (*p == 'p' && strchr(" \t\n<>:", p[1]))
+        {
+            // The coprocess's stdin for >&p, its stdout for <&p; p:NAME picks one by name
+            r->op = REDIR_COPROC;
+            r->src = input ? PIPE_READ : PIPE_WRITE;
+            return p + (p[1] == ':' ? 2 : 1);
+        }
+        // >&file is &>file; with a number in front it is a plain n>file
+        r->op = input ? REDIR_IN : REDIR_OUT;
+        *both = !input && !explicit_fd;
+        return p;
+    }
+    if (input)
+        r->op = p[1] == '>' ? REDIR_RDWR : REDIR_IN;
+    else
+        r->op = p[1] == '>' ? REDIR_APPEND : (p[1] == '|' ? REDIR_CLOBBER : REDIR_OUT);
+    return p + (p[1] == '>' || (!input && p[1] == '|') ? 2 : 1);
+}
+
+// Parse a single command into words and redirections
+int parse_command(char *input, Command *cmd) 
+{
+    cmd->argc = 0;
+    cmd->num_redirs = 0;
+    cmd->background = 0;
+    cmd->pipe_out = 0;
+    cmd->kind = 0;
+    cmd->substituted = 0;
+    
+    // Check for & at the end (background execution)
+    char *bg_pos = input;
+    while (*bg_pos) bg_pos++;
+    bg_pos--;
+    
+    // Skip trailing whitespace
+    while (bg_pos > input && (*bg_pos == ' ' || *bg_pos == '\t' || *bg_pos == '\n')) 
+        bg_pos--;
+    
+    // Check if last non-whitespace character is & (but not the one of >&)
+    if (bg_pos > input && *bg_pos == '&' && bg_pos[-1] != '>' && bg_pos[-1] != '<') 
+    {
+        cmd->background = 1;
+        *bg_pos = '\0';  // Remove & from command string
+    }
+    
+    // Words and redirection targets are moved down to the front of input as
+    // they are read. A token's terminating NUL lands on the character after
+    // it, which may start the next operator, so it is written only once that
+    // operator has been scanned
+    char *rd = input, *wr = input, *nul = NULL;
+    int word_start = 1;
+    int status = 0;
+    while (*rd) 
+    {
+        if (*rd == ' ' || *rd == '\t' || *rd == '\n') 
+        {
+            rd++;
+            word_start = 1;
+            continue;
+        }
+        
+        Redirect r;
+        int both;
+        char *after = scan_operator(rd, word_start, &r, &both);
+        word_start = 0;
+        if (after && (r.op == REDIR_DUP || r.op == REDIR_CLOSE || (r.op == REDIR_COPROC && after[-1] == 'p'))) 
+        {
+            if (add_redirect(cmd, &r) < 0) 
+            {
+                status = -1;
+                break;
+            }
+            rd = after;
+            continue;
+        }
+        
+        // A word, or the target of a file redirection
+        char *start = after ? after : rd;
+        while (after && (*start == ' ' || *start == '\t')) 
+            start++;
+        char *end = skip_word(start, " \t\n<>");
+        if (nul) 
+            *nul = '\0';
+        nul = NULL;
+        rd = end;
+        if (end == start) 
+        {
+            // Operator without a target: ignored
+            continue;
+        }
+        
+        size_t len = end - start;
+        memmove(wr, start, len);
+        if (after) 
+        {
+            r.target = wr;
+            if (add_redirect(cmd, &r) < 0 || 
+                (both && add_redirect(cmd, &(Redirect){ STDERR_FILENO, REDIR_DUP, STDOUT_FILENO, NULL, -1 }) < 0)) 
+            {
+                status = -1;
+                break;
+            }
+        }
+        else if (cmd->argc < MAX_ARGS - 1) 
+        {
+            cmd->argv[cmd->argc++] = wr;
+        }
+        else 
+        {
+            // Literal words are never dropped: batch only splits expanded ones
+            fprintf(stderr, "%s%s: too many arguments (limit %d)%s\n",
+                    COLOR_RED, cmd->argv[0], MAX_ARGS - 1, COLOR_RESET);
+            status = -1;
+            break;
+        }
+        nul = wr + len;
+        wr = nul + 1;
+    }
+    if (nul) 
+        *nul = '\0';
+    cmd->argv[cmd->argc] = NULL;
+    return status;
+}
+
+// Split input by | to get pipeline commands
+int split_pipeline(char *input, Command cmds[]) 
+{
+    int num_cmds = 0;
+    char *cmd_str = input;
+    
+    while (cmd_str) 
+    {
+        // Cut at the next | that is not inside a substitution or a >|
+        char *next = skip_word(cmd_str, "|");
+        while (*next && next > cmd_str && next[-1] == '>') 
+            next = skip_word(next + 1, "|");
+        if (*next) 
+            *next++ = '\0';
+        else 
+            next = NULL;
+        
+        // Skip leading whitespace
+        while (*cmd_str && (*cmd_str == ' ' || *cmd_str == '\t')) 
+            cmd_str++;
+        
+        if (*cmd_str) 
+        {
+            if (num_cmds == MAX_CMDS) 
+            {
+                fprintf(stderr, "%stoo many pipeline stages (limit %d)%s\n", COLOR_RED, MAX_CMDS, COLOR_RESET);
+                return -1;
+            }
+            if (parse_command(cmd_str, &cmds[num_cmds]) < 0) 
+                return -1;
+            if (cmds[num_cmds].argc > 0) 
+                num_cmds++;
+        }
+        
+        cmd_str = next;
+    }
+    
+    return num_cmds;
+}
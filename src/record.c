@@ -0,0 +1,190 @@
+/*
+ * record.c - Session recording for replay benchmarks
+ *
+ * Every input the interactive loop compiles is appended to a text file
+ * with how long the user took to type it, how long it ran, its status
+ * and the directory it ran in. tinyshell-replay feeds such a file back
+ * to a shell over a pty and reports per-command latencies, so parser,
+ * executor and job control changes can be measured on real sessions.
+ */
+
+#include "../include/record.h"
+#include "../include/stats.h"
+#include "../include/utils.h"
+#include <time.h>
+
+static int record_fd = -1;
+static char *record_path;
+static char *last_cwd; // cwd of the previous entry, to leave it out when unchanged
+static unsigned session; // Bumped by record_open()/record_close()
+
+// The input between record_begin() and record_end()
+static char *cur_text;
+static char *cur_cwd;
+static uint64_t cur_think_ns;
+static uint64_t cur_start; // When it started to run
+static unsigned cur_session;
+
+// Append s with \, tab and newline escaped
+static void put_escaped(StrBuf *sb, const char *s)
+{
+    for (; *s; s++)
+    {
+        if (*s == '\\')
+            sb_append(sb, "\\\\", 2);
+        else if (*s == '\t')
+            sb_append(sb, "\\t", 2);
+        else if (*s == '\n')
+            sb_append(sb, "\\n", 2);
+        else
+            sb_putc(sb, *s);
+    }
+}
+
+// Undo put_escaped() in place
+static void unescape(char *s)
+{
+    char *out = s;
+    for (; *s; s++)
+    {
+        if (*s == '\\' && s[1])
+        {
+            s++;
+            *out++ = *s == 't' ? '\t' : *s == 'n' ? '\n' : *s;
+        }
+        else
+            *out++ = *s;
+    }
+    *out = '\0';
+}
+
+int record_open(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    record_close();
+    record_fd = fd;
+    record_path = strdup(path);
+
+    char header[128];
+    int n = snprintf(header, sizeof(header), "%s %lld %d\n", RECORD_MAGIC, (long long)time(NULL), (int)getpid());
+    write_all(fd, header, n);
+    return 0;
+}
+
+void record_close(void)
+{
+    if (record_fd >= 0)
+        close(record_fd);
+    record_fd = -1;
+    free(record_path);
+    record_path = NULL;
+    free(last_cwd);
+    last_cwd = NULL;
+    session++;
+}
+
+void record_begin(const char *text, uint64_t think_ns)
+{
+    free(cur_text);
+    free(cur_cwd);
+    cur_text = cur_cwd = NULL;
+    if (record_fd < 0)
+        return;
+    char cwd[PATH_MAX_LEN];
+    cur_text = strdup(text);
+    cur_cwd = strdup(getcwd(cwd, sizeof(cwd)) ? cwd : "");
+    cur_think_ns = think_ns;
+    cur_session = session;
+    cur_start = monotonic_ns();
+}
+
+void record_end(int status)
+{
+    uint64_t run_ns = monotonic_ns() - cur_start;
+    if (record_fd < 0 || !cur_text || !cur_cwd || cur_session != session)
+        return;
+
+    StrBuf sb;
+    sb_init(&sb);
+    char nums[80];
+    int same = last_cwd && strcmp(last_cwd, cur_cwd) == 0;
+    snprintf(nums, sizeof(nums), "%llu\t%llu\t%d\t", (unsigned long long)(cur_think_ns / 1000000),
+             (unsigned long long)(run_ns / 1000), status);
+    sb_append(&sb, nums, strlen(nums));
+    if (!same)
+        put_escaped(&sb, cur_cwd);
+    sb_putc(&sb, '\t');
+    put_escaped(&sb, cur_text);
+    sb_putc(&sb, '\n');
+
+    // One write per entry: shells recording to the same file don't interleave
+    if (sb.data && sb.len <= RECORD_LINE_MAX && write_all(record_fd, sb.data, sb.len) == 0 && !same)
+    {
+        free(last_cwd);
+        last_cwd = cur_cwd;
+        cur_cwd = NULL;
+    }
+    sb_free(&sb);
+}
+
+int record_parse(char *line, RecordEntry *entry)
+{
+    if (line[0] == '#' || line[0] == '\0')
+        return 1;
+    char *field[5];
+    field[0] = line;
+    for (int i = 1; i < 5; i++)
+    {
+        char *tab = strchr(field[i - 1], '\t');
+        if (!tab)
+            return -1;
+        *tab = '\0';
+        field[i] = tab + 1;
+    }
+    char *end;
+    entry->think_ms = strtoull(field[0], &end, 10);
+    if (*end)
+        return -1;
+    entry->run_us = strtoull(field[1], &end, 10);
+    if (*end)
+        return -1;
+    entry->status = strtol(field[2], &end, 10);
+    if (*end)
+        return -1;
+    unescape(field[3]);
+    unescape(field[4]);
+    entry->cwd = field[3][0] ? field[3] : NULL;
+    entry->text = field[4];
+    return 0;
+}
+
+// Built-in: record - start or stop recording interactive input
+int builtin_record(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        if (record_fd >= 0)
+            printf("recording to %s\n", record_path);
+        else
+            printf("recording off\n");
+        return 0;
+    }
+    if (argc > 2)
+    {
+        fprintf(stderr, "%srecord: usage: record [FILE|off]%s\n", COLOR_RED, COLOR_RESET);
+        return 2;
+    }
+    if (strcmp(argv[1], "off") == 0)
+    {
+        record_close();
+        return 0;
+    }
+    if (record_open(argv[1]) < 0)
+    {
+        fprintf(stderr, "%srecord: %s: %s%s\n", COLOR_RED, argv[1], strerror(errno), COLOR_RESET);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * resolve.c - Command name resolution (aliases, functions, builtins, PATH)
+ *
+ * Every name the shell knows lives in one open-addressing hash table, so
+ * resolving a command is a single probe sequence no matter how many
+ * builtins, functions or aliases exist. PATH lookups are remembered in the
+ * same entries and dropped when PATH changes.
+ */
+
+#include "../include/resolve.h"
+#include "../include/expand.h"
+
+#define NAME_TABLE_INIT 64 // Initial slot count (power of two)
+#define MAX_ALIAS_DEPTH 16 // Alias-of-alias expansions per command
+
+static NameEntry *table;
+static size_t table_cap;
+static size_t table_used;
+static int builtins_loaded;
+
+static char *last_path; // PATH value the hashed lookups belong to
+static uint32_t path_gen;
+
+// FNV-1a
+static uint32_t hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (const char *p = name; *p; p++)
+    {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Slot for a name: its entry, or the empty slot where it would go
+static NameEntry *probe(NameEntry *slots, size_t cap, const char *name, uint32_t h)
+{
+    size_t i = h & (cap - 1);
+    while (slots[i].name && (slots[i].hash != h || strcmp(slots[i].name, name) != 0))
+        i = (i + 1) & (cap - 1);
+    return &slots[i];
+}
+
+// Double the table, keeping it at most half full
+static int grow_table(void)
+{
+    size_t cap = table_cap ? table_cap * 2 : NAME_TABLE_INIT;
+    NameEntry *slots = calloc(cap, sizeof(NameEntry));
+    if (!slots)
+        return -1;
+    for (size_t i = 0; i < table_cap; i++)
+    {
+        if (table[i].name)
+            *probe(slots, cap, table[i].name, table[i].hash) = table[i];
+    }
+    free(table);
+    table = slots;
+    table_cap = cap;
+    return 0;
+}
+
+// Builtins are entered on first use
+static void load_builtins(void)
+{
+    if (builtins_loaded)
+        return;
+    builtins_loaded = 1;
+    register_builtins();
+}
+
+// Find a name in the table
+NameEntry* name_find(const char *name)
+{
+    load_builtins();
+    if (!table)
+        return NULL;
+    NameEntry *e = probe(table, table_cap, name, hash_name(name));
+    return e->name ? e : NULL;
+}
+
+// Find a name, adding an empty entry if it is unknown
+NameEntry* name_add(const char *name)
+{
+    uint32_t h = hash_name(name);
+    if (table)
+    {
+        NameEntry *e = probe(table, table_cap, name, h);
+        if (e->name)
+            return e;
+    }
+    if ((table_used + 1) * 2 > table_cap && grow_table() < 0)
+        return NULL;
+
+    NameEntry *e = probe(table, table_cap, name, h);
+    e->name = strdup(name);
+    if (!e->name)
+        return NULL;
+    e->hash = h;
+    table_used++;
+    return e;
+}
+
+// Iterate over all entries
+NameEntry* name_next(size_t *iter)
+{
+    load_builtins();
+    while (*iter < table_cap)
+    {
+        NameEntry *e = &table[(*iter)++];
+        if (e->name)
+            return e;
+    }
+    return NULL;
+}
+
+// Free an entry's alias
+static void clear_alias(NameEntry *e)
+{
+    free(e->alias_words);
+    free(e->alias_argv);
+    free(e->alias);
+    e->alias = NULL;
+    e->alias_argv = NULL;
+    e->alias_words = NULL;
+    e->alias_argc = 0;
+}
+
+// Define or replace an alias
+int alias_set(const char *name, const char *value)
+{
+    NameEntry *e = name_add(name);
+    if (!e)
+        return -1;
+
+    // Split once here so commands only splice pointers
+    char *alias = strdup(value);
+    char *words = strdup(value);
+    char **argv = malloc(sizeof(char *) * MAX_ARGS);
+    if (!alias || !words || !argv)
+    {
+        free(alias);
+        free(words);
+        free(argv);
+        return -1;
+    }
+    int argc = 0;
+    for (char *w = strtok(words, " \t\n"); w && argc < MAX_ARGS - 1; w = strtok(NULL, " \t\n"))
+        argv[argc++] = w;
+    argv[argc] = NULL;
+
+    clear_alias(e);
+    e->alias = alias;
+    e->alias_argv = argv;
+    e->alias_words = words;
+    e->alias_argc = argc;
+    return 0;
+}
+
+// Remove an alias
+int alias_unset(const char *name)
+{
+    NameEntry *e = name_find(name);
+    if (!e || !e->alias)
+        return -1;
+    clear_alias(e);
+    return 0;
+}
+
+// Replace an aliased command name with the alias words
+int alias_expand(Command *cmd)
+{
+    int first = 0;
+    while (first < cmd->argc && assignment_name_len(cmd->argv[first]) > 0)
+        first++;
+
+    const char *expanded[MAX_ALIAS_DEPTH];
+    for (int depth = 0; depth < MAX_ALIAS_DEPTH && first < cmd->argc; depth++)
+    {
+        NameEntry *e = name_find(cmd->argv[first]);
+        if (!e || !e->alias)
+            return 0;
+
+        // An alias naming itself (alias ls=ls -F) stops after one round
+        for (int i = 0; i < depth; i++)
+        {
+            if (expanded[i] == e->name)
+                return 0;
+        }
+        expanded[depth] = e->name;
+
+        int rest = cmd->argc - first - 1;
+        if (first + e->alias_argc + rest > MAX_ARGS - 1)
+        {
+            fprintf(stderr, "%s%s: too many arguments (limit %d)%s\n",
+                    COLOR_RED, cmd->argv[first], MAX_ARGS - 1, COLOR_RESET);
+            return -1;
+        }
+        memmove(&cmd->argv[first + e->alias_argc], &cmd->argv[first + 1], sizeof(char *) * rest);
+        memcpy(&cmd->argv[first], e->alias_argv, sizeof(char *) * e->alias_argc);
+        cmd->argc = first + e->alias_argc + rest;
+        cmd->argv[cmd->argc] = NULL;
+    }
+    return 0;
+}
+
+// Look up an executable on PATH, remembering the result until PATH changes
+const char* resolve_path(const char *name)
+{
+    const char *path = getenv("PATH");
+    if (!path)
+        return NULL;
+    if (!last_path || strcmp(path, last_path) != 0)
+    {
+        free(last_path);
+        last_path = strdup(path);
+        path_gen++;
+    }
+
+    NameEntry *e = name_find(name);
+    if (e && e->path && e->path_gen == path_gen)
+        return e->path;
+
+    // Misses are not remembered, so newly installed commands are found
+    char *path_copy = strdup(path);
+    if (!path_copy)
+        return NULL;
+    char full[PATH_MAX_LEN];
+    char *found = NULL;
+    for (char *dir = strtok(path_copy, ":"); dir; dir = strtok(NULL, ":"))
+    {
+        snprintf(full, sizeof(full), "%s/%s", dir, name);
+        if (access(full, X_OK) == 0)
+        {
+            found = full;
+            break;
+        }
+    }
+    free(path_copy);
+    if (!found)
+        return NULL;
+
+    e = name_add(name);
+    if (!e)
+        return NULL;
+    free(e->path);
+    e->path = strdup(found);
+    e->path_gen = path_gen;
+    return e->path;
+}
+
+// Decide once what an expanded command runs
+void resolve_command(Command *cmd)
+{
+    if (cmd->kind != CMD_UNRESOLVED)
+        return;
+    cmd->first = 0;
+    cmd->builtin = NULL;
+    cmd->path = NULL;
+    while (cmd->first < cmd->argc && assignment_name_len(cmd->argv[cmd->first]) > 0)
+        cmd->first++;
+    if (cmd->first == cmd->argc)
+    {
+        cmd->kind = CMD_ASSIGN;
+        return;
+    }
+
+    const char *name = cmd->argv[cmd->first];
+    if (strchr(name, '/'))
+    {
+        cmd->kind = CMD_EXTERNAL;
+        cmd->path = name;
+        return;
+    }
+
+    NameEntry *e = name_find(name);
+    if (e && e->func)
+        cmd->kind = CMD_FUNCTION;
+    else if (e && e->builtin)
+    {
+        cmd->kind = CMD_BUILTIN;
+        cmd->builtin = e->builtin;
+    }
+    else if ((cmd->path = resolve_path(name)) != NULL)
+        cmd->kind = CMD_EXTERNAL;
+    else
+        cmd->kind = CMD_NOT_FOUND;
+}
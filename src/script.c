@@ -0,0 +1,1516 @@
+/*
+ * script.c - Control flow (if/while/until/for/case, ( ) and { } groups, functions)
+ *
+ * Input is compiled once into a small bytecode program whose simple
+ * commands are pre-split into words; the interpreter only expands words
+ * and launches pipelines, so loop bodies never re-lex and reuse their
+ * expansion buffers across iterations.
+ */
+
+#include "../include/script.h"
+#include "../include/parser.h"
+#include "../include/executor.h"
+#include "../include/expand.h"
+#include "../include/utils.h"
+#include "../include/resolve.h"
+#include "../include/fanout.h"
+#include <ctype.h>
+#include <fnmatch.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#define MAX_LOOP_NEST  32 // Nested loops while compiling/running
+#define MAX_CALL_DEPTH 64 // Nested function calls
+#define MAX_BREAKS     64 // break statements per loop
+#define MAX_FUNCS      128
+#define MAX_GROUP_NEST 32 // Redirected { } groups active at once
+
+#define GROUP_MARK '\x01' // Stands for a ( ) or { } stage in pipeline text
+
+// ---------------------------------------------------------------------------
+// Lexer
+// ---------------------------------------------------------------------------
+
+typedef enum {
+    T_WORD, T_NEWLINE, T_SEMI, T_DSEMI, T_AMP, T_AND, T_OR,
+    T_PIPE, T_LPAREN, T_RPAREN, T_EOF
+} TokType;
+
+typedef struct
+{
+    TokType type;
+    const char *start; // Word text (not NUL-terminated)
+    int len;
+} Token;
+
+// Characters that end a word
+static int is_special(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '&' ||
+           c == '|' || c == '(' || c == ')';
+}
+
+// Check whether the special character at q is part of a redirection operator
+static int is_redirect_char(const char *q, const char *word)
+{
+    if (*q == '&')
+        return q[1] == '>' || (q > word && (q[-1] == '>' || q[-1] == '<'));
+    return *q == '|' && q > word && q[-1] == '>';
+}
+
+// Split text into tokens; returns the count (last token is T_EOF)
+static int lex(const char *text, Token **out)
+{
+    int cap = 64, n = 0;
+    Token *toks = malloc(sizeof(Token) * cap);
+    const char *p = text;
+
+    while (toks)
+    {
+        if (n + 1 >= cap)
+        {
+            cap *= 2;
+            Token *grown = realloc(toks, sizeof(Token) * cap);
+            if (!grown)
+            {
+                free(toks);
+                return -1;
+            }
+            toks = grown;
+        }
+
+        while (*p == ' ' || *p == '\t' || (p[0] == '\\' && p[1] == '\n'))
+            p += (*p == '\\') ? 2 : 1;
+        if (*p == '#')
+        {
+            while (*p && *p != '\n')
+                p++;
+        }
+
+        Token *t = &toks[n++];
+        t->start = p;
+        t->len = 1;
+        if (!*p)
+        {
+            t->type = T_EOF;
+            break;
+        }
+        else if (*p == '\n')
+            t->type = T_NEWLINE;
+        else if (p[0] == ';' && p[1] == ';')
+            t->type = T_DSEMI, t->len = 2;
+        else if (*p == ';')
+            t->type = T_SEMI;
+        else if (p[0] == '&' && p[1] == '&')
+            t->type = T_AND, t->len = 2;
+        else if (*p == '&' && p[1] != '>')
+            t->type = T_AMP;
+        else if (p[0] == '|' && p[1] == '|')
+            t->type = T_OR, t->len = 2;
+        else if (*p == '|')
+            t->type = T_PIPE;
+        else if (*p == '(')
+            t->type = T_LPAREN;
+        else if (*p == ')')
+            t->type = T_RPAREN;
+        else
+        {
+            // Word: substitutions are atomic, and the "&" and "|" of
+            // redirection operators (2>&1, &>file, >|file) belong to it
+            const char *q = p;
+            while (*q && (!is_special(*q) || is_redirect_char(q, p)))
+            {
+                if (q[0] == '`' || (q[0] == '$' && q[1] == '('))
+                    q = skip_subst(q);
+                else if (q[0] == '$' && q[1] == '{')
+                {
+                    const char *close = strchr(q, '}');
+                    q = close ? close + 1 : q + strlen(q);
+                }
+                else
+                    q++;
+            }
+            t->type = T_WORD;
+            t->len = q - p;
+        }
+        p += t->len;
+    }
+
+    *out = toks;
+    return toks ? n : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Compiler
+// ---------------------------------------------------------------------------
+
+// break/continue bookkeeping for one loop being compiled
+typedef struct
+{
+    uint32_t continue_pc; // Target of continue
+    uint32_t breaks[MAX_BREAKS]; // OP_JMP instructions to patch with the exit pc
+    int nbreaks;
+    int redir_depth; // Redirected groups open where the loop starts
+} LoopCtx;
+
+typedef struct
+{
+    Token *toks;
+    int pos;
+    Program *prog;
+    StrBuf pool;
+    uint32_t code_cap, pipes_cap, cmds_cap, words_cap;
+    LoopCtx loops[MAX_LOOP_NEST];
+    int nloops;
+    int redir_depth; // Redirected { } groups around the code being compiled
+    int status; // SCRIPT_OK / SCRIPT_INCOMPLETE / SCRIPT_ERROR
+} Compiler;
+
+// Jumps to one target that is not known yet (the end of an if or a case)
+typedef struct
+{
+    uint32_t *at; // Instructions to patch
+    uint32_t n, cap;
+} JumpList;
+
+static void compile_list(Compiler *c, const char *const *terms);
+
+// Grow a dynamic array to hold at least need elements
+static int grow(void **arr, uint32_t *cap, uint32_t need, size_t elem)
+{
+    if (need <= *cap)
+        return 0;
+    uint32_t n = *cap ? *cap * 2 : 16;
+    while (n < need)
+        n *= 2;
+    void *p = realloc(*arr, (size_t)n * elem);
+    if (!p)
+        return -1;
+    *arr = p;
+    *cap = n;
+    return 0;
+}
+
+static Token *peek(Compiler *c)
+{
+    return &c->toks[c->pos];
+}
+
+static Token *next(Compiler *c)
+{
+    Token *t = &c->toks[c->pos];
+    if (t->type != T_EOF)
+        c->pos++;
+    return t;
+}
+
+// Check whether a token is the given word
+static int tok_is(const Token *t, const char *word)
+{
+    return t->type == T_WORD && (int)strlen(word) == t->len && strncmp(t->start, word, t->len) == 0;
+}
+
+// Report a syntax error (or note that more input is needed at EOF)
+static void syntax_error(Compiler *c, const Token *t)
+{
+    if (c->status != SCRIPT_OK)
+        return;
+    if (t->type == T_EOF)
+    {
+        c->status = SCRIPT_INCOMPLETE;
+        return;
+    }
+    c->status = SCRIPT_ERROR;
+    int len = (t->type == T_NEWLINE) ? 7 : t->len;
+    const char *text = (t->type == T_NEWLINE) ? "newline" : t->start;
+    fprintf(stderr, "%ssyntax error near '%.*s'%s\n", COLOR_RED, len, text, COLOR_RESET);
+}
+
+// Consume a required keyword
+static void expect(Compiler *c, const char *word)
+{
+    if (c->status != SCRIPT_OK)
+        return;
+    if (tok_is(peek(c), word))
+        next(c);
+    else
+        syntax_error(c, peek(c));
+}
+
+static void skip_newlines(Compiler *c)
+{
+    while (peek(c)->type == T_NEWLINE)
+        next(c);
+}
+
+// Copy a string into the pool, returning its offset
+static uint32_t pool_add(Compiler *c, const char *s, size_t len)
+{
+    uint32_t off = c->pool.len;
+    sb_append(&c->pool, s, len);
+    sb_putc(&c->pool, '\0');
+    return off;
+}
+
+static uint32_t emit(Compiler *c, OpCode op, int32_t a, int32_t b)
+{
+    Program *p = c->prog;
+    if (grow((void **)&p->code, &c->code_cap, p->ncode + 1, sizeof(Insn)) < 0)
+    {
+        c->status = SCRIPT_ERROR;
+        return 0;
+    }
+    p->code[p->ncode] = (Insn){ op, a, b };
+    return p->ncode++;
+}
+
+static void patch(Compiler *c, uint32_t at, int32_t target)
+{
+    if (c->status == SCRIPT_OK)
+        c->prog->code[at].a = target;
+}
+
+static uint32_t here(Compiler *c)
+{
+    return c->prog->ncode;
+}
+
+// Remember a jump whose target is not known yet
+static void add_jump(Compiler *c, JumpList *j, uint32_t at)
+{
+    if (grow((void **)&j->at, &j->cap, j->n + 1, sizeof(uint32_t)) < 0)
+    {
+        c->status = SCRIPT_ERROR;
+        return;
+    }
+    j->at[j->n++] = at;
+}
+
+// Point every remembered jump at target and forget them
+static void patch_jumps(Compiler *c, JumpList *j, int32_t target)
+{
+    for (uint32_t i = 0; i < j->n; i++)
+        patch(c, j->at[i], target);
+    free(j->at);
+    *j = (JumpList){ 0 };
+}
+
+static uint32_t add_word(Compiler *c, uint32_t off)
+{
+    Program *p = c->prog;
+    if (grow((void **)&p->words, &c->words_cap, p->nwords + 1, sizeof(uint32_t)) < 0)
+    {
+        c->status = SCRIPT_ERROR;
+        return 0;
+    }
+    p->words[p->nwords] = off;
+    return p->nwords++;
+}
+
+// Store a parsed command (its strings are in the pool) as a template
+static CmdTemplate *add_command(Compiler *c, const Command *cmd)
+{
+    Program *p = c->prog;
+    if (grow((void **)&p->cmds, &c->cmds_cap, p->ncmds + 1, sizeof(CmdTemplate)) < 0)
+        return NULL;
+    const char *pool = c->pool.data;
+    CmdTemplate *t = &p->cmds[p->ncmds++];
+    t->argv_start = p->nwords;
+    t->argc = cmd->argc;
+    for (int j = 0; j < cmd->argc; j++)
+        add_word(c, cmd->argv[j] - pool);
+    t->redir_start = p->nwords;
+    t->num_redirs = cmd->num_redirs;
+    for (int j = 0; j < cmd->num_redirs; j++)
+    {
+        const Redirect *r = &cmd->redirs[j];
+        add_word(c, REDIR_PACK(r->fd, r->op, r->src));
+        add_word(c, r->target ? (uint32_t)(r->target - pool) : NO_STR);
+    }
+    t->background = cmd->background;
+    return t;
+}
+
+// Parse pipeline text once with the regular parser and store it as templates
+static int add_pipe(Compiler *c, const char *text)
+{
+    Program *p = c->prog;
+    uint32_t base = pool_add(c, text, strlen(text));
+
+    // Parse scratch is large (MAX_CMDS stages) and reused by every compile
+    static Command *cmds;
+    if (!cmds && !(cmds = malloc(sizeof(Command) * MAX_CMDS)))
+        return -1;
+    int num_cmds = split_pipeline(c->pool.data + base, cmds);
+    if (num_cmds <= 0)
+        return -1;
+
+    if (grow((void **)&p->pipes, &c->pipes_cap, p->npipes + 1, sizeof(PipeTemplate)) < 0)
+        return -1;
+    p->pipes[p->npipes] = (PipeTemplate){ p->ncmds, (uint32_t)num_cmds };
+    for (int i = 0; i < num_cmds; i++)
+    {
+        CmdTemplate *t = add_command(c, &cmds[i]);
+        if (!t)
+            return -1;
+
+        // A group's marker holds its body's pc; only redirections may follow it
+        if (cmds[i].argv[0][0] == GROUP_MARK)
+        {
+            if (cmds[i].argc > 1)
+            {
+                fprintf(stderr, "%ssyntax error near '%s'%s\n", COLOR_RED, cmds[i].argv[1], COLOR_RESET);
+                return -1;
+            }
+            t->argc = 0;
+            t->argv_start = strtoul(cmds[i].argv[0] + 1, NULL, 10);
+        }
+    }
+    return p->npipes++;
+}
+
+// Store the redirection words that follow a { } group as a template;
+// returns its index, or -1 after reporting a syntax error
+static int add_group_redirs(Compiler *c)
+{
+    StrBuf text;
+    sb_init(&text);
+    while (peek(c)->type == T_WORD)
+    {
+        Token *t = next(c);
+        if (text.len)
+            sb_putc(&text, ' ');
+        sb_append(&text, t->start, t->len);
+    }
+    uint32_t base = pool_add(c, text.data, text.len);
+    sb_free(&text);
+
+    Command cmd;
+    if (parse_command(c->pool.data + base, &cmd) < 0)
+    {
+        c->status = SCRIPT_ERROR;
+        return -1;
+    }
+    if (cmd.argc > 0)
+    {
+        fprintf(stderr, "%ssyntax error near '%s'%s\n", COLOR_RED, cmd.argv[0], COLOR_RESET);
+        c->status = SCRIPT_ERROR;
+        return -1;
+    }
+    if (cmd.background || !add_command(c, &cmd))
+    {
+        c->status = SCRIPT_ERROR;
+        return -1;
+    }
+    return c->prog->ncmds - 1;
+}
+
+// break / continue as a whole command
+static int compile_loop_jump(Compiler *c, const Token *t)
+{
+    int is_break = tok_is(t, "break");
+    if (!is_break && !tok_is(t, "continue"))
+        return 0;
+    TokType after = c->toks[c->pos + 1].type;
+    if (after == T_WORD || after == T_PIPE || after == T_AMP)
+        return 0;
+    if (c->nloops == 0)
+    {
+        fprintf(stderr, "%s%.*s: only meaningful in a loop%s\n", COLOR_RED, t->len, t->start, COLOR_RESET);
+        c->status = SCRIPT_ERROR;
+        return 1;
+    }
+
+    next(c);
+    LoopCtx *loop = &c->loops[c->nloops - 1];
+
+    // Leaving redirected groups puts the shell's descriptors back first
+    for (int i = loop->redir_depth; i < c->redir_depth; i++)
+        emit(c, OP_UNREDIR, 0, 0);
+    if (!is_break)
+        emit(c, OP_JMP, loop->continue_pc, 0);
+    else if (loop->nbreaks < MAX_BREAKS)
+        loop->breaks[loop->nbreaks++] = emit(c, OP_JMP, 0, 0);
+    else
+        c->status = SCRIPT_ERROR;
+    return 1;
+}
+
+// Body of a ( ) or { } pipeline stage, compiled out of line behind an
+// OP_GROUP that skips it; returns the pc of the body
+static uint32_t compile_group_body(Compiler *c)
+{
+    static const char *const paren_end[] = { NULL };
+    static const char *const brace_end[] = { "}", NULL };
+    int paren = peek(c)->type == T_LPAREN;
+    Token *open = next(c);
+
+    // It runs in a child: loops and redirections around it are not its own
+    int saved_loops = c->nloops, saved_redirs = c->redir_depth;
+    c->nloops = 0;
+    c->redir_depth = 0;
+    uint32_t skip = emit(c, OP_GROUP, 0, 0);
+    compile_list(c, paren ? paren_end : brace_end);
+    if (!paren)
+        expect(c, "}");
+    else if (peek(c)->type == T_RPAREN)
+        next(c);
+    else
+        syntax_error(c, peek(c));
+    emit(c, OP_HALT, 0, 0);
+    c->nloops = saved_loops;
+    c->redir_depth = saved_redirs;
+
+    if (c->status == SCRIPT_OK)
+    {
+        const Token *close = &c->toks[c->pos - 1];
+        c->prog->code[skip].a = here(c);
+        c->prog->code[skip].b = pool_add(c, open->start, close->start + close->len - open->start);
+    }
+    return skip + 1;
+}
+
+// Check whether a word after prev is in command position (where "{" and
+// "}" are keywords)
+static int command_position(const Token *prev)
+{
+    static const char *const keywords[] = { "{", "}", "!", "if", "then", "elif", "else", "while", "until", "do", NULL };
+    if (prev->type != T_WORD)
+        return 1;
+    for (int i = 0; keywords[i]; i++)
+    {
+        if (tok_is(prev, keywords[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Index of the token after the "}" closing the group at the current
+// position, or -1 if the input ends first
+static int group_close(Compiler *c)
+{
+    int depth = 0;
+    for (int i = c->pos; c->toks[i].type != T_EOF; i++)
+    {
+        const Token *t = &c->toks[i];
+        if (t->type != T_WORD || t->len != 1 || (*t->start != '{' && *t->start != '}'))
+            continue;
+        if (i > c->pos && !command_position(&c->toks[i - 1]))
+            continue;
+        depth += *t->start == '{' ? 1 : -1;
+        if (depth == 0)
+            return i + 1;
+    }
+    return -1;
+}
+
+// Check whether the { } group at the current position needs a process of
+// its own: piped, in the background, or copying its output to several files
+static int group_is_stage(Compiler *c)
+{
+    int i = group_close(c);
+    if (i < 0)
+        return 0;
+    int words = i;
+    while (c->toks[i].type == T_WORD)
+        i++;
+    if (c->toks[i].type == T_PIPE || c->toks[i].type == T_AMP)
+        return 1;
+    if (i == words)
+        return 0;
+
+    StrBuf text;
+    sb_init(&text);
+    for (int j = words; j < i; j++)
+    {
+        sb_append(&text, c->toks[j].start, c->toks[j].len);
+        sb_putc(&text, ' ');
+    }
+    Command cmd;
+    int fanout = 0;
+    if (parse_command(text.data, &cmd) < 0)
+        c->status = SCRIPT_ERROR;
+    else
+        fanout = fanout_needed(&cmd);
+    sb_free(&text);
+    return fanout;
+}
+
+// Pipeline stages joined by |, optionally ending in &; a stage is a simple
+// command or a ( ) or { } group followed by redirections
+static void compile_simple_pipeline(Compiler *c)
+{
+    if (compile_loop_jump(c, peek(c)))
+        return;
+
+    StrBuf text;
+    sb_init(&text);
+    for (;;)
+    {
+        int words = 0;
+        if (peek(c)->type == T_LPAREN || tok_is(peek(c), "{"))
+        {
+            char mark[16];
+            snprintf(mark, sizeof(mark), "%c%u", GROUP_MARK, compile_group_body(c));
+            if (c->status != SCRIPT_OK)
+                break;
+            sb_append(&text, mark, strlen(mark));
+            words++;
+        }
+        while (peek(c)->type == T_WORD)
+        {
+            Token *t = next(c);
+            if (words++)
+                sb_putc(&text, ' ');
+            sb_append(&text, t->start, t->len);
+        }
+        if (words == 0)
+        {
+            syntax_error(c, peek(c));
+            break;
+        }
+        if (peek(c)->type != T_PIPE)
+            break;
+        next(c);
+        skip_newlines(c);
+        sb_append(&text, " | ", 3);
+    }
+    if (c->status == SCRIPT_OK && peek(c)->type == T_AMP)
+    {
+        next(c);
+        sb_append(&text, " &", 2);
+    }
+
+    if (c->status == SCRIPT_OK)
+    {
+        int pipe = add_pipe(c, text.data);
+        if (pipe < 0)
+            c->status = SCRIPT_ERROR;
+        else
+            emit(c, OP_RUN, pipe, 0);
+    }
+    sb_free(&text);
+}
+
+static void push_loop(Compiler *c, uint32_t continue_pc)
+{
+    if (c->nloops == MAX_LOOP_NEST)
+    {
+        fprintf(stderr, "%sloops nested too deeply%s\n", COLOR_RED, COLOR_RESET);
+        c->status = SCRIPT_ERROR;
+        return;
+    }
+    c->loops[c->nloops].continue_pc = continue_pc;
+    c->loops[c->nloops].nbreaks = 0;
+    c->loops[c->nloops].redir_depth = c->redir_depth;
+    c->nloops++;
+}
+
+static void pop_loop(Compiler *c, uint32_t exit_pc)
+{
+    if (c->nloops == 0)
+        return;
+    LoopCtx *loop = &c->loops[--c->nloops];
+    for (int i = 0; i < loop->nbreaks; i++)
+        patch(c, loop->breaks[i], exit_pc);
+}
+
+// if LIST then LIST [elif LIST then LIST]... [else LIST] fi
+static void compile_if(Compiler *c)
+{
+    static const char *const cond_end[] = { "then", NULL };
+    static const char *const body_end[] = { "elif", "else", "fi", NULL };
+    static const char *const else_end[] = { "fi", NULL };
+    JumpList ends = { 0 };
+
+    next(c);
+    for (;;)
+    {
+        compile_list(c, cond_end);
+        expect(c, "then");
+        uint32_t skip = emit(c, OP_JFALSE, 0, 0);
+        compile_list(c, body_end);
+        add_jump(c, &ends, emit(c, OP_JMP, 0, 0));
+        patch(c, skip, here(c));
+        if (c->status != SCRIPT_OK || !tok_is(peek(c), "elif"))
+            break;
+        next(c);
+    }
+
+    if (tok_is(peek(c), "else"))
+    {
+        next(c);
+        compile_list(c, else_end);
+    }
+    else
+    {
+        emit(c, OP_TRUE, 0, 0);  // No branch taken: status 0
+    }
+    expect(c, "fi");
+    patch_jumps(c, &ends, here(c));
+}
+
+// while/until LIST do LIST done
+static void compile_while(Compiler *c)
+{
+    static const char *const cond_end[] = { "do", NULL };
+    static const char *const body_end[] = { "done", NULL };
+    int until = tok_is(next(c), "until");
+
+    uint32_t top = here(c);
+    compile_list(c, cond_end);
+    expect(c, "do");
+    uint32_t exit_jump = emit(c, until ? OP_JTRUE : OP_JFALSE, 0, 0);
+    push_loop(c, top);
+    compile_list(c, body_end);
+    expect(c, "done");
+    emit(c, OP_JMP, top, 0);
+    patch(c, exit_jump, here(c));
+    pop_loop(c, here(c));
+    emit(c, OP_TRUE, 0, 0);
+}
+
+// for NAME [in WORDS...] ; do LIST done
+static void compile_for(Compiler *c)
+{
+    static const char *const body_end[] = { "done", NULL };
+    next(c);
+    Token *name = next(c);
+    if (name->type != T_WORD || assignment_name_len(name->start) != 0 ||
+        !(isalpha((unsigned char)name->start[0]) || name->start[0] == '_'))
+    {
+        syntax_error(c, name);
+        return;
+    }
+    uint32_t var = pool_add(c, name->start, name->len);
+
+    uint32_t first = c->prog->nwords, count = 0;
+    skip_newlines(c);
+    if (tok_is(peek(c), "in"))
+    {
+        next(c);
+        while (peek(c)->type == T_WORD)
+        {
+            Token *t = next(c);
+            add_word(c, pool_add(c, t->start, t->len));
+            count++;
+        }
+    }
+    else
+    {
+        add_word(c, pool_add(c, "$@", 2));
+        count = 1;
+    }
+    if (peek(c)->type == T_SEMI)
+        next(c);
+    skip_newlines(c);
+    expect(c, "do");
+
+    emit(c, OP_FOR_INIT, first, count);
+    uint32_t loop = emit(c, OP_FOR_NEXT, var, 0);
+    push_loop(c, loop);
+    compile_list(c, body_end);
+    expect(c, "done");
+    emit(c, OP_JMP, loop, 0);
+    uint32_t end = emit(c, OP_FOR_END, 0, 0);
+    if (c->status == SCRIPT_OK)
+        c->prog->code[loop].b = end;
+    pop_loop(c, end);
+}
+
+// case WORD in [(]PAT[|PAT]...) LIST ;; ... esac
+static void compile_case(Compiler *c)
+{
+    static const char *const item_end[] = { "esac", NULL };
+    JumpList ends = { 0 };
+    JumpList matches = { 0 }; // OP_CASE_MATCH of the item, patched through b
+
+    next(c);
+    Token *subject = next(c);
+    if (subject->type != T_WORD)
+    {
+        syntax_error(c, subject);
+        return;
+    }
+    emit(c, OP_CASE_SET, pool_add(c, subject->start, subject->len), 0);
+    skip_newlines(c);
+    expect(c, "in");
+
+    while (c->status == SCRIPT_OK)
+    {
+        skip_newlines(c);
+        if (tok_is(peek(c), "esac"))
+            break;
+        if (peek(c)->type == T_LPAREN)
+            next(c);
+
+        matches.n = 0;
+        for (;;)
+        {
+            Token *pat = next(c);
+            if (pat->type != T_WORD)
+            {
+                syntax_error(c, pat);
+                break;
+            }
+            add_jump(c, &matches, emit(c, OP_CASE_MATCH, pool_add(c, pat->start, pat->len), 0));
+            if (peek(c)->type != T_PIPE)
+                break;
+            next(c);
+        }
+        if (c->status != SCRIPT_OK)
+            break;
+        if (peek(c)->type != T_RPAREN)
+        {
+            syntax_error(c, peek(c));
+            break;
+        }
+        next(c);
+
+        uint32_t skip = emit(c, OP_JMP, 0, 0);
+        for (uint32_t i = 0; i < matches.n && c->status == SCRIPT_OK; i++)
+            c->prog->code[matches.at[i]].b = here(c);
+        compile_list(c, item_end);
+        add_jump(c, &ends, emit(c, OP_JMP, 0, 0));
+        patch(c, skip, here(c));
+        if (peek(c)->type == T_DSEMI)
+            next(c);
+        else if (!tok_is(peek(c), "esac"))
+            syntax_error(c, peek(c));
+    }
+    free(matches.at);
+    expect(c, "esac");
+    emit(c, OP_TRUE, 0, 0);  // No pattern matched: status 0
+    patch_jumps(c, &ends, here(c));
+}
+
+// { LIST } [REDIRECTIONS], run by the shell itself; the files are opened
+// once for the whole group and the shell's descriptors restored after it
+static void compile_group(Compiler *c)
+{
+    static const char *const group_end[] = { "}", NULL };
+    int close = group_close(c);
+    int redirected = close >= 0 && c->toks[close].type == T_WORD;
+    uint32_t redir = 0;
+    next(c);
+    if (redirected)
+    {
+        redir = emit(c, OP_REDIR, 0, 0);
+        c->redir_depth++;
+    }
+    compile_list(c, group_end);
+    expect(c, "}");
+    if (!redirected)
+        return;
+
+    c->redir_depth--;
+    emit(c, OP_UNREDIR, 0, 0);
+    int tmpl = c->status == SCRIPT_OK ? add_group_redirs(c) : -1;
+    if (tmpl >= 0)
+    {
+        c->prog->code[redir].a = tmpl;
+        c->prog->code[redir].b = here(c);
+    }
+}
+
+static void compile_command(Compiler *c);
+
+// NAME () BODY  or  function NAME BODY
+static void compile_function(Compiler *c, int keyword)
+{
+    if (keyword)
+        next(c);
+    Token *name = next(c);
+    if (name->type != T_WORD)
+    {
+        syntax_error(c, name);
+        return;
+    }
+    if (peek(c)->type == T_LPAREN)
+    {
+        next(c);
+        if (peek(c)->type != T_RPAREN)
+        {
+            syntax_error(c, peek(c));
+            return;
+        }
+        next(c);
+    }
+    skip_newlines(c);
+
+    // Loops outside the function are not break targets inside it, and it
+    // runs outside the groups around its definition
+    int saved_loops = c->nloops, saved_redirs = c->redir_depth;
+    c->nloops = 0;
+    c->redir_depth = 0;
+    uint32_t def = emit(c, OP_DEFUN, pool_add(c, name->start, name->len), 0);
+    compile_command(c);
+    emit(c, OP_RET, 0, 0);
+    if (c->status == SCRIPT_OK)
+        c->prog->code[def].b = here(c);
+    c->nloops = saved_loops;
+    c->redir_depth = saved_redirs;
+}
+
+// Check for NAME ( ) at the current position
+static int at_function_def(Compiler *c)
+{
+    return peek(c)->type == T_WORD && c->toks[c->pos + 1].type == T_LPAREN &&
+           c->toks[c->pos + 2].type == T_RPAREN;
+}
+
+// One command: compound construct, function definition or simple pipeline
+static void compile_command(Compiler *c)
+{
+    Token *t = peek(c);
+    int compound = 1;
+    if (tok_is(t, "if"))
+        compile_if(c);
+    else if (tok_is(t, "while") || tok_is(t, "until"))
+        compile_while(c);
+    else if (tok_is(t, "for"))
+        compile_for(c);
+    else if (tok_is(t, "case"))
+        compile_case(c);
+    else if (tok_is(t, "{") && !group_is_stage(c))
+        compile_group(c);
+    else if (tok_is(t, "function"))
+        compile_function(c, 1);
+    else if (at_function_def(c))
+        compile_function(c, 0);
+    else
+    {
+        compound = 0;
+        compile_simple_pipeline(c);
+    }
+
+    if (compound && c->status == SCRIPT_OK &&
+        (peek(c)->type == T_PIPE || peek(c)->type == T_AMP))
+    {
+        fprintf(stderr, "%scompound commands cannot be piped or backgrounded%s\n", COLOR_RED, COLOR_RESET);
+        c->status = SCRIPT_ERROR;
+    }
+}
+
+// [!] command
+static void compile_pipeline(Compiler *c)
+{
+    int negate = 0;
+    if (tok_is(peek(c), "!"))
+    {
+        next(c);
+        negate = 1;
+    }
+    compile_command(c);
+    if (negate)
+        emit(c, OP_NOT, 0, 0);
+}
+
+// pipeline [&& pipeline | || pipeline]...
+static void compile_and_or(Compiler *c)
+{
+    compile_pipeline(c);
+    while (c->status == SCRIPT_OK && (peek(c)->type == T_AND || peek(c)->type == T_OR))
+    {
+        OpCode op = (next(c)->type == T_AND) ? OP_JFALSE : OP_JTRUE;
+        skip_newlines(c);
+        uint32_t skip = emit(c, op, 0, 0);
+        compile_pipeline(c);
+        patch(c, skip, here(c));
+    }
+}
+
+// Check whether the next token ends the current list
+static int at_list_end(Compiler *c, const char *const *terms)
+{
+    Token *t = peek(c);
+    if (t->type == T_EOF || t->type == T_DSEMI || t->type == T_RPAREN)
+        return 1;
+    for (int i = 0; terms && terms[i]; i++)
+    {
+        if (tok_is(t, terms[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Commands separated by ; or newlines, up to a terminator keyword
+static void compile_list(Compiler *c, const char *const *terms)
+{
+    while (c->status == SCRIPT_OK)
+    {
+        while (peek(c)->type == T_NEWLINE || peek(c)->type == T_SEMI)
+            next(c);
+        if (at_list_end(c, terms))
+        {
+            // Inside a construct, running out of input means "keep reading"
+            if (terms && peek(c)->type == T_EOF)
+                c->status = SCRIPT_INCOMPLETE;
+            return;
+        }
+        compile_and_or(c);
+        if (c->status != SCRIPT_OK)
+            return;
+
+        Token *t = peek(c);
+        if (t->type == T_SEMI || t->type == T_NEWLINE)
+            next(c);
+        else if (!at_list_end(c, terms))
+            syntax_error(c, t);
+    }
+}
+
+// Compile text to a program
+int script_compile(const char *text, Program **out)
+{
+    Compiler c;
+    memset(&c, 0, sizeof(c));
+    if (lex(text, &c.toks) < 0)
+        return SCRIPT_ERROR;
+    c.prog = calloc(1, sizeof(Program));
+    if (!c.prog)
+    {
+        free(c.toks);
+        return SCRIPT_ERROR;
+    }
+    sb_init(&c.pool);
+
+    compile_list(&c, NULL);
+    if (c.status == SCRIPT_OK && peek(&c)->type != T_EOF)
+        syntax_error(&c, peek(&c));
+    emit(&c, OP_HALT, 0, 0);
+
+    free(c.toks);
+    c.prog->pool = c.pool.data;
+    c.prog->pool_len = c.pool.len;
+    c.prog->refs = 1;
+    if (c.status != SCRIPT_OK)
+    {
+        script_release(c.prog);
+        return c.status;
+    }
+    *out = c.prog;
+    return SCRIPT_OK;
+}
+
+// Drop a reference to a program
+void script_release(Program *prog)
+{
+    if (!prog || --prog->refs > 0)
+        return;
+    if (prog->map)
+    {
+        munmap(prog->map, prog->map_len);
+        free(prog);
+        return;
+    }
+    free(prog->code);
+    free(prog->pipes);
+    free(prog->cmds);
+    free(prog->words);
+    free(prog->pool);
+    free(prog);
+}
+
+// ---------------------------------------------------------------------------
+// Interpreter
+// ---------------------------------------------------------------------------
+
+// Defined shell function
+typedef struct
+{
+    char *name;
+    Program *prog;
+    uint32_t pc; // First instruction of the body
+} FuncDef;
+
+// Active function call
+typedef struct
+{
+    Program *ret_prog;
+    uint32_t ret_pc;
+    int loop_depth; // Loop stack height at the call
+    int redir_depth; // Redirected groups open at the call
+    int saved_argc;
+    char **saved_argv;
+    char *argv[MAX_ARGS]; // Positional parameters of this call
+    StrBuf args; // Storage for the positional parameters
+} Frame;
+
+// Active for loop: expanded items stored back to back
+typedef struct
+{
+    StrBuf items;
+    size_t cursor;
+} LoopState;
+
+static FuncDef funcs[MAX_FUNCS];
+static int nfuncs;
+static Frame frames[MAX_CALL_DEPTH];
+static int nframes;
+static LoopState loop_stack[MAX_LOOP_NEST * 4];
+static int nloop_states;
+static StrBuf run_arenas[2 * MAX_CALL_DEPTH]; // Word expansion storage per run/call level
+static int arena_level = -1;
+static StrBuf case_subject;
+static RedirSave redir_stack[MAX_GROUP_NEST]; // Redirected { } groups being run
+static int nredirs;
+
+static FuncDef *find_func(const char *name)
+{
+    NameEntry *e = name_find(name);
+    return e ? e->func : NULL;
+}
+
+// Register (or replace) a function; the program stays alive while referenced
+static void define_func(const char *name, Program *prog, uint32_t pc)
+{
+    FuncDef *f = find_func(name);
+    if (!f)
+    {
+        if (nfuncs == MAX_FUNCS)
+        {
+            fprintf(stderr, "%s%s: too many functions%s\n", COLOR_RED, name, COLOR_RESET);
+            return;
+        }
+        NameEntry *e = name_add(name);
+        if (!e)
+            return;
+        f = &funcs[nfuncs++];
+        f->name = strdup(name);
+        e->func = f;
+    }
+    else
+    {
+        script_release(f->prog);
+    }
+    f->prog = prog;
+    f->pc = pc;
+    prog->refs++;
+}
+
+// Materialize a command template (no allocation)
+static void load_command(Program *prog, const CmdTemplate *t, Command *cmd)
+{
+    cmd->num_redirs = t->num_redirs;
+    for (uint32_t j = 0; j < t->num_redirs; j++)
+    {
+        uint32_t packed = prog->words[t->redir_start + 2 * j];
+        uint32_t target = prog->words[t->redir_start + 2 * j + 1];
+        cmd->redirs[j] = (Redirect){ REDIR_PACKED_FD(packed), REDIR_PACKED_OP(packed), REDIR_PACKED_SRC(packed),
+                                     target == NO_STR ? NULL : prog->pool + target, -1 };
+    }
+    cmd->background = t->background;
+    cmd->pipe_out = 0;
+    cmd->kind = CMD_UNRESOLVED;
+    cmd->argc = t->argc;
+    for (uint32_t j = 0; j < t->argc; j++)
+        cmd->argv[j] = prog->pool + prog->words[t->argv_start + j];
+    cmd->argv[t->argc] = NULL;
+}
+
+// Materialize a pipeline template into cmd_buf (no allocation)
+static int load_pipe(Program *prog, uint32_t index, Command *cmd_buf)
+{
+    PipeTemplate *pt = &prog->pipes[index];
+    for (uint32_t i = 0; i < pt->num_cmds; i++)
+    {
+        CmdTemplate *t = &prog->cmds[pt->cmd_start + i];
+        Command *cmd = &cmd_buf[i];
+        load_command(prog, t, cmd);
+        if (t->argc == 0)
+        {
+            // ( ) or { } stage: named by its text, kept by the OP_GROUP before its body
+            cmd->argc = 1;
+            cmd->argv[0] = prog->pool + prog->code[t->argv_start - 1].b;
+            cmd->argv[1] = NULL;
+            cmd->kind = CMD_GROUP;
+            cmd->first = 0;
+            cmd->group = prog;
+            cmd->group_pc = t->argv_start;
+        }
+    }
+    return pt->num_cmds;
+}
+
+// Restore the shell's descriptors down to depth redirected groups
+static void unwind_redirections(int depth)
+{
+    while (nredirs > depth)
+        restore_redirections(&redir_stack[--nredirs]);
+}
+
+// Push a call frame and switch positional parameters
+static int call_func(FuncDef *f, Command *cmd, Program **prog, uint32_t *pc)
+{
+    if (nframes == MAX_CALL_DEPTH || arena_level + 1 == 2 * MAX_CALL_DEPTH)
+    {
+        fprintf(stderr, "%s%s: maximum function nesting exceeded%s\n", COLOR_RED, f->name, COLOR_RESET);
+        return -1;
+    }
+    Frame *fr = &frames[nframes++];
+    fr->ret_prog = *prog;
+    fr->ret_pc = *pc + 1;
+    fr->loop_depth = nloop_states;
+    fr->redir_depth = nredirs;
+    fr->saved_argc = positional_argc;
+    fr->saved_argv = positional_argv;
+
+    // Copy arguments out of the caller's arena, which is reused
+    fr->args.len = 0;
+    size_t offs[MAX_ARGS];
+    int n = cmd->argc - 1;
+    for (int i = 0; i < n; i++)
+    {
+        offs[i] = fr->args.len;
+        sb_append(&fr->args, cmd->argv[i + 1], strlen(cmd->argv[i + 1]) + 1);
+    }
+    for (int i = 0; i < n; i++)
+        fr->argv[i] = fr->args.data + offs[i];
+    fr->argv[n] = NULL;
+    positional_argc = n;
+    positional_argv = fr->argv;
+
+    *prog = f->prog;
+    *pc = f->pc;
+    arena_level++;
+    return 0;
+}
+
+// Pop a call frame
+static void return_from_func(Program **prog, uint32_t *pc)
+{
+    Frame *fr = &frames[--nframes];
+    arena_level--;
+    nloop_states = fr->loop_depth;
+    unwind_redirections(fr->redir_depth);
+    positional_argc = fr->saved_argc;
+    positional_argv = fr->saved_argv;
+    *prog = fr->ret_prog;
+    *pc = fr->ret_pc;
+}
+
+// Expand a for-loop word list into a fresh loop state
+static int for_init(Program *prog, uint32_t first, uint32_t count)
+{
+    if (nloop_states == (int)(sizeof(loop_stack) / sizeof(loop_stack[0])))
+    {
+        fprintf(stderr, "%sfor: loops nested too deeply%s\n", COLOR_RED, COLOR_RESET);
+        return -1;
+    }
+    LoopState *ls = &loop_stack[nloop_states];
+    ls->items.len = 0;
+    ls->cursor = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        char *word = prog->pool + prog->words[first + i];
+        if (expand_fields(&word, 1, &ls->items) < 0)
+            return -1;
+    }
+    nloop_states++;
+    return 0;
+}
+
+// Interpreter loop; stops at OP_HALT or when a frame returns to no program.
+// tail: this run is all that is left of a forked child, so its last
+// command may exec in place
+static int vm_exec(Program *prog, uint32_t pc, int base_frames, int tail)
+{
+    int base_loops = nloop_states;
+    int base_redirs = nredirs;
+
+    // Nested runs (e.g. from a builtin) get their own expansion storage,
+    // since the outer command's words are still in use
+    if (arena_level + 1 == 2 * MAX_CALL_DEPTH)
+    {
+        fprintf(stderr, "%sscript nesting too deep%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    Command *cmd_buf = NULL; // Grown to the longest pipeline run
+    StrBuf *stage_arenas = NULL; // One per stage: growing an arena moves the words in it
+    uint32_t cmd_cap = 0;
+    arena_level++;
+    prog->refs++;
+    Program *start = prog;
+
+    for (;;)
+    {
+        StrBuf *arena = &run_arenas[arena_level];
+        Insn *in = &prog->code[pc];
+        switch ((OpCode)in->op)
+        {
+        case OP_HALT:
+            goto done;
+
+        case OP_RUN:
+        {
+            uint32_t stages = prog->pipes[in->a].num_cmds;
+            if (stages > cmd_cap)
+            {
+                Command *grown = realloc(cmd_buf, sizeof(Command) * stages);
+                if (grown)
+                    cmd_buf = grown;
+                StrBuf *more = grown ? realloc(stage_arenas, sizeof(StrBuf) * stages) : NULL;
+                if (!more)
+                {
+                    perror("realloc");
+                    goto done;
+                }
+                stage_arenas = more;
+                for (uint32_t i = cmd_cap; i < stages; i++)
+                    sb_init(&stage_arenas[i]);
+                cmd_cap = stages;
+            }
+            int n = load_pipe(prog, in->a, cmd_buf);
+            int ok = 1;
+            for (int i = 0; i < n && ok; i++)
+            {
+                stage_arenas[i].len = 0;
+                // batch expands its own arguments, without the MAX_ARGS limit
+                if (cmd_buf[i].kind == CMD_GROUP)
+                {
+                    ok = expand_command(&cmd_buf[i], &stage_arenas[i]) == 0;
+                    continue;
+                }
+                if (strcmp(cmd_buf[i].argv[0], "batch") == 0)
+                {
+                    cmd_buf[i].kind = CMD_BATCH;
+                    cmd_buf[i].first = 0;
+                    continue;
+                }
+                ok = alias_expand(&cmd_buf[i]) == 0 && expand_command(&cmd_buf[i], &stage_arenas[i]) == 0;
+            }
+            if (!ok)
+            {
+                last_exit_status = 1;
+                pc++;
+                break;
+            }
+
+            Command *cmd = &cmd_buf[0];
+            int plain = (n == 1 && cmd->argc > 0 && cmd->num_redirs == 0);
+            if (plain && strcmp(cmd->argv[0], "return") == 0 && nframes > base_frames)
+            {
+                if (cmd->argc > 1)
+                    last_exit_status = atoi(cmd->argv[1]) & 0xff;
+                return_from_func(&prog, &pc);
+                if (!prog)
+                    goto done;
+                break;
+            }
+            if (plain)
+                resolve_command(cmd);
+            if (plain && cmd->kind == CMD_FUNCTION && cmd->first == 0)
+            {
+                if (call_func(find_func(cmd->argv[0]), cmd, &prog, &pc) < 0)
+                {
+                    last_exit_status = 1;
+                    pc++;
+                }
+                break;
+            }
+
+            // The last command of a forked group becomes the child: no fork, no wait
+            if (tail && n == 1 && !cmd->background && prog == start && nframes == base_frames &&
+                prog->code[pc + 1].op == OP_HALT)
+            {
+                resolve_command(cmd);
+                if (cmd->kind == CMD_EXTERNAL)
+                {
+                    if (open_redirections(cmd) < 0)
+                    {
+                        last_exit_status = 1;
+                        pc++;
+                        break;
+                    }
+                    fflush(stdout);
+                    exec_command(cmd);
+                }
+            }
+
+            run_pipeline(cmd_buf, n);
+
+            // Ctrl-C on a foreground command stops the whole script, like other shells
+            if (interactive && last_exit_status == 128 + SIGINT)
+                goto done;
+            pc++;
+            break;
+        }
+
+        case OP_NOT:
+            last_exit_status = !last_exit_status;
+            pc++;
+            break;
+
+        case OP_TRUE:
+            last_exit_status = 0;
+            pc++;
+            break;
+
+        case OP_JMP:
+            pc = in->a;
+            break;
+
+        case OP_JFALSE:
+            pc = last_exit_status != 0 ? (uint32_t)in->a : pc + 1;
+            break;
+
+        case OP_JTRUE:
+            pc = last_exit_status == 0 ? (uint32_t)in->a : pc + 1;
+            break;
+
+        case OP_FOR_INIT:
+            if (for_init(prog, in->a, in->b) < 0)
+                goto done;
+            pc++;
+            break;
+
+        case OP_FOR_NEXT:
+        {
+            LoopState *ls = &loop_stack[nloop_states - 1];
+            if (ls->cursor >= ls->items.len)
+            {
+                pc = in->b;
+                break;
+            }
+            const char *item = ls->items.data + ls->cursor;
+            ls->cursor += strlen(item) + 1;
+            setenv(prog->pool + in->a, item, 1);
+            pc++;
+            break;
+        }
+
+        case OP_FOR_END:
+            nloop_states--;
+            pc++;
+            break;
+
+        case OP_CASE_SET:
+            case_subject.len = 0;
+            expand_word(prog->pool + in->a, &case_subject);
+            sb_putc(&case_subject, '\0');
+            pc++;
+            break;
+
+        case OP_CASE_MATCH:
+        {
+            arena->len = 0;
+            expand_word(prog->pool + in->a, arena);
+            sb_putc(arena, '\0');
+            pc = fnmatch(arena->data, case_subject.data, 0) == 0 ? (uint32_t)in->b : pc + 1;
+            break;
+        }
+
+        case OP_DEFUN:
+            define_func(prog->pool + in->a, prog, pc + 1);
+            last_exit_status = 0;
+            pc = in->b;
+            break;
+
+        case OP_RET:
+            return_from_func(&prog, &pc);
+            if (!prog)
+                goto done;
+            break;
+
+        case OP_GROUP:
+            pc = in->a;
+            break;
+
+        case OP_REDIR:
+        {
+            Command redir;
+            load_command(prog, &prog->cmds[in->a], &redir);
+            arena->len = 0;
+            if (nredirs == MAX_GROUP_NEST)
+                fprintf(stderr, "%sredirected groups nested too deeply%s\n", COLOR_RED, COLOR_RESET);
+            else if (expand_command(&redir, arena) == 0 && redirect_shell(&redir, &redir_stack[nredirs]) == 0)
+            {
+                nredirs++;
+                pc++;
+                break;
+            }
+            last_exit_status = 1;
+            pc = in->b;
+            break;
+        }
+
+        case OP_UNREDIR:
+            restore_redirections(&redir_stack[--nredirs]);
+            pc++;
+            break;
+        }
+    }
+
+done:
+    // Unwind anything left by an aborted run
+    while (nframes > base_frames)
+        return_from_func(&prog, &pc);
+    nloop_states = base_loops;
+    unwind_redirections(base_redirs);
+    arena_level--;
+    free(cmd_buf);
+    for (uint32_t i = 0; i < cmd_cap; i++)
+        sb_free(&stage_arenas[i]);
+    free(stage_arenas);
+    script_release(start);
+    return last_exit_status;
+}
+
+// Execute a program
+int script_run(Program *prog)
+{
+    return vm_exec(prog, 0, nframes, 0);
+}
+
+// Run a ( ) or { } stage's body in the child forked for it
+int script_run_group(Program *prog, uint32_t pc)
+{
+    return vm_exec(prog, pc, nframes, 1);
+}
+
+// Check whether a shell function is defined
+int script_is_function(const char *name)
+{
+    return find_func(name) != NULL;
+}
+
+// Call a function outside the interpreter loop (e.g. as a pipeline stage)
+int script_call(int argc, char **argv)
+{
+    FuncDef *f = find_func(argv[0]);
+    if (!f)
+        return -1;
+
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.argc = argc;
+    for (int i = 0; i < argc && i < MAX_ARGS - 1; i++)
+        cmd.argv[i] = argv[i];
+    cmd.argv[argc < MAX_ARGS - 1 ? argc : MAX_ARGS - 1] = NULL;
+
+    // A frame that returns to no program ends the run
+    Program *prog = NULL;
+    uint32_t pc = 0;
+    int base_frames = nframes;
+    if (call_func(f, &cmd, &prog, &pc) < 0)
+        return 1;
+    return vm_exec(prog, pc, base_frames, 0);
+}
+
+// Compile and run text
+int script_eval(const char *text)
+{
+    Program *prog;
+    int rc = script_compile(text, &prog);
+    if (rc == SCRIPT_INCOMPLETE)
+    {
+        fprintf(stderr, "%ssyntax error: unexpected end of input%s\n", COLOR_RED, COLOR_RESET);
+        return -1;
+    }
+    if (rc != SCRIPT_OK)
+        return -1;
+    int status = script_run(prog);
+    script_release(prog);
+    return status;
+}
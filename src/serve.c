@@ -0,0 +1,468 @@
+/*
+ * serve.c - Persistent server mode (tinyshell --serve PATH)
+ *
+ * A cold start pays for exec, dynamic linking and shell setup on every
+ * command; a server pays once. Clients (tinyshell-client) connect to a
+ * Unix SOCK_SEQPACKET socket and send a script with its cwd, environment
+ * and arguments, attaching their stdin/stdout/stderr via SCM_RIGHTS.
+ *
+ * Copies of the server are forked ahead of time and wait in accept(), so
+ * no fork is on a client's path. The spare that takes a connection reads
+ * the request, hands the connection to the server and becomes the script's
+ * shell, running it through the ordinary compiler and executor. The server
+ * passes on signals the client forwards and, when the script's shell
+ * exits, replies with its status and the rusage wait4() reports. Every
+ * request starts from the server's pristine state, so clients never see
+ * each other's cd, variables or functions.
+ */
+
+#include "../include/serve.h"
+#include "../include/builtins.h"
+#include "../include/executor.h"
+#include "../include/expand.h"
+#include "../include/script.h"
+#include "../include/stats.h"
+#include "../include/utils.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+// A spare that took a connection tells the server (the connection attached)
+typedef struct
+{
+    pid_t pid;
+    uint64_t t0; // When the request arrived
+} TakenNote;
+
+// A request whose script is running
+typedef struct
+{
+    pid_t pid;
+    int pidfd;
+    int conn; // -1 once the client hung up, or for a spare that failed
+    uint64_t t0;
+} Running;
+
+// A SERVE_RUN request (strings point into the message buffer)
+typedef struct
+{
+    uint32_t flags;
+    char *cwd;
+    char *script;
+    char **strs; // env entries, then args
+    int envc;
+    int argc;
+} RunRequest;
+
+static volatile sig_atomic_t stop_requested;
+static pid_t spares[SERVE_SPARES]; // Idle spares (0 = free slot)
+static Running *running;
+static int num_running, running_cap;
+
+static void on_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+// Split a request into its strings; returns -1 if it is malformed
+static int parse_run(char *buf, size_t len, RunRequest *req)
+{
+    ServeRequest hdr;
+    if (len < sizeof(hdr))
+        return -1;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.type != SERVE_RUN || hdr.envc > len || hdr.argc > len)
+        return -1;
+    size_t nstr = 2 + hdr.envc + hdr.argc;
+    char **strs = malloc(sizeof(char *) * nstr);
+    if (!strs)
+        return -1;
+    char *p = buf + sizeof(hdr), *end = buf + len;
+    for (size_t i = 0; i < nstr; i++)
+    {
+        char *nul = memchr(p, '\0', end - p);
+        if (!nul)
+        {
+            free(strs);
+            return -1;
+        }
+        strs[i] = p;
+        p = nul + 1;
+    }
+    req->flags = hdr.flags;
+    req->cwd = strs[0];
+    req->script = strs[1];
+    req->strs = strs;
+    req->envc = hdr.envc;
+    req->argc = hdr.argc;
+    return 0;
+}
+
+// Become the request's shell and run its script: never returns
+static void run_request(RunRequest *req, const int fds[3])
+{
+    for (int i = 0; i < 3; i++)
+        dup2(fds[i], i);
+    for (int i = 0; i < 3; i++)
+        close(fds[i]);
+
+    // Behave like "tinyshell SCRIPT" started by the client
+    signal(SIGPIPE, SIG_DFL);
+    struct sigaction sa_chld;
+    sa_chld.sa_handler = sigchld_handler;
+    sigemptyset(&sa_chld.sa_mask);
+    sa_chld.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa_chld, NULL);
+
+    if (req->flags & SERVE_ENV_CLEAR)
+        clearenv();
+    char **env = req->strs + 2;
+    for (int i = 0; i < req->envc; i++)
+    {
+        if (strchr(env[i], '='))
+            putenv(env[i]);
+        else
+            unsetenv(env[i]);
+    }
+    if (chdir(req->cwd) < 0)
+    {
+        fprintf(stderr, "%stinyshell: %s: %s%s\n", COLOR_RED, req->cwd, strerror(errno), COLOR_RESET);
+        _exit(1);
+    }
+    positional_argc = req->argc;
+    positional_argv = req->strs + 2 + req->envc;
+
+    Program *prog;
+    int rc = script_compile(req->script, &prog);
+    if (rc != SCRIPT_OK)
+    {
+        if (rc == SCRIPT_INCOMPLETE)
+            fprintf(stderr, "%ssyntax error: unexpected end of input%s\n", COLOR_RED, COLOR_RESET);
+        _exit(2);
+    }
+    exit(script_run(prog));
+}
+
+// A spare: wait for a connection, report it taken, run its request
+static void spare_main(int sock, int ctl)
+{
+    // Other clients' connections must close when the server closes them
+    for (int i = 0; i < num_running; i++)
+    {
+        if (running[i].conn >= 0)
+            close(running[i].conn);
+        if (running[i].pidfd >= 0)
+            close(running[i].pidfd);
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() == 1)
+        _exit(0);
+    int conn;
+    do
+        conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+    while (conn < 0 && (errno == EINTR || errno == ECONNABORTED));
+    if (conn < 0)
+        _exit(1);
+    // From here on the script outlives a server shutdown, and is signalled as a group
+    prctl(PR_SET_PDEATHSIG, 0);
+    setpgid(0, 0);
+
+    TakenNote note = { getpid(), monotonic_ns() };
+    char *buf = malloc(SERVE_MSG_MAX);
+    int fds[MAX_PASSED_FDS];
+    int nfds = 0;
+    RunRequest req;
+    long n = buf ? recv_fds(conn, buf, SERVE_MSG_MAX, fds, &nfds) : -1;
+    if (n <= 0 || nfds != 3 || parse_run(buf, n, &req) < 0)
+    {
+        // Nothing to run: the server only needs to know we're no longer spare
+        send_fds(ctl, &note, sizeof(note), NULL, 0);
+        _exit(2);
+    }
+    send_fds(ctl, &note, sizeof(note), &conn, 1);
+    close(conn);
+    close(ctl);
+    close(sock);
+    run_request(&req, fds);
+}
+
+static void take_notes(int ctl);
+
+// Fork spares until SERVE_SPARES wait in accept()
+static void fill_spares(int sock, int ctl[2])
+{
+    for (int i = 0; i < SERVE_SPARES; i++)
+    {
+        // A spare killed while idle never reports. One that exited after
+        // taking a request has a note waiting, which must be read first
+        siginfo_t info;
+        info.si_pid = 0;
+        if (spares[i] && waitid(P_PID, spares[i], &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid)
+        {
+            take_notes(ctl[PIPE_READ]);
+            if (spares[i] == info.si_pid)
+            {
+                waitpid(spares[i], NULL, 0);
+                spares[i] = 0;
+            }
+        }
+        if (spares[i])
+            continue;
+        pid_t pid = fork();
+        if (pid == 0)
+            spare_main(sock, ctl[PIPE_WRITE]);
+        if (pid < 0)
+        {
+            perror("fork");
+            return;
+        }
+        spares[i] = pid;
+    }
+}
+
+static int idle_spares(void)
+{
+    int n = 0;
+    for (int i = 0; i < SERVE_SPARES; i++)
+        n += spares[i] != 0;
+    return n;
+}
+
+static void finish_running(int i);
+
+// Start watching a spare that took a connection
+static void add_running(const TakenNote *note, int conn)
+{
+    for (int i = 0; i < SERVE_SPARES; i++)
+    {
+        if (spares[i] == note->pid)
+            spares[i] = 0;
+    }
+    if (num_running == running_cap)
+    {
+        int cap = running_cap ? running_cap * 2 : 16;
+        Running *r = realloc(running, sizeof(Running) * cap);
+        if (!r)
+        {
+            perror("realloc");
+            if (conn >= 0)
+                close(conn);
+            return;
+        }
+        running = r;
+        running_cap = cap;
+    }
+    Running *r = &running[num_running++];
+    r->pid = note->pid;
+    r->pidfd = syscall(SYS_pidfd_open, note->pid, 0);
+    r->conn = conn;
+    r->t0 = note->t0;
+    // Without pidfds (before Linux 5.3) requests are served one at a time
+    if (r->pidfd < 0)
+        finish_running(num_running - 1);
+}
+
+// Read every note waiting on the (non-blocking) control socket
+static void take_notes(int ctl)
+{
+    TakenNote note;
+    int conn[MAX_PASSED_FDS];
+    int nconn;
+    while (recv_fds(ctl, &note, sizeof(note), conn, &nconn) == (long)sizeof(note))
+        add_running(&note, nconn > 0 ? conn[0] : -1);
+}
+
+// Collect a finished script and send its client the reply
+static void finish_running(int i)
+{
+    Running *r = &running[i];
+    int status = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    while (wait4(r->pid, &status, 0, &ru) < 0 && errno == EINTR)
+        ;
+    if (r->conn >= 0)
+    {
+        ServeReply reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.status = status_to_code(status);
+        reply.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+        reply.wall_ns = monotonic_ns() - r->t0;
+        reply.utime_us = (int64_t)ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec;
+        reply.stime_us = (int64_t)ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+        reply.maxrss_kb = ru.ru_maxrss;
+        reply.minflt = ru.ru_minflt;
+        reply.majflt = ru.ru_majflt;
+        reply.nvcsw = ru.ru_nvcsw;
+        reply.nivcsw = ru.ru_nivcsw;
+        send_fds(r->conn, &reply, sizeof(reply), NULL, 0);
+        close(r->conn);
+    }
+    if (r->pidfd >= 0)
+        close(r->pidfd);
+    running[i] = running[--num_running];
+}
+
+// Act on a message (or hangup) from a running request's client
+static void client_event(Running *r, char *buf)
+{
+    int fds[MAX_PASSED_FDS];
+    int nfds;
+    long n = recv_fds(r->conn, buf, SERVE_MSG_MAX, fds, &nfds);
+    for (int i = 0; i < nfds; i++)
+        close(fds[i]);
+    ServeRequest hdr;
+    if (n >= (long)sizeof(hdr))
+    {
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (hdr.type == SERVE_SIGNAL && hdr.sig > 0 && hdr.sig < NSIG)
+            kill(-r->pid, hdr.sig);
+    }
+    else if (n <= 0)
+    {
+        // Like a terminal closing under a shell
+        close(r->conn);
+        r->conn = -1;
+        kill(-r->pid, SIGHUP);
+        kill(-r->pid, SIGCONT);
+    }
+}
+
+// Bind the listening socket, replacing a stale one but never a live server
+static int bind_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "%stinyshell: %s: socket path too long%s\n", COLOR_RED, path, COLOR_RESET);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode) || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            fprintf(stderr, "%stinyshell: %s: already in use%s\n", COLOR_RED, path, COLOR_RESET);
+            close(sock);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    // Only the owner may connect: requests run with the server's privileges
+    mode_t old_mask = umask(0077);
+    int rc = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc < 0 || listen(sock, SERVE_BACKLOG) < 0)
+    {
+        perror(path);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Run as a server until SIGINT or SIGTERM
+int serve_main(const char *path)
+{
+    // Requests dup2() onto 0-2, so those must not be free for other descriptors
+    int fd;
+    while ((fd = open("/dev/null", O_RDWR)) >= 0 && fd <= STDERR_FILENO)
+        ;
+    if (fd > STDERR_FILENO)
+        close(fd);
+
+    int sock = bind_socket(path);
+    if (sock < 0)
+        return 1;
+    int ctl[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ctl) < 0 ||
+        fcntl(ctl[PIPE_READ], F_SETFL, O_NONBLOCK) < 0)
+    {
+        perror("socketpair");
+        close(sock);
+        unlink(path);
+        return 1;
+    }
+
+    struct sigaction sa;
+    sa.sa_handler = on_stop;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; // poll() must return to see the flag
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    // Scripts are collected by wait4() with their rusage, not the reaper
+    signal(SIGCHLD, SIG_DFL);
+
+    // Do once what every request would otherwise repeat
+    find_builtin("exit");
+
+    char *buf = malloc(SERVE_MSG_MAX);
+    struct pollfd *pfd = NULL;
+    while (buf && !stop_requested)
+    {
+        // Replace taken spares while nothing runs (on a busy machine the
+        // fork would compete with the scripts), or at once if none is left
+        if (num_running == 0 || idle_spares() == 0)
+            fill_spares(sock, ctl);
+
+        struct pollfd *grown = realloc(pfd, sizeof(struct pollfd) * (1 + 2 * num_running));
+        if (!grown)
+            break;
+        pfd = grown;
+        pfd[0] = (struct pollfd){ ctl[PIPE_READ], POLLIN, 0 };
+        for (int i = 0; i < num_running; i++)
+        {
+            pfd[1 + 2 * i] = (struct pollfd){ running[i].pidfd, POLLIN, 0 };
+            pfd[2 + 2 * i] = (struct pollfd){ running[i].conn, POLLIN, 0 };
+        }
+        if (poll(pfd, 1 + 2 * num_running, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        // Backwards, as finishing one moves the last entry into its slot
+        for (int i = num_running - 1; i >= 0; i--)
+        {
+            if (pfd[2 + 2 * i].revents && running[i].conn >= 0)
+                client_event(&running[i], buf);
+            if (pfd[1 + 2 * i].revents)
+                finish_running(i);
+        }
+        if (pfd[0].revents & POLLIN)
+            take_notes(ctl[PIPE_READ]);
+    }
+
+    // Stop taking connections; scripts already running are left to finish
+    for (int i = 0; i < SERVE_SPARES; i++)
+    {
+        if (spares[i])
+            kill(spares[i], SIGTERM);
+    }
+    close(sock);
+    unlink(path);
+    free(pfd);
+    free(buf);
+    return 0;
+}
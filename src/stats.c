@@ -0,0 +1,151 @@
+/*
+ * stats.c - Low-overhead counters and latency histograms
+ */
+
+#include "../include/stats.h"
+#include "../include/shell.h"
+
+_Atomic uint64_t stat_counters[STAT_COUNTER_MAX];
+static Histogram histograms[HIST_MAX];
+
+static const char *counter_names[STAT_COUNTER_MAX] = {
+    "commands", "builtins", "pipelines", "forks", "launcher_spawns", "jobs_created",
+    "jobs_reaped", "sigchld", "child_signaled", "child_stopped",
+    "cache_hits", "cache_misses", "cache_evictions", "deadlines_fired"
+};
+
+// Name, unit and divisor used to display each histogram
+static const struct {
+    const char *name;
+    const char *unit;
+    double scale;
+} hist_info[HIST_MAX] = {
+    { "fork_latency", "us", 1000.0 },
+    { "run_time", "ms", 1000.0 },
+    { "pipeline_depth", "cmds", 1.0 },
+};
+
+// Map a value to its bucket: exact below 2^SUB_BITS, log-linear above
+static unsigned bucket_index(uint64_t v)
+{
+    if (v < (1u << HIST_SUB_BITS))
+        return (unsigned)v;
+    unsigned e = 63 - __builtin_clzll(v);
+    unsigned sub = (v >> (e - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1);
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+// Highest value that falls in a bucket
+static uint64_t bucket_upper(unsigned i)
+{
+    if (i < (1u << HIST_SUB_BITS))
+        return i;
+    unsigned e = (i >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    uint64_t sub = i & ((1u << HIST_SUB_BITS) - 1);
+    uint64_t width = 1ull << (e - HIST_SUB_BITS);
+    return (1ull << e) + sub * width + width - 1;
+}
+
+// Record a histogram sample
+void stat_record(StatHist h, uint64_t value)
+{
+    Histogram *hist = &histograms[h];
+    atomic_fetch_add_explicit(&hist->buckets[bucket_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+}
+
+// Summary of one histogram snapshot
+typedef struct
+{
+    uint64_t count;
+    double mean, p50, p90, p99, max;
+} HistSummary;
+
+static HistSummary summarize(StatHist h)
+{
+    Histogram *hist = &histograms[h];
+    HistSummary s = { 0, 0, 0, 0, 0, 0 };
+    uint64_t snap[HIST_BUCKETS];
+    uint64_t total = 0;
+
+    // Snapshot first so percentiles are consistent with each other
+    for (unsigned i = 0; i < HIST_BUCKETS; i++)
+    {
+        snap[i] = atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+        total += snap[i];
+    }
+    if (total == 0)
+        return s;
+
+    double scale = hist_info[h].scale;
+    uint64_t sum = atomic_load_explicit(&hist->sum, memory_order_relaxed);
+    s.count = total;
+    s.mean = (double)sum / total / scale;
+
+    const double quantiles[3] = { 0.50, 0.90, 0.99 };
+    double *out[3] = { &s.p50, &s.p90, &s.p99 };
+    uint64_t seen = 0;
+    int q = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++)
+    {
+        if (!snap[i])
+            continue;
+        seen += snap[i];
+        while (q < 3 && seen >= (uint64_t)(quantiles[q] * total + 0.5))
+            *out[q++] = bucket_upper(i) / scale;
+        s.max = bucket_upper(i) / scale;
+    }
+    while (q < 3)
+        *out[q++] = s.max;
+    return s;
+}
+
+// Print all counters and histograms
+void stats_print(int json)
+{
+    if (json)
+    {
+        printf("{\"counters\":{");
+        for (int i = 0; i < STAT_COUNTER_MAX; i++)
+            printf("%s\"%s\":%llu", i ? "," : "", counter_names[i],
+                   (unsigned long long)atomic_load(&stat_counters[i]));
+        printf("},\"histograms\":{");
+        for (int h = 0; h < HIST_MAX; h++)
+        {
+            HistSummary s = summarize(h);
+            printf("%s\"%s\":{\"unit\":\"%s\",\"count\":%llu,\"mean\":%.3f,"
+                   "\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+                   h ? "," : "", hist_info[h].name, hist_info[h].unit,
+                   (unsigned long long)s.count, s.mean, s.p50, s.p90, s.p99, s.max);
+        }
+        printf("}}\n");
+        return;
+    }
+
+    printf("%-16s %12s\n", "counter", "value");
+    for (int i = 0; i < STAT_COUNTER_MAX; i++)
+        printf("%-16s %12llu\n", counter_names[i], (unsigned long long)atomic_load(&stat_counters[i]));
+
+    printf("\n%-16s %-5s %8s %10s %10s %10s %10s %10s\n",
+           "histogram", "unit", "count", "mean", "p50", "p90", "p99", "max");
+    for (int h = 0; h < HIST_MAX; h++)
+    {
+        HistSummary s = summarize(h);
+        printf("%-16s %-5s %8llu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               hist_info[h].name, hist_info[h].unit, (unsigned long long)s.count,
+               s.mean, s.p50, s.p90, s.p99, s.max);
+    }
+}
+
+// Reset all counters and histograms
+void stats_reset(void)
+{
+    for (int i = 0; i < STAT_COUNTER_MAX; i++)
+        atomic_store_explicit(&stat_counters[i], 0, memory_order_relaxed);
+    for (int h = 0; h < HIST_MAX; h++)
+    {
+        atomic_store_explicit(&histograms[h].sum, 0, memory_order_relaxed);
+        for (unsigned i = 0; i < HIST_BUCKETS; i++)
+            atomic_store_explicit(&histograms[h].buckets[i], 0, memory_order_relaxed);
+    }
+}
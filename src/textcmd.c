@@ -0,0 +1,716 @@
+/*
+ * textcmd.c - In-process grep -F, wc and head
+ *
+ * These three end most interactive pipelines and spend their time looking
+ * for newlines or a fixed string, which scan.c does a vector at a time.
+ * They run as ordinary pipeline stages (forked, never in the shell itself)
+ * but skip the exec and the dynamic loading of the real programs. Regular
+ * files are mapped rather than read; pipes are read in large blocks that
+ * are cut at the last newline so matching never sees half a line.
+ * Options they don't know hand the whole command line to the real program.
+ */
+
+#include "../include/textcmd.h"
+#include "../include/scan.h"
+#include "../include/executor.h"
+#include "../include/utils.h"
+#include <signal.h>
+#include <sys/mman.h>
+
+// Buffered output (write errors such as EPIPE stop the command)
+typedef struct
+{
+    int fd;
+    int failed;
+    size_t len;
+    char buf[TEXT_OUT_BUF];
+} Out;
+
+// One input: a mapping of a regular file, or a growing read buffer
+typedef struct
+{
+    int fd;
+    char *map; // Mapping from the page holding the start offset to EOF
+    size_t map_len;
+    size_t skip; // map + skip is the first byte to process
+    off_t start; // File offset of that byte (-1 for streams)
+    char *buf; // Stream data: [used, len) is still unprocessed
+    size_t len, used, cap;
+    int eof;
+} Source;
+
+static void out_flush(Out *o)
+{
+    if (o->len > 0 && !o->failed && write_all(o->fd, o->buf, o->len) < 0)
+        o->failed = 1;
+    o->len = 0;
+}
+
+static void out_put(Out *o, const char *s, size_t n)
+{
+    if (o->len + n > sizeof(o->buf))
+    {
+        out_flush(o);
+        if (n >= sizeof(o->buf))
+        {
+            if (!o->failed && write_all(o->fd, s, n) < 0)
+                o->failed = 1;
+            return;
+        }
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static void out_str(Out *o, const char *s)
+{
+    out_put(o, s, strlen(s));
+}
+
+// Hand a command line this module doesn't handle to the real program
+static int run_external(char **argv)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        return 2;
+    }
+    if (pid == 0)
+    {
+        reset_child_signals();
+        exec_with_path(argv[0], argv);
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return 2;
+    }
+    return status_to_code(status);
+}
+
+// Open a named input ("-" is standard input)
+static int open_input(const char *cmd, const char *name, int quiet)
+{
+    if (strcmp(name, "-") == 0)
+        return STDIN_FILENO;
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && !quiet)
+        fprintf(stderr, "%s%s: %s: %s%s\n", COLOR_RED, cmd, name, strerror(errno), COLOR_RESET);
+    return fd;
+}
+
+static void close_input(int fd)
+{
+    if (fd != STDIN_FILENO)
+        close(fd);
+}
+
+// Map a regular file from its current offset; anything else is read
+static void source_open(Source *s, int fd)
+{
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->start = -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+        return;
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0)
+        return;
+    if (st.st_size <= pos)
+    {
+        s->start = pos;
+        s->eof = 1;
+        return;
+    }
+    off_t base = pos - pos % sysconf(_SC_PAGESIZE);
+    void *m = mmap(NULL, st.st_size - base, PROT_READ, MAP_PRIVATE, fd, base);
+    if (m == MAP_FAILED)
+        return;
+    madvise(m, st.st_size - base, MADV_SEQUENTIAL);
+    s->map = m;
+    s->map_len = st.st_size - base;
+    s->skip = pos - base;
+    s->start = pos;
+}
+
+// Next block of input; with lines set it ends after a newline unless at EOF
+// Returns its length, 0 at EOF or -1 on a read error
+static ssize_t source_next(Source *s, const char **data, int lines)
+{
+    if (s->map)
+    {
+        if (s->eof)
+            return 0;
+        s->eof = 1;
+        *data = s->map + s->skip;
+        return s->map_len - s->skip;
+    }
+
+    // Keep the partial line left over from the previous block
+    memmove(s->buf, s->buf + s->used, s->len - s->used);
+    s->len -= s->used;
+    s->used = 0;
+    while (!s->eof)
+    {
+        if (s->len == s->cap)
+        {
+            size_t cap = s->cap ? s->cap * 2 : TEXT_CHUNK;
+            char *buf = realloc(s->buf, cap);
+            if (!buf)
+                return -1;
+            s->buf = buf;
+            s->cap = cap;
+        }
+        ssize_t n = read(s->fd, s->buf + s->len, s->cap - s->len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+        {
+            s->eof = 1;
+            break;
+        }
+        s->len += n;
+        if (!lines || memchr(s->buf + s->len - n, '\n', n))
+            break;
+    }
+    size_t end = s->len;
+    if (lines && !s->eof)
+        end = (const char *)memrchr(s->buf, '\n', s->len) - s->buf + 1;
+    s->used = end;
+    *data = s->buf;
+    return end;
+}
+
+static void source_close(Source *s)
+{
+    if (s->map)
+        munmap(s->map, s->map_len);
+    free(s->buf);
+}
+
+// ---- grep ----
+
+typedef struct
+{
+    const char *pat[TEXT_MAX_PATTERNS];
+    size_t len[TEXT_MAX_PATTERNS];
+    const char *next[TEXT_MAX_PATTERNS]; // Each pattern's next hit in the block (end = none, NULL = unknown)
+    int npat;
+    int count, invert, quiet, number, names, list, silent;
+    const char *name; // Current file as printed
+    size_t lineno; // Newlines before counted
+    const char *counted;
+    size_t selected; // Lines selected in the current file
+    int stop; // Nothing more to do for this file
+    Out out;
+} Grep;
+
+// Earliest match of any pattern at or after p
+static const char *find_any(Grep *g, const char *p, const char *end)
+{
+    if (g->npat == 1)
+    {
+        const char *hit = scan_find(p, end - p, g->pat[0], g->len[0]);
+        return hit && hit < end ? hit : NULL;
+    }
+    const char *best = end;
+    for (int k = 0; k < g->npat; k++)
+    {
+        if (!g->next[k] || g->next[k] < p)
+        {
+            const char *hit = scan_find(p, end - p, g->pat[k], g->len[k]);
+            g->next[k] = hit ? hit : end;
+        }
+        if (g->next[k] < best)
+            best = g->next[k];
+    }
+    return best < end ? best : NULL;
+}
+
+// Act on one selected line (len includes its newline, if any)
+static void select_line(Grep *g, const char *line, size_t len)
+{
+    g->selected++;
+    if (g->quiet)
+    {
+        g->stop = 1;
+        return;
+    }
+    if (g->list)
+    {
+        out_str(&g->out, g->name);
+        out_put(&g->out, "\n", 1);
+        g->stop = 1;
+        return;
+    }
+    if (g->count)
+        return;
+    if (g->names)
+    {
+        out_str(&g->out, g->name);
+        out_put(&g->out, ":", 1);
+    }
+    if (g->number)
+    {
+        g->lineno += scan_count(g->counted, line - g->counted, '\n');
+        g->counted = line;
+        char num[24];
+        int n = snprintf(num, sizeof(num), "%zu:", g->lineno + 1);
+        out_put(&g->out, num, n);
+    }
+    out_put(&g->out, line, len);
+    if (line[len - 1] != '\n')
+        out_put(&g->out, "\n", 1);
+}
+
+// Select every line in [p, end) (the lines between -v matches)
+static void select_region(Grep *g, const char *p, const char *end)
+{
+    if (!g->quiet && !g->list && !g->names && !g->number)
+    {
+        size_t lines = scan_count(p, end - p, '\n') + (end[-1] != '\n');
+        g->selected += lines;
+        if (g->count)
+            return;
+        out_put(&g->out, p, end - p);
+        if (end[-1] != '\n')
+            out_put(&g->out, "\n", 1);
+        return;
+    }
+    while (p < end && !g->stop)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *next = nl ? nl + 1 : end;
+        select_line(g, p, next - p);
+        p = next;
+    }
+}
+
+// Run the patterns over a block of whole lines
+static void grep_block(Grep *g, const char *data, size_t len)
+{
+    const char *p = data, *end = data + len;
+    g->counted = data;
+    for (int k = 0; k < g->npat; k++)
+        g->next[k] = NULL;
+    while (p < end && !g->stop && !g->out.failed)
+    {
+        const char *hit = find_any(g, p, end);
+        const char *start = end, *next = end;
+        if (hit)
+        {
+            const char *nl = memrchr(p, '\n', hit - p);
+            start = nl ? nl + 1 : p;
+            nl = memchr(hit, '\n', end - hit);
+            next = nl ? nl + 1 : end;
+        }
+        if (g->invert)
+        {
+            if (start > p)
+                select_region(g, p, start);
+        }
+        else if (hit)
+            select_line(g, start, next - start);
+        else
+            break;
+        p = next;
+    }
+    if (g->number)
+        g->lineno += scan_count(g->counted, end - g->counted, '\n');
+}
+
+// Add a -e pattern; returns -1 if there are too many
+static int add_pattern(Grep *g, const char *p)
+{
+    if (g->npat == TEXT_MAX_PATTERNS)
+        return -1;
+    g->pat[g->npat] = p;
+    g->len[g->npat] = strlen(p);
+    g->npat++;
+    return 0;
+}
+
+// Built-in: grep (fixed strings)
+int builtin_grep(int argc, char **argv)
+{
+    static Grep g;
+    memset(&g, 0, sizeof(g));
+    g.out.fd = STDOUT_FILENO;
+    int fixed = 0, names = -1;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        for (const char *o = argv[i] + 1; *o; o++)
+        {
+            if (*o == 'e')
+            {
+                const char *p = o[1] ? o + 1 : i + 1 < argc ? argv[++i] : NULL;
+                if (!p || add_pattern(&g, p) < 0)
+                    return run_external(argv);
+                break;
+            }
+            switch (*o)
+            {
+            case 'F': fixed = 1; break;
+            case 'c': g.count = 1; break;
+            case 'v': g.invert = 1; break;
+            case 'q': g.quiet = 1; break;
+            case 'n': g.number = 1; break;
+            case 'l': g.list = 1; break;
+            case 's': g.silent = 1; break;
+            case 'H': names = 1; break;
+            case 'h': names = 0; break;
+            default: return run_external(argv);
+            }
+        }
+    }
+    if (g.npat == 0)
+    {
+        if (i == argc)
+            return run_external(argv);
+        add_pattern(&g, argv[i++]);
+    }
+    // Without -F a pattern is a regex: only take those that match literally
+    for (int k = 0; k < g.npat && !fixed; k++)
+    {
+        if (strpbrk(g.pat[k], ".[]*^$\\"))
+            return run_external(argv);
+    }
+
+    char *stdin_only[] = { "-", NULL };
+    char **files = i < argc ? argv + i : stdin_only;
+    int nfiles = i < argc ? argc - i : 1;
+    g.names = names >= 0 ? names : nfiles > 1;
+    int error = 0;
+    size_t total = 0;
+    for (int f = 0; f < nfiles && !(g.quiet && total); f++)
+    {
+        int fd = open_input("grep", files[f], g.silent);
+        if (fd < 0)
+        {
+            error = 1;
+            continue;
+        }
+        g.name = fd == STDIN_FILENO ? "(standard input)" : files[f];
+        g.lineno = 0;
+        g.selected = 0;
+        g.stop = 0;
+        Source src;
+        source_open(&src, fd);
+        const char *data;
+        ssize_t n = 0;
+        while (!g.stop && !g.out.failed && (n = source_next(&src, &data, 1)) > 0)
+        {
+            grep_block(&g, data, n);
+            // Streams may be live (tail -f | grep): pass matches on per read
+            if (!src.map)
+                out_flush(&g.out);
+        }
+        if (!g.stop && n < 0)
+        {
+            if (!g.silent)
+                fprintf(stderr, "%sgrep: %s: %s%s\n", COLOR_RED, files[f], strerror(errno), COLOR_RESET);
+            error = 1;
+        }
+        if (g.count && !g.quiet && !g.list)
+        {
+            char line[PATH_MAX_LEN + 32];
+            int len = g.names ? snprintf(line, sizeof(line), "%s:%zu\n", g.name, g.selected)
+                              : snprintf(line, sizeof(line), "%zu\n", g.selected);
+            out_put(&g.out, line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1);
+        }
+        total += g.selected;
+        source_close(&src);
+        close_input(fd);
+    }
+    out_flush(&g.out);
+    if (g.out.failed)
+        return 2;
+    if (error && !(g.quiet && total))
+        return 2;
+    return total ? 0 : 1;
+}
+
+// ---- wc ----
+
+typedef struct
+{
+    size_t lines, words, bytes;
+} Counts;
+
+// Count one input; returns -1 on a read error
+static int wc_count(int fd, int lines, int words, Counts *c)
+{
+    // Bytes alone of a regular file need no reading
+    struct stat st;
+    if (!lines && !words && fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        if (pos >= 0)
+        {
+            c->bytes = st.st_size > pos ? st.st_size - pos : 0;
+            return 0;
+        }
+    }
+    Source src;
+    source_open(&src, fd);
+    const char *data;
+    ssize_t n;
+    int in_word = 0;
+    while ((n = source_next(&src, &data, 0)) > 0)
+    {
+        c->bytes += n;
+        if (lines)
+            c->lines += scan_count(data, n, '\n');
+        if (words)
+            c->words += scan_words(data, n, &in_word);
+    }
+    source_close(&src);
+    return n < 0 ? -1 : 0;
+}
+
+// Built-in: wc
+int builtin_wc(int argc, char **argv)
+{
+    int lines = 0, words = 0, bytes = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        for (const char *o = argv[i] + 1; *o; o++)
+        {
+            switch (*o)
+            {
+            case 'l': lines = 1; break;
+            case 'w': words = 1; break;
+            case 'c': bytes = 1; break;
+            default: return run_external(argv);
+            }
+        }
+    }
+    if (!lines && !words && !bytes)
+        lines = words = bytes = 1;
+
+    char *stdin_only[] = { "-", NULL };
+    char **files = i < argc ? argv + i : stdin_only;
+    int nfiles = i < argc ? argc - i : 1;
+
+    // Column width as coreutils picks it: wide enough for the total size of
+    // the regular files, at least 7 if any input is not one, 1 for a single count
+    int width = 1;
+    if (nfiles > 1 || lines + words + bytes > 1)
+    {
+        uintmax_t total_size = 0;
+        int min_width = 1;
+        for (int f = 0; f < nfiles; f++)
+        {
+            struct stat st;
+            int r = strcmp(files[f], "-") == 0 ? fstat(STDIN_FILENO, &st) : stat(files[f], &st);
+            if (r < 0)
+            {
+                if (f == 0)
+                    break;
+                continue;
+            }
+            if (S_ISREG(st.st_mode))
+                total_size += st.st_size;
+            else
+                min_width = 7;
+        }
+        for (; total_size >= 10; total_size /= 10)
+            width++;
+        if (width < min_width)
+            width = min_width;
+    }
+
+    Out out;
+    out.fd = STDOUT_FILENO;
+    out.failed = 0;
+    out.len = 0;
+    Counts total = { 0, 0, 0 };
+    int status = 0;
+    for (int f = 0; f <= nfiles && !out.failed; f++)
+    {
+        Counts c = { 0, 0, 0 };
+        const char *name = NULL;
+        if (f == nfiles)
+        {
+            if (nfiles == 1)
+                break;
+            c = total;
+            name = "total";
+        }
+        else
+        {
+            int fd = open_input("wc", files[f], 0);
+            if (fd < 0)
+            {
+                status = 1;
+                continue;
+            }
+            int r = wc_count(fd, lines, words, &c);
+            close_input(fd);
+            if (r < 0)
+            {
+                fprintf(stderr, "%swc: %s: %s%s\n", COLOR_RED, files[f], strerror(errno), COLOR_RESET);
+                status = 1;
+                continue;
+            }
+            total.lines += c.lines;
+            total.words += c.words;
+            total.bytes += c.bytes;
+            if (i < argc)
+                name = files[f];
+        }
+        char line[3 * 24 + PATH_MAX_LEN];
+        size_t len = 0;
+        const size_t field[3] = { c.lines, c.words, c.bytes };
+        const int shown[3] = { lines, words, bytes };
+        for (int k = 0; k < 3; k++)
+        {
+            if (shown[k])
+                len += snprintf(line + len, sizeof(line) - len, "%s%*zu", len ? " " : "", width, field[k]);
+        }
+        if (name)
+            len += snprintf(line + len, sizeof(line) - len, " %s", name);
+        if (len >= sizeof(line) - 1)
+            len = sizeof(line) - 2;
+        line[len++] = '\n';
+        out_put(&out, line, len);
+    }
+    out_flush(&out);
+    return out.failed ? 1 : status;
+}
+
+// ---- head ----
+
+// Parse a non-negative count (no size suffixes); returns -1 if it isn't one
+static int parse_count(const char *s, size_t *out)
+{
+    if (!s || !*s || *s < '0' || *s > '9')
+        return -1;
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*end || errno)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+// Copy the first n lines (or bytes) of one input
+static int head_copy(int fd, size_t n, int bytes, Out *out)
+{
+    Source src;
+    source_open(&src, fd);
+    const char *data;
+    ssize_t len = 0;
+    size_t used = 0; // Bytes of input written
+    while (n > 0 && !out->failed && (len = source_next(&src, &data, 0)) > 0)
+    {
+        size_t take = len;
+        if (bytes)
+        {
+            if (take > n)
+                take = n;
+            n -= take;
+        }
+        else
+        {
+            size_t seen;
+            const char *nl = scan_nth(data, len, '\n', n, &seen);
+            if (nl)
+            {
+                take = nl - data + 1;
+                n = 0;
+            }
+            else
+                n -= seen;
+        }
+        out_put(out, data, take);
+        used += take;
+        if (!src.map)
+            out_flush(out);
+    }
+    // Leave a shared regular file positioned after what was shown
+    if (src.start >= 0)
+        lseek(fd, src.start + used, SEEK_SET);
+    source_close(&src);
+    return len < 0 ? -1 : 0;
+}
+
+// Built-in: head
+int builtin_head(int argc, char **argv)
+{
+    size_t n = 10;
+    int bytes = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--") == 0)
+        {
+            i++;
+            break;
+        }
+        if (arg[1] >= '0' && arg[1] <= '9')
+        {
+            if (parse_count(arg + 1, &n) < 0)
+                return run_external(argv);
+            bytes = 0;
+            continue;
+        }
+        if ((arg[1] != 'n' && arg[1] != 'c') ||
+            parse_count(arg[2] ? arg + 2 : i + 1 < argc ? argv[++i] : NULL, &n) < 0)
+            return run_external(argv);
+        bytes = arg[1] == 'c';
+    }
+
+    char *stdin_only[] = { "-", NULL };
+    char **files = i < argc ? argv + i : stdin_only;
+    int nfiles = i < argc ? argc - i : 1;
+    Out out;
+    out.fd = STDOUT_FILENO;
+    out.failed = 0;
+    out.len = 0;
+    int status = 0, shown = 0;
+    for (int f = 0; f < nfiles && !out.failed; f++)
+    {
+        int fd = open_input("head", files[f], 0);
+        if (fd < 0)
+        {
+            status = 1;
+            continue;
+        }
+        if (nfiles > 1)
+        {
+            out_str(&out, shown++ ? "\n==> " : "==> ");
+            out_str(&out, fd == STDIN_FILENO ? "standard input" : files[f]);
+            out_str(&out, " <==\n");
+        }
+        if (head_copy(fd, n, bytes, &out) < 0)
+        {
+            fprintf(stderr, "%shead: %s: %s%s\n", COLOR_RED, files[f], strerror(errno), COLOR_RESET);
+            status = 1;
+        }
+        close_input(fd);
+    }
+    out_flush(&out);
+    return out.failed ? 1 : status;
+}
@@ -0,0 +1,170 @@
+/*
+ * trace.c - Chrome Trace Event output for process launches
+ * Load the resulting file in chrome://tracing or https://ui.perfetto.dev
+ */
+
+#include "../include/trace.h"
+#include "../include/shell.h"
+
+#define TRACE_EVENT_MAX 1024
+
+int trace_fd = -1;
+static pid_t trace_owner; // Only the shell that opened the trace may close it
+
+// Fixed-size event builder (no malloc/stdio so it is safe in signal handlers)
+typedef struct
+{
+    char buf[TRACE_EVENT_MAX];
+    size_t len;
+} TraceEvent;
+
+static void ev_str(TraceEvent *ev, const char *s)
+{
+    while (*s && ev->len < sizeof(ev->buf) - 1)
+        ev->buf[ev->len++] = *s++;
+}
+
+static void ev_num(TraceEvent *ev, uint64_t n)
+{
+    char tmp[24];
+    int i = 0;
+    do {
+        tmp[i++] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    while (i > 0 && ev->len < sizeof(ev->buf) - 1)
+        ev->buf[ev->len++] = tmp[--i];
+}
+
+// Append a JSON string literal, escaping quotes, backslashes and controls
+static void ev_json(TraceEvent *ev, const char *s)
+{
+    ev_str(ev, "\"");
+    for (; *s && ev->len < sizeof(ev->buf) - 16; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+        {
+            ev->buf[ev->len++] = '\\';
+            ev->buf[ev->len++] = c;
+        }
+        else if (c < 0x20)
+        {
+            ev_str(ev, "\\u00");
+            ev->buf[ev->len++] = "0123456789abcdef"[c >> 4];
+            ev->buf[ev->len++] = "0123456789abcdef"[c & 0xf];
+        }
+        else
+        {
+            ev->buf[ev->len++] = c;
+        }
+    }
+    ev_str(ev, "\"");
+}
+
+static void ev_begin(TraceEvent *ev, const char *name, const char *cat, const char *ph, uint64_t ts)
+{
+    ev->len = 0;
+    ev_str(ev, "{\"name\":");
+    ev_json(ev, name);
+    ev_str(ev, ",\"cat\":");
+    ev_json(ev, cat);
+    ev_str(ev, ",\"ph\":\"");
+    ev_str(ev, ph);
+    ev_str(ev, "\",\"ts\":");
+    ev_num(ev, ts);
+    ev_str(ev, ",\"pid\":");
+    ev_num(ev, (uint64_t)getpid());
+    ev_str(ev, ",\"tid\":");
+    ev_num(ev, (uint64_t)getpid());
+}
+
+static void ev_finish(TraceEvent *ev, const char *detail)
+{
+    if (detail)
+    {
+        ev_str(ev, ",\"args\":{\"detail\":");
+        ev_json(ev, detail);
+        ev_str(ev, "}");
+    }
+    ev_str(ev, "},\n");
+    if (write(trace_fd, ev->buf, ev->len) < 0)
+    {
+        // Nothing useful to do from a hot path or signal handler
+    }
+}
+
+// Record a complete event
+void trace_complete(const char *name, const char *cat, uint64_t start, const char *detail)
+{
+    if (trace_fd < 0)
+        return;
+    int saved_errno = errno;
+    uint64_t end = trace_now();
+    TraceEvent ev;
+    ev_begin(&ev, name, cat, "X", start);
+    ev_str(&ev, ",\"dur\":");
+    ev_num(&ev, end - start);
+    ev_finish(&ev, detail);
+    errno = saved_errno;
+}
+
+// Record an instant event
+void trace_instant(const char *name, const char *cat, const char *detail)
+{
+    if (trace_fd < 0)
+        return;
+    int saved_errno = errno;
+    TraceEvent ev;
+    ev_begin(&ev, name, cat, "i", trace_now());
+    ev_str(&ev, ",\"s\":\"p\"");
+    ev_finish(&ev, detail);
+    errno = saved_errno;
+}
+
+// Start writing a trace file
+int trace_open(const char *path)
+{
+    trace_close();
+
+    // O_APPEND keeps events from the shell and its children whole;
+    // O_CLOEXEC hides the file from exec'd programs
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    if (write(fd, "[\n", 2) != 2)
+    {
+        close(fd);
+        return -1;
+    }
+    trace_fd = fd;
+    trace_owner = getpid();
+
+    // Once per process: the handler copes with a trace that is already closed
+    static int close_at_exit;
+    if (!close_at_exit)
+        close_at_exit = atexit(trace_close) == 0;
+
+    TraceEvent ev;
+    ev_begin(&ev, "process_name", "__metadata", "M", 0);
+    ev_str(&ev, ",\"args\":{\"name\":\"tinyshell\"}");
+    ev_finish(&ev, NULL);
+    return 0;
+}
+
+// Close the JSON array and stop tracing
+void trace_close(void)
+{
+    if (trace_fd < 0 || getpid() != trace_owner)
+        return;
+    // Final event has no trailing comma so the file is a valid JSON array
+    TraceEvent ev;
+    ev_begin(&ev, "trace_end", "__metadata", "i", trace_now());
+    ev_str(&ev, ",\"s\":\"g\"}\n]\n");
+    if (write(trace_fd, ev.buf, ev.len) < 0)
+    {
+        // Best effort: the file is still loadable without the closing bracket
+    }
+    close(trace_fd);
+    trace_fd = -1;
+}
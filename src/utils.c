@@ -1,33 +1,191 @@
-/*
- * utils.c - Utility functions
- */
-
-#include "../include/utils.h"
-#include "../include/shell.h"
-
-// Get the current working directory for prompt
-char* get_current_dir(void)
-{
-    static char cwd[PATH_MAX_LEN];
-    if (getcwd(cwd, sizeof(cwd)) != NULL) 
-    {
-        return cwd;
-    }
-    return NULL;
-}
-
-// Read a line from stdin
-char* read_line(void)
-{
-    char *line = NULL;
-    size_t cap = 0;
-    ssize_t n = getline(&line, &cap, stdin);
-    
-    if (n == -1) 
-    {
-        free(line);
-        return NULL;
-    }
-    
-    return line;
-}
+/*
+ * utils.c - Utility functions
+ */
+
+#include "../include/utils.h"
+#include "../include/shell.h"
+#include <sys/socket.h>
+
+// Get the current working directory for prompt
+char* get_current_dir(void)
+{
+    static char cwd[PATH_MAX_LEN];
+    if (getcwd(cwd, sizeof(cwd)) != NULL) 
+    {
+        return cwd;
+    }
+    return NULL;
+}
+
+// Read a line from stdin
+char* read_line(void)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n = getline(&line, &cap, stdin);
+    
+    if (n == -1) 
+    {
+        free(line);
+        return NULL;
+    }
+    
+    return line;
+}
+
+// Initialize an empty buffer
+void sb_init(StrBuf *sb)
+{
+    sb->data = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+// Grow the buffer geometrically so repeated appends stay amortized O(1)
+int sb_reserve(StrBuf *sb, size_t extra)
+{
+    if (sb->len + extra + 1 <= sb->cap)
+        return 0;
+
+    size_t cap = sb->cap ? sb->cap : 256;
+    while (cap < sb->len + extra + 1)
+        cap *= 2;
+
+    char *data = realloc(sb->data, cap);
+    if (!data)
+        return -1;
+    sb->data = data;
+    sb->cap = cap;
+    return 0;
+}
+
+// Append n bytes to the buffer
+int sb_append(StrBuf *sb, const char *s, size_t n)
+{
+    if (sb_reserve(sb, n) < 0)
+        return -1;
+    memcpy(sb->data + sb->len, s, n);
+    sb->len += n;
+    sb->data[sb->len] = '\0';
+    return 0;
+}
+
+// Append a single character to the buffer
+int sb_putc(StrBuf *sb, char c)
+{
+    return sb_append(sb, &c, 1);
+}
+
+// Release the buffer's memory
+void sb_free(StrBuf *sb)
+{
+    free(sb->data);
+    sb_init(sb);
+}
+
+// Write all bytes, retrying short writes
+int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Send a message with file descriptors attached
+long send_fds(int sock, const void *buf, size_t len, const int *fds, int nfds)
+{
+    struct iovec iov = { (void *)buf, len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (nfds > 0)
+    {
+        if (nfds > MAX_PASSED_FDS)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        msg.msg_control = ctrl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+// Receive a message and any attached file descriptors
+long recv_fds(int sock, void *buf, size_t len, int *fds, int *nfds)
+{
+    struct iovec iov = { buf, len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl.buf;
+    msg.msg_controllen = sizeof(ctrl.buf);
+
+    *nfds = 0;
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return -1;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds + *nfds, CMSG_DATA(cmsg), sizeof(int) * count);
+            *nfds += count;
+        }
+    }
+    return n;
+}
+
+// Format a byte count as 512B, 1.5K, 3.2M, ...
+void format_bytes(char *buf, size_t size, uint64_t n)
+{
+    static const char units[] = "KMGTP";
+    if (n < 1024)
+    {
+        snprintf(buf, size, "%lluB", (unsigned long long)n);
+        return;
+    }
+    double v = n / 1024.0;
+    int u = 0;
+    while (v >= 1024 && u < 4)
+    {
+        v /= 1024;
+        u++;
+    }
+    snprintf(buf, size, "%.1f%c", v, units[u]);
+}
@@ -0,0 +1,587 @@
+/*
+ * watch.c - Rerun commands when files change (onchange)
+ *
+ * Every registration's directories are watched through one inotify
+ * descriptor; a file is watched through its directory, so editors that
+ * save by renaming a new copy over it are still seen. Events only move a
+ * registration's due time to "now + debounce", so a burst of writes
+ * becomes one rerun once things are quiet. A single timerfd is armed for
+ * the earliest due time. Both sit in an epoll set that the shell's input
+ * loop polls, so nothing runs while files are left alone. A rerun first
+ * stops the previous one (signal to its process group), then starts the
+ * command as a background job in a process group of its own.
+ */
+
+#include "../include/watch.h"
+#include "../include/executor.h"
+#include "../include/script.h"
+#include "../include/deadline.h"
+#include "../include/joblog.h"
+#include "../include/stats.h"
+#include "../include/utils.h"
+#include <dirent.h>
+#include <libgen.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#define WATCH_IDLE UINT64_MAX // due_ns with no rerun pending
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+
+// One onchange registration
+typedef struct
+{
+    int id; // 0 = free slot
+    Program *prog; // The command, compiled once
+    char *text; // The command as typed
+    char *paths; // The watched paths, for listings
+    int recursive;
+    int sig; // Sent to a previous run still going
+    uint64_t debounce_ns;
+    uint64_t due_ns; // Next rerun, WATCH_IDLE if none
+    pid_t pid; // Current or last run (its process group), 0 if none
+    int pidfd; // Readable once that run exited (-1 if none)
+    unsigned runs;
+    unsigned dirs; // Directories watched
+} Watch;
+
+// One watched directory of one registration (several may share a wd)
+typedef struct
+{
+    int wd;
+    Watch *w;
+    char *dir; // Path of the directory
+    char *name; // Only this entry matters (NULL = any)
+} WatchDir;
+
+static Watch watches[WATCH_MAX];
+static int next_id = 1;
+static WatchDir *dirs;
+static int ndirs, dirs_cap;
+static int inotify_fd = -1;
+static int timer_fd = -1;
+static int epoll_fd = -1;
+
+// Create the inotify, timer and epoll descriptors on first use
+static int watch_init(void)
+{
+    if (epoll_fd >= 0)
+        return 0;
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    if (inotify_fd < 0 || timer_fd < 0 || epoll_fd < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ev) < 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) < 0)
+    {
+        perror("onchange");
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+        if (timer_fd >= 0)
+            close(timer_fd);
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        inotify_fd = timer_fd = epoll_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// Arm the timer for the earliest pending rerun
+static void rearm(void)
+{
+    uint64_t next = WATCH_IDLE;
+    for (int i = 0; i < WATCH_MAX; i++)
+    {
+        if (watches[i].id != 0 && watches[i].due_ns < next)
+            next = watches[i].due_ns;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next != WATCH_IDLE)
+    {
+        its.it_value.tv_sec = next / 1000000000u;
+        its.it_value.tv_nsec = next % 1000000000u;
+        if (next == 0)
+            its.it_value.tv_nsec = 1;  // All zero would disarm
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Watch one directory for a registration; name limits it to one entry
+static int add_dir(Watch *w, const char *dir, const char *name)
+{
+    int wd = inotify_add_watch(inotify_fd, dir, WATCH_EVENTS | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        fprintf(stderr, "%sonchange: %s: %s%s\n", COLOR_RED, dir, strerror(errno), COLOR_RESET);
+        return -1;
+    }
+    if (ndirs == dirs_cap)
+    {
+        int cap = dirs_cap ? dirs_cap * 2 : 64;
+        WatchDir *grown = realloc(dirs, sizeof(WatchDir) * cap);
+        if (!grown)
+        {
+            perror("onchange");
+            return -1;
+        }
+        dirs = grown;
+        dirs_cap = cap;
+    }
+    WatchDir *d = &dirs[ndirs++];
+    d->wd = wd;
+    d->w = w;
+    d->dir = strdup(dir);
+    d->name = name ? strdup(name) : NULL;
+    w->dirs++;
+    return 0;
+}
+
+// Watch a directory and everything below it
+static int add_tree(Watch *w, const char *dir)
+{
+    if (add_dir(w, dir, NULL) < 0)
+        return -1;
+    DIR *dp = opendir(dir);
+    if (!dp)
+        return 0;
+    struct dirent *e;
+    StrBuf sub;
+    sb_init(&sub);
+    int rc = 0;
+    while (rc == 0 && (e = readdir(dp)) != NULL)
+    {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+        sub.len = 0;
+        sb_append(&sub, dir, strlen(dir));
+        sb_putc(&sub, '/');
+        sb_append(&sub, e->d_name, strlen(e->d_name) + 1);
+        struct stat st;
+        int is_dir = e->d_type == DT_DIR ||
+                     (e->d_type == DT_UNKNOWN && lstat(sub.data, &st) == 0 && S_ISDIR(st.st_mode));
+        if (is_dir)
+            rc = add_tree(w, sub.data);
+    }
+    sb_free(&sub);
+    closedir(dp);
+    return rc;
+}
+
+// Remove a kernel watch no registration uses any more
+static void release_wd(int wd)
+{
+    for (int i = 0; i < ndirs; i++)
+    {
+        if (dirs[i].wd == wd)
+            return;
+    }
+    inotify_rm_watch(inotify_fd, wd);
+}
+
+// Drop a registration's directories, or (w NULL) every record of a wd the
+// kernel already removed
+static void remove_dirs(const Watch *w, int wd)
+{
+    int kept = 0, nfreed = 0;
+    int *freed = w ? malloc(sizeof(int) * (ndirs + 1)) : NULL;
+    for (int i = 0; i < ndirs; i++)
+    {
+        WatchDir *d = &dirs[i];
+        if (w ? d->w != w : d->wd != wd)
+        {
+            dirs[kept++] = *d;
+            continue;
+        }
+        if (freed)
+            freed[nfreed++] = d->wd;
+        d->w->dirs--;
+        free(d->dir);
+        free(d->name);
+    }
+    ndirs = kept;
+
+    // inotify hands out one wd per directory, shared by registrations
+    for (int i = 0; i < nfreed; i++)
+        release_wd(freed[i]);
+    free(freed);
+}
+
+// Check whether a registration's last run is still going
+static int run_active(const Watch *w)
+{
+    struct pollfd pfd = { w->pidfd, POLLIN, 0 };
+    return w->pidfd >= 0 && poll(&pfd, 1, 0) == 0;
+}
+
+// Wait up to ns for a run to exit
+static int wait_exit(const Watch *w, uint64_t ns)
+{
+    struct pollfd pfd = { w->pidfd, POLLIN, 0 };
+    while (poll(&pfd, 1, (int)(ns / 1000000)) < 0 && errno == EINTR)
+        ;
+    return pfd.revents != 0;
+}
+
+// Stop a registration's previous run if it is still going
+static void cancel_run(Watch *w)
+{
+    if (run_active(w))
+    {
+        // Stopped jobs only see the signal once continued
+        kill(-w->pid, w->sig);
+        if (w->sig != SIGKILL && w->sig != SIGCONT)
+            kill(-w->pid, SIGCONT);
+        if (!wait_exit(w, WATCH_CANCEL_NS))
+        {
+            kill(-w->pid, SIGKILL);
+            wait_exit(w, WATCH_CANCEL_NS);
+        }
+    }
+    if (w->pidfd >= 0)
+        close(w->pidfd);
+    w->pidfd = -1;
+}
+
+// Start a registration's command as a background job
+static void start_run(Watch *w)
+{
+    cancel_run(w);
+
+    sigset_t mask, prev;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    int log_fd = interactive ? joblog_pipe() : -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        if (log_fd >= 0)
+        {
+            close(log_fd);
+            joblog_discard();
+        }
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return;
+    }
+    if (pid == 0)
+    {
+        // Reruns never read the terminal, and run without job control
+        reset_child_signals();
+        setpgid(0, 0);
+        int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (null_fd >= 0)
+            dup2(null_fd, STDIN_FILENO);
+        if (log_fd >= 0)
+        {
+            dup2(log_fd, STDOUT_FILENO);
+            dup2(log_fd, STDERR_FILENO);
+        }
+        interactive = 0;
+        int code = script_run(w->prog);
+        fflush(stdout);
+        _exit(code & 0xff);
+    }
+
+    setpgid(pid, pid);
+    stat_inc(STAT_FORKS);
+    w->pid = pid;
+    w->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    w->runs++;
+    if (interactive)
+    {
+        int job_num = add_job(pid, pid, w->text, monotonic_ns());
+        if (log_fd >= 0)
+            joblog_attach(job_num, w->text);
+        printf("[%d] %d\n", job_num, pid);
+    }
+    if (log_fd >= 0)
+        close(log_fd);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+// Note a change for a registration: its rerun moves to now + debounce
+static void touch(Watch *w, uint64_t now)
+{
+    w->due_ns = now + w->debounce_ns;
+}
+
+// Handle one inotify event
+static void handle_event(const struct inotify_event *ev, uint64_t now)
+{
+    if (ev->mask & IN_Q_OVERFLOW)
+    {
+        // Events were lost: assume everything changed
+        for (int i = 0; i < WATCH_MAX; i++)
+        {
+            if (watches[i].id != 0)
+                touch(&watches[i], now);
+        }
+        return;
+    }
+    if (ev->mask & IN_IGNORED)
+    {
+        // The directory is gone (or was unwatched)
+        remove_dirs(NULL, ev->wd);
+        return;
+    }
+
+    int n = ndirs;  // New subdirectories are appended: not matched again
+    for (int i = 0; i < n; i++)
+    {
+        WatchDir *d = &dirs[i];
+        if (d->wd != ev->wd)
+            continue;
+        if (d->name && (ev->len == 0 || strcmp(d->name, ev->name) != 0))
+            continue;
+        Watch *w = d->w;
+        touch(w, now);
+        if (w->recursive && (ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && ev->len > 0)
+        {
+            StrBuf sub;
+            sb_init(&sub);
+            sb_append(&sub, d->dir, strlen(d->dir));
+            sb_putc(&sub, '/');
+            sb_append(&sub, ev->name, strlen(ev->name) + 1);
+            add_tree(w, sub.data);  // May move the table: d is not used after this
+            sb_free(&sub);
+        }
+    }
+}
+
+// Descriptor for the event loop while anything is watched
+int watch_fd(void)
+{
+    for (int i = 0; i < WATCH_MAX; i++)
+    {
+        if (watches[i].id != 0)
+            return epoll_fd;
+    }
+    return -1;
+}
+
+// Read file events and start due reruns
+int watch_run(void)
+{
+    if (epoll_fd < 0)
+        return 0;
+
+    uint64_t now = monotonic_ns();
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + len;)
+        {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            handle_event(ev, now);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        return 0;
+    int started = 0;
+    now = monotonic_ns();
+    for (int i = 0; i < WATCH_MAX; i++)
+    {
+        Watch *w = &watches[i];
+        if (w->id == 0 || w->due_ns > now)
+            continue;
+        w->due_ns = WATCH_IDLE;
+        start_run(w);
+        started++;
+    }
+    rearm();
+    return started;
+}
+
+// Free a registration
+static void clear_watch(Watch *w)
+{
+    cancel_run(w);
+    remove_dirs(w, -1);
+    script_release(w->prog);
+    free(w->text);
+    free(w->paths);
+    memset(w, 0, sizeof(*w));
+    w->pidfd = -1;
+}
+
+// Join words with spaces
+static char *join_words(char **words, int n)
+{
+    StrBuf sb;
+    sb_init(&sb);
+    for (int i = 0; i < n; i++)
+    {
+        if (i)
+            sb_putc(&sb, ' ');
+        sb_append(&sb, words[i], strlen(words[i]));
+    }
+    sb_putc(&sb, '\0');
+    return sb.data;
+}
+
+// Watch one PATH argument for a registration
+static int add_path(Watch *w, const char *path)
+{
+    struct stat st;
+    int exists = stat(path, &st) == 0;
+    if (!exists && errno != ENOENT)
+    {
+        fprintf(stderr, "%sonchange: %s: %s%s\n", COLOR_RED, path, strerror(errno), COLOR_RESET);
+        return -1;
+    }
+    if (exists && S_ISDIR(st.st_mode))
+        return w->recursive ? add_tree(w, path) : add_dir(w, path, NULL);
+
+    // A file is watched through its directory (so it may not exist yet)
+    char *dir_copy = strdup(path);
+    char *name_copy = strdup(path);
+    int rc = -1;
+    if (dir_copy && name_copy)
+        rc = add_dir(w, dirname(dir_copy), basename(name_copy));
+    free(dir_copy);
+    free(name_copy);
+    return rc;
+}
+
+// List the registrations
+static void list_watches(void)
+{
+    for (int i = 0; i < WATCH_MAX; i++)
+    {
+        const Watch *w = &watches[i];
+        if (w->id == 0)
+            continue;
+        printf("[%d] %s%s -- %s  (%u dir%s, debounce %.2fs, %u run%s%s)\n", w->id, w->recursive ? "-r " : "",
+               w->paths, w->text, w->dirs, w->dirs == 1 ? "" : "s", w->debounce_ns / 1e9, w->runs,
+               w->runs == 1 ? "" : "s", run_active(w) ? ", running" : "");
+    }
+}
+
+// Built-in: onchange - rerun a command when files change
+int builtin_onchange(int argc, char **argv)
+{
+    if (argc == 1)
+    {
+        list_watches();
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[1], "-x") == 0)
+    {
+        int id = atoi(argv[2]);
+        for (int i = 0; i < WATCH_MAX; i++)
+        {
+            if (id > 0 && watches[i].id == id)
+            {
+                clear_watch(&watches[i]);
+                rearm();
+                return 0;
+            }
+        }
+        fprintf(stderr, "%sonchange: %s: no such watch%s\n", COLOR_RED, argv[2], COLOR_RESET);
+        return 1;
+    }
+
+    int recursive = 0, run_now = 0, sig = SIGTERM;
+    uint64_t debounce_ns = WATCH_DEBOUNCE_NS;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && strcmp(argv[i], "--") != 0; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0)
+            recursive = 1;
+        else if (strcmp(argv[i], "-i") == 0)
+            run_now = 1;
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc && parse_duration(argv[i + 1], &debounce_ns) == 0)
+            i++;
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && (sig = parse_signal(argv[i + 1])) > 0)
+            i++;
+        else
+        {
+            fprintf(stderr, "%sonchange: %s: invalid option or value%s\n", COLOR_RED, argv[i], COLOR_RESET);
+            return 1;
+        }
+    }
+    int first_path = i;
+    while (i < argc && strcmp(argv[i], "--") != 0)
+        i++;
+    if (i == first_path || i + 1 >= argc)
+    {
+        fprintf(stderr, "%sonchange: usage: onchange [-r] [-i] [-d SECS] [-s SIG] PATH... -- COMMAND...%s\n",
+                COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+
+    Watch *w = NULL;
+    for (int j = 0; j < WATCH_MAX && !w; j++)
+    {
+        if (watches[j].id == 0)
+            w = &watches[j];
+    }
+    if (!w)
+    {
+        fprintf(stderr, "%sonchange: too many watches%s\n", COLOR_RED, COLOR_RESET);
+        return 1;
+    }
+    if (watch_init() < 0)
+        return 1;
+
+    // Compile once: every rerun executes the same program
+    char *text = join_words(argv + i + 1, argc - i - 1);
+    Program *prog;
+    int rc = text ? script_compile(text, &prog) : SCRIPT_ERROR;
+    if (rc != SCRIPT_OK)
+    {
+        if (rc == SCRIPT_INCOMPLETE)
+            fprintf(stderr, "%sonchange: syntax error: unexpected end of input%s\n", COLOR_RED, COLOR_RESET);
+        free(text);
+        return 1;
+    }
+    w->id = next_id++;
+    w->prog = prog;
+    w->text = text;
+    w->paths = join_words(argv + first_path, i - first_path);
+    w->recursive = recursive;
+    w->sig = sig;
+    w->debounce_ns = debounce_ns;
+    w->due_ns = run_now ? monotonic_ns() : WATCH_IDLE;
+    w->pidfd = -1;
+    for (int j = first_path; j < i; j++)
+    {
+        if (add_path(w, argv[j]) < 0)
+        {
+            clear_watch(w);
+            return 1;
+        }
+    }
+    rearm();
+
+    if (interactive)
+    {
+        printf("[%d] watching %u director%s\n", w->id, w->dirs, w->dirs == 1 ? "y" : "ies");
+        return 0;
+    }
+
+    // Scripts have no input loop: wait for changes here until killed
+    for (;;)
+    {
+        struct pollfd pfd = { epoll_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+        {
+            perror("onchange");
+            return 1;
+        }
+        watch_run();
+    }
+}
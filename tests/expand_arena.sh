@@ -0,0 +1,26 @@
+#!/bin/sh
+# Regression: expanding a later pipeline stage must not move the words of an
+# earlier one (they used to share one arena, and growing it freed them)
+# usage: tests/expand_arena.sh [SHELL]
+
+shell=${1:-./tinyshell}
+X=$(printf '%0300d' 0 | tr 0 a)
+export X
+expected=$(printf '%s\n' "$X")
+
+script=$(mktemp)
+trap 'rm -f "$script"' EXIT
+printf 'echo $X | env V=$X$X$X$X cat\n' > "$script"
+
+status=0
+got=$("$shell" "$script" 2>&1)
+if [ "$got" != "$expected" ]; then
+    echo "expand_arena: script run: wrong output" >&2
+    status=1
+fi
+got=$(printf 'echo $X | env V=$X$X$X$X cat\n' | "$shell" 2>/dev/null | grep -x 'a*')
+if [ "$got" != "$expected" ]; then
+    echo "expand_arena: interactive run: wrong output" >&2
+    status=1
+fi
+exit $status
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Regression: a stage that never execs (a function or a { } group) must not
+# keep its own pipe's read end open, or it never gets SIGPIPE when the next
+# stage exits and the pipeline hangs
+# usage: tests/pipe_close.sh [SHELL]
+
+shell=${1:-./tinyshell}
+
+script=$(mktemp)
+trap 'rm -f "$script"' EXIT
+cat > "$script" <<'EOF'
+f() { while true; do echo y; done; }
+f | head -n 1
+{ while true; do echo y; done; } | head -n 1
+EOF
+
+got=$(timeout 10 "$shell" "$script" 2>&1)
+status=$?
+if [ $status -eq 124 ]; then
+    echo "pipe_close: pipeline did not finish" >&2
+    exit 1
+fi
+if [ "$got" != "$(printf 'y\ny')" ]; then
+    echo "pipe_close: wrong output" >&2
+    exit 1
+fi
+exit 0